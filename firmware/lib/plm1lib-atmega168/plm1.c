@@ -1,19 +1,21 @@
 /*******************************************************************************
 * Filename:     plm1.c
 * Description:  File implementing the PLM-1 library.
-* Version:      1.6.1
-* Note:         
+* Version:      1.15.0
+* Note:         The ISR and the main loop exchange packets through single
+*               producer/single consumer rings: each index has one writer and
+*               is published after the data it covers, so the main loop never
+*               masks interrupts on the data path. Packet buffers come from
+*               a pool owned by the main loop: the ISR receives into buffers
+*               posted in advance and hands them over with the packets.
 *******************************************************************************/
 
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
+#include <avr/pgmspace.h>
 #include "plm1.h"
-//#include "port.h"
-
-/*------------------------------------------------------------------------------
-  Global variables declaration
-------------------------------------------------------------------------------*/
+#include "port.h"
 
 /*------------------------------------------------------------------------------
   Local constants declaration
@@ -32,59 +34,51 @@
 #define PLM_CC_TX_OVERRUN              0x19                         // Transmitter over-run. [In]
 #define PLM_CC_NOP                     0x1F                         // No Operation. [In/Out]
 
-/*------------------------------------------------------------------------------
-  Local types definition
-------------------------------------------------------------------------------*/
+// Value of the precomputed nibble when the End Of Packet is being sent.
+#define TX_NIBBLE_NONE                 0xFF
+
+// Backoff parameters tests.
+#if (PLM_BACKOFF_MIN_WINDOW < 1) || (PLM_BACKOFF_MIN_WINDOW & (PLM_BACKOFF_MIN_WINDOW - 1))
+#   error PLM-1 LIBRARY: 'PLM_BACKOFF_MIN_WINDOW' must be a power of 2!
+#endif
+#if (PLM_BACKOFF_MAX_WINDOW > 128) || (PLM_BACKOFF_MAX_WINDOW & (PLM_BACKOFF_MAX_WINDOW - 1))
+#   error PLM-1 LIBRARY: 'PLM_BACKOFF_MAX_WINDOW' must be a power of 2 lower or equal to 128!
+#endif
+#if PLM_BACKOFF_MAX_WINDOW < PLM_BACKOFF_MIN_WINDOW
+#   error PLM-1 LIBRARY: 'PLM_BACKOFF_MAX_WINDOW' is lower than 'PLM_BACKOFF_MIN_WINDOW'!
+#endif
+
+// Journal parameters tests.
+#if (PLM_JOURNAL_SIZE < 1) || (PLM_JOURNAL_SIZE > 128) || (PLM_JOURNAL_SIZE & (PLM_JOURNAL_SIZE - 1))
+#   error PLM-1 LIBRARY: 'PLM_JOURNAL_SIZE' must be a power of 2 lower or equal to 128!
+#endif
+
+// Trace parameters tests.
+#if (PLM_TRACE_SIZE > 128) || (PLM_TRACE_SIZE & (PLM_TRACE_SIZE - 1))
+#   error PLM-1 LIBRARY: 'PLM_TRACE_SIZE' must be 0 or a power of 2 lower or equal to 128!
+#endif
+
+// Pool parameters tests.
+#if (PLM_POOL_BUFFER_NBR < 2) || (PLM_POOL_BUFFER_NBR > 254)
+#   error PLM-1 LIBRARY: 'PLM_POOL_BUFFER_NBR' must be between 2 and 254!
+#endif
+#if (PLM_POOL_RX_RESERVED < 1) || (PLM_POOL_TX_RESERVED < 1) || ((PLM_POOL_RX_RESERVED + PLM_POOL_TX_RESERVED) > PLM_POOL_BUFFER_NBR)
+#   error PLM-1 LIBRARY: 'PLM_POOL_RX_RESERVED' and 'PLM_POOL_TX_RESERVED' must be at least 1 and fit in 'PLM_POOL_BUFFER_NBR'!
+#endif
 
-// PLM-1 library' state.
-typedef enum _plm1_state_ {
-    PLM1_STATE_NOT_CONFIGURED = 0,
-    PLM1_STATE_CONFIGURING,
-    PLM1_STATE_IDLE,
-    PLM1_STATE_NEGOTIATING,
-    PLM1_STATE_TRANSMITTING,
-    PLM1_STATE_RECEIVING
-} plm1_state;
-
-// Structure holding packet descriptor.
-typedef struct _packet_desc_t_ {
-    bool used;                                                      // true if this descriptor is in use.
-    uint16_t start;                                                 // Offset of the packet inside buffer.
-    uint8_t size;                                                   // Size of the packet.
-} packet_desc_t;
-
-// Structure holding variables for reception.
-typedef struct _plm1_rx_t_ {
-    bool invalid_packet;                                            // Receiving an invalid packet.
-    uint8_t packet_index;                                           // Index of the oldest received packet.
-    bool msb;                                                       // true if next nibble to be received is the MSB.
-    packet_desc_t packet_desc[PLM_RX_MAX_PACKET_NBR];               // Reception packet descriptors.
-    uint8_t desc_index;                                             // Index of the next available packet descriptor.
-    uint8_t buffer[PLM_RX_BUFFER_SIZE];                             // Buffer for reception.
-    uint16_t buffer_empty_size;                                     // Number of bytes available in the reception buffer.
-    uint16_t buffer_empty_index;                                    // Index of the next available byte in reception buffer.
-} plm1_rx_t;
-
-// Structure holding variables for transmission.
-typedef struct _plm1_tx_t_ {
-    uint8_t config_nibble_index;                                    // Index of the next configuration nibble to send.
-    uint16_t byte_sent;                                             // Number of bytes already sent in the current packet.
-    uint8_t packet_index;                                           // Index of the packet to send.
-    bool msb;                                                       // true if next nibble to be transmistted is the MSB.
-    packet_desc_t packet_desc[PLM_TX_MAX_PACKET_NBR];               // Transmission packet descriptors.
-    uint8_t desc_index;                                             // Index of the next available packet descriptor.
-    uint8_t buffer[PLM_TX_BUFFER_SIZE];                             // Buffer for transmission.
-    uint16_t buffer_empty_size;                                     // Number of bytes available in the transmission buffer.
-    uint16_t buffer_empty_index;                                    // Index of the next available byte in transmission buffer.
-} plm1_tx_t;
-
-// Structure holding status of PLM-1.
-typedef struct _plm1_sts_t_ {
-    volatile plm1_state state;                                      // PLM-1 library' state.
-    uint8_t cfg[PLM_CONFIG_DATA_LENGTH];                            // Current configuration string.
-    bool spi_in_use;                                                // SPI transaction status.
-    plm1_status status[2];                                          // Library status buffer.
-} plm1_sts_t;
+// Default configuration string generated from plmcfg.h (CRC nibble excluded).
+static const uint8_t plm_default_cfg[PLM_CONFIG_DATA_LENGTH] PROGMEM = PLM_CFG_DEFAULT;
+
+// Ticks without nibble from PLM-1 allowed in each state (0 = not watched).
+// Configuration states are only watched after a soft reset of the watchdog.
+static const uint16_t wd_timeouts[PLM1_STATE_NBR] PROGMEM = {
+    /* PLM1_STATE_NOT_CONFIGURED */ PLM_CONFIG_TIMEOUT,
+    /* PLM1_STATE_CONFIGURING    */ PLM_CONFIG_TIMEOUT,
+    /* PLM1_STATE_IDLE           */ 0,
+    /* PLM1_STATE_NEGOTIATING    */ PLM_WD_NEGOTIATING_TIMEOUT,
+    /* PLM1_STATE_TRANSMITTING   */ PLM_WD_TRANSMITTING_TIMEOUT,
+    /* PLM1_STATE_RECEIVING      */ PLM_WD_RECEIVING_TIMEOUT
+};
 
 /*------------------------------------------------------------------------------
   Local macros declaration
@@ -99,58 +93,52 @@ typedef struct _plm1_sts_t_ {
 #   define CS_ENABLE(_enable)   ((_enable) ?  CLR_OUTPUT(PLM_CS) : SET_OUTPUT(PLM_CS))
 #endif
 
-// Mask PLM-1 and SPI interrupt.
+// Mask PLM-1, SPI and timer interrupt of the instance.
 #define MASK_INTERRUPTS()                                                      \
-    PLM_INT_DISABLE();                                                         \
-    PLM_SPI_INT_DISABLE()
+    plm->port->mask_irq(plm->port->arg, true)
 
-// Unmask PLM-1 and SPI interrupt.
+// Unmask PLM-1, SPI and timer interrupt of the instance.
 #define UNMASK_INTERRUPTS()                                                    \
-    PLM_INT_ENABLE();                                                          \
-    PLM_SPI_INT_ENABLE()
+    plm->port->mask_irq(plm->port->arg, false)
 
 // Increment index of a ring buffer.
 #define INCR(_index, _limit)                                                   \
     ((_index) >= (_limit) - 1) ? ((_index) = 0) : (++(_index))
 
-// Reset reception buffer.
-#define RX_RESET()                                                             \
-    plm_rx.packet_index = 0;                                                   \
-    plm_rx.msb = true;                                                         \
-    for(plm_i = 0; plm_i < PLM_RX_MAX_PACKET_NBR; plm_i++) {                   \
-        plm_rx.packet_desc[plm_i].size = 0;                                    \
-        plm_rx.packet_desc[plm_i].used = false;                                \
-    }                                                                          \
-    plm_rx.desc_index = 0;                                                     \
-    plm_rx.buffer_empty_size = PLM_RX_BUFFER_SIZE;                             \
-    plm_rx.buffer_empty_index = 0
-
-// Clear current packet descriptor.
+// Clear the packet descriptor being received. Packets already queued are
+// kept, the main loop owns them.
 #define RX_CLEAR_PKT()                                                         \
-    if(plm_rx.packet_desc[plm_rx.packet_index].used == false) {                \
-        plm_rx.packet_desc[plm_rx.packet_index].size = 0;                      \
-        plm_rx.invalid_packet = false;                                         \
-        plm_rx.msb = true;                                                     \
-    } 
+    plm->rx.packet_desc[plm->rx.desc_index].size = 0;                          \
+    plm->rx.invalid_packet = false;                                            \
+    plm->rx.msb = true
 
-// Reset transmission buffer.
+// Reset transmission buffer. Queued packets are dropped by consuming them,
+// the main loop keeps writing at its own index.
 #define TX_RESET()                                                             \
-    plm_tx.packet_index = 0;                                                   \
-    plm_tx.msb = true;                                                         \
-    plm_tx.byte_sent = 0;                                                      \
-    for(plm_i = 0; plm_i < PLM_TX_MAX_PACKET_NBR; plm_i++)                     \
-        plm_tx.packet_desc[plm_i].used = false;                                \
-    plm_tx.desc_index = 0;                                                     \
-    plm_tx.buffer_empty_size = PLM_TX_BUFFER_SIZE;                             \
-    plm_tx.buffer_empty_index = 0
-
-// Remove current packet from transmission buffer.
+    plm->tx.packet_index = plm->tx.desc_index;                                 \
+    plm->tx.msb = true;                                                        \
+    plm->tx.byte_sent = 0;                                                     \
+    plm->tx.window = plm->sts.min_window;                                      \
+    plm->tx.backoff = 0
+
+// Increment a counter, saturating at its maximum value.
+#define SAT_INC(_counter)                                                      \
+    if(++(_counter) == 0) --(_counter)
+
+// Add to a 32 bits counter, saturating at its maximum value.
+#define SAT_ADD(_counter, _value)                                              \
+    (_counter) = ((_counter) > (0xFFFFFFFFUL - (_value))) ? 0xFFFFFFFFUL : ((_counter) + (_value))
+
+// Remove current packet from transmission buffer; its descriptor and bytes
+// are given back to the main loop once the index is published.
 #define TX_REMOVE_PKT()                                                        \
-    plm_tx.buffer_empty_size += plm_tx.packet_desc[plm_tx.packet_index].size;  \
-    plm_tx.packet_desc[plm_tx.packet_index].used = false;                      \
-    INCR(plm_tx.packet_index, PLM_TX_MAX_PACKET_NBR);                          \
-    plm_tx.byte_sent = 0;                                                      \
-    plm_tx.msb = true
+    SAT_INC(plm->sts.stats.tx_packets);                                        \
+    plm->sts.link.tx_packets++;                                                \
+    SAT_ADD(plm->sts.stats.tx_bytes, plm->tx.packet_desc[plm->tx.packet_index].size); \
+    PLM_MEMORY_BARRIER();                                                      \
+    INCR(plm->tx.packet_index, PLM_TX_DESC_NBR);                               \
+    plm->tx.byte_sent = 0;                                                     \
+    plm->tx.msb = true
 
 // Convert byte count into nibble count.
 #define NIB(_byteCount)                                                        \
@@ -162,47 +150,132 @@ typedef struct _plm1_sts_t_ {
 
 // Start a byte transmission to SPI interface.
 #define SPI_TX_START(_data)                                                    \
-    CS_ENABLE(true);                                                           \
-    plm_sts.spi_in_use = true;                                                         \
-    PLM_SPI_TX_FUNC(_data)
+    plm->port->set_cs(plm->port->arg, true);                                   \
+    plm->sts.spi_in_use = true;                                                \
+    TRACE_BEGIN(PLM_TRACE_NONE);                                               \
+    plm->port->spi_tx(plm->port->arg, TRACE_TX(_data));                        \
+    TRACE_END()
 
 // Continue a SPI transaction by sending a new byte.
 #define SPI_TX_NEXT(_data)                                                     \
-    PLM_SPI_TX_FUNC(_data)
+    plm->port->spi_tx(plm->port->arg, TRACE_TX(_data))
 
 // Stop SPI transaction.
 #define SPI_TX_STOP()                                                          \
-    CS_ENABLE(false);                                                          \
-    plm_sts.spi_in_use = false
+    plm->port->set_cs(plm->port->arg, false);                                  \
+    plm->sts.spi_in_use = false
 
-/*------------------------------------------------------------------------------
-  Local variables declaration
-------------------------------------------------------------------------------*/
+#if PLM_TRACE_SIZE > 0
+
+// Start a trace entry.
+#define TRACE_BEGIN(_rxNibble)                                                 \
+    plm->trace.entry.time = PLM_TRACE_TIME();                                  \
+    plm->trace.entry.rx = (_rxNibble);                                         \
+    plm->trace.entry.tx = PLM_TRACE_NONE;                                      \
+    plm->trace.entry.state = plm->sts.state << 4
+
+// Record the nibble written to SPI port (evaluates to the nibble).
+#define TRACE_TX(_txNibble)                                                    \
+    (plm->trace.entry.tx = (_txNibble))
+
+// Store the trace entry into the ring, dropped if the ring is full.
+#define TRACE_END()                                                            \
+    plm->trace.entry.state |= plm->sts.state;                                  \
+    store_trace_entry(plm)
 
-static plm1_rx_t plm_rx;                                            // Reception struct.
-static plm1_tx_t plm_tx;                                            // Transmission struct.
-static plm1_sts_t plm_sts;                                          // PLM-1 status struct.
-static uint8_t plm_i;                                               // Used by **_RESET() macros.
+#else
+
+#define TRACE_BEGIN(_rxNibble)
+#define TRACE_TX(_txNibble)            (_txNibble)
+#define TRACE_END()
+
+#endif
 
 /*------------------------------------------------------------------------------
   Local functions declaration
 ------------------------------------------------------------------------------*/
 
-static void state_configuring(uint8_t rxNibble);
-static void state_idle(uint8_t rxNibble);
-static void state_negotiating(uint8_t rxNibble);
-static void state_transmitting(uint8_t rxNibble);
-static void state_receiving(uint8_t rxNibble);
-
-static void record_status(plm1_status sts);
-static void store_rx_nibble(uint8_t nibble);
-static uint8_t get_tx_nibble(void);
-static bool update_tx_nibble(void);
-static void eop_received(void);
+static void state_not_configured(plm1_t* plm, uint8_t rxNibble);
+static void state_configuring(plm1_t* plm, uint8_t rxNibble);
+static void state_idle_data(plm1_t* plm, uint8_t rxNibble);
+static void state_idle_ctrl(plm1_t* plm, uint8_t rxNibble);
+static void state_negotiating_ctrl(plm1_t* plm, uint8_t rxNibble);
+static void state_transmitting_data(plm1_t* plm, uint8_t rxNibble);
+static void state_transmitting_ctrl(plm1_t* plm, uint8_t rxNibble);
+static void state_receiving_data(plm1_t* plm, uint8_t rxNibble);
+static void state_receiving_ctrl(plm1_t* plm, uint8_t rxNibble);
+
+static void record_status(plm1_t* plm, plm1_status sts);
+static void start_configuration(plm1_t* plm);
+static void start_backoff(plm1_t* plm);
+static bool wd_expired(plm1_t* plm, plm1_state state, uint16_t ticks);
+static void wd_recover(plm1_t* plm, plm1_state state);
+static uint8_t next_random(plm1_t* plm);
+static uint8_t floor_pow2(uint8_t n);
+static void store_rx_nibble(plm1_t* plm, uint8_t nibble);
+static bool get_rx_buffer(plm1_t* plm);
+static bool tx_pending(plm1_t* plm);
+static uint8_t get_tx_nibble(plm1_t* plm);
+static bool update_tx_nibble(plm1_t* plm);
+static void complete_tx_packet(plm1_t* plm, plm1_tx_outcome outcome);
+static void prepare_tx_nibble(plm1_t* plm);
+static void accept_rx_header(plm1_t* plm);
+#if PLM_ACCEPT_ADDR_SIZE > 0
+static void accept_rx_address(plm1_t* plm);
+#endif
+static void drop_rx_packet(plm1_t* plm, plm1_drop reason);
+static void eop_received(plm1_t* plm, bool errored);
+static plm1_rx_channel_t* find_rx_channel(plm1_t* plm, uint8_t channel);
+static plm1_packet_desc_t* oldest_rx_packet(plm1_t* plm);
+static plm1_packet_desc_t* oldest_channel_packet(plm1_t* plm, uint8_t channel);
+static uint8_t* peek_rx_packet(plm1_t* plm, plm1_packet_desc_t* pkt, uint8_t* length, plm1_priority* prio, uint8_t* channel);
+static plm1_tx_handle forward_rx_packet(plm1_t* plm, plm1_packet_desc_t* pkt, uint8_t length, plm1_priority prio, uint8_t channel);
+static uint8_t read_rx_packet(plm1_t* plm, plm1_packet_desc_t* pkt, uint8_t* dataPacket, plm1_priority* prio, uint8_t* channel);
+static void release_rx_packet(plm1_t* plm, plm1_packet_desc_t* pkt, bool freeBuffer);
+static plm1_tx_handle send_packet(plm1_t* plm, uint8_t* data, uint8_t length, plm1_priority prio, uint8_t channel, bool rawMode, bool reserved);
+static uint8_t alloc_tx_buffer(plm1_t* plm, bool reserved);
+static plm1_tx_handle queue_tx_packet(plm1_t* plm, uint8_t buffer, uint8_t size);
+static void reclaim_tx_buffers(plm1_t* plm);
+static void post_rx_buffers(plm1_t* plm);
+static void balance_pool(plm1_t* plm);
+static void read_shared(void* dest, const void* src, uint8_t size);
+#if PLM_TRACE_SIZE > 0
+static void store_trace_entry(plm1_t* plm);
+#endif
 
-static void build_cfg_string(void);
+static void build_cfg_string(plm1_t* plm);
 static uint8_t crc4(uint8_t nibble, uint8_t oldCrc);
-static uint8_t log2_round(float n, bool ceil);
+
+static void default_set_cs(void* arg, bool select);
+static void default_set_reset(void* arg, bool run);
+static bool default_get_cnfgd(void* arg);
+static void default_spi_tx(void* arg, uint8_t byte);
+static void default_mask_irq(void* arg, bool mask);
+
+// State machine handlers, indexed by state and nibble class (data nibble or
+// special character).
+static void (* const state_handlers[PLM1_STATE_NBR][2])(plm1_t* plm, uint8_t rxNibble) = {
+    /* PLM1_STATE_NOT_CONFIGURED */ { state_not_configured,    state_not_configured    },
+    /* PLM1_STATE_CONFIGURING    */ { state_configuring,       state_configuring       },
+    /* PLM1_STATE_IDLE           */ { state_idle_data,         state_idle_ctrl         },
+    /* PLM1_STATE_NEGOTIATING    */ { state_idle_data,         state_negotiating_ctrl  },
+    /* PLM1_STATE_TRANSMITTING   */ { state_transmitting_data, state_transmitting_ctrl },
+    /* PLM1_STATE_RECEIVING      */ { state_receiving_data,    state_receiving_ctrl    }
+};
+
+/*------------------------------------------------------------------------------
+  Global variables declaration
+------------------------------------------------------------------------------*/
+
+// Port of a PLM-1 wired as described by the USER parameters of plm1.h.
+const plm1_port plm1_default_port = {
+    default_set_cs,
+    default_set_reset,
+    default_get_cnfgd,
+    default_spi_tx,
+    default_mask_irq,
+    NULL
+};
 
 /*------------------------------------------------------------------------------
   Global functions
@@ -210,39 +283,86 @@ static uint8_t log2_round(float n, bool ceil);
 
 /*******************************************************************************
 * Name:         plm1_init()        
-* Description:  Initialize the PLM-1 library according to the USER parameters
+* Description:  Initialize a PLM-1 instance according to the USER parameters
 *               defined on top of the plm1.h file.
-* Parameters:   None.
+* Parameters:   plm: Instance to initialize.
+*               port: Hardware bindings of the instance, &plm1_default_port
+*                     for the PLM-1 described in plm1.h.
 * Return:       None.
-* Note:         
+* Note:         "port" must stay valid as long as the instance is used.
 *******************************************************************************/
-void plm1_init(void)
+void plm1_init(plm1_t* plm, const plm1_port* port)
 {   
-    // Hold reset line of PLM-1.
-    CLR_OUTPUT(PLM_nRESET);
+    uint8_t i;
     
     // Initialize library variables.
-    memset(&plm_rx, 0, sizeof(plm_rx));
-    memset(&plm_tx, 0, sizeof(plm_tx));
-    memset(&plm_sts, 0, sizeof(plm_sts));
+    memset(plm, 0, sizeof(plm1_t));
+    plm->port = port;
+    
+    // All packet buffers free, some posted for reception.
+    for(i = 0; i < PLM_POOL_BUFFER_NBR; i++)
+    {
+        plm->pool.free[i] = i;
+    }
+    plm->pool.free_nbr = PLM_POOL_BUFFER_NBR;
+    plm->rx.buffer = PLM_POOL_NO_BUFFER;
+    post_rx_buffers(plm);
+    
+    // Hold reset line of PLM-1.
+    plm->port->set_reset(plm->port->arg, false);
+    
+    // Default backoff policy.
+    plm->sts.seed = PLM_BACKOFF_SEED;
+    plm->sts.min_window = PLM_BACKOFF_MIN_WINDOW;
+    plm->sts.max_window = PLM_BACKOFF_MAX_WINDOW;
     
     // Reset tx/rx variables.
-    RX_RESET();
+    RX_CLEAR_PKT();
     TX_RESET();
     
     // Remove SPI chip select.
-    CS_ENABLE(false);
+    plm->port->set_cs(plm->port->arg, false);
 }
 
 /*******************************************************************************
 * Name:         plm1_configure()        
 * Description:  Send configuration to PLM-1.
-* Parameters:   cfg: Configuration string. If NULL or invalid, the default
+* Parameters:   plm: Driver instance.
+*               cfg: Configuration string. If NULL or invalid, the default
 *                    configuration is used.
 * Return:       true if configuration has been done successfully, false otherwise.
-* Note:         This function block until configuration has been done.
+* Note:         This function block until configuration has been done or all
+*               attempts failed. plm1_timer() must be running for the timeout
+*               to expire.
+*******************************************************************************/
+bool plm1_configure(plm1_t* plm, uint8_t* cfg)
+{
+    plm1_cfg_result result;
+    
+    plm1_configure_start(plm, cfg, NULL);
+    
+    // Wait until configuration has finished.
+    do
+    {
+        result = plm1_configure_poll(plm);
+    } while(result == PLM1_CFG_IN_PROGRESS);
+    
+    return (result == PLM1_CFG_DONE);
+}
+
+/*******************************************************************************
+* Name:         plm1_configure_start()        
+* Description:  Start sending configuration to PLM-1 and return at once.
+* Parameters:   plm: Driver instance.
+*               cfg: Configuration string. If NULL or invalid, the default
+*                    configuration is used.
+*               callback: Called by plm1_configure_poll() when configuration
+*                         is over. NULL value is supported.
+* Return:       None.
+* Note:         An attempt lasting more than PLM_CONFIG_TIMEOUT ticks, or
+*               rejected by PLM-1, is retried up to PLM_CONFIG_RETRIES times.
 *******************************************************************************/
-bool plm1_configure(uint8_t* cfg)
+void plm1_configure_start(plm1_t* plm, uint8_t* cfg, plm1_cfg_callback callback)
 {
     uint8_t byteIndex;
     bool useDefaultCfg = true;
@@ -250,7 +370,7 @@ bool plm1_configure(uint8_t* cfg)
     MASK_INTERRUPTS();
     
     // Start PLM-1 if not already done.
-    SET_OUTPUT(PLM_nRESET);
+    plm->port->set_reset(plm->port->arg, true);
     
     // Argument is valid?
     if(cfg != NULL)
@@ -262,7 +382,7 @@ bool plm1_configure(uint8_t* cfg)
             {
                 // Configuration seems to be valid!
                 useDefaultCfg = false;
-                memcpy(plm_sts.cfg, cfg, PLM_CONFIG_DATA_LENGTH);
+                memcpy(plm->sts.cfg, cfg, PLM_CONFIG_DATA_LENGTH);
                 break;
             }
         }
@@ -271,878 +391,2495 @@ bool plm1_configure(uint8_t* cfg)
     // Build and use default configuration string?
     if(useDefaultCfg)
     {
-        build_cfg_string();
+        build_cfg_string(plm);
     }
     
-    // Reset configuration variables.
-    plm_tx.config_nibble_index = 0;
-    plm_sts.state = PLM1_STATE_CONFIGURING;
+    plm->sts.cfg_pending = true;
+    plm->sts.cfg_retries = PLM_CONFIG_RETRIES;
+    plm->sts.wd_reset = false;
+    plm->sts.cfg_callback = callback;
+    start_configuration(plm);
     
-    // Send Software Reset command and configuration will be done by plm1_spi_isr().
-    SPI_TX_START(PLM_CC_RESET);
     UNMASK_INTERRUPTS();
+}
+
+/*******************************************************************************
+* Name:         plm1_configure_poll()        
+* Description:  Follow the configuration started by plm1_configure_start().
+*               ** This function must be called from the main loop **
+* Parameters:   plm: Driver instance.
+* Return:       PLM1_CFG_IN_PROGRESS while configuring, then PLM1_CFG_DONE or
+*               PLM1_CFG_FAILED.
+* Note:         Handles the timeout and the retries, and calls the completion
+*               callback once, from the main loop. Interrupts are only masked
+*               to abort or restart a failed attempt.
+*******************************************************************************/
+plm1_cfg_result plm1_configure_poll(plm1_t* plm)
+{
+    plm1_cfg_result result = PLM1_CFG_IN_PROGRESS;
+    bool finished = false;
+    plm1_state state = plm->sts.state;
     
-    // Wait until configuration has finished.
-    while(plm_sts.state == PLM1_STATE_CONFIGURING);
+    if(plm->sts.cfg_pending)
+    {
+        // Attempt failed or timed out?
+        if((state == PLM1_STATE_NOT_CONFIGURED) ||
+           ((state == PLM1_STATE_CONFIGURING) &&
+            ((uint16_t)(plm1_get_tick(plm) - plm->sts.cfg_start) >= PLM_CONFIG_TIMEOUT)))
+        {
+            MASK_INTERRUPTS();
+            
+            // State may have changed since it was read.
+            if(plm->sts.state == PLM1_STATE_CONFIGURING)
+            {
+                SPI_TX_STOP();
+                plm->sts.state = PLM1_STATE_NOT_CONFIGURED;
+            }
+            
+            if(plm->sts.state == PLM1_STATE_NOT_CONFIGURED)
+            {
+                // Attempt failed, retry if allowed.
+                record_status(plm, PLM1_STS_CONFIG_FAILED);
+                if(plm->sts.cfg_retries > 0)
+                {
+                    plm->sts.cfg_retries--;
+                    start_configuration(plm);
+                }
+                else
+                {
+                    plm->sts.cfg_pending = false;
+                    finished = true;
+                }
+            }
+            
+            UNMASK_INTERRUPTS();
+        }
+        else if(state != PLM1_STATE_CONFIGURING)
+        {
+            plm->sts.cfg_pending = false;
+            finished = true;
+        }
+    }
+    
+    if(plm->sts.cfg_pending == false)
+    {
+        result = (plm->sts.state == PLM1_STATE_NOT_CONFIGURED) ? PLM1_CFG_FAILED : PLM1_CFG_DONE;
+    }
+    
+    // Notify the application outside of the critical section.
+    if(finished && (plm->sts.cfg_callback != NULL))
+    {
+        plm->sts.cfg_callback(plm, result == PLM1_CFG_DONE);
+    }
     
-    return(plm_sts.state != PLM1_STATE_NOT_CONFIGURED);
+    return (result);
 }
 
 /*******************************************************************************
 * Name:         plm1_interrupt()        
 * Description:  Handler of PLM-1 packet reception and transmission.
 *               ** This function must be called from PLM-1 external interrupt **
-* Parameters:   None.
+* Parameters:   plm: Driver instance.
 * Return:       None.
-* Note:         
+* Note:         Like plm1_spi_isr(), runs with global interrupts disabled.
 *******************************************************************************/
-void plm1_interrupt(void)
+void plm1_interrupt(plm1_t* plm)
 {
-    MASK_INTERRUPTS();
-    
     // Send a NOP command only if PLM-1 is configured and a SPI transaction is
     // not already started.
-    if((plm_sts.state >= PLM1_STATE_IDLE) && (plm_sts.spi_in_use == false))
+    if((plm->sts.state >= PLM1_STATE_IDLE) && (plm->sts.spi_in_use == false))
     {
         SPI_TX_START(PLM_CC_NOP);
     }
+}
+
+/*******************************************************************************
+* Name:         plm1_timer()        
+* Description:  Time base of the library; count down the collision backoff and
+*               start the negotiation of packets queued while the line was
+*               idle.
+*               ** This function must be called from a periodic timer ISR **
+* Parameters:   plm: Driver instance.
+* Return:       None.
+* Note:         A backoff slot lasts PLM_BACKOFF_SLOT_TICKS calls. Like
+*               plm1_spi_isr(), runs with global interrupts disabled.
+*******************************************************************************/
+void plm1_timer(plm1_t* plm)
+{
+    ++plm->sts.tick;
+    if(plm->sts.stats_clear)
+    {
+        memset(&plm->sts.stats, 0, sizeof(plm1_stats));
+        PLM_MEMORY_BARRIER();
+        plm->sts.stats_clear = false;
+    }
+    SAT_ADD(plm->sts.stats.dwell[plm->sts.state], 1);
+    SAT_INC(plm->sts.wd_ticks);
     
-    UNMASK_INTERRUPTS();
+    if(plm->tx.backoff > 0)
+    {
+        if(--plm->tx.backoff == 0)
+        {
+            SAT_INC(plm->sts.stats.retries);
+        }
+    }
+    
+    // Start transmitting if the line is free, otherwise the state machine
+    // will as soon as it comes back to idle.
+    if((plm->sts.state == PLM1_STATE_IDLE) && (plm->sts.spi_in_use == false) && tx_pending(plm))
+    {
+        SPI_TX_START(get_tx_nibble(plm));
+        prepare_tx_nibble(plm);
+        plm->sts.state = PLM1_STATE_NEGOTIATING;
+        SAT_INC(plm->sts.stats.negotiations);
+        plm->sts.wd_ticks = 0;
+    }
 }
 
 /*******************************************************************************
 * Name:         plm1_spi_isr()        
 * Description:  Parser of data received from SPI port.
 *               ** This function must be called from SPI reception ISR **
-* Parameters:   rxNibble: Received 5 bits nibble.
+* Parameters:   plm: Driver instance.
+*               rxNibble: Received 5 bits nibble.
 * Return:       None.
-* Note:         
+* Note:         The ISR runs with global interrupts disabled, so the PLM-1,
+*               SPI and timer interrupts are not masked again here. The ISR
+*               must not re-enable interrupts (no ISR_NOBLOCK).
 *******************************************************************************/
-void plm1_spi_isr(uint8_t rxNibble)
+void plm1_spi_isr(plm1_t* plm, uint8_t rxNibble)
 {    
-    MASK_INTERRUPTS();
-
-    switch(plm_sts.state)
-    {
-      case PLM1_STATE_CONFIGURING:
-        // During configuration...
-        state_configuring(rxNibble);
-        break;
-        
-      case PLM1_STATE_IDLE:
-        // Not transmitting nor receiving...      
-        state_idle(rxNibble);
-        break;
-        
-      case PLM1_STATE_RECEIVING:
-        // Receiving data from powerline...
-        state_receiving(rxNibble);
-        break;
-        
-      case PLM1_STATE_NEGOTIATING:
-        // Try to start a transmission...
-        state_negotiating(rxNibble);
-        break;
-        
-      case PLM1_STATE_TRANSMITTING:
-        // During a transmission...
-        state_transmitting(rxNibble);
-        break;
-      
-      case PLM1_STATE_NOT_CONFIGURED:
-      default:
-        // Plm-1 not yet configured...
-        break;
-    }
-    
-    UNMASK_INTERRUPTS();
+    plm->sts.wd_ticks = 0;
+    TRACE_BEGIN(rxNibble);
+    state_handlers[plm->sts.state][(rxNibble >> 4) & 0x01](plm, rxNibble);
+    TRACE_END();
 }
 
 /*******************************************************************************
 * Name:         plm1_send_data()        
 * Description:  Send a packet on the powerline (basic function).
-* Parameters:   data: Data to send.
+* Parameters:   plm: Driver instance.
+*               data: Data to send.
 *               length: Length of the data array.
-* Return:       true if the packet has been queued successfully, false otherwise.
+* Return:       Handle of the packet, PLM_TX_NO_HANDLE if it was not queued.
 * Note:         
 *******************************************************************************/
-bool plm1_send_data(uint8_t* data, uint8_t length)
+plm1_tx_handle plm1_send_data(plm1_t* plm, uint8_t* data, uint8_t length)
 {
-   return plm1_send_packet(data, length, PLM1_PRIO_NORMAL, PLM_TX_CHANNEL, false);
+   return plm1_send_packet(plm, data, length, PLM1_PRIO_NORMAL, PLM_TX_CHANNEL, false);
 }
 
 /*******************************************************************************
 * Name:         plm1_send_packet()        
 * Description:  Send a packet on the powerline (complete function).
-* Parameters:   data: Data to send.
+* Parameters:   plm: Driver instance.
+*               data: Data to send.
 *               length: Length of the data array.
 *               prio: Packet priority.
 *               channel: Channel number used to send packet.
 *               rawMode: When set to true, "prio" and "channel" arguments are not
 *                        considered and the "data" array contains the entire 
 *                        packet (including channel number and packet priority).
-* Return:       true if the packet has been queued successfully, false otherwise.
-* Note:         
+* Return:       Handle of the packet, PLM_TX_NO_HANDLE if it was not queued.
+* Note:         The packet is published to the ISR without masking interrupts;
+*               if the line is idle, plm1_timer() starts its transmission on
+*               the next tick. Its completion is reported with the handle by
+*               plm1_tx_poll().
 *******************************************************************************/
-bool plm1_send_packet(uint8_t* data, uint8_t length, plm1_priority prio, uint8_t channel, bool rawMode)
+plm1_tx_handle plm1_send_packet(plm1_t* plm, uint8_t* data, uint8_t length, plm1_priority prio, uint8_t channel, bool rawMode)
 {
-    bool txSuccess = false;
-    uint32_t txIndexEnd;
-    uint16_t txLength = length;
-    
-    // Compute packet size.
-    if(rawMode == false)
-    {
-        // Add size of the PLM1 header.
-        txLength += PLM_PACKET_HEADER_SIZE;
-    }
-    
-    // Buffer space available?
-    if((txLength <= plm_tx.buffer_empty_size) && (txLength <= PLM_MAX_PACKET_SIZE) && (length > 0))
-    {
-        // Packet descriptor available?
-        if(plm_tx.packet_desc[plm_tx.desc_index].used == false)
-        {
-            // Fill packet descriptor.
-            plm_tx.packet_desc[plm_tx.desc_index].start = plm_tx.buffer_empty_index;
-            plm_tx.packet_desc[plm_tx.desc_index].size = (uint8_t)txLength;
+    return (send_packet(plm, data, length, prio, channel, rawMode, false));
+}
 
-            // Copy PLM1 header if necessary.
-            if(rawMode == false)
-            {
-                plm_tx.buffer[plm_tx.buffer_empty_index] = (uint8_t)prio;
-                INCR(plm_tx.buffer_empty_index, PLM_TX_BUFFER_SIZE);
-                plm_tx.buffer[plm_tx.buffer_empty_index] = channel;
-                INCR(plm_tx.buffer_empty_index, PLM_TX_BUFFER_SIZE);
-            }
-            
-            // Copy data into buffer.
-            txIndexEnd = (uint32_t)plm_tx.buffer_empty_index + (uint32_t)length - 1;
-            if(txIndexEnd < PLM_TX_BUFFER_SIZE)
-            {
-                // Linear array available into buffer.
-                memcpy(&plm_tx.buffer[plm_tx.buffer_empty_index], data, length);
-            }
-            else
-            {
-                uint16_t tempLength = PLM_TX_BUFFER_SIZE - plm_tx.buffer_empty_index;
-                
-                // Copy a part of the packet at the buffer's end.
-                memcpy(&plm_tx.buffer[plm_tx.buffer_empty_index], data, tempLength);
-                
-                // Copy remaining data at the buffer's begining.
-                memcpy(plm_tx.buffer, data + tempLength, length - tempLength);
-            }
-                        
-            // Update transmission struct.
-            plm_tx.packet_desc[plm_tx.desc_index].used = true;
-            INCR(plm_tx.desc_index, PLM_TX_MAX_PACKET_NBR);
-            plm_tx.buffer_empty_size -= txLength;
-            plm_tx.buffer_empty_index = (plm_tx.buffer_empty_index + length) % PLM_TX_BUFFER_SIZE;
-            
-            // Packet successfully queued!
-            txSuccess = true;
-            
-            // Send packet if PLM-1 is idle and a SPI transaction is not already started.
-            if((plm_sts.state == PLM1_STATE_IDLE) && (plm_sts.spi_in_use == false))
-            {
-                SPI_TX_START(get_tx_nibble());
-                plm_sts.state = PLM1_STATE_NEGOTIATING;
-            }
-        }
-    }
-    
-    return (txSuccess);  
+/*******************************************************************************
+* Name:         plm1_send_reserved()        
+* Description:  Send a packet on the powerline in a buffer reserved by
+*               plm1_tx_reserve().
+* Parameters:   plm: Driver instance.
+*               data: Data to send.
+*               length: Length of the data array.
+*               prio: Packet priority.
+*               channel: Channel number used to send packet.
+* Return:       Handle of the packet, PLM_TX_NO_HANDLE if it was not queued.
+* Note:         Fails if no buffer is reserved, even if others are free: the
+*               reservation is the whole share of its owner.
+*******************************************************************************/
+plm1_tx_handle plm1_send_reserved(plm1_t* plm, uint8_t* data, uint8_t length, plm1_priority prio, uint8_t channel)
+{
+    return (send_packet(plm, data, length, prio, channel, false, true));
 }
 
 /*******************************************************************************
 * Name:         plm1_receive()        
 * Description:  Get received packets.
-* Parameters:   dataPacket: Pointer to an array to which complete packets are
+* Parameters:   plm: Driver instance.
+*               dataPacket: Pointer to an array to which complete packets are
 *                           copied (packet does not include the PLM-1 header).
 *               priority: Priority of the received packet. NULL value is
 *                         supported.
 *               channel: Software channel on wich packet has been received.
 *                        NULL value is supported.
 * Return:       Length of the packet loaded in "dataPacket".
-* Note:         
+* Note:         Returns the oldest packet not read yet, whatever its channel.
+*               Its buffer goes back to the pool.
 *******************************************************************************/
-uint8_t plm1_receive(uint8_t* dataPacket, plm1_priority* prio, uint8_t* channel)
+uint8_t plm1_receive(plm1_t* plm, uint8_t* dataPacket, plm1_priority* prio, uint8_t* channel)
 {
-    uint8_t length;
-    uint32_t rxIndexEnd;
-    packet_desc_t* pkt = &plm_rx.packet_desc[plm_rx.packet_index]; 
+    plm1_packet_desc_t* pkt;
+    uint8_t length = 0;
     
-    // Complete packet received?
-    if(pkt->used)
-    {
-        // Get packet priority.
-        if(prio != NULL)
-        {
-            *prio = (plm1_priority)plm_rx.buffer[pkt->start];
-        }
-        INCR(pkt->start, PLM_RX_BUFFER_SIZE);
-        
-        // Get channel number.
-        if(channel != NULL)
-        {
-            *channel = plm_rx.buffer[pkt->start];
-        }
-        INCR(pkt->start, PLM_RX_BUFFER_SIZE);
-        
-        // Copy received packet without PLM-1 header.
-        length = pkt->size - PLM_PACKET_HEADER_SIZE;
-        rxIndexEnd = pkt->start + length - 1;
-        if(rxIndexEnd < PLM_RX_BUFFER_SIZE)
-        {
-            // Linear buffer.
-            memcpy(dataPacket, &plm_rx.buffer[pkt->start], length);
-        }
-        else
-        {
-            uint16_t tempLength = PLM_RX_BUFFER_SIZE - pkt->start;
-                
-            // Copy the part of the packet present at buffer's end.
-            memcpy(dataPacket, &plm_rx.buffer[pkt->start], tempLength);
-            
-            // Copy remaining data present at buffer's begining.
-            memcpy(dataPacket + tempLength, plm_rx.buffer, length - tempLength);        
-        }
-
-        // Free reception buffer and packet descriptor.
-        plm_rx.buffer_empty_size += pkt->size;
-        pkt->size = 0;
-        pkt->used = false;
-        INCR(plm_rx.packet_index, PLM_RX_MAX_PACKET_NBR);
-    }
-    else
+    balance_pool(plm);
+    
+    pkt = oldest_rx_packet(plm);
+    if(pkt != NULL)
     {
-        // No packet available.
-        length = 0;
+        length = read_rx_packet(plm, pkt, dataPacket, prio, channel);
     }
     
     return (length);
 }
 
 /*******************************************************************************
-* Name:         plm1_get_status()        
-* Description:  Returns library status.
-* Parameters:   None.
-* Return:       Library status.
-* Note:         
+* Name:         plm1_receive_channel()        
+* Description:  Get received packets of a specific channel.
+* Parameters:   plm: Driver instance.
+*               channel: Software channel to read, layer bits ignored.
+*               dataPacket: Pointer to an array to which complete packets are
+*                           copied (packet does not include the PLM-1 header).
+*               priority: Priority of the received packet. NULL value is
+*                         supported.
+* Return:       Length of the packet loaded in "dataPacket".
+* Note:         Packets of other channels stay queued, so a slow consumer does
+*               not block the others.
 *******************************************************************************/
-plm1_status plm1_get_status(void)
+uint8_t plm1_receive_channel(plm1_t* plm, uint8_t channel, uint8_t* dataPacket, plm1_priority* prio)
 {
-    plm1_status sts;
+    plm1_packet_desc_t* pkt;
+    uint8_t length = 0;
     
-    MASK_INTERRUPTS();
+    balance_pool(plm);
     
-    // "status[0]" is the oldest and "status[1]" the newest.
-    sts = plm_sts.status[0];
-    plm_sts.status[0] = plm_sts.status[1];
-    plm_sts.status[1] = PLM1_STS_OK;
+    pkt = oldest_channel_packet(plm, channel);
+    if(pkt != NULL)
+    {
+        length = read_rx_packet(plm, pkt, dataPacket, prio, NULL);
+    }
     
-    UNMASK_INTERRUPTS();
+    return (length);
+}
+
+/*******************************************************************************
+* Name:         plm1_rx_errored()        
+* Description:  Check if the last packet read or peeked was received with
+*               errors.
+* Parameters:   plm: Driver instance.
+* Return:       true if PLM-1 reported a reception error on it.
+* Note:         Only packets with PLM_CHANNEL_FEC_MASK bits are delivered with
+*               errors, other ones are dropped. Their header may be corrupted
+*               too.
+*******************************************************************************/
+bool plm1_rx_errored(plm1_t* plm)
+{
+    return (plm->rx.errored);
+}
+
+/*******************************************************************************
+* Name:         plm1_rx_channel()        
+* Description:  Get the channel byte of the last packet read or peeked.
+* Parameters:   plm: Driver instance.
+* Return:       Channel byte, layer bits included.
+* Note:         Gives the layer bits of the packets read by the functions
+*               taking a channel, which match on the channel number only.
+*******************************************************************************/
+uint8_t plm1_rx_channel(plm1_t* plm)
+{
+    return (plm->rx.read_channel);
+}
+
+/*******************************************************************************
+* Name:         plm1_peek()        
+* Description:  Get the oldest received packet without copying it.
+* Parameters:   plm: Driver instance.
+*               length: Length of the packet data (PLM-1 header excluded).
+*               prio: Priority of the packet. NULL value is supported.
+*               channel: Software channel of the packet. NULL value is
+*                        supported.
+* Return:       Packet data inside its pool buffer, NULL if no packet is
+*               available.
+* Note:         The packet stays queued until plm1_release(), plm1_forward()
+*               or plm1_receive(). Its data may be modified in place, and
+*               extended up to PLM_PACKET_DATA_SIZE bytes before forwarding.
+*******************************************************************************/
+uint8_t* plm1_peek(plm1_t* plm, uint8_t* length, plm1_priority* prio, uint8_t* channel)
+{
+    balance_pool(plm);
     
-    return (sts);
+    return (peek_rx_packet(plm, oldest_rx_packet(plm), length, prio, channel));
 }
 
 /*******************************************************************************
-* Name:         plm1_tx_idle()        
-* Description:  Get transmitter state.
-* Parameters:   None.
-* Return:       true if transmission buffer is empty, false otherwise.
-* Note:         
+* Name:         plm1_peek_channel()        
+* Description:  Get the oldest received packet of a specific channel without
+*               copying it.
+* Parameters:   plm: Driver instance.
+*               channel: Software channel to read, layer bits ignored.
+*               length: Length of the packet data (PLM-1 header excluded).
+*               prio: Priority of the packet. NULL value is supported.
+* Return:       Packet data inside its pool buffer, NULL if no packet of this
+*               channel is available.
+* Note:         As plm1_peek(), but packets of other channels stay queued and
+*               do not hide this one. The packet is freed by
+*               plm1_release_channel() or plm1_forward_channel().
 *******************************************************************************/
-bool plm1_tx_idle(void)
+uint8_t* plm1_peek_channel(plm1_t* plm, uint8_t channel, uint8_t* length, plm1_priority* prio)
 {
-    return (plm_tx.buffer_empty_size == PLM_TX_BUFFER_SIZE);
+    balance_pool(plm);
+    
+    return (peek_rx_packet(plm, oldest_channel_packet(plm, channel), length, prio, NULL));
 }
 
 /*******************************************************************************
-* Name:         plm1_get_configuration()        
-* Description:  Get configuration string curently used.
-* Parameters:   cfg: Array used to return current configuration string.
-* Return:       true if a configuration string is available, false if PLM-1 is
-*               not currently configured.
+* Name:         plm1_release()        
+* Description:  Free the packet returned by plm1_peek().
+* Parameters:   plm: Driver instance.
+* Return:       None.
 * Note:         
 *******************************************************************************/
-bool plm1_get_configuration(uint8_t* cfg)
+void plm1_release(plm1_t* plm)
 {
-    bool configured;
+    plm1_packet_desc_t* pkt = oldest_rx_packet(plm);
     
-    MASK_INTERRUPTS();
-    
-    if(plm_sts.state <= PLM1_STATE_CONFIGURING)
-    {
-        // Not yet configured.
-        memset(cfg, 0, PLM_CONFIG_DATA_LENGTH);
-        configured = false;
-    }
-    else
+    if(pkt != NULL)
     {
-        // Get configuration.
-        memcpy(cfg, plm_sts.cfg, PLM_CONFIG_DATA_LENGTH);
-        configured = true;
+        release_rx_packet(plm, pkt, true);
     }
-    
-    UNMASK_INTERRUPTS();
-    
-    return (configured);
 }
 
-/*------------------------------------------------------------------------------
-  Local functions
-------------------------------------------------------------------------------*/
-
 /*******************************************************************************
-* Name:         state_configuring()        
-* Description:  Execute state "Configuring".
-* Parameters:   rxNibble: Nibble received from PLM-1.
+* Name:         plm1_release_channel()        
+* Description:  Free the packet returned by plm1_peek_channel().
+* Parameters:   plm: Driver instance.
+*               channel: Software channel of the packet.
 * Return:       None.
 * Note:         
 *******************************************************************************/
-static void state_configuring(uint8_t rxNibble)
+void plm1_release_channel(plm1_t* plm, uint8_t channel)
 {
-    // During configuration, send next configuration nibble.
-    if(plm_tx.config_nibble_index < NIB(PLM_CONFIG_DATA_LENGTH))
+    plm1_packet_desc_t* pkt = oldest_channel_packet(plm, channel);
+    
+    if(pkt != NULL)
     {
-        SPI_TX_NEXT(GET_NIBBLE(plm_sts.cfg, plm_tx.config_nibble_index));
-        ++plm_tx.config_nibble_index;
+        release_rx_packet(plm, pkt, true);
     }
-    else
-    {
-        // Configuration finished.
-        SPI_TX_STOP();
+}
 
-        // Test pin CNFGD if set.
-#ifdef PLM_CNFGD
-        if(GET_INPUT(PLM_CNFGD) == 0)
-        {
-            // Configuration fails...
-            plm_sts.state = PLM1_STATE_NOT_CONFIGURED;
-        }
-        else
+/*******************************************************************************
+* Name:         plm1_forward()        
+* Description:  Send the packet returned by plm1_peek() without copying it.
+* Parameters:   plm: Driver instance.
+*               length: Length of the packet data (up to PLM_PACKET_DATA_SIZE).
+*               prio: Packet priority.
+*               channel: Channel number used to send packet.
+* Return:       Handle of the packet, PLM_TX_NO_HANDLE if it was not queued.
+* Note:         The buffer of the received packet is moved to the transmission
+*               queue; the PLM-1 header is rewritten in place. If it cannot be
+*               queued, the packet stays available to plm1_peek().
+*******************************************************************************/
+plm1_tx_handle plm1_forward(plm1_t* plm, uint8_t length, plm1_priority prio, uint8_t channel)
+{
+    return (forward_rx_packet(plm, oldest_rx_packet(plm), length, prio, channel));
+}
+
+/*******************************************************************************
+* Name:         plm1_forward_channel()        
+* Description:  Send the packet returned by plm1_peek_channel() without copying
+*               it.
+* Parameters:   plm: Driver instance.
+*               rxChannel: Software channel the packet was received on.
+*               length: Length of the packet data (up to PLM_PACKET_DATA_SIZE).
+*               prio: Packet priority.
+*               channel: Channel number used to send packet.
+* Return:       Handle of the packet, PLM_TX_NO_HANDLE if it was not queued.
+* Note:         See plm1_forward(). If it cannot be queued, the packet stays
+*               available to plm1_peek_channel().
+*******************************************************************************/
+plm1_tx_handle plm1_forward_channel(plm1_t* plm, uint8_t rxChannel, uint8_t length, plm1_priority prio, uint8_t channel)
+{
+    return (forward_rx_packet(plm, oldest_channel_packet(plm, rxChannel), length, prio, channel));
+}
+
+/*******************************************************************************
+* Name:         plm1_subscribe()        
+* Description:  Subscribe to a reception channel.
+* Parameters:   plm: Driver instance.
+*               channel: Software channel to receive.
+*               depth: Max nb of packets queued for this channel; further
+*                      packets are dropped until the application reads them.
+* Return:       true if subscribed, false if no subscription slot is available.
+* Note:         As long as no channel is subscribed, all packets are received.
+*               Once a channel is subscribed, packets of unsubscribed channels
+*               are discarded on reception. Only the channel number is
+*               matched: the packets of the channel with any layer bits are
+*               received (see PLM_CHANNEL_NUMBER_MASK).
+*******************************************************************************/
+bool plm1_subscribe(plm1_t* plm, uint8_t channel, uint8_t depth)
+{
+    plm1_rx_channel_t* rxChannel;
+    bool subscribed = false;
+    uint8_t i;
+    
+    rxChannel = find_rx_channel(plm, channel);
+    if(rxChannel != NULL)
+    {
+        // Already subscribed, update depth.
+        rxChannel->depth = (depth != 0) ? depth : 1;
+        subscribed = true;
+    }
+    else
+    {
+        for(i = 0; i < PLM_RX_CHANNEL_NBR; i++)
+        {
+            if(plm->rx.channels[i].depth == 0)
+            {
+                // The ISR ignores the slot until its depth is published.
+                memset(&plm->rx.channels[i], 0, sizeof(plm1_rx_channel_t));
+                plm->rx.channels[i].channel = channel & PLM_CHANNEL_NUMBER_MASK;
+                PLM_MEMORY_BARRIER();
+                plm->rx.channels[i].depth = (depth != 0) ? depth : 1;
+                plm->rx.channel_nbr++;
+                subscribed = true;
+                break;
+            }
+        }
+    }
+    
+    return (subscribed);
+}
+
+/*******************************************************************************
+* Name:         plm1_unsubscribe()        
+* Description:  Unsubscribe from a reception channel.
+* Parameters:   plm: Driver instance.
+*               channel: Software channel to stop receiving.
+* Return:       None.
+* Note:         Packets of this channel already queued can still be read.
+*******************************************************************************/
+void plm1_unsubscribe(plm1_t* plm, uint8_t channel)
+{
+    plm1_rx_channel_t* rxChannel;
+    
+    rxChannel = find_rx_channel(plm, channel);
+    if(rxChannel != NULL)
+    {
+        rxChannel->depth = 0;
+        plm->rx.channel_nbr--;
+    }
+}
+
+/*******************************************************************************
+* Name:         plm1_get_channel_stats()        
+* Description:  Get reception counters of a subscribed channel.
+* Parameters:   plm: Driver instance.
+*               channel: Software channel.
+*               stats: Struct used to return the counters.
+* Return:       true if the channel is subscribed, false otherwise.
+* Note:         
+*******************************************************************************/
+bool plm1_get_channel_stats(plm1_t* plm, uint8_t channel, plm1_channel_stats* stats)
+{
+    plm1_rx_channel_t* rxChannel;
+    plm1_rx_channel_t snapshot;
+    
+    rxChannel = find_rx_channel(plm, channel);
+    if(rxChannel != NULL)
+    {
+        read_shared(&snapshot, rxChannel, sizeof(plm1_rx_channel_t));
+        stats->depth = snapshot.depth;
+        stats->occupancy = snapshot.queued - snapshot.read;
+        stats->received = snapshot.received;
+        stats->dropped = snapshot.dropped;
+    }
+    
+    return (rxChannel != NULL);
+}
+
+/*******************************************************************************
+* Name:         plm1_set_accept()        
+* Description:  Set the reception accept filter.
+* Parameters:   plm: Driver instance.
+*               accept: Filter to apply, NULL to accept all packets.
+* Return:       None.
+* Note:         The filter is applied by the ISR as soon as the channel byte
+*               (and the address bytes) of a packet are received; rejected
+*               packets do not use reception buffer space. It is combined with
+*               the channel subscriptions.
+*******************************************************************************/
+void plm1_set_accept(plm1_t* plm, const plm1_accept* accept)
+{
+#if PLM_ACCEPT_ADDR_SIZE > 0
+    uint8_t i;
+#endif
+    
+    MASK_INTERRUPTS();
+    
+    memset(&plm->rx.accept, 0, sizeof(plm1_accept));
+    plm->rx.accept_addr = false;
+    if(accept != NULL)
+    {
+        plm->rx.accept.channel_mask = accept->channel_mask;
+        plm->rx.accept.channel_value = accept->channel_value & accept->channel_mask;
+#if PLM_ACCEPT_ADDR_SIZE > 0
+        for(i = 0; i < PLM_ACCEPT_ADDR_SIZE; i++)
+        {
+            plm->rx.accept.addr_mask[i] = accept->addr_mask[i];
+            plm->rx.accept.addr_value[i] = accept->addr_value[i] & accept->addr_mask[i];
+            if(accept->addr_mask[i] != 0)
+            {
+                plm->rx.accept_addr = true;
+            }
+        }
+#endif
+    }
+    
+    UNMASK_INTERRUPTS();
+}
+
+/*******************************************************************************
+* Name:         plm1_get_status()        
+* Description:  Returns library status.
+* Parameters:   plm: Driver instance.
+* Return:       Library status, oldest first.
+* Note:         Statuses recorded while the queue is full are dropped; they are
+*               still counted in the statistics and the journal.
+*******************************************************************************/
+plm1_status plm1_get_status(plm1_t* plm)
+{
+    plm1_status sts = PLM1_STS_OK;
+    uint8_t tail = plm->sts.status_tail;
+    
+    if(tail != plm->sts.status_head)
+    {
+        PLM_MEMORY_BARRIER();
+        sts = plm->sts.status[tail & (PLM_STATUS_QUEUE_SIZE - 1)];
+        PLM_MEMORY_BARRIER();
+        plm->sts.status_tail = tail + 1;
+    }
+    
+    return (sts);
+}
+
+/*******************************************************************************
+* Name:         plm1_tx_idle()        
+* Description:  Get transmitter state.
+* Parameters:   plm: Driver instance.
+* Return:       true if transmission buffer is empty, false otherwise.
+* Note:         
+*******************************************************************************/
+bool plm1_tx_idle(plm1_t* plm)
+{
+    return (plm->tx.packet_index == plm->tx.desc_index);
+}
+
+/*******************************************************************************
+* Name:         plm1_tx_hold()        
+* Description:  Hold queued packets in the transmission buffer or release them.
+* Parameters:   plm: Driver instance.
+*               hold: true to hold the packets, false to release them.
+* Return:       None.
+* Note:         Packets keep being queued while held. A packet whose
+*               negotiation already started is sent to the end; the next one
+*               waits for the release. Used by scheduled access MAC layers.
+*******************************************************************************/
+void plm1_tx_hold(plm1_t* plm, bool hold)
+{
+    plm->tx.hold = hold;
+}
+
+/*******************************************************************************
+* Name:         plm1_tx_reserve()        
+* Description:  Reserve packet buffers for the next packets to send.
+* Parameters:   plm: Driver instance.
+*               count: Nb of buffers wanted in reserve, 0 to cancel the
+*                      reservation.
+* Return:       Nb of buffers reserved, lower than "count" if the pool is short.
+* Note:         A reserved buffer stays free but is no longer posted for
+*               reception, so that plm1_send_reserved() is sure to queue as
+*               many packets as reserved. Only plm1_send_reserved() uses the
+*               reserved buffers; plm1_send_packet() and plm1_forward() share
+*               the rest of the transmission share. Used to grant
+*               transmission credits to a host: reserve what is granted, and
+*               release it (count 0) once the host is idle.
+*******************************************************************************/
+uint8_t plm1_tx_reserve(plm1_t* plm, uint8_t count)
+{
+    reclaim_tx_buffers(plm);
+    
+    // Release the buffers reserved beyond "count".
+    while(plm->pool.tx_reserved > count)
+    {
+        plm->pool.tx_reserved--;
+        plm->pool.tx_held--;
+    }
+    
+    // Reserve free buffers, within the share of transmission.
+    while((plm->pool.tx_reserved < count) && (plm->pool.free_nbr > plm->pool.tx_reserved) &&
+          (plm->pool.tx_held < (PLM_POOL_BUFFER_NBR - PLM_POOL_RX_RESERVED)))
+    {
+        plm->pool.tx_reserved++;
+        plm->pool.tx_held++;
+    }
+    
+    // Buffers released go back to reception.
+    post_rx_buffers(plm);
+    
+    return (plm->pool.tx_reserved);
+}
+
+/*******************************************************************************
+* Name:         plm1_set_tx_callback()        
+* Description:  Set the transmission completion callback.
+* Parameters:   plm: Driver instance.
+*               callback: Called by plm1_tx_poll() for each completed packet.
+*                         NULL value is supported.
+* Return:       None.
+* Note:         
+*******************************************************************************/
+void plm1_set_tx_callback(plm1_t* plm, plm1_tx_callback callback)
+{
+    plm->tx.callback = callback;
+}
+
+/*******************************************************************************
+* Name:         plm1_tx_poll()        
+* Description:  Report the completed transmissions to the completion callback.
+*               ** This function must be called from the main loop **
+* Parameters:   plm: Driver instance.
+* Return:       Number of completions reported.
+* Note:         The ISR queues up to PLM_TX_DONE_QUEUE_SIZE completions; the
+*               next ones are only counted in "tx_done_lost". Completions are
+*               discarded if no callback is set.
+*******************************************************************************/
+uint8_t plm1_tx_poll(plm1_t* plm)
+{
+    plm1_tx_done done;
+    uint8_t tail = plm->tx.done_tail;
+    uint8_t count = 0;
+    
+    while(tail != plm->tx.done_head)
+    {
+        PLM_MEMORY_BARRIER();
+        done = plm->tx.done[tail & (PLM_TX_DONE_QUEUE_SIZE - 1)];
+        PLM_MEMORY_BARRIER();
+        plm->tx.done_tail = ++tail;
+        
+        if(plm->tx.callback != NULL)
+        {
+            plm->tx.callback(plm, &done);
+        }
+        count++;
+    }
+    
+    // Buffers of the sent packets go back to the pool.
+    balance_pool(plm);
+    
+    return (count);
+}
+
+/*******************************************************************************
+* Name:         plm1_watchdog()        
+* Description:  Detect a driver stuck in a state and recover from it.
+*               ** This function must be called from the main loop **
+* Parameters:   plm: Driver instance.
+* Return:       true if the driver has been recovered.
+* Note:         A state is stuck when PLM-1 sends no nibble for the timeout of
+*               the state (PLM_WD_xxx_TIMEOUT). A stuck reception is dropped;
+*               a stuck packet is retried after a backoff up to
+*               PLM_WD_TX_RETRIES times, then aborted. After
+*               PLM_WD_MAX_RECOVERIES recoveries without any packet sent or
+*               received, PLM-1 is soft reset and configured again with the
+*               current configuration string. Interrupts are only masked to
+*               recover.
+*******************************************************************************/
+bool plm1_watchdog(plm1_t* plm)
+{
+    bool recovered = false;
+    plm1_state state = plm->sts.state;
+    uint32_t progress;
+    uint32_t rxPackets;
+    uint16_t ticks;
+    
+    // Forget the past recoveries once packets flow again (a clear of the
+    // statistics is not taken for progress).
+    read_shared(&progress, &plm->sts.stats.tx_packets, sizeof(progress));
+    read_shared(&rxPackets, &plm->sts.stats.rx_packets, sizeof(rxPackets));
+    progress += rxPackets;
+    if(progress > plm->sts.wd_progress)
+    {
+        plm->sts.wd_recoveries = 0;
+        plm->sts.wd_tx_retries = 0;
+    }
+    plm->sts.wd_progress = progress;
+    
+    // Soft reset finished?
+    if(plm->sts.wd_reset && (state >= PLM1_STATE_IDLE))
+    {
+        plm->sts.wd_reset = false;
+    }
+    
+    read_shared(&ticks, &plm->sts.wd_ticks, sizeof(ticks));
+    if(wd_expired(plm, state, ticks))
+    {
+        MASK_INTERRUPTS();
+        
+        // State may have changed since it was read.
+        if((plm->sts.state == state) && wd_expired(plm, state, plm->sts.wd_ticks))
+        {
+            wd_recover(plm, state);
+            recovered = true;
+        }
+        
+        UNMASK_INTERRUPTS();
+    }
+    
+    return (recovered);
+}
+
+/*******************************************************************************
+* Name:         plm1_get_configuration()        
+* Description:  Get configuration string curently used.
+* Parameters:   plm: Driver instance.
+*               cfg: Array used to return current configuration string.
+* Return:       true if a configuration string is available, false if PLM-1 is
+*               not currently configured.
+* Note:         The configuration string is only written by the main loop.
+*******************************************************************************/
+bool plm1_get_configuration(plm1_t* plm, uint8_t* cfg)
+{
+    bool configured;
+    
+    if(plm->sts.state <= PLM1_STATE_CONFIGURING)
+    {
+        // Not yet configured.
+        memset(cfg, 0, PLM_CONFIG_DATA_LENGTH);
+        configured = false;
+    }
+    else
+    {
+        // Get configuration.
+        memcpy(cfg, plm->sts.cfg, PLM_CONFIG_DATA_LENGTH);
+        configured = true;
+    }
+    
+    return (configured);
+}
+
+/*******************************************************************************
+* Name:         plm1_set_backoff()        
+* Description:  Set the collision backoff policy.
+* Parameters:   plm: Driver instance.
+*               seed: Seed of the pseudo-random slot generator. Should be unique
+*                     per node (serial number, address...) so that contending
+*                     nodes do not draw the same slots:
+*                     PLM_BACKOFF_NODE_SEED() gives one per node address.
+*               minWindow: Initial contention window in slots (power of 2).
+*               maxWindow: Maximum contention window in slots (power of 2, up
+*                          to 128). The window doubles on each collision until
+*                          this cap and is reset once the line is acquired.
+* Return:       None.
+* Note:         Masks interrupts; meant to be called at initialization.
+*               Windows which are not a power of 2 are rounded down to one,
+*               the slot draw masks the random byte with (window - 1).
+*******************************************************************************/
+void plm1_set_backoff(plm1_t* plm, uint16_t seed, uint8_t minWindow, uint8_t maxWindow)
+{
+    MASK_INTERRUPTS();
+    
+    // A null seed would lock the generator.
+    plm->sts.seed = (seed != 0) ? seed : PLM_BACKOFF_SEED;
+    plm->sts.min_window = (minWindow != 0) ? floor_pow2(minWindow) : 1;
+    plm->sts.max_window = (maxWindow > 128) ? 128 : floor_pow2(maxWindow);
+    if(plm->sts.max_window < plm->sts.min_window)
+    {
+        plm->sts.max_window = plm->sts.min_window;
+    }
+    plm->tx.window = plm->sts.min_window;
+    
+    UNMASK_INTERRUPTS();
+}
+
+/*******************************************************************************
+* Name:         plm1_get_stats()        
+* Description:  Get a snapshot of the driver statistics.
+* Parameters:   plm: Driver instance.
+*               stats: Struct used to return the statistics.
+* Return:       None.
+* Note:         Unlike plm1_get_status(), reading does not clear anything.
+*               Counters cleared by plm1_clear_stats() read as zero until
+*               the clear is done by the next plm1_timer() tick.
+*******************************************************************************/
+void plm1_get_stats(plm1_t* plm, plm1_stats* stats)
+{
+    // The flag is only set by the main loop: once seen cleared, the copy
+    // below cannot predate the clear.
+    if(plm->sts.stats_clear)
+    {
+        memset(stats, 0, sizeof(plm1_stats));
+        return;
+    }
+    
+    read_shared(stats, &plm->sts.stats, sizeof(plm1_stats));
+}
+
+/*******************************************************************************
+* Name:         plm1_get_stat()        
+* Description:  Get one counter of the driver statistics.
+* Parameters:   plm: Driver instance.
+*               stat: Counter.
+*               index: Index of the counter in its array (status, dwell,
+*                      rx_drops and recoveries), 0 otherwise.
+* Return:       Value of the counter, 0 if "index" is out of its array.
+* Note:         Unlike plm1_get_stats(), only the counter is copied, so that
+*               the caller needs no plm1_stats on its stack.
+*******************************************************************************/
+uint32_t plm1_get_stat(plm1_t* plm, plm1_stat stat, uint8_t index)
+{
+    plm1_stats* stats = &plm->sts.stats;
+    const uint16_t* counter16 = NULL;
+    const uint32_t* counter32 = NULL;
+    uint16_t value16;
+    uint32_t value32 = 0;
+    
+    switch(stat)
+    {
+      case PLM1_STAT_STATUS:
+        counter16 = (index < 16) ? &stats->status[index] : NULL;
+        break;
+        
+      case PLM1_STAT_TX_PACKETS:
+        counter32 = &stats->tx_packets;
+        break;
+        
+      case PLM1_STAT_TX_BYTES:
+        counter32 = &stats->tx_bytes;
+        break;
+        
+      case PLM1_STAT_RX_PACKETS:
+        counter32 = &stats->rx_packets;
+        break;
+        
+      case PLM1_STAT_RX_BYTES:
+        counter32 = &stats->rx_bytes;
+        break;
+        
+      case PLM1_STAT_NEGOTIATIONS:
+        counter16 = &stats->negotiations;
+        break;
+        
+      case PLM1_STAT_RETRIES:
+        counter16 = &stats->retries;
+        break;
+        
+      case PLM1_STAT_DWELL:
+        counter32 = (index < PLM1_STATE_NBR) ? &stats->dwell[index] : NULL;
+        break;
+        
+      case PLM1_STAT_RX_DROPS:
+        counter16 = (index < PLM1_DROP_NBR) ? &stats->rx_drops[index] : NULL;
+        break;
+        
+      case PLM1_STAT_TX_DONE_LOST:
+        counter16 = &stats->tx_done_lost;
+        break;
+        
+      case PLM1_STAT_RECOVERIES:
+        counter16 = (index < PLM1_WD_NBR) ? &stats->recoveries[index] : NULL;
+        break;
+        
+      default:
+        break;
+    }
+    
+    // Cleared on the next tick (see plm1_get_stats()).
+    if(plm->sts.stats_clear)
+    {
+        return (0);
+    }
+    
+    if(counter16 != NULL)
+    {
+        read_shared(&value16, counter16, sizeof(value16));
+        value32 = value16;
+    }
+    else if(counter32 != NULL)
+    {
+        read_shared(&value32, counter32, sizeof(value32));
+    }
+    
+    return (value32);
+}
+
+/*******************************************************************************
+* Name:         plm1_get_link_counters()        
+* Description:  Get a snapshot of the link counters.
+* Parameters:   plm: Driver instance.
+*               counters: Struct used to return the counters.
+* Return:       None.
+* Note:         For the upper layers measuring the link over a window:
+*               plm1_clear_stats() does not touch these counters.
+*******************************************************************************/
+void plm1_get_link_counters(plm1_t* plm, plm1_link_counters* counters)
+{
+    read_shared(counters, &plm->sts.link, sizeof(plm1_link_counters));
+}
+
+/*******************************************************************************
+* Name:         plm1_clear_stats()        
+* Description:  Clear the driver statistics and journal.
+* Parameters:   plm: Driver instance.
+* Return:       None.
+* Note:         The counters are written by the ISR, so they are not cleared
+*               here: the clear is requested and done by the next
+*               plm1_timer() tick, which the other ISRs cannot interrupt.
+*******************************************************************************/
+void plm1_clear_stats(plm1_t* plm)
+{
+    plm->sts.stats_clear = true;
+    read_shared(&plm->sts.journal_base, &plm->sts.journal_seq, sizeof(plm->sts.journal_seq));
+}
+
+/*******************************************************************************
+* Name:         plm1_get_journal()        
+* Description:  Get a snapshot of the event journal.
+* Parameters:   plm: Driver instance.
+*               events: Array used to return the events, oldest first.
+*               maxEvents: Size of the "events" array.
+* Return:       Number of events loaded in "events".
+* Note:         Only the most recent events are returned if the journal holds
+*               more than "maxEvents".
+*******************************************************************************/
+uint8_t plm1_get_journal(plm1_t* plm, plm1_event* events, uint8_t maxEvents)
+{
+    uint16_t seq;
+    uint16_t available;
+    uint8_t count;
+    uint8_t i;
+    
+    // Copy again if events have been recorded meanwhile.
+    do
+    {
+        read_shared(&seq, &plm->sts.journal_seq, sizeof(seq));
+        available = seq - plm->sts.journal_base;
+        if(available > PLM_JOURNAL_SIZE)
+        {
+            available = PLM_JOURNAL_SIZE;
+        }
+        count = (available < maxEvents) ? (uint8_t)available : maxEvents;
+        for(i = 0; i < count; i++)
+        {
+            events[i] = plm->sts.journal[(seq - count + i) & (PLM_JOURNAL_SIZE - 1)];
+        }
+        PLM_MEMORY_BARRIER();
+    } while(memcmp(&seq, &plm->sts.journal_seq, sizeof(seq)) != 0);
+    
+    return (count);
+}
+
+/*******************************************************************************
+* Name:         plm1_read_trace()        
+* Description:  Read and remove the oldest nibble trace entries.
+* Parameters:   plm: Driver instance.
+*               entries: Array used to return the entries, oldest first.
+*               maxEntries: Size of the "entries" array. 0 returns the number
+*                           of entries available without removing any.
+* Return:       Number of entries loaded in "entries" (or available).
+* Note:         Always returns 0 when PLM_TRACE_SIZE is 0. New entries are
+*               dropped while the trace is full, then reported by a gap entry
+*               (rx = PLM_TRACE_LOST).
+*******************************************************************************/
+uint8_t plm1_read_trace(plm1_t* plm, plm1_trace_entry* entries, uint8_t maxEntries)
+{
+    uint8_t count = 0;
+    
+#if PLM_TRACE_SIZE > 0
+    uint8_t tail = plm->trace.tail;
+    uint8_t i;
+    
+    count = plm->trace.head - tail;
+    PLM_MEMORY_BARRIER();
+    
+    if(maxEntries != 0)
+    {
+        count = (count < maxEntries) ? count : maxEntries;
+        for(i = 0; i < count; i++)
+        {
+            entries[i] = plm->trace.entries[(uint8_t)(tail + i) & (PLM_TRACE_SIZE - 1)];
+        }
+        
+        // Give the entries back to the ISR.
+        PLM_MEMORY_BARRIER();
+        plm->trace.tail = tail + count;
+    }
 #endif
+    
+    return (count);
+}
+
+/*******************************************************************************
+* Name:         plm1_get_tick()        
+* Description:  Get the number of plm1_timer() ticks elapsed.
+* Parameters:   plm: Driver instance.
+* Return:       Tick counter; wraps around, compare with unsigned differences.
+* Note:         
+*******************************************************************************/
+uint16_t plm1_get_tick(plm1_t* plm)
+{
+    uint16_t tick;
+    
+    read_shared(&tick, &plm->sts.tick, sizeof(tick));
+    
+    return (tick);
+}
+
+/*******************************************************************************
+* Name:         plm1_cfg_finalize()        
+* Description:  Complete a configuration string with its CRC nibble.
+* Parameters:   cfg: Configuration string of PLM_CONFIG_DATA_LENGTH bytes, as
+*                    built by PLM_CFG_STRING() or PLM_CFG_PROFILE().
+* Return:       None.
+* Note:         The low nibble of the last byte is overwritten.
+*******************************************************************************/
+void plm1_cfg_finalize(uint8_t* cfg)
+{
+    uint8_t byteIndex;
+    uint8_t cfgCrc = 0;
+    
+    // Compute CRC of configuration string.
+    for(byteIndex = 0;  byteIndex < (PLM_CONFIG_DATA_LENGTH - 1); byteIndex++)
+    {
+        cfgCrc = crc4(cfg[byteIndex] >> 4, cfgCrc);
+        cfgCrc = crc4(cfg[byteIndex] & 0x0F, cfgCrc);
+    }
+    cfgCrc = crc4(cfg[PLM_CONFIG_DATA_LENGTH - 1] >> 4, cfgCrc);
+    
+    // Complete configuration string by adding CRC value on last nibble.
+    cfg[PLM_CONFIG_DATA_LENGTH - 1] = (cfg[PLM_CONFIG_DATA_LENGTH - 1] & 0xF0) | (cfgCrc & 0x0F);
+}
+
+/*------------------------------------------------------------------------------
+  Local functions
+------------------------------------------------------------------------------*/
+
+/*******************************************************************************
+* Name:         state_not_configured()        
+* Description:  Execute state "Not configured".
+* Parameters:   plm: Driver instance.
+*               rxNibble: Nibble received from PLM-1.
+* Return:       None.
+* Note:         Plm-1 not yet configured; nibbles are ignored.
+*******************************************************************************/
+static void state_not_configured(plm1_t* plm, uint8_t rxNibble)
+{
+}
+
+/*******************************************************************************
+* Name:         state_configuring()        
+* Description:  Execute state "Configuring".
+* Parameters:   plm: Driver instance.
+*               rxNibble: Nibble received from PLM-1.
+* Return:       None.
+* Note:         Used for both data nibbles and special characters.
+*******************************************************************************/
+static void state_configuring(plm1_t* plm, uint8_t rxNibble)
+{
+    // During configuration, send next configuration nibble.
+    if(plm->tx.config_nibble_index < NIB(PLM_CONFIG_DATA_LENGTH))
+    {
+        SPI_TX_NEXT(GET_NIBBLE(plm->sts.cfg, plm->tx.config_nibble_index));
+        ++plm->tx.config_nibble_index;
+    }
+    else
+    {
+        // Configuration finished.
+        SPI_TX_STOP();
+
+        // Test pin CNFGD if the port provides it.
+        if((plm->port->get_cnfgd != NULL) && !plm->port->get_cnfgd(plm->port->arg))
+        {
+            // Configuration fails...
+            plm->sts.state = PLM1_STATE_NOT_CONFIGURED;
+        }
+        else
+        {
+            // Configuration seems to be done successfully!
+            plm->sts.state = PLM1_STATE_IDLE;
+            
+            // Queued packets are dropped, report them.
+            while(plm->tx.packet_index != plm->tx.desc_index)
+            {
+                PLM_MEMORY_BARRIER();
+                complete_tx_packet(plm, PLM1_TX_ABORTED);
+                INCR(plm->tx.packet_index, PLM_TX_DESC_NBR);
+            }
+                
+            // Reset tx/rx variables.
+            RX_CLEAR_PKT();
+            TX_RESET();
+        }
+    }
+}
+
+/*******************************************************************************
+* Name:         state_idle_data()        
+* Description:  Execute state "Idle" or "Negotiating" on a data nibble.
+* Parameters:   plm: Driver instance.
+*               rxNibble: Nibble received from PLM-1.
+* Return:       None.
+* Note:         While negotiating, a data nibble means PLM-1 does not acquire
+*               the line.
+*******************************************************************************/
+static void state_idle_data(plm1_t* plm, uint8_t rxNibble)
+{
+    // Reception started.
+    store_rx_nibble(plm, rxNibble);
+    SPI_TX_STOP();
+    plm->sts.state = PLM1_STATE_RECEIVING;
+}
+
+/*******************************************************************************
+* Name:         state_idle_ctrl()        
+* Description:  Execute state "Idle" on a special character.
+* Parameters:   plm: Driver instance.
+*               rxNibble: Nibble received from PLM-1.
+* Return:       None.
+* Note:         
+*******************************************************************************/
+static void state_idle_ctrl(plm1_t* plm, uint8_t rxNibble)
+{
+    switch(rxNibble)
+    {              
+      case PLM_CC_RX_OVERRUN:
+        // PLM-1 was receiving and an error happends.
+        record_status(plm, PLM1_STS_RX_OVERRUN);
+        break;
+        
+      case PLM_CC_RX_ERROR:
+        // A start of packet has been detected without following data.
+        // Ignore this error since it's caused by noise on powerline.
+      default:
+        // Other special characters are ignored.
+        break;
+    }
+    
+    // Start transmitting if a packet is available.
+    if(tx_pending(plm))
+    {
+        // Write first nibble.
+        SPI_TX_NEXT(get_tx_nibble(plm));
+        prepare_tx_nibble(plm);
+        plm->sts.state = PLM1_STATE_NEGOTIATING;
+        SAT_INC(plm->sts.stats.negotiations);
+    }
+    else
+    {
+        // Do not transmit packet.
+        SPI_TX_STOP();
+    }
+}
+
+/*******************************************************************************
+* Name:         state_negotiating_ctrl()        
+* Description:  Execute state "Negotiating" on a special character.
+* Parameters:   plm: Driver instance.
+*               rxNibble: Nibble received from PLM-1.
+* Return:       None.
+* Note:         
+*******************************************************************************/
+static void state_negotiating_ctrl(plm1_t* plm, uint8_t rxNibble)
+{
+    switch(rxNibble)
+    {  
+      case PLM_CC_TXRE:
+        // Transmission started! Send next nibble.
+        SPI_TX_NEXT(plm->tx.next_nibble);
+        update_tx_nibble(plm);
+        prepare_tx_nibble(plm);
+        plm->sts.state = PLM1_STATE_TRANSMITTING;
+        
+        // Line acquired, reset contention window.
+        plm->tx.window = plm->sts.min_window;
+        break;
+        
+      case PLM_CC_COLLISION:
+        // Collision happends... retry after a backoff.
+        start_backoff(plm);
+        record_status(plm, PLM1_STS_COLLISION);
+        break;
+        
+      case PLM_CC_RX_ERROR:
+        // PLM-1 was already receiving and an error happends... retry after a backoff.
+        start_backoff(plm);
+        record_status(plm, PLM1_STS_ERROR_RECEIVED);
+        break;
+        
+      case PLM_CC_RX_OVERRUN:
+        // PLM-1 was already receiving and an error happends... retry after a backoff.
+        start_backoff(plm);
+        record_status(plm, PLM1_STS_RX_OVERRUN);
+        break;
+        
+      default:
+        // Other special characters are ignored.
+        SPI_TX_STOP();
+        break;
+    }
+}
+
+/*******************************************************************************
+* Name:         state_transmitting_data()        
+* Description:  Execute state "Transmitting" on a data nibble.
+* Parameters:   plm: Driver instance.
+*               rxNibble: Nibble received from PLM-1.
+* Return:       None.
+* Note:         Only special character should be received in this state.
+*******************************************************************************/
+static void state_transmitting_data(plm1_t* plm, uint8_t rxNibble)
+{
+    // Data nibble received, should not happend!!
+    SPI_TX_STOP();
+}
+
+/*******************************************************************************
+* Name:         state_transmitting_ctrl()        
+* Description:  Execute state "Transmitting" on a special character.
+* Parameters:   plm: Driver instance.
+*               rxNibble: Nibble received from PLM-1.
+* Return:       None.
+* Note:         On TXRE the precomputed nibble is written before anything else
+*               so that the transmit register is refilled as soon as possible.
+*******************************************************************************/
+static void state_transmitting_ctrl(plm1_t* plm, uint8_t rxNibble)
+{
+    // Nibble transmitted and packet not finished? (hot path)
+    if((rxNibble == PLM_CC_TXRE) && (plm->tx.next_nibble != TX_NIBBLE_NONE))
+    {
+        SPI_TX_NEXT(plm->tx.next_nibble);
+        update_tx_nibble(plm);
+        prepare_tx_nibble(plm);
+    }
+    else
+    {
+        switch(rxNibble)
+        {
+          case PLM_CC_TXRE:
+            // End Of Packet transmitted!
+            update_tx_nibble(plm);
+            
+            // Send next packet if one is available.
+            if(tx_pending(plm))
+            {
+                // Write first nibble.
+                SPI_TX_NEXT(get_tx_nibble(plm));
+                prepare_tx_nibble(plm);
+                plm->sts.state = PLM1_STATE_NEGOTIATING;
+                SAT_INC(plm->sts.stats.negotiations);
+            }
+            else
+            {
+                // Do not transmit packet.
+                SPI_TX_STOP();
+                plm->sts.state = PLM1_STATE_IDLE;
+            }
+            break;
+            
+          case PLM_CC_TX_UNDERRUN:
+            // Retransmit current packet to PLM-1
+            plm->tx.byte_sent = 0;
+            plm->tx.msb = true;
+            SPI_TX_NEXT(get_tx_nibble(plm));
+            prepare_tx_nibble(plm);
+            record_status(plm, PLM1_STS_TX_UNDERRUN);
+            break;
+                
+          case PLM_CC_TX_OVERRUN:
+            // Retransmit current packet to PLM-1
+            plm->tx.byte_sent = 0;
+            plm->tx.msb = true;
+            SPI_TX_NEXT(get_tx_nibble(plm));
+            prepare_tx_nibble(plm);
+            record_status(plm, PLM1_STS_TX_OVERRUN);
+            break;
+            
+          default:
+            // Other special characters are ignored.
+            SPI_TX_STOP();
+            break;
+        }
+    }
+}
+
+/*******************************************************************************
+* Name:         state_receiving_data()        
+* Description:  Execute state "Receiving" on a data nibble.
+* Parameters:   plm: Driver instance.
+*               rxNibble: Nibble received from PLM-1.
+* Return:       None.
+* Note:         
+*******************************************************************************/
+static void state_receiving_data(plm1_t* plm, uint8_t rxNibble)
+{
+    store_rx_nibble(plm, rxNibble);
+    SPI_TX_STOP();
+}
+
+/*******************************************************************************
+* Name:         state_receiving_ctrl()        
+* Description:  Execute state "Receiving" on a special character.
+* Parameters:   plm: Driver instance.
+*               rxNibble: Nibble received from PLM-1.
+* Return:       None.
+* Note:         
+*******************************************************************************/
+static void state_receiving_ctrl(plm1_t* plm, uint8_t rxNibble)
+{
+    switch(rxNibble)
+    {
+      case PLM_CC_EOP:
+        // End of packet received!
+        eop_received(plm, false);
+        plm->sts.state = PLM1_STATE_IDLE;
+        break;
+        
+      case PLM_CC_RX_ERROR:
+        // Invalid packet received by PLM-1. A coded packet is delivered
+        // anyway, flagged: plm1fec may correct its errors.
+        if(!plm->rx.invalid_packet &&
+           (plm->rx.packet_desc[plm->rx.desc_index].size >= PLM_PACKET_HEADER_SIZE) &&
+           (plm->rx.packet_desc[plm->rx.desc_index].channel & PLM_CHANNEL_FEC_MASK))
+        {
+            eop_received(plm, true);
+        }
+        else
+        {
+            RX_CLEAR_PKT();
+        }
+        record_status(plm, PLM1_STS_ERROR_RECEIVED);
+        plm->sts.state = PLM1_STATE_IDLE;
+        break;
+        
+      case PLM_CC_RX_OVERRUN:
+        // Firmware doesn't get data from PLM-1 fast enough.
+        RX_CLEAR_PKT();
+        record_status(plm, PLM1_STS_RX_OVERRUN);
+        plm->sts.state = PLM1_STATE_IDLE;
+        break;
+        
+      default:
+        // Other special characters are ignored.
+        break;
+    }
+    
+    // Start transmitting if a packet is available and reception is over.
+    if((plm->sts.state == PLM1_STATE_IDLE) && tx_pending(plm))
+    {
+        // Write first nibble.
+        SPI_TX_NEXT(get_tx_nibble(plm));
+        prepare_tx_nibble(plm);
+        plm->sts.state = PLM1_STATE_NEGOTIATING;
+        SAT_INC(plm->sts.stats.negotiations);
+    }
+    else
+    {
+        // Do not transmit packet.
+        SPI_TX_STOP();
+    }
+}
+
+/*******************************************************************************
+* Name:         record_status()        
+* Description:  Record a new library status, count it and add it to the
+*               journal.
+* Parameters:   plm: Driver instance.
+*               New library status.
+* Return:       None.
+* Note:         Producer side of the status queue and of the journal; called
+*               from the ISR, or from the main loop with interrupts masked.
+*******************************************************************************/
+static void record_status(plm1_t* plm, plm1_status sts)
+{
+    plm1_event* event = &plm->sts.journal[plm->sts.journal_seq & (PLM_JOURNAL_SIZE - 1)];
+    uint8_t head = plm->sts.status_head;
+    
+    // Count and journal every event.
+    SAT_INC(plm->sts.stats.status[sts & 0x0F]);
+    if((sts == PLM1_STS_ERROR_RECEIVED) || (sts == PLM1_STS_COLLISION))
+    {
+        plm->sts.link.errors++;
+    }
+    event->tick = plm->sts.tick;
+    event->status = (uint8_t)sts;
+    event->state = (uint8_t)plm->sts.state;
+    PLM_MEMORY_BARRIER();
+    plm->sts.journal_seq++;
+    
+    // Queue the status if the application has room for it.
+    if((uint8_t)(head - plm->sts.status_tail) < PLM_STATUS_QUEUE_SIZE)
+    {
+        plm->sts.status[head & (PLM_STATUS_QUEUE_SIZE - 1)] = sts;
+        PLM_MEMORY_BARRIER();
+        plm->sts.status_head = head + 1;
+    }
+}
+
+/*******************************************************************************
+* Name:         start_configuration()        
+* Description:  Start a configuration attempt.
+* Parameters:   plm: Driver instance.
+* Return:       None.
+* Note:         Interrupts must be masked by the caller.
+*******************************************************************************/
+static void start_configuration(plm1_t* plm)
+{
+    // Reset configuration variables.
+    plm->tx.config_nibble_index = 0;
+    plm->sts.state = PLM1_STATE_CONFIGURING;
+    plm->sts.cfg_start = plm->sts.tick;
+    plm->sts.wd_ticks = 0;
+    
+    // Send Software Reset command and configuration will be done by plm1_spi_isr().
+    SPI_TX_START(PLM_CC_RESET);
+}
+
+/*******************************************************************************
+* Name:         start_backoff()        
+* Description:  Abort current negotiation and wait a random number of slots
+*               before the next one.
+* Parameters:   plm: Driver instance.
+* Return:       None.
+* Note:         Slot count is drawn in [1, window], then the contention window
+*               is doubled up to its cap.
+*******************************************************************************/
+static void start_backoff(plm1_t* plm)
+{
+    uint8_t slots;
+    
+    SPI_TX_STOP();
+    plm->sts.state = PLM1_STATE_IDLE;
+    SAT_INC(plm->tx.track[plm->tx.packet_index].retries);
+    
+    slots = (next_random(plm) & (plm->tx.window - 1)) + 1;
+    plm->tx.backoff = (uint16_t)slots * PLM_BACKOFF_SLOT_TICKS;
+    
+    if(plm->tx.window < plm->sts.max_window)
+    {
+        plm->tx.window <<= 1;
+        if(plm->tx.window > plm->sts.max_window)
+        {
+            plm->tx.window = plm->sts.max_window;
+        }
+    }
+}
+
+/*******************************************************************************
+* Name:         wd_expired()        
+* Description:  Check if the driver stays too long in a state.
+* Parameters:   plm: Driver instance.
+*               state: State of the driver.
+*               ticks: Ticks since the last nibble from PLM-1.
+* Return:       true if the timeout of the state is over.
+* Note:         A configuration started by plm1_configure_start() is followed
+*               by plm1_configure_poll(), not by the watchdog.
+*******************************************************************************/
+static bool wd_expired(plm1_t* plm, plm1_state state, uint16_t ticks)
+{
+    uint16_t timeout = pgm_read_word(&wd_timeouts[state]);
+    
+    if((state < PLM1_STATE_IDLE) && !plm->sts.wd_reset)
+    {
+        timeout = 0;
+    }
+    
+    return ((timeout != 0) && (ticks >= timeout));
+}
+
+/*******************************************************************************
+* Name:         wd_recover()        
+* Description:  Get the driver out of a stuck state.
+* Parameters:   plm: Driver instance.
+*               state: Stuck state.
+* Return:       None.
+* Note:         Interrupts must be masked by the caller. The status is recorded
+*               first, so that the journal keeps the stuck state.
+*******************************************************************************/
+static void wd_recover(plm1_t* plm, plm1_state state)
+{
+    plm1_wd_action action;
+    
+    record_status(plm, PLM1_STS_WATCHDOG);
+    plm->sts.wd_ticks = 0;
+    
+    if((state < PLM1_STATE_IDLE) || (++plm->sts.wd_recoveries >= PLM_WD_MAX_RECOVERIES))
+    {
+        // PLM-1 does not answer anymore, reset and configure it again.
+        // Queued packets are aborted once configured.
+        action = PLM1_WD_RESET;
+        plm->sts.wd_reset = true;
+        plm->sts.wd_recoveries = 0;
+        plm->sts.wd_tx_retries = 0;
+        SPI_TX_STOP();
+        RX_CLEAR_PKT();
+        start_configuration(plm);
+    }
+    else if(state == PLM1_STATE_RECEIVING)
+    {
+        // End Of Packet never came.
+        action = PLM1_WD_RX_DROPPED;
+        SPI_TX_STOP();
+        RX_CLEAR_PKT();
+        plm->sts.state = PLM1_STATE_IDLE;
+    }
+    else if(plm->sts.wd_tx_retries < PLM_WD_TX_RETRIES)
+    {
+        // Send the packet again from its first byte.
+        action = PLM1_WD_TX_RETRIED;
+        plm->sts.wd_tx_retries++;
+        plm->tx.byte_sent = 0;
+        plm->tx.msb = true;
+        start_backoff(plm);
+    }
+    else
+    {
+        // Give up the packet.
+        action = PLM1_WD_TX_ABORTED;
+        plm->sts.wd_tx_retries = 0;
+        SPI_TX_STOP();
+        complete_tx_packet(plm, PLM1_TX_ABORTED);
+        PLM_MEMORY_BARRIER();
+        INCR(plm->tx.packet_index, PLM_TX_DESC_NBR);
+        plm->tx.byte_sent = 0;
+        plm->tx.msb = true;
+        plm->tx.window = plm->sts.min_window;
+        plm->sts.state = PLM1_STATE_IDLE;
+    }
+    
+    SAT_INC(plm->sts.stats.recoveries[action]);
+}
+
+/*******************************************************************************
+* Name:         next_random()        
+* Description:  Step the backoff pseudo-random generator.
+* Parameters:   plm: Driver instance.
+* Return:       Pseudo-random byte.
+* Note:         16 bits Galois LFSR (x^16 + x^14 + x^13 + x^11 + 1).
+*******************************************************************************/
+static uint8_t next_random(plm1_t* plm)
+{
+    uint8_t lsb = plm->sts.seed & 0x01;
+    
+    plm->sts.seed >>= 1;
+    if(lsb)
+    {
+        plm->sts.seed ^= 0xB400;
+    }
+    
+    return ((uint8_t)plm->sts.seed);
+}
+
+/*******************************************************************************
+* Name:         floor_pow2()        
+* Description:  Round a number down to a power of 2.
+* Parameters:   n: Number, not null.
+* Return:       Highest power of 2 lower or equal to "n".
+* Note:         
+*******************************************************************************/
+static uint8_t floor_pow2(uint8_t n)
+{
+    uint8_t pow2 = 0x80;
+    
+    while(pow2 > n)
+    {
+        pow2 >>= 1;
+    }
+    
+    return (pow2);
+}
+
+/*******************************************************************************
+* Name:         store_rx_nibble()        
+* Description:  Store received data nibble.
+* Parameters:   plm: Driver instance.
+*               nibble: Data nibble received from PLM-1.
+* Return:       None.
+* Note:         The packet is filtered as soon as its header (and address
+*               bytes) are stored; once rejected, its nibbles are ignored and
+*               its buffer is kept for the next packet.
+*******************************************************************************/
+static void store_rx_nibble(plm1_t* plm, uint8_t nibble)
+{
+    uint8_t size = plm->rx.packet_desc[plm->rx.desc_index].size;
+    uint8_t* buffer;
+    
+    // Is this packet already declared invalid?
+    if(!plm->rx.invalid_packet)
+    {
+        // First nibble of the packet? Get a buffer for it.
+        if((size == 0) && plm->rx.msb && !get_rx_buffer(plm))
         {
-            // Configuration seems to be done successfully!
-            plm_sts.state = PLM1_STATE_IDLE;
+            drop_rx_packet(plm, PLM1_DROP_BUFFER_FULL);
+            record_status(plm, PLM1_STS_PACKET_MISSED);
+        }
+        else if(size < PLM_MAX_PACKET_SIZE)
+        {
+            buffer = plm->pool.buffers[plm->rx.buffer];
+            if(plm->rx.msb) {
+                // Most significant nibble case.
+                // Store it in the buffer, shifting of 4 bits.
+                buffer[size] = nibble << 4;
+            }
+            else {
+                // Least significant nibble case.
+                // Merge with the most significant nibble and store in buffer.
+                buffer[size] |= nibble;
+                plm->rx.packet_desc[plm->rx.desc_index].size = ++size;
                 
-            // Reset tx/rx variables.
-            RX_RESET();
-            TX_RESET();
+                // Filter the packet as soon as the checked bytes are there.
+                if(size == PLM_PACKET_HEADER_SIZE)
+                {
+                    accept_rx_header(plm);
+                }
+#if PLM_ACCEPT_ADDR_SIZE > 0
+                else if((size == PLM_PACKET_HEADER_SIZE + PLM_ACCEPT_ADDR_SIZE) && plm->rx.accept_addr)
+                {
+                    accept_rx_address(plm);
+                }
+#endif
+            }
+            plm->rx.msb = !plm->rx.msb;            
+        }
+        else
+        {
+            // Packet too long to be received by our code.
+            drop_rx_packet(plm, PLM1_DROP_TOO_LONG);
+            record_status(plm, PLM1_STS_PACKET_MISSED);
         }
     }
 }
 
 /*******************************************************************************
-* Name:         state_idle()        
-* Description:  Execute state "Idle".
-* Parameters:   rxNibble: Nibble received from PLM-1.
-* Return:       None.
+* Name:         get_rx_buffer()        
+* Description:  Get a buffer for the packet being received.
+* Parameters:   plm: Driver instance.
+* Return:       true if the packet has a buffer and a free descriptor.
+* Note:         Takes the next buffer posted by the main loop, unless the one
+*               of a dropped packet is still there.
+*******************************************************************************/
+static bool get_rx_buffer(plm1_t* plm)
+{
+    uint8_t descIndex = plm->rx.desc_index;
+    uint8_t tail = plm->pool.post_tail;
+    bool ready = false;
+    
+    // Descriptor of the next packet must stay free.
+    INCR(descIndex, PLM_RX_DESC_NBR);
+    if(descIndex != plm->rx.packet_index)
+    {
+        if((plm->rx.buffer == PLM_POOL_NO_BUFFER) && (tail != plm->pool.post_head))
+        {
+            // Read the buffer posted up to "post_head" only.
+            PLM_MEMORY_BARRIER();
+            plm->rx.buffer = plm->pool.post[tail];
+            INCR(tail, PLM_RX_POST_NBR);
+            plm->pool.post_tail = tail;
+        }
+        ready = (plm->rx.buffer != PLM_POOL_NO_BUFFER);
+    }
+    
+    return (ready);
+}
+
+/*******************************************************************************
+* Name:         tx_pending()        
+* Description:  Check if a packet is waiting, no backoff is running and the
+*               transmitter is not held.
+* Parameters:   plm: Driver instance.
+* Return:       true if a packet can be negotiated.
+* Note:         The descriptor published by the main loop is read after the
+*               index.
+*******************************************************************************/
+static bool tx_pending(plm1_t* plm)
+{
+    bool pending = (plm->tx.packet_index != plm->tx.desc_index) && (plm->tx.backoff == 0) && !plm->tx.hold;
+    
+    PLM_MEMORY_BARRIER();
+    
+    return (pending);
+}
+
+/*******************************************************************************
+* Name:         get_tx_nibble()        
+* Description:  Get next nibble to send to PLM-1.
+* Parameters:   plm: Driver instance.
+* Return:       Nibble to send to PLM-1.
+
 * Note:         
 *******************************************************************************/
-static void state_idle(uint8_t rxNibble)
+static uint8_t get_tx_nibble(plm1_t* plm)
 {
-    // Reception started?
-    if((rxNibble & 0x10) == 0)
+    uint8_t data;
+    
+    // Nibbles remaining in current packet?
+    if(plm->tx.byte_sent < plm->tx.packet_desc[plm->tx.packet_index].size)
     {
-        // Data nibble received.
-        store_rx_nibble(rxNibble);
-        SPI_TX_STOP();
-        plm_sts.state = PLM1_STATE_RECEIVING;
+        // Get data from tx buffer.
+        data = plm->pool.buffers[plm->tx.packet_desc[plm->tx.packet_index].buffer][plm->tx.byte_sent];
+        
+        // Get nibble into byte.
+        if(plm->tx.msb)
+        {
+            data = data >> 4;
+        }
+        data &= 0x0F;
     }
     else
     {
-        // Special character received.
-        switch(rxNibble)
-        {              
-          case PLM_CC_RX_OVERRUN:
-            // PLM-1 was receiving and an error happends.
-            record_status(PLM1_STS_RX_OVERRUN);
-            break;
-            
-          case PLM_CC_RX_ERROR:
-            // A start of packet has been detected without following data.
-            // Ignore this error since it's caused by noise on powerline.
-          default:
-            // Other special characters are ignored.
-            break;
+        // Send an End Of Packet.
+        data = PLM_CC_EOP;
+    }
+    
+    return (data);
+}
+
+/*******************************************************************************
+* Name:         update_tx_nibble()        
+* Description:  Update transmission struct.
+* Parameters:   plm: Driver instance.
+* Return:       true if complete packet has been sent, false otherwise.
+* Note:         
+*******************************************************************************/
+static bool update_tx_nibble(plm1_t* plm)
+{
+    bool pktSent = false;
+    
+    // Data nibble sent?
+    if(plm->tx.byte_sent < plm->tx.packet_desc[plm->tx.packet_index].size)
+    {
+        // Complete byte has been sent?
+        if(plm->tx.msb == false)
+        {
+            // Send next byte on upcoming transaction.
+            plm->tx.byte_sent++;
         }
+        plm->tx.msb = !plm->tx.msb;
+    }
+    else
+    {
+        // An End Of Packet has just been sent.
+        pktSent = true;
         
-        // Start transmitting if a packet is available.
-        if(plm_tx.packet_desc[plm_tx.packet_index].used)
+        // Report and remove packet from tx buffer.
+        complete_tx_packet(plm, PLM1_TX_SENT);
+        TX_REMOVE_PKT();
+    }
+    
+    return (pktSent);
+}
+
+/*******************************************************************************
+* Name:         complete_tx_packet()        
+* Description:  Queue the completion of the current transmission packet.
+* Parameters:   plm: Driver instance.
+*               outcome: Outcome of the packet.
+* Return:       None.
+* Note:         Producer side of the completion queue, called from the ISR
+*               before the packet is removed. Dropped and counted if the queue
+*               is full.
+*******************************************************************************/
+static void complete_tx_packet(plm1_t* plm, plm1_tx_outcome outcome)
+{
+    plm1_tx_track_t* track = &plm->tx.track[plm->tx.packet_index];
+    plm1_tx_done* done;
+    uint8_t head = plm->tx.done_head;
+    
+    if((uint8_t)(head - plm->tx.done_tail) < PLM_TX_DONE_QUEUE_SIZE)
+    {
+        done = &plm->tx.done[head & (PLM_TX_DONE_QUEUE_SIZE - 1)];
+        done->handle = track->handle;
+        done->outcome = (uint8_t)outcome;
+        done->retries = track->retries;
+        done->queue_time = plm->sts.tick - track->queued;
+        PLM_MEMORY_BARRIER();
+        plm->tx.done_head = head + 1;
+    }
+    else
+    {
+        SAT_INC(plm->sts.stats.tx_done_lost);
+    }
+}
+
+/*******************************************************************************
+* Name:         prepare_tx_nibble()        
+* Description:  Precompute the nibble to write on the next TXRE.
+* Parameters:   plm: Driver instance.
+* Return:       None.
+* Note:         Must be called each time a nibble of the current packet has
+*               been written to SPI port. The buffer index computation is done
+*               here, outside of the window between TXRE and the SPI write.
+*******************************************************************************/
+static void prepare_tx_nibble(plm1_t* plm)
+{
+    uint16_t byteIndex = plm->tx.byte_sent;
+    uint8_t data;
+    
+    // Next nibble is the LSB of the current byte, or the MSB of the next one.
+    if(plm->tx.msb == false)
+    {
+        byteIndex++;
+    }
+    
+    if(plm->tx.byte_sent >= plm->tx.packet_desc[plm->tx.packet_index].size)
+    {
+        // End Of Packet being sent, the packet is over on next TXRE.
+        data = TX_NIBBLE_NONE;
+    }
+    else if(byteIndex >= plm->tx.packet_desc[plm->tx.packet_index].size)
+    {
+        // Last nibble of the packet being sent.
+        data = PLM_CC_EOP;
+    }
+    else
+    {
+        // Get data from tx buffer.
+        data = plm->pool.buffers[plm->tx.packet_desc[plm->tx.packet_index].buffer][byteIndex];
+        data = plm->tx.msb ? (data & 0x0F) : (data >> 4);
+    }
+    
+    plm->tx.next_nibble = data;
+}
+
+/*******************************************************************************
+* Name:         accept_rx_header()        
+* Description:  Check the channel of the packet being received against the
+*               subscriptions and the accept filter.
+* Parameters:   plm: Driver instance.
+* Return:       None.
+* Note:         Called once the PLM-1 header is stored.
+*******************************************************************************/
+static void accept_rx_header(plm1_t* plm)
+{
+    plm1_packet_desc_t* pkt = &plm->rx.packet_desc[plm->rx.desc_index];
+    plm1_rx_channel_t* rxChannel;
+    
+    // Demultiplex on channel byte.
+    pkt->channel = plm->pool.buffers[plm->rx.buffer][1];
+    rxChannel = find_rx_channel(plm, pkt->channel);
+    plm->rx.channel = rxChannel;
+    
+    if(((pkt->channel & plm->rx.accept.channel_mask) != plm->rx.accept.channel_value) ||
+       ((rxChannel == NULL) && (plm->rx.channel_nbr > 0)))
+    {
+        // Channel filtered out or not subscribed.
+        drop_rx_packet(plm, PLM1_DROP_CHANNEL);
+    }
+    else if((rxChannel != NULL) && ((uint8_t)(rxChannel->queued - rxChannel->read) >= rxChannel->depth))
+    {
+        // Channel queue full.
+        if(rxChannel->dropped < 0xFFFF)
         {
-            // Write first nibble.
-            SPI_TX_NEXT(get_tx_nibble());
-            plm_sts.state = PLM1_STATE_NEGOTIATING;
+            rxChannel->dropped++;
         }
-        else
+        drop_rx_packet(plm, PLM1_DROP_QUEUE_FULL);
+    }
+}
+
+#if PLM_ACCEPT_ADDR_SIZE > 0
+/*******************************************************************************
+* Name:         accept_rx_address()        
+* Description:  Check the address bytes of the packet being received against
+*               the accept filter.
+* Parameters:   plm: Driver instance.
+* Return:       None.
+* Note:         Called once the address bytes following the header are stored.
+*******************************************************************************/
+static void accept_rx_address(plm1_t* plm)
+{
+    uint8_t* address = &plm->pool.buffers[plm->rx.buffer][PLM_PACKET_HEADER_SIZE];
+    uint8_t i;
+    
+    for(i = 0; i < PLM_ACCEPT_ADDR_SIZE; i++)
+    {
+        if((address[i] & plm->rx.accept.addr_mask[i]) != plm->rx.accept.addr_value[i])
         {
-            // Do not transmit packet.
-            SPI_TX_STOP();
+            drop_rx_packet(plm, PLM1_DROP_ADDRESS);
+            break;
         }
     }
 }
+#endif
 
 /*******************************************************************************
-* Name:         state_negotiating()        
-* Description:  Execute state "Negotiating".
-* Parameters:   rxNibble: Nibble received from PLM-1.
+* Name:         drop_rx_packet()        
+* Description:  Declare the packet being received invalid.
+* Parameters:   plm: Driver instance.
+*               reason: Reason of the drop.
 * Return:       None.
-* Note:         
+* Note:         Following nibbles are ignored until the end of the packet.
+*******************************************************************************/
+static void drop_rx_packet(plm1_t* plm, plm1_drop reason)
+{
+    plm->rx.invalid_packet = true;
+    SAT_INC(plm->sts.stats.rx_drops[reason]);
+}
+
+/*******************************************************************************
+* Name:         eop_received()        
+* Description:  END OF PACKET received; update reception struct.
+* Parameters:   plm: Driver instance.
+*               errored: true if PLM-1 reported a reception error.
+* Return:       None.
+* Note:         A valid packet is published to the main loop by advancing
+*               "desc_index" once its descriptor is written. The buffer of an
+*               invalid packet is kept for the next one.
 *******************************************************************************/
-static void state_negotiating(uint8_t rxNibble)
+static void eop_received(plm1_t* plm, bool errored)
 {
-    // Transmission started?
-    if((rxNibble & 0x10) == 0)
+    plm1_packet_desc_t* pkt = &plm->rx.packet_desc[plm->rx.desc_index];
+    plm1_rx_channel_t* rxChannel = plm->rx.channel;
+    uint8_t descIndex;
+    
+    if(plm->rx.invalid_packet)
     {
-        // Data nibble received; PLM-1 does not acquire the line.
-        store_rx_nibble(rxNibble);
-        SPI_TX_STOP();
-        plm_sts.state = PLM1_STATE_RECEIVING;
+        // Invalid packet, already counted. Clear packet descriptor.
+        pkt->size = 0;
+    }
+    else if(pkt->size < PLM_PACKET_HEADER_SIZE)
+    {
+        // Packet too short to hold a PLM-1 header.
+        drop_rx_packet(plm, PLM1_DROP_TOO_SHORT);
+        pkt->size = 0;
+    }
+#if PLM_ACCEPT_ADDR_SIZE > 0
+    else if((pkt->size < PLM_PACKET_HEADER_SIZE + PLM_ACCEPT_ADDR_SIZE) && plm->rx.accept_addr)
+    {
+        // Address bytes to check missing.
+        drop_rx_packet(plm, PLM1_DROP_ADDRESS);
+        pkt->size = 0;
     }
+#endif
     else
     {
-        // Special character received.
-        switch(rxNibble)
-        {  
-          case PLM_CC_COLLISION:
-            // Collision happends... retry.
-            SPI_TX_NEXT(get_tx_nibble());
-            record_status(PLM1_STS_COLLISION);
-            break;
-            
-          case PLM_CC_TXRE:
-            // Transmission started! Send next nibble.
-            update_tx_nibble();
-            SPI_TX_NEXT(get_tx_nibble());
-            plm_sts.state = PLM1_STATE_TRANSMITTING;
-            break;
-            
-          case PLM_CC_RX_ERROR:
-            // PLM-1 was already receiving and an error happends... retry.
-            SPI_TX_NEXT(get_tx_nibble());
-            record_status(PLM1_STS_ERROR_RECEIVED);
-            break;
-            
-          case PLM_CC_RX_OVERRUN:
-            // PLM-1 was already receiving and an error happends... retry.
-            SPI_TX_NEXT(get_tx_nibble());
-            record_status(PLM1_STS_RX_OVERRUN);
-            break;
-            
-          default:
-            // Other special characters are ignored.
-            SPI_TX_STOP();
-            break;
+        // Valid packet! Channel checked by accept_rx_header().
+        if(rxChannel != NULL)
+        {
+            rxChannel->queued++;
+            rxChannel->received++;
+        }
+        SAT_INC(plm->sts.stats.rx_packets);
+        plm->sts.link.rx_packets++;
+        SAT_ADD(plm->sts.stats.rx_bytes, pkt->size);
+        pkt->buffer = plm->rx.buffer;
+        pkt->consumed = false;
+        pkt->errored = errored;
+        plm->rx.buffer = PLM_POOL_NO_BUFFER;
+        
+        // Publish the packet with its buffer, next descriptor is free (see
+        // get_rx_buffer()).
+        descIndex = plm->rx.desc_index;
+        INCR(descIndex, PLM_RX_DESC_NBR);
+        plm->rx.packet_desc[descIndex].size = 0;
+        PLM_MEMORY_BARRIER();
+        plm->rx.desc_index = descIndex;
+    }
+    
+    // Reset reception variables.
+    plm->rx.msb = true;
+    plm->rx.invalid_packet = false;
+}
+
+/*******************************************************************************
+* Name:         find_rx_channel()        
+* Description:  Find a subscribed reception channel.
+* Parameters:   plm: Driver instance.
+*               channel: Software channel, layer bits ignored.
+* Return:       Subscribed channel, NULL if not subscribed.
+* Note:         
+*******************************************************************************/
+static plm1_rx_channel_t* find_rx_channel(plm1_t* plm, uint8_t channel)
+{
+    uint8_t i;
+    
+    channel &= PLM_CHANNEL_NUMBER_MASK;
+    for(i = 0; i < PLM_RX_CHANNEL_NBR; i++)
+    {
+        if((plm->rx.channels[i].depth != 0) && (plm->rx.channels[i].channel == channel))
+        {
+            return (&plm->rx.channels[i]);
+        }
+    }
+    
+    return (NULL);
+}
+
+/*******************************************************************************
+* Name:         oldest_rx_packet()        
+* Description:  Find the oldest received packet not read yet.
+* Parameters:   plm: Driver instance.
+* Return:       Descriptor of the packet, NULL if no packet is available.
+* Note:         
+*******************************************************************************/
+static plm1_packet_desc_t* oldest_rx_packet(plm1_t* plm)
+{
+    uint8_t descIndex = plm->rx.packet_index;
+    uint8_t descEnd = plm->rx.desc_index;
+    
+    // Read the descriptors published up to "descEnd" only.
+    PLM_MEMORY_BARRIER();
+    
+    while(descIndex != descEnd)
+    {
+        if(plm->rx.packet_desc[descIndex].consumed == false)
+        {
+            return (&plm->rx.packet_desc[descIndex]);
         }
+        INCR(descIndex, PLM_RX_DESC_NBR);
     }
+    
+    return (NULL);
 }
 
 /*******************************************************************************
-* Name:         state_transmitting()        
-* Description:  Execute state "Transmitting".
-* Parameters:   rxNibble: Nibble received from PLM-1.
-* Return:       None.
+* Name:         oldest_channel_packet()        
+* Description:  Find the oldest received packet of a channel not read yet.
+* Parameters:   plm: Driver instance.
+*               channel: Software channel, layer bits ignored.
+* Return:       Descriptor of the packet, NULL if no packet is available.
 * Note:         
 *******************************************************************************/
-static void state_transmitting(uint8_t rxNibble)
+static plm1_packet_desc_t* oldest_channel_packet(plm1_t* plm, uint8_t channel)
 {
-    // Only special character should be received in this state.
-    if((rxNibble & 0x10) == 0)
-    {
-        // Data nibble received, should not happend!!
-        SPI_TX_STOP();
-    }
-    else
+    uint8_t descIndex = plm->rx.packet_index;
+    uint8_t descEnd = plm->rx.desc_index;
+    
+    // Read the descriptors published up to "descEnd" only.
+    PLM_MEMORY_BARRIER();
+    
+    channel &= PLM_CHANNEL_NUMBER_MASK;
+    while(descIndex != descEnd)
     {
-        switch(rxNibble)
+        if((plm->rx.packet_desc[descIndex].consumed == false) &&
+           ((plm->rx.packet_desc[descIndex].channel & PLM_CHANNEL_NUMBER_MASK) == channel))
         {
-          case PLM_CC_TXRE:
-            // Nibble transmitted!
-            if(update_tx_nibble())
-            {
-                // Packet successfully transmitted!                
-                // Send next packet if one is available.
-                if(plm_tx.packet_desc[plm_tx.packet_index].used)
-                {
-                    // Write first nibble.
-                    SPI_TX_NEXT(get_tx_nibble());
-                    plm_sts.state = PLM1_STATE_NEGOTIATING;
-                }
-                else
-                {
-                    // Do not transmit packet.
-                    SPI_TX_STOP();
-                    plm_sts.state = PLM1_STATE_IDLE;
-                }
-            }
-            else
-            {
-                // Send next nibble!
-                SPI_TX_NEXT(get_tx_nibble());
-            }
-            break;
-            
-          case PLM_CC_TX_UNDERRUN:
-            // Retransmit current packet to PLM-1
-            plm_tx.byte_sent = 0;
-            plm_tx.msb = true;
-            SPI_TX_NEXT(get_tx_nibble());
-            record_status(PLM1_STS_TX_UNDERRUN);
-            break;
-                
-          case PLM_CC_TX_OVERRUN:
-            // Retransmit current packet to PLM-1
-            plm_tx.byte_sent = 0;
-            plm_tx.msb = true;
-            SPI_TX_NEXT(get_tx_nibble());
-            record_status(PLM1_STS_TX_OVERRUN);
-            break;
-            
-          default:
-            // Other special characters are ignored.
-            SPI_TX_STOP();
-            break;
+            return (&plm->rx.packet_desc[descIndex]);
         }
+        INCR(descIndex, PLM_RX_DESC_NBR);
     }
+    
+    return (NULL);
 }
 
 /*******************************************************************************
-* Name:         state_receiving()        
-* Description:  Execute state "Receiving".
-* Parameters:   rxNibble: Nibble received from PLM-1.
-* Return:       None.
+* Name:         peek_rx_packet()        
+* Description:  Get a received packet without copying it.
+* Parameters:   plm: Driver instance.
+*               pkt: Descriptor of the packet, NULL value is supported.
+*               length, prio, channel: See plm1_peek().
+* Return:       Packet data inside its pool buffer, NULL if "pkt" is NULL.
 * Note:         
 *******************************************************************************/
-static void state_receiving(uint8_t rxNibble)
+static uint8_t* peek_rx_packet(plm1_t* plm, plm1_packet_desc_t* pkt, uint8_t* length, plm1_priority* prio, uint8_t* channel)
 {
-    // Receiving packet from powerline.
-    if((rxNibble & 0x10) == 0)
+    if(pkt == NULL)
     {
-        // Data nibble received.
-        store_rx_nibble(rxNibble);
-        SPI_TX_STOP();
+        return (NULL);
     }
-    else
+    
+    *length = pkt->size - PLM_PACKET_HEADER_SIZE;
+    plm->rx.errored = pkt->errored;
+    plm->rx.read_channel = pkt->channel;
+    if(prio != NULL)
     {
-        // Special character received.
-        switch(rxNibble)
-        {
-          case PLM_CC_EOP:
-            // End of packet received!
-            eop_received();
-            plm_sts.state = PLM1_STATE_IDLE;
-            break;
-            
-          case PLM_CC_RX_ERROR:
-            // Invalid packet received by PLM-1.
-            RX_CLEAR_PKT();
-            record_status(PLM1_STS_ERROR_RECEIVED);
-            plm_sts.state = PLM1_STATE_IDLE;
-            break;
-            
-          case PLM_CC_RX_OVERRUN:
-            // Firmware doesn't get data from PLM-1 fast enough.
-            RX_CLEAR_PKT();
-            record_status(PLM1_STS_RX_OVERRUN);
-            plm_sts.state = PLM1_STATE_IDLE;
-            break;
-            
-          default:
-            // Other special characters are ignored.
-            break;
-        }
+        *prio = (plm1_priority)plm->pool.buffers[pkt->buffer][0];
+    }
+    if(channel != NULL)
+    {
+        *channel = pkt->channel;
+    }
+    
+    return (&plm->pool.buffers[pkt->buffer][PLM_PACKET_HEADER_SIZE]);
+}
+
+/*******************************************************************************
+* Name:         forward_rx_packet()        
+* Description:  Move a received packet to the transmission queue.
+* Parameters:   plm: Driver instance.
+*               pkt: Descriptor of the packet, NULL value is supported.
+*               length, prio, channel: See plm1_forward().
+* Return:       Handle of the packet, PLM_TX_NO_HANDLE if it was not queued.
+* Note:         
+*******************************************************************************/
+static plm1_tx_handle forward_rx_packet(plm1_t* plm, plm1_packet_desc_t* pkt, uint8_t length, plm1_priority prio, uint8_t channel)
+{
+    plm1_tx_handle handle = PLM_TX_NO_HANDLE;
+    uint8_t buffer;
+    
+    reclaim_tx_buffers(plm);
+    
+    // Transmission may not use the buffers reserved for reception.
+    if((pkt != NULL) && (length > 0) && (length <= PLM_PACKET_DATA_SIZE) &&
+       (plm->pool.tx_held < (PLM_POOL_BUFFER_NBR - PLM_POOL_RX_RESERVED)))
+    {
+        buffer = pkt->buffer;
+        plm->pool.buffers[buffer][0] = (uint8_t)prio;
+        plm->pool.buffers[buffer][1] = channel;
         
-        // Start transmitting if a packet is available and reception is over.
-        if((plm_sts.state == PLM1_STATE_IDLE) && (plm_tx.packet_desc[plm_tx.packet_index].used))
-        {
-            // Write first nibble.
-            SPI_TX_NEXT(get_tx_nibble());
-            plm_sts.state = PLM1_STATE_NEGOTIATING;
-        }
-        else
-        {
-            // Do not transmit packet.
-            SPI_TX_STOP();
-        }
+        // Hand the buffer over from reception to transmission.
+        release_rx_packet(plm, pkt, false);
+        plm->pool.tx_held++;
+        handle = queue_tx_packet(plm, buffer, length + PLM_PACKET_HEADER_SIZE);
     }
+    
+    return (handle);
 }
 
+/*******************************************************************************
+* Name:         read_rx_packet()        
+* Description:  Copy a received packet and free its buffer.
+* Parameters:   plm: Driver instance.
+*               pkt: Descriptor of the packet to read.
+*               dataPacket: Pointer to an array to which the packet is copied
+*                           (packet does not include the PLM-1 header).
+*               priority: Priority of the packet. NULL value is supported.
+*               channel: Software channel of the packet. NULL value is
+*                        supported.
+* Return:       Length of the packet loaded in "dataPacket".
+* Note:         
+*******************************************************************************/
+static uint8_t read_rx_packet(plm1_t* plm, plm1_packet_desc_t* pkt, uint8_t* dataPacket, plm1_priority* prio, uint8_t* channel)
+{
+    uint8_t* packet = plm->pool.buffers[pkt->buffer];
+    uint8_t length = pkt->size - PLM_PACKET_HEADER_SIZE;
+    
+    // Get packet priority.
+    if(prio != NULL)
+    {
+        *prio = (plm1_priority)packet[0];
+    }
+    
+    // Get channel number.
+    if(channel != NULL)
+    {
+        *channel = pkt->channel;
+    }
+    
+    // Copy received packet without PLM-1 header.
+    memcpy(dataPacket, &packet[PLM_PACKET_HEADER_SIZE], length);
+    plm->rx.errored = pkt->errored;
+    plm->rx.read_channel = pkt->channel;
+    release_rx_packet(plm, pkt, true);
+    
+    return (length);
+}
 
 /*******************************************************************************
-* Name:         record_status()        
-* Description:  Record a new library status.
-* Parameters:   New library status.
+* Name:         release_rx_packet()        
+* Description:  Remove a packet from the reception queue.
+* Parameters:   plm: Driver instance.
+*               pkt: Descriptor of the packet.
+*               freeBuffer: true to give its buffer back to the pool, false
+*                           if the caller takes it over.
 * Return:       None.
-* Note:         
+* Note:         Descriptors are freed in reception order; a packet read ahead
+*               of older ones is only marked as consumed. Freed descriptors
+*               are given back to the ISR by advancing "packet_index".
 *******************************************************************************/
-static void record_status(plm1_status sts)
+static void release_rx_packet(plm1_t* plm, plm1_packet_desc_t* pkt, bool freeBuffer)
 {
-    // "status[0]" is the oldest and "status[1]" the newest.
-    if(plm_sts.status[0] == PLM1_STS_OK)
+    plm1_rx_channel_t* rxChannel;
+    uint8_t buffer = pkt->buffer;
+    uint8_t descIndex;
+    uint8_t descEnd;
+    
+    // Update channel occupancy.
+    rxChannel = find_rx_channel(plm, pkt->channel);
+    if((rxChannel != NULL) && (rxChannel->read != rxChannel->queued))
     {
-        plm_sts.status[0] = sts;
+        rxChannel->read++;
     }
-    else if (plm_sts.status[1] == PLM1_STS_OK)
+    
+    // Free packet descriptors, oldest first.
+    pkt->consumed = true;
+    descIndex = plm->rx.packet_index;
+    descEnd = plm->rx.desc_index;
+    while((descIndex != descEnd) && plm->rx.packet_desc[descIndex].consumed)
     {
-        plm_sts.status[1] = sts;
+        INCR(descIndex, PLM_RX_DESC_NBR);
     }
-    else
+    PLM_MEMORY_BARRIER();
+    plm->rx.packet_index = descIndex;
+    
+    // Free the buffer and post a new one.
+    plm->pool.rx_held--;
+    if(freeBuffer)
     {
-        // Delete the oldest status.
-        plm_sts.status[0] = plm_sts.status[1];
-        plm_sts.status[1] = sts;
+        plm->pool.free[plm->pool.free_nbr++] = buffer;
     }
+    post_rx_buffers(plm);
 }
 
 /*******************************************************************************
-* Name:         store_rx_nibble()        
-* Description:  Store received data nibble.
-* Parameters:   nibble: Data nibble received from PLM-1.
-* Return:       None.
-* Note:         
+* Name:         send_packet()        
+* Description:  Copy a packet into a buffer and queue it.
+* Parameters:   plm: Driver instance.
+*               data, length, prio, channel, rawMode: See plm1_send_packet().
+*               reserved: true to take a buffer reserved by plm1_tx_reserve(),
+*                         false to take an unreserved one.
+* Return:       Handle of the packet, PLM_TX_NO_HANDLE if it was not queued.
 *******************************************************************************/
-static void store_rx_nibble(uint8_t nibble)
+static plm1_tx_handle send_packet(plm1_t* plm, uint8_t* data, uint8_t length, plm1_priority prio, uint8_t channel, bool rawMode, bool reserved)
 {
-    uint16_t bufIndex;
+    plm1_tx_handle handle = PLM_TX_NO_HANDLE;
+    uint16_t txLength = length;
+    uint8_t* packet;
+    uint8_t buffer;
     
-    // Is this packet already declared invalid?
-    if(!plm_rx.invalid_packet)
+    // Compute packet size.
+    if(rawMode == false)
+    {
+        // Add size of the PLM1 header.
+        txLength += PLM_PACKET_HEADER_SIZE;
+    }
+    
+    // Packet size valid?
+    if((txLength <= PLM_MAX_PACKET_SIZE) && (length > 0))
     {
-        // Buffer full or packet too long?
-        if((plm_rx.packet_desc[plm_rx.desc_index].used == false) &&
-           (plm_rx.packet_desc[plm_rx.desc_index].size < plm_rx.buffer_empty_size) &&
-           (plm_rx.packet_desc[plm_rx.desc_index].size < PLM_MAX_PACKET_SIZE))
+        // Packet buffer available?
+        buffer = alloc_tx_buffer(plm, reserved);
+        if(buffer != PLM_POOL_NO_BUFFER)
         {
-            bufIndex = (plm_rx.buffer_empty_index + plm_rx.packet_desc[plm_rx.desc_index].size) % PLM_RX_BUFFER_SIZE;
-            if(plm_rx.msb) {
-                // Most significant nibble case.
-                // Store it in the buffer, shifting of 4 bits.
-                plm_rx.buffer[bufIndex] = nibble << 4;
-            }
-            else {
-                // Least significant nibble case.
-                // Merge with the most significant nibble and store in buffer.
-                plm_rx.buffer[bufIndex] |= nibble;
-                ++plm_rx.packet_desc[plm_rx.desc_index].size;
+            packet = plm->pool.buffers[buffer];
+            
+            // Copy PLM1 header if necessary.
+            if(rawMode == false)
+            {
+                *packet++ = (uint8_t)prio;
+                *packet++ = channel;
             }
-            plm_rx.msb = !plm_rx.msb;            
-        }
-        else
-        {
-            // Buffer full or packet too long to be received by our code.
-            plm_rx.invalid_packet = true;
-            record_status(PLM1_STS_PACKET_MISSED);
+            
+            // Copy data into buffer and publish the packet.
+            memcpy(packet, data, length);
+            handle = queue_tx_packet(plm, buffer, (uint8_t)txLength);
         }
     }
+    
+    return (handle);  
 }
 
 /*******************************************************************************
-* Name:         get_tx_nibble()        
-* Description:  Get next nibble to send to PLM-1.
-* Parameters:   None.
-* Return:       Nibble to send to PLM-1.
-
-* Note:         
+* Name:         alloc_tx_buffer()        
+* Description:  Allocate a buffer for a packet to send.
+* Parameters:   plm: Driver instance.
+*               reserved: true to take a buffer reserved by plm1_tx_reserve(),
+*                         false to take an unreserved one.
+* Return:       Buffer index, PLM_POOL_NO_BUFFER if none is available.
+* Note:         Transmission never holds the PLM_POOL_RX_RESERVED buffers
+*               kept for reception. A transmission descriptor is always free
+*               for the buffer. The reserved buffers are counted in "tx_held"
+*               and are the last free ones.
 *******************************************************************************/
-static uint8_t get_tx_nibble(void)
+static uint8_t alloc_tx_buffer(plm1_t* plm, bool reserved)
 {
-    uint16_t dataIndex;
-    uint8_t data;
+    uint8_t buffer = PLM_POOL_NO_BUFFER;
     
-    // Nibbles remaining in current packet?
-    if(plm_tx.byte_sent < plm_tx.packet_desc[plm_tx.packet_index].size)
+    reclaim_tx_buffers(plm);
+    
+    if(reserved)
     {
-        // Get data from tx buffer.
-        dataIndex = (plm_tx.packet_desc[plm_tx.packet_index].start + plm_tx.byte_sent);
-        if(dataIndex >= PLM_TX_BUFFER_SIZE)
-        {
-            dataIndex -= PLM_TX_BUFFER_SIZE;
-        }
-        data = plm_tx.buffer[dataIndex];
-        
-        // Get nibble into byte.
-        if(plm_tx.msb)
+        if(plm->pool.tx_reserved > 0)
         {
-            data = data >> 4;
+            // Already counted as held.
+            plm->pool.tx_reserved--;
+            buffer = plm->pool.free[--plm->pool.free_nbr];
         }
-        data &= 0x0F;
     }
-    else
+    else if((plm->pool.tx_held < (PLM_POOL_BUFFER_NBR - PLM_POOL_RX_RESERVED)) && (plm->pool.free_nbr > plm->pool.tx_reserved))
     {
-        // Send an End Of Packet.
-        data = PLM_CC_EOP;
+        buffer = plm->pool.free[--plm->pool.free_nbr];
+        plm->pool.tx_held++;
     }
     
-    return (data);
+    return (buffer);
 }
 
 /*******************************************************************************
-* Name:         update_tx_nibble()        
-* Description:  Update transmission struct.
-* Parameters:   None.
-* Return:       true if complete packet has been sent, false otherwise.
+* Name:         queue_tx_packet()        
+* Description:  Publish a packet to the ISR for transmission.
+* Parameters:   plm: Driver instance.
+*               buffer: Buffer holding the packet, PLM-1 header included.
+*               size: Size of the packet.
+* Return:       Handle of the packet.
 * Note:         
 *******************************************************************************/
-static bool update_tx_nibble(void)
+static plm1_tx_handle queue_tx_packet(plm1_t* plm, uint8_t buffer, uint8_t size)
 {
-    bool pktSent = false;
+    plm1_tx_track_t* track = &plm->tx.track[plm->tx.desc_index];
+    uint8_t descIndex = plm->tx.desc_index;
     
-    // Data nibble sent?
-    if(plm_tx.byte_sent < plm_tx.packet_desc[plm_tx.packet_index].size)
+    // Fill packet descriptor.
+    plm->tx.packet_desc[descIndex].buffer = buffer;
+    plm->tx.packet_desc[descIndex].size = size;
+    
+    // Track the packet until its completion.
+    if(++plm->tx.handle == PLM_TX_NO_HANDLE)
     {
-        // Complete byte has been sent?
-        if(plm_tx.msb == false)
-        {
-            // Send next byte on upcoming transaction.
-            plm_tx.byte_sent++;
-        }
-        plm_tx.msb = !plm_tx.msb;
+        ++plm->tx.handle;
     }
-    else
+    track->handle = plm->tx.handle;
+    track->retries = 0;
+    track->queued = plm1_get_tick(plm);
+    
+    // Publish the packet once descriptor and data are written.
+    INCR(descIndex, PLM_TX_DESC_NBR);
+    PLM_MEMORY_BARRIER();
+    plm->tx.desc_index = descIndex;
+    
+    return (track->handle);
+}
+
+/*******************************************************************************
+* Name:         reclaim_tx_buffers()        
+* Description:  Give the buffers of the sent packets back to the pool.
+* Parameters:   plm: Driver instance.
+* Return:       None.
+* Note:         Main loop side; packets sent or dropped by the ISR are the ones
+*               behind "packet_index".
+*******************************************************************************/
+static void reclaim_tx_buffers(plm1_t* plm)
+{
+    uint8_t tail = plm->tx.packet_index;
+    
+    PLM_MEMORY_BARRIER();
+    
+    while(plm->tx.reclaim_index != tail)
     {
-        // An End Of Packet has just been sent.
-        pktSent = true;
-        
-        // Remove packet from tx buffer.
-        TX_REMOVE_PKT();
+        plm->pool.free[plm->pool.free_nbr++] = plm->tx.packet_desc[plm->tx.reclaim_index].buffer;
+        plm->pool.tx_held--;
+        INCR(plm->tx.reclaim_index, PLM_TX_DESC_NBR);
     }
+}
+
+/*******************************************************************************
+* Name:         post_rx_buffers()        
+* Description:  Post empty buffers for the ISR to receive into.
+* Parameters:   plm: Driver instance.
+* Return:       None.
+* Note:         Up to PLM_POOL_RX_RESERVED buffers are kept posted: the ISR
+*               receives that many packets back to back before a main loop
+*               function of the driver posts new ones. Reception never holds
+*               the PLM_POOL_TX_RESERVED buffers kept for transmission, nor
+*               the buffers reserved by plm1_tx_reserve().
+*******************************************************************************/
+static void post_rx_buffers(plm1_t* plm)
+{
+    uint8_t head = plm->pool.post_head;
+    uint8_t next = head;
     
-    return (pktSent);
+    INCR(next, PLM_RX_POST_NBR);
+    while((next != plm->pool.post_tail) && (plm->pool.free_nbr > plm->pool.tx_reserved) &&
+          (plm->pool.rx_held < (PLM_POOL_BUFFER_NBR - PLM_POOL_TX_RESERVED)))
+    {
+        plm->pool.post[head] = plm->pool.free[--plm->pool.free_nbr];
+        plm->pool.rx_held++;
+        PLM_MEMORY_BARRIER();
+        plm->pool.post_head = next;
+        head = next;
+        INCR(next, PLM_RX_POST_NBR);
+    }
 }
 
 /*******************************************************************************
-* Name:         eop_received()        
-* Description:  END OF PACKET received; update reception struct.
-* Parameters:   None.
+* Name:         balance_pool()        
+* Description:  Reclaim the buffers of the sent packets and post reception
+*               buffers.
+* Parameters:   plm: Driver instance.
 * Return:       None.
-* Note:         
+* Note:         Called by the main loop functions of the driver.
+*******************************************************************************/
+static void balance_pool(plm1_t* plm)
+{
+    reclaim_tx_buffers(plm);
+    post_rx_buffers(plm);
+}
+
+/*******************************************************************************
+* Name:         read_shared()        
+* Description:  Copy data written by the ISR without masking interrupts.
+* Parameters:   dest: Destination of the copy.
+*               src: Data written by the ISR.
+*               size: Size of the data in bytes.
+* Return:       None.
+* Note:         The copy is done again until it matches the source, so that
+*               a multi-byte value updated by an interrupt is never torn.
 *******************************************************************************/
-static void eop_received(void)
+static void read_shared(void* dest, const void* src, uint8_t size)
 {
-    // Reception buffer was full?
-    if(plm_rx.packet_desc[plm_rx.desc_index].used == false)
+    do
     {
-        if(plm_rx.invalid_packet)
-        {
-            // Invalid packet. Clear packet descriptor.
-            plm_rx.packet_desc[plm_rx.desc_index].size = 0;
-        }
-        else if(plm_rx.packet_desc[plm_rx.desc_index].size)
+        memcpy(dest, src, size);
+        PLM_MEMORY_BARRIER();
+    } while(memcmp(dest, src, size) != 0);
+}
+
+#if PLM_TRACE_SIZE > 0
+/*******************************************************************************
+* Name:         store_trace_entry()        
+* Description:  Store the trace entry being recorded into the ring.
+* Parameters:   plm: Driver instance.
+* Return:       None.
+* Note:         The entry is dropped if the ring is full. Once there is room
+*               again, a gap entry counting the dropped entries is stored
+*               first, so that a decoder knows the trace is not continuous.
+*******************************************************************************/
+static void store_trace_entry(plm1_t* plm)
+{
+    uint8_t head = plm->trace.head;
+    uint8_t room = PLM_TRACE_SIZE - (uint8_t)(head - plm->trace.tail);
+    plm1_trace_entry* gap;
+    
+    // Room for the entry, and for the gap entry before it?
+    if(room > ((plm->trace.lost != 0) ? 1 : 0))
+    {
+        if(plm->trace.lost != 0)
         {
-            // Valid packet! Update reception state and packet descriptor.
-            plm_rx.packet_desc[plm_rx.desc_index].start = plm_rx.buffer_empty_index;
-            plm_rx.packet_desc[plm_rx.desc_index].used = true;
-            plm_rx.buffer_empty_size -= plm_rx.packet_desc[plm_rx.desc_index].size;
-            plm_rx.buffer_empty_index = (plm_rx.buffer_empty_index + plm_rx.packet_desc[plm_rx.desc_index].size) % PLM_RX_BUFFER_SIZE;
-            INCR(plm_rx.desc_index, PLM_RX_MAX_PACKET_NBR);
+            gap = &plm->trace.entries[head & (PLM_TRACE_SIZE - 1)];
+            gap->time = plm->trace.entry.time;
+            gap->rx = PLM_TRACE_LOST;
+            gap->tx = plm->trace.lost;
+            gap->state = (plm->trace.entry.state & 0xF0) | (plm->trace.entry.state >> 4);
+            plm->trace.lost = 0;
+            head++;
         }
+        plm->trace.entries[head & (PLM_TRACE_SIZE - 1)] = plm->trace.entry;
+        PLM_MEMORY_BARRIER();
+        plm->trace.head = head + 1;
+    }
+    else
+    {
+        SAT_INC(plm->trace.lost);
     }
-    
-    // Reset reception variables.
-    plm_rx.msb = true;
-    plm_rx.invalid_packet = false;
 }
+#endif
 
 /*******************************************************************************
 * Name:         build_cfg_string()        
 * Description:  Build default PLM-1 configuration string using plmcfg.h file.
-* Parameters:   None.
+* Parameters:   plm: Driver instance.
 * Return:       None.
 * Note:         This function is not mandatory for PLM-1 library usage. It can
 *               be removed to lighten memory requirement.
 *******************************************************************************/
-static void build_cfg_string(void)
+static void build_cfg_string(plm1_t* plm)
 {
-    uint8_t byteIndex;
-    uint8_t cfgCrc = 0;
-    
-    // Compute some advanced parameters if they are not already defined in plmcfg.h.
-#ifndef DPHG
-/*  +----------------------------------------------------+
-    |          |      /   16 * (N0 - 1)(N1 - 1) \  |     |
-    |   DPHG = | log  | ------------------------|  |     |
-    |          |    2 |  WDIR                   |  |     |
-    |          |_     \ 2     * XDIV * (N0 - N1)/ _|     |
-    +----------------------------------------------------+ */
-    uint8_t DPHG = (log2_round((16.0 * (N0 _PRIME_SIGN 1) * (N1 _PRIME_SIGN 1)) / ((short)(1 << WDIV) * XDIV * _PRIME_SIGN(-1) * (N0 - N1)), false) - 1);
-#endif
-#ifndef OFFSET
-/*  +----------------------------------------------------------------+
-    |             (DPHG + WDIV + 1)          (N0 - 1) + (N1 - 1)     |
-    |   OFFSET = 2                  * XDIV * -------------------     |
-    |                                        (N0 - 1)(N1 - 1)        |
-    +----------------------------------------------------------------+ */
-    short OFFSET = (short)( _PRIME_SIGN(-1) * ((long)1 << (DPHG + WDIV + 1)) * XDIV * (float)((N0 _PRIME_SIGN 1) + (N1 _PRIME_SIGN 1)) / ((short)(N0 _PRIME_SIGN 1) * (N1 _PRIME_SIGN 1)));
-#endif
-#ifndef FTH
-/*  +-------------------------------------------------------------------------------------+
-    |                                     /           WDIR                 \              |
-    |          (DPHG + WDIV + 2)          |          2     * N0 * CPB      |              |
-    |   FTH = 2                  * XDIV * |1 - ----------------------------| + OFFSET     |
-    |                                     |     WDIR                       |              |
-    |                                     \    2     * CPB * (N0 - 1) + N0 /              |
-    +-------------------------------------------------------------------------------------+ */
-    uint8_t FTH = (uint8_t)(((short)1 << (DPHG + WDIV + 2)) * XDIV * (1 - (float)((long)(1 << WDIV) * N0 * CPB)/((long)(1 << WDIV) * CPB * (N0 _PRIME_SIGN 1) + N0)) + OFFSET);
-#endif
-#ifndef FITH
-    uint8_t FITH = (uint8_t)(FTH * 2);
-#endif
-#ifndef FC
-/*  +---------------------------------------------------------------------------------------------------------+
-    |                                          _             _                                                |
-    |                                         |      / CPB \  |                       |  (n + 4)    6   |     |
-    |   FC = [n2,n1,n0,m2,m1,m0]          n = | log  | --- |  | - 1          m = 15 - | 2        * ---  |     |
-    |                                         |    2 \  6  /  |                       |_           CPB _|     |
-    +---------------------------------------------------------------------------------------------------------+ */
-    uint8_t temp_N = log2_round(CPB / 6.0, true) - 1;
-    uint8_t FC = ((temp_N & 0x7) << 3) | ((15 - (uint8_t)(((uint16_t)1 << (temp_N + 4)) * 6 / CPB)) & 0x7);
-#endif
-#ifndef THRESHOLD
-    uint8_t THRESHOLD;
-    uint16_t temp_WPB = CPB;
-    uint8_t temp_CPBn4 = 0;
-    while(temp_WPB & 0xFFF0)
-    {
-        temp_CPBn4 = (uint8_t)(temp_WPB & 0x01);
-        temp_WPB = temp_WPB >> 1;
-    }
-    THRESHOLD = (uint8_t)((temp_WPB + temp_CPBn4) / 2);
-#endif
-    
-    // Fill configuration string.
-    plm_sts.cfg[0] = PATTERN;
-    plm_sts.cfg[1] = MASK;
-    plm_sts.cfg[2] = (THRESHOLD << 3) | (XDIV >> 4);
-    plm_sts.cfg[3] = (uint8_t)(XDIV << 4) | (DPHG & 0x0F);
-    plm_sts.cfg[4] = (uint8_t)(OFFSET >> 3);
-    plm_sts.cfg[5] = (uint8_t)(OFFSET << 5) | (FITH >> 3);
-    plm_sts.cfg[6] = (uint8_t)(FITH << 5) | (FTH >> 2);
-    plm_sts.cfg[7] = (uint8_t)(FTH << 6) | (FC & 0x3F);
-    plm_sts.cfg[8] = (WDIV << 6) | (INPOL << 5) | (LTRINT << 4) | (INTPOL << 3) | (INTYPE << 2) | (TXOUTPOL << 1) | TXOUTYPE;
-    plm_sts.cfg[9] = (TXENPOL << 7) | 0x60 | (NOPRIO << 4) | (NOPREAM << 3) | (NOMAC << 2) | (uint8_t)(CPB >> 8);
-    plm_sts.cfg[10] = (uint8_t)CPB;
-    plm_sts.cfg[11] = (DEL << 1) | (HT0PB >> 4);
-    plm_sts.cfg[12] = (uint8_t)(HT0PB << 4) | (CPT1 >> 4);
-    plm_sts.cfg[13] = (uint8_t)(CPT1 << 4) | (CPT0 >> 4);
-    plm_sts.cfg[14] = (uint8_t)(CPT0 << 4) | (RND >> 4);
-    plm_sts.cfg[15] = (uint8_t)(RND << 4) | (TIMCFG >> 4);
-    plm_sts.cfg[16] = (uint8_t)(TIMCFG << 4) | (FC_LOW >> 4);
-    plm_sts.cfg[17] = (uint8_t)(FC_LOW << 4) | (FC_HIGH >> 4);
-    plm_sts.cfg[18] = (uint8_t)(FC_HIGH << 4);
-                     
-    // Compute CRC of configuration string.
-    for(byteIndex = 0;  byteIndex < (PLM_CONFIG_DATA_LENGTH - 1); byteIndex++)
-    {
-        cfgCrc = crc4(plm_sts.cfg[byteIndex] >> 4, cfgCrc);
-        cfgCrc = crc4(plm_sts.cfg[byteIndex] & 0x0F, cfgCrc);
-    }
-    cfgCrc = crc4(plm_sts.cfg[PLM_CONFIG_DATA_LENGTH - 1] >> 4, cfgCrc);
-    
-    // Complete configuration string by adding CRC value on last nibble.
-    plm_sts.cfg[PLM_CONFIG_DATA_LENGTH - 1] = plm_sts.cfg[PLM_CONFIG_DATA_LENGTH - 1] | (cfgCrc & 0x0F);
+    // Get configuration string generated at compile time.
+    memcpy_P(plm->sts.cfg, plm_default_cfg, PLM_CONFIG_DATA_LENGTH);
+    plm1_cfg_finalize(plm->sts.cfg);
 }
 
 /*******************************************************************************
@@ -1174,46 +2911,87 @@ static uint8_t crc4(uint8_t nibble, uint8_t oldCrc)
 }
 
 /*******************************************************************************
-* Name:         log2_round()        
-* Description:  Compute binary log (log2).
-* Parameters:   n: log2(n).
-*               ceil: Use a CEIL function to round result if true, otherwise use
-*                     a FLOOR function.
-* Return:       Computed binary log.
-* Note:         This function is not mandatory for PLM-1 library usage. It can
-*               be removed to lighten memory requirement.
+* Name:         default_set_cs()
+* Description:  Drive the PLM_CS pin according to PLM_CSPOL.
+* Parameters:   arg: Unused.
+*               select: true to select PLM-1.
+* Return:       None.
+* Note:         
+*******************************************************************************/
+static void default_set_cs(void* arg, bool select)
+{
+    CS_ENABLE(select);
+}
+
+/*******************************************************************************
+* Name:         default_set_reset()
+* Description:  Drive the PLM_nRESET pin.
+* Parameters:   arg: Unused.
+*               run: false to hold PLM-1 in reset, true to release it.
+* Return:       None.
+* Note:         
+*******************************************************************************/
+static void default_set_reset(void* arg, bool run)
+{
+    if(run)
+    {
+        SET_OUTPUT(PLM_nRESET);
+    }
+    else
+    {
+        CLR_OUTPUT(PLM_nRESET);
+    }
+}
+
+/*******************************************************************************
+* Name:         default_get_cnfgd()
+* Description:  Read the PLM_CNFGD pin.
+* Parameters:   arg: Unused.
+* Return:       false if PLM-1 reports a configuration failure.
+* Note:         Always true when PLM_CNFGD is not defined.
+*******************************************************************************/
+static bool default_get_cnfgd(void* arg)
+{
+#ifdef PLM_CNFGD
+    return (GET_INPUT(PLM_CNFGD) != 0);
+#else
+    return (true);
+#endif
+}
+
+/*******************************************************************************
+* Name:         default_spi_tx()
+* Description:  Send a byte to SPI port with PLM_SPI_TX_FUNC().
+* Parameters:   arg: Unused.
+*               byte: Byte to send.
+* Return:       None.
+* Note:         
 *******************************************************************************/
-static uint8_t log2_round(float n, bool ceil)
+static void default_spi_tx(void* arg, uint8_t byte)
 {
-    uint8_t result;
+    PLM_SPI_TX_FUNC(byte);
+}
 
-    if(ceil)
+/*******************************************************************************
+* Name:         default_mask_irq()
+* Description:  Mask or unmask PLM-1, SPI and timer interrupts.
+* Parameters:   arg: Unused.
+*               mask: true to mask the interrupts, false to unmask them.
+* Return:       None.
+* Note:         
+*******************************************************************************/
+static void default_mask_irq(void* arg, bool mask)
+{
+    if(mask)
     {
-        // Use a "ceil" function to round result.
-        result = (n <=   1.0) ? 0 :
-                 (n <=   2.0) ? 1 :
-                 (n <=   4.0) ? 2 :
-                 (n <=   8.0) ? 3 :
-                 (n <=  16.0) ? 4 :
-                 (n <=  32.0) ? 5 :
-                 (n <=  64.0) ? 6 :
-                 (n <= 128.0) ? 7 :
-                 (n <= 256.0) ? 8 :
-                 (n <= 512.0) ? 9 : 10;
+        PLM_INT_DISABLE();
+        PLM_SPI_INT_DISABLE();
+        PLM_TIMER_INT_DISABLE();
     }
     else
     {
-        // Use a "floor" function to round result.
-        result = (n <   2.0) ? 0 :
-                 (n <   4.0) ? 1 :
-                 (n <   8.0) ? 2 :
-                 (n <  16.0) ? 3 :
-                 (n <  32.0) ? 4 :
-                 (n <  64.0) ? 5 :
-                 (n < 128.0) ? 6 :
-                 (n < 256.0) ? 7 :
-                 (n < 512.0) ? 8 : 9;
+        PLM_INT_ENABLE();
+        PLM_SPI_INT_ENABLE();
+        PLM_TIMER_INT_ENABLE();
     }
-    
-    return (result);
 }
@@ -1,8 +1,11 @@
 /*******************************************************************************
 * Filename:     plm1.h
 * Description:  File defining the PLM-1 library.
-* Version:      1.6.1
-* Note:         
+* Version:      1.15.0
+* Note:         All driver state lives in a plm1_t instance, so several PLM-1
+*               can be driven by one MCU, each through its own plm1_port.
+*               Received and transmitted packets share one pool of packet
+*               buffers; a received packet can be forwarded without a copy.
 *******************************************************************************/
 
 #ifndef _PLM1_H_
@@ -11,6 +14,10 @@
 #include "plmcfg.h"
 #include <avr/io.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 
 /*******************************************************************************
  * USER PARAMETERS
@@ -26,12 +33,30 @@
 #define PLM_INT_ENABLE()               SET_BIT(EIMSK,INT0)      /* Enable/Unmask PLM-1 interrupt. */
 #define PLM_SPI_INT_DISABLE()          CLR_BIT(SPCR,SPIE)       /* Disable/Mask SPI reception interrupt. */
 #define PLM_SPI_INT_ENABLE()           SET_BIT(SPCR,SPIE)       /* Enable/Unmask SPI reception interrupt. */
+#define PLM_TIMER_INT_DISABLE()        CLR_BIT(TIMSK2,OCIE2A)   /* Disable/Mask timer interrupt calling plm1_timer(). */
+#define PLM_TIMER_INT_ENABLE()         SET_BIT(TIMSK2,OCIE2A)   /* Enable/Unmask timer interrupt calling plm1_timer(). */
 #define PLM_SPI_TX_FUNC(_byte)         SPDR = (_byte)           /* Function to send a byte to SPI port. */
-#define PLM_RX_BUFFER_SIZE             128                      // Size of the reception buffer in bytes.
-#define PLM_RX_MAX_PACKET_NBR          10                       // Max nb of packets in the rx buffer.
-#define PLM_TX_BUFFER_SIZE             128                      // Size of the transmission buffer in bytes.
-#define PLM_TX_MAX_PACKET_NBR          10                       // Max nb of packets in the tx buffer.
+#define PLM_MEMORY_BARRIER()           __asm__ __volatile__ ("" ::: "memory") /* Orders ring writes before their index is published. */
+#define PLM_POOL_BUFFER_NBR            6                        // Nb of packet buffers shared by reception and transmission.
+#define PLM_POOL_RX_RESERVED           3                        // Buffers kept posted for reception (packets received back to back without the main loop), never used to transmit.
+#define PLM_POOL_TX_RESERVED           1                        // Buffers never used to receive.
+#define PLM_RX_CHANNEL_NBR             4                        // Max nb of subscribed channels.
+#define PLM_ACCEPT_ADDR_SIZE           0                        // Nb of data bytes after the header checked by the accept filter (0 = channel only).
 #define PLM_TX_CHANNEL                 4                        // Default transmission channel.
+#define PLM_BACKOFF_SEED               0xACE1                   // Backoff random seed, should be unique per node.
+#define PLM_BACKOFF_MIN_WINDOW         2                        // Initial contention window in slots (power of 2).
+#define PLM_BACKOFF_MAX_WINDOW         64                       // Maximum contention window in slots (power of 2).
+#define PLM_BACKOFF_SLOT_TICKS         1                        // Duration of a backoff slot in plm1_timer() ticks.
+#define PLM_JOURNAL_SIZE               16                       // Nb of events kept in the journal (power of 2).
+#define PLM_CONFIG_TIMEOUT             100                      // Ticks allowed for a configuration attempt.
+#define PLM_CONFIG_RETRIES             2                        // Configuration attempts retried after a failure.
+#define PLM_WD_NEGOTIATING_TIMEOUT     50                       // Ticks without nibble from PLM-1 allowed while negotiating (0 = not watched).
+#define PLM_WD_TRANSMITTING_TIMEOUT    20                       // Ticks without nibble from PLM-1 allowed while transmitting (0 = not watched).
+#define PLM_WD_RECEIVING_TIMEOUT       20                       // Ticks without nibble from PLM-1 allowed while receiving (0 = not watched).
+#define PLM_WD_TX_RETRIES              1                        // Watchdog retries of a stuck packet before it is aborted.
+#define PLM_WD_MAX_RECOVERIES          3                        // Recoveries without packet sent or received before PLM-1 is soft reset.
+#define PLM_TRACE_SIZE                 0                        // Nb of nibble trace entries (power of 2, 0 = trace disabled).
+#define PLM_TRACE_TIME()               TCNT1                    /* Free running 16 bits timer used to timestamp the trace (Timer1 in normal mode, 4 us per tick in the sketch). */
 /*******************************************************************************
  * END OF USER PARAMETERS
  ******************************************************************************/
@@ -41,15 +66,36 @@
 #define PLM_PACKET_HEADER_SIZE         2                        // 1 byte for Packet Priority + 1 byte for Channel Number.
 #define PLM_PACKET_DATA_SIZE           (PLM_MAX_PACKET_SIZE-PLM_PACKET_HEADER_SIZE) // Size allowed for data into packet.
 #define PLM_CONFIG_DATA_LENGTH         19                       // Configuration string length in bytes.
+#define PLM_TRACE_NONE                 0xFF                     // No nibble received/transmitted in a trace entry.
+#define PLM_TRACE_LOST                 0xFE                     // "rx" of a gap entry, "tx" holds the nb of entries lost.
+#define PLM_RX_DESC_NBR                (PLM_POOL_BUFFER_NBR-PLM_POOL_TX_RESERVED+1) // Reception ring slots, one per buffer reception may hold (one kept free).
+#define PLM_TX_DESC_NBR                (PLM_POOL_BUFFER_NBR+1)  // Transmission ring slots (one kept free).
+#define PLM_RX_POST_NBR                (PLM_POOL_RX_RESERVED+1) // Posted reception buffers ring slots (one kept free).
+#define PLM_POOL_NO_BUFFER             0xFF                     // No packet buffer.
+#define PLM_STATUS_QUEUE_SIZE          4                        // Nb of statuses queued (power of 2).
+#define PLM_TX_DONE_QUEUE_SIZE         8                        // Nb of transmission completions queued (power of 2).
+#define PLM_TX_NO_HANDLE               0                        // Handle returned when a packet is not queued.
+#define PLM_BACKOFF_NODE_SEED(_node)   ((uint16_t)(PLM_BACKOFF_SEED+0x1021*(_node))) // Backoff seed of a node address, one per address.
+
+// Channel byte allocation. Application channels only use the low nibble; the
+// optional layers flag their packets in the high nibble, each one in its own
+// bits, so that they can be stacked. Sending: plm1agg, then plm1lz, then
+// plm1fec; receiving in the reverse order, each layer clearing its bits.
+// Subscriptions and the reception functions taking a channel match on the
+// channel number only: a packet is queued to its channel whatever layer bits
+// it carries, and plm1_rx_channel() gives them, so all the nodes using a
+// channel must stack the same layers. Packets with PLM_CHANNEL_FEC_MASK bits
+// are delivered even when PLM-1 reports a reception error, for plm1fec to
+// correct them (see plm1_rx_errored()).
+#define PLM_CHANNEL_NUMBER_MASK        0x0F                     // Channel number of the application (0 to 15).
+#define PLM_CHANNEL_FEC_MASK           0x30                     // plm1fec: code rate of the payload.
+#define PLM_CHANNEL_AGG_FLAG           0x40                     // plm1agg: several messages in the payload.
+#define PLM_CHANNEL_LZ_FLAG            0x80                     // plm1lz: payload compressed.
 
 // Define Powerline modem version.
 #define PLM_VERSION_PLM1               0
 #define PLM_VERSION_PLM1A              1
 
-/*------------------------------------------------------------------------------
-  Global variables definition
-------------------------------------------------------------------------------*/
-
 /*------------------------------------------------------------------------------
   Global types definition
 ------------------------------------------------------------------------------*/
@@ -70,44 +116,446 @@ typedef enum {
     PLM1_STS_COLLISION = 0x04,                                  // Collision detected.
     PLM1_STS_TX_UNDERRUN = 0x07,                                // Transmitter underrun.
     PLM1_STS_TX_OVERRUN = 0x09,                                 // Transmitter overrun.
-    PLM1_STS_PACKET_MISSED = 0x0C                               // A packet has been lost due to library's buffer overflow.
+    PLM1_STS_PACKET_MISSED = 0x0C,                              // A packet has been lost due to library's buffer overflow.
+    PLM1_STS_CONFIG_FAILED = 0x0D,                              // A configuration attempt failed or timed out.
+    PLM1_STS_WATCHDOG = 0x0E                                    // The driver was stuck in a state, recovered by plm1_watchdog().
 } plm1_status;
 
+// Configuration result.
+typedef enum _plm1_cfg_result_ {
+    PLM1_CFG_IN_PROGRESS = 0,                                   // Configuration not finished yet.
+    PLM1_CFG_DONE,                                              // PLM-1 configured.
+    PLM1_CFG_FAILED                                             // All configuration attempts failed.
+} plm1_cfg_result;
+
+// Reason of a received packet drop.
+typedef enum _plm1_drop_ {
+    PLM1_DROP_CHANNEL = 0,                                      // Channel not subscribed or rejected by the accept filter.
+    PLM1_DROP_ADDRESS,                                          // Address bytes rejected by the accept filter.
+    PLM1_DROP_QUEUE_FULL,                                       // Queue of the channel full.
+    PLM1_DROP_BUFFER_FULL,                                      // No packet buffer ready for reception.
+    PLM1_DROP_TOO_LONG,                                         // Packet longer than PLM_MAX_PACKET_SIZE.
+    PLM1_DROP_TOO_SHORT,                                        // Packet shorter than the PLM-1 header.
+    PLM1_DROP_NBR                                               // Number of drop reasons.
+} plm1_drop;
+
+// Recovery done by the watchdog.
+typedef enum _plm1_wd_action_ {
+    PLM1_WD_RX_DROPPED = 0,                                     // Packet being received dropped.
+    PLM1_WD_TX_RETRIED,                                         // Packet being sent retried after a backoff.
+    PLM1_WD_TX_ABORTED,                                         // Packet being sent aborted.
+    PLM1_WD_RESET,                                              // PLM-1 soft reset and configured again.
+    PLM1_WD_NBR                                                 // Number of recoveries.
+} plm1_wd_action;
+
+// Reception accept filter. A packet is kept if every checked byte matches:
+// (byte & mask) == value. A null mask accepts any value.
+typedef struct _plm1_accept_ {
+    uint8_t channel_mask;                                       // Bits of the channel byte checked.
+    uint8_t channel_value;                                      // Expected value of the checked channel bits.
+#if PLM_ACCEPT_ADDR_SIZE > 0
+    uint8_t addr_mask[PLM_ACCEPT_ADDR_SIZE];                    // Bits of the address bytes checked.
+    uint8_t addr_value[PLM_ACCEPT_ADDR_SIZE];                   // Expected value of the checked address bits.
+#endif
+} plm1_accept;
+
+// Handle of a queued packet (PLM_TX_NO_HANDLE if not queued).
+typedef uint8_t plm1_tx_handle;
+
+// Outcome of a queued packet.
+typedef enum _plm1_tx_outcome_ {
+    PLM1_TX_SENT = 0,                                           // Packet transmitted on the powerline.
+    PLM1_TX_ABORTED                                             // Packet dropped when PLM-1 has been configured again, or by the watchdog.
+} plm1_tx_outcome;
+
+// Transmission completion of a queued packet.
+typedef struct _plm1_tx_done_ {
+    plm1_tx_handle handle;                                      // Handle returned by plm1_send_packet().
+    uint8_t outcome;                                            // Outcome of the packet (plm1_tx_outcome).
+    uint8_t retries;                                            // Negotiations retried after a backoff.
+    uint16_t queue_time;                                        // plm1_timer() ticks from queuing to completion.
+} plm1_tx_done;
+
+// PLM-1 driver instance.
+typedef struct _plm1_t_ plm1_t;
+
+// Configuration completion callback, called from plm1_configure_poll().
+typedef void (*plm1_cfg_callback)(plm1_t* plm, bool success);
+
+// Transmission completion callback, called from plm1_tx_poll().
+typedef void (*plm1_tx_callback)(plm1_t* plm, const plm1_tx_done* done);
+
+// Function queuing a packet: plm1_send_packet() in normal mode, or the send
+// function of a layer stacked on it (see PLM_CHANNEL_NUMBER_MASK).
+typedef plm1_tx_handle (*plm1_send_func)(plm1_t* plm, uint8_t* data, uint8_t length, plm1_priority prio, uint8_t channel);
+
+// Hardware bindings of a PLM-1 instance. Functions are called from the ISRs.
+typedef struct _plm1_port_ {
+    void (*set_cs)(void* arg, bool select);                     // Select (true) or release (false) PLM-1 on SPI bus.
+    void (*set_reset)(void* arg, bool run);                     // Hold PLM-1 in reset (false) or release it (true).
+    bool (*get_cnfgd)(void* arg);                               // Read CNFGD pin, false if not configured. May be NULL.
+    void (*spi_tx)(void* arg, uint8_t byte);                    // Send a byte to SPI port.
+    void (*mask_irq)(void* arg, bool mask);                     // Mask (true) or unmask (false) PLM-1, SPI and timer interrupts.
+    void* arg;                                                  // Argument passed to the functions.
+} plm1_port;
+
+// PLM-1 library' state.
+typedef enum _plm1_state_ {
+    PLM1_STATE_NOT_CONFIGURED = 0,
+    PLM1_STATE_CONFIGURING,
+    PLM1_STATE_IDLE,
+    PLM1_STATE_NEGOTIATING,
+    PLM1_STATE_TRANSMITTING,
+    PLM1_STATE_RECEIVING,
+    PLM1_STATE_NBR                                              // Number of states.
+} plm1_state;
+
+// Driver statistics. Counters saturate instead of wrapping.
+typedef struct _plm1_stats_ {
+    uint16_t status[16];                                        // Occurrences of each status code (index is the plm1_status value).
+    uint32_t tx_packets;                                        // Packets transmitted.
+    uint32_t tx_bytes;                                          // Bytes transmitted (PLM-1 header included).
+    uint32_t rx_packets;                                        // Packets received.
+    uint32_t rx_bytes;                                          // Bytes received (PLM-1 header included).
+    uint16_t negotiations;                                      // Negotiations of the line started.
+    uint16_t retries;                                           // Transmissions retried after a backoff.
+    uint32_t dwell[PLM1_STATE_NBR];                             // plm1_timer() ticks spent in each state.
+    uint16_t rx_drops[PLM1_DROP_NBR];                           // Received packets dropped (index is the plm1_drop value).
+    uint16_t tx_done_lost;                                      // Transmission completions lost, completion queue full.
+    uint16_t recoveries[PLM1_WD_NBR];                           // Watchdog recoveries (index is the plm1_wd_action value).
+} plm1_stats;
+
+// Link counters. Unlike the statistics, they wrap instead of saturating and
+// are never cleared: the difference of two snapshots counts the events
+// between them, as long as less than 65536 occured.
+typedef struct _plm1_link_counters_ {
+    uint16_t tx_packets;                                        // Packets transmitted.
+    uint16_t rx_packets;                                        // Packets received.
+    uint16_t errors;                                            // PLM1_STS_ERROR_RECEIVED and PLM1_STS_COLLISION statuses.
+} plm1_link_counters;
+
+// Counter of the driver statistics read by plm1_get_stat().
+typedef enum _plm1_stat_ {
+    PLM1_STAT_STATUS = 0,                                       // "status" (index is the plm1_status value).
+    PLM1_STAT_TX_PACKETS,                                       // "tx_packets".
+    PLM1_STAT_TX_BYTES,                                         // "tx_bytes".
+    PLM1_STAT_RX_PACKETS,                                       // "rx_packets".
+    PLM1_STAT_RX_BYTES,                                         // "rx_bytes".
+    PLM1_STAT_NEGOTIATIONS,                                     // "negotiations".
+    PLM1_STAT_RETRIES,                                          // "retries".
+    PLM1_STAT_DWELL,                                            // "dwell" (index is the plm1_state value).
+    PLM1_STAT_RX_DROPS,                                         // "rx_drops" (index is the plm1_drop value).
+    PLM1_STAT_TX_DONE_LOST,                                     // "tx_done_lost".
+    PLM1_STAT_RECOVERIES                                        // "recoveries" (index is the plm1_wd_action value).
+} plm1_stat;
+
+// Journal event.
+typedef struct _plm1_event_ {
+    uint16_t tick;                                              // plm1_timer() tick of the event.
+    uint8_t status;                                             // Status code (plm1_status).
+    uint8_t state;                                              // Library state when the event occured (plm1_state).
+} plm1_event;
+
+// Reception counters of a subscribed channel.
+typedef struct _plm1_channel_stats_ {
+    uint8_t depth;                                              // Max nb of packets queued for the channel.
+    uint8_t occupancy;                                          // Nb of packets currently queued.
+    uint16_t received;                                          // Packets queued since subscription.
+    uint16_t dropped;                                           // Packets dropped because the queue was full.
+} plm1_channel_stats;
+
+// Nibble trace entry (5 bytes, dumped as is by the "trace" command). Entries
+// dropped while the trace is full are reported by a gap entry stored before
+// the next one (rx = PLM_TRACE_LOST, state before and after = state when the
+// trace resumes).
+typedef struct _plm1_trace_entry_ {
+    uint16_t time;                                              // PLM_TRACE_TIME() when the entry was recorded.
+    uint8_t rx;                                                 // Nibble received from SPI port (PLM_TRACE_NONE if none).
+    uint8_t tx;                                                 // Nibble written to SPI port (PLM_TRACE_NONE if none).
+    uint8_t state;                                              // State before (bits 7-4) and after (bits 3-0).
+} plm1_trace_entry;
+
+/*------------------------------------------------------------------------------
+  Driver instance definition (private, accessed through the functions below)
+------------------------------------------------------------------------------*/
+
+// Structure holding packet descriptor.
+typedef struct _plm1_packet_desc_t_ {
+    uint8_t buffer;                                             // Pool buffer holding the packet (PLM-1 header included).
+    uint8_t size;                                               // Size of the packet.
+    uint8_t channel;                                            // Channel of the packet (reception only).
+    bool consumed;                                              // true if already read, buffer not yet freed (reception only).
+    bool errored;                                               // true if PLM-1 reported a reception error (coded packets only).
+} plm1_packet_desc_t;
+
+// Structure tracking a queued packet until its completion.
+typedef struct _plm1_tx_track_t_ {
+    plm1_tx_handle handle;                                      // Handle of the packet.
+    uint8_t retries;                                            // Negotiations retried after a backoff.
+    uint16_t queued;                                            // Tick when the packet was queued.
+} plm1_tx_track_t;
+
+// Structure holding a subscribed reception channel. Written by the main loop
+// but "queued", "received" and "dropped" written by the ISR.
+typedef struct _plm1_rx_channel_t_ {
+    uint8_t channel;                                            // Channel number.
+    volatile uint8_t depth;                                     // Max nb of packets queued (0: slot unused), written last.
+    volatile uint8_t queued;                                    // Packets queued by the ISR (wraps).
+    volatile uint8_t read;                                      // Packets read by the main loop (wraps).
+    uint16_t received;                                          // Packets queued since subscription.
+    uint16_t dropped;                                           // Packets dropped because the queue was full.
+} plm1_rx_channel_t;
+
+// Structure holding variables for reception. The ISR produces packets at
+// "desc_index", the main loop consumes them at "packet_index".
+typedef struct _plm1_rx_t_ {
+    bool invalid_packet;                                        // Receiving an invalid packet.
+    volatile uint8_t packet_index;                              // Index of the oldest received packet (main loop).
+    bool msb;                                                   // true if next nibble to be received is the MSB.
+    plm1_packet_desc_t packet_desc[PLM_RX_DESC_NBR];            // Reception packet descriptors.
+    volatile uint8_t desc_index;                                // Index of the packet being received (ISR).
+    uint8_t buffer;                                             // Pool buffer of the packet being received (ISR).
+    plm1_rx_channel_t channels[PLM_RX_CHANNEL_NBR];             // Subscribed channels.
+    volatile uint8_t channel_nbr;                               // Nb of subscribed channels, 0 to accept all.
+    plm1_rx_channel_t* channel;                                 // Subscribed channel of the packet being received (NULL if none).
+    plm1_accept accept;                                         // Accept filter.
+    bool accept_addr;                                           // true if the accept filter checks address bytes.
+    bool errored;                                               // Error flag of the last packet read or peeked (main loop).
+    uint8_t read_channel;                                       // Channel byte of the last packet read or peeked (main loop).
+} plm1_rx_t;
+
+// Structure holding variables for transmission. The main loop produces
+// packets at "desc_index", the ISR consumes them at "packet_index".
+typedef struct _plm1_tx_t_ {
+    uint8_t config_nibble_index;                                // Index of the next configuration nibble to send.
+    uint16_t byte_sent;                                         // Number of bytes already sent in the current packet.
+    volatile uint8_t packet_index;                              // Index of the packet to send (ISR).
+    bool msb;                                                   // true if next nibble to be transmistted is the MSB.
+    plm1_packet_desc_t packet_desc[PLM_TX_DESC_NBR];            // Transmission packet descriptors.
+    volatile uint8_t desc_index;                                // Index of the next available packet descriptor (main loop).
+    uint8_t reclaim_index;                                      // Index of the oldest sent packet whose buffer is not freed (main loop).
+    uint8_t window;                                             // Current contention window in slots.
+    uint16_t backoff;                                           // Ticks to wait before the next negotiation.
+    uint8_t next_nibble;                                        // Nibble to write on next TXRE (TX_NIBBLE_NONE after EOP).
+    volatile bool hold;                                         // true if queued packets are held (see plm1_tx_hold()).
+    plm1_tx_track_t track[PLM_TX_DESC_NBR];                     // Tracking of the queued packets (indexed as "packet_desc").
+    plm1_tx_handle handle;                                      // Handle of the last queued packet (main loop).
+    plm1_tx_done done[PLM_TX_DONE_QUEUE_SIZE];                  // Completion queue.
+    volatile uint8_t done_head;                                 // Completions recorded (ISR, wraps).
+    volatile uint8_t done_tail;                                 // Completions read (main loop, wraps).
+    plm1_tx_callback callback;                                  // Completion callback.
+} plm1_tx_t;
+
+// Structure holding status of PLM-1.
+typedef struct _plm1_sts_t_ {
+    volatile plm1_state state;                                  // PLM-1 library' state.
+    uint8_t cfg[PLM_CONFIG_DATA_LENGTH];                        // Current configuration string.
+    bool spi_in_use;                                            // SPI transaction status.
+    plm1_status status[PLM_STATUS_QUEUE_SIZE];                  // Library status queue.
+    volatile uint8_t status_head;                               // Statuses recorded (ISR, wraps).
+    volatile uint8_t status_tail;                               // Statuses read (main loop, wraps).
+    uint16_t seed;                                              // Backoff pseudo-random generator state.
+    uint8_t min_window;                                         // Initial contention window in slots.
+    uint8_t max_window;                                         // Maximum contention window in slots.
+    uint16_t tick;                                              // plm1_timer() ticks counter.
+    plm1_stats stats;                                           // Driver statistics.
+    volatile bool stats_clear;                                  // Statistics clear requested (main loop), done by plm1_timer() (ISR).
+    plm1_link_counters link;                                    // Link counters (ISR, wrap).
+    plm1_event journal[PLM_JOURNAL_SIZE];                       // Ring of recent events.
+    uint16_t journal_seq;                                       // Events recorded (ISR, wraps).
+    uint16_t journal_base;                                      // "journal_seq" when last cleared (main loop).
+    bool cfg_pending;                                           // Configuration started by plm1_configure_start() not finished.
+    uint8_t cfg_retries;                                        // Configuration attempts left.
+    uint16_t cfg_start;                                         // Tick of the current configuration attempt.
+    plm1_cfg_callback cfg_callback;                             // Configuration completion callback.
+    uint16_t wd_ticks;                                          // Ticks since the last nibble from PLM-1 (ISR).
+    uint32_t wd_progress;                                       // Packets sent and received at the last watchdog check.
+    uint8_t wd_recoveries;                                      // Watchdog recoveries since a packet was sent or received.
+    uint8_t wd_tx_retries;                                      // Watchdog retries of the current packet.
+    bool wd_reset;                                              // Soft reset started by the watchdog not finished.
+} plm1_sts_t;
+
+// Structure holding the packet buffers pool. Buffers are only allocated and
+// freed by the main loop; the ISR gets reception buffers through the "post"
+// ring and gives them back through the reception ring.
+typedef struct _plm1_pool_t_ {
+    uint8_t buffers[PLM_POOL_BUFFER_NBR][PLM_MAX_PACKET_SIZE];  // Packet buffers.
+    uint8_t free[PLM_POOL_BUFFER_NBR];                          // Stack of free buffers.
+    uint8_t free_nbr;                                           // Nb of free buffers.
+    uint8_t rx_held;                                            // Buffers posted or holding received packets.
+    uint8_t tx_held;                                            // Buffers holding packets to send or not reclaimed.
+    uint8_t tx_reserved;                                        // Free buffers reserved for the next packets to send (counted in "tx_held").
+    uint8_t post[PLM_RX_POST_NBR];                              // Empty buffers posted for reception.
+    volatile uint8_t post_head;                                 // Index of the next buffer posted (main loop).
+    volatile uint8_t post_tail;                                 // Index of the next buffer taken (ISR).
+} plm1_pool_t;
+
+#if PLM_TRACE_SIZE > 0
+// Structure holding the nibble trace.
+typedef struct _plm1_trace_t_ {
+    plm1_trace_entry entry;                                     // Entry being recorded.
+    plm1_trace_entry entries[PLM_TRACE_SIZE];                   // Ring of recorded entries.
+    volatile uint8_t head;                                      // Entries recorded (ISR, wraps).
+    volatile uint8_t tail;                                      // Entries read (main loop, wraps).
+    uint8_t lost;                                               // Entries dropped since the last gap entry (ISR, saturated).
+} plm1_trace_t;
+#endif
+
+// PLM-1 driver instance.
+struct _plm1_t_ {
+    const plm1_port* port;                                      // Hardware bindings.
+    plm1_rx_t rx;                                               // Reception.
+    plm1_tx_t tx;                                               // Transmission.
+    plm1_sts_t sts;                                             // Status.
+    plm1_pool_t pool;                                           // Packet buffers.
+#if PLM_TRACE_SIZE > 0
+    plm1_trace_t trace;                                         // Nibble trace.
+#endif
+};
+
+/*------------------------------------------------------------------------------
+  Global variables definition
+------------------------------------------------------------------------------*/
+
+// Port of a PLM-1 wired as described by the USER parameters on top of this file.
+extern const plm1_port plm1_default_port;
+
 /*------------------------------------------------------------------------------
   Global functions definition
 ------------------------------------------------------------------------------*/
 
-// Initialize the PLM-1 library according to the USER parameters defined on top of this file.
-void plm1_init(void);
+// Initialize a PLM-1 instance according to the USER parameters defined on top of this file.
+void plm1_init(plm1_t* plm, const plm1_port* port);
 
-// Configure the PLM-1 using a configuration string.
-bool plm1_configure(uint8_t* cfg);
+// Configure the PLM-1 using a configuration string (blocking).
+bool plm1_configure(plm1_t* plm, uint8_t* cfg);
+
+// Start configuring the PLM-1 and return at once.
+void plm1_configure_start(plm1_t* plm, uint8_t* cfg, plm1_cfg_callback callback);
+
+// Follow the configuration started by plm1_configure_start().
+// ** This function must be called from the main loop **
+plm1_cfg_result plm1_configure_poll(plm1_t* plm);
 
 // Handler of PLM-1 interrupt.
 // ** This function must be called from PLM-1 interrupt ISR **
-void plm1_interrupt(void);
+void plm1_interrupt(plm1_t* plm);
+
+// Time base of the library (backoff, upper layers timeouts).
+// ** This function must be called from a periodic timer ISR **
+void plm1_timer(plm1_t* plm);
 
 // Parser of data received from SPI port.
 // ** This function must be called from SPI reception ISR **
-void plm1_spi_isr(uint8_t rxNibble);
+void plm1_spi_isr(plm1_t* plm, uint8_t rxNibble);
 
 // Send a packet on the powerline (basic function).
-bool plm1_send_data(uint8_t* data, uint8_t length);
+plm1_tx_handle plm1_send_data(plm1_t* plm, uint8_t* data, uint8_t length);
 
 // Send a packet on the powerline (complete function).
-bool plm1_send_packet(uint8_t* data, uint8_t length, plm1_priority prio, uint8_t channel, bool rawMode);
+plm1_tx_handle plm1_send_packet(plm1_t* plm, uint8_t* data, uint8_t length, plm1_priority prio, uint8_t channel, bool rawMode);
+
+// Send a packet on the powerline in a buffer reserved by plm1_tx_reserve().
+plm1_tx_handle plm1_send_reserved(plm1_t* plm, uint8_t* data, uint8_t length, plm1_priority prio, uint8_t channel);
 
 // Get received packets.
-uint8_t plm1_receive(uint8_t* dataPacket, plm1_priority* prio, uint8_t* channel);
+uint8_t plm1_receive(plm1_t* plm, uint8_t* dataPacket, plm1_priority* prio, uint8_t* channel);
+
+// Get received packets of a specific channel.
+uint8_t plm1_receive_channel(plm1_t* plm, uint8_t channel, uint8_t* dataPacket, plm1_priority* prio);
+
+// Check if the last packet read or peeked was received with errors.
+bool plm1_rx_errored(plm1_t* plm);
+
+// Get the channel byte of the last packet read or peeked.
+uint8_t plm1_rx_channel(plm1_t* plm);
+
+// Get the oldest received packet without copying it.
+uint8_t* plm1_peek(plm1_t* plm, uint8_t* length, plm1_priority* prio, uint8_t* channel);
+
+// Get the oldest received packet of a specific channel without copying it.
+uint8_t* plm1_peek_channel(plm1_t* plm, uint8_t channel, uint8_t* length, plm1_priority* prio);
+
+// Free the packet returned by plm1_peek().
+void plm1_release(plm1_t* plm);
+
+// Free the packet returned by plm1_peek_channel().
+void plm1_release_channel(plm1_t* plm, uint8_t channel);
+
+// Send the packet returned by plm1_peek() without copying it.
+plm1_tx_handle plm1_forward(plm1_t* plm, uint8_t length, plm1_priority prio, uint8_t channel);
+
+// Send the packet returned by plm1_peek_channel() without copying it.
+plm1_tx_handle plm1_forward_channel(plm1_t* plm, uint8_t rxChannel, uint8_t length, plm1_priority prio, uint8_t channel);
+
+// Subscribe to a reception channel.
+bool plm1_subscribe(plm1_t* plm, uint8_t channel, uint8_t depth);
+
+// Unsubscribe from a reception channel.
+void plm1_unsubscribe(plm1_t* plm, uint8_t channel);
+
+// Get reception counters of a subscribed channel.
+bool plm1_get_channel_stats(plm1_t* plm, uint8_t channel, plm1_channel_stats* stats);
+
+// Set the reception accept filter.
+void plm1_set_accept(plm1_t* plm, const plm1_accept* accept);
 
 
 // Get library status.
-plm1_status plm1_get_status(void);
+plm1_status plm1_get_status(plm1_t* plm);
 
 // Get transmitter state.
-bool plm1_tx_idle(void);
+bool plm1_tx_idle(plm1_t* plm);
+
+// Hold queued packets in the transmission buffer or release them.
+void plm1_tx_hold(plm1_t* plm, bool hold);
+
+// Reserve packet buffers for the next packets to send.
+uint8_t plm1_tx_reserve(plm1_t* plm, uint8_t count);
+
+// Set the transmission completion callback.
+void plm1_set_tx_callback(plm1_t* plm, plm1_tx_callback callback);
+
+// Report the completed transmissions to the completion callback.
+// ** This function must be called from the main loop **
+uint8_t plm1_tx_poll(plm1_t* plm);
+
+// Detect a driver stuck in a state and recover from it.
+// ** This function must be called from the main loop **
+bool plm1_watchdog(plm1_t* plm);
 
 // Get configuration string curently used.
-bool plm1_get_configuration(uint8_t* cfg);
+bool plm1_get_configuration(plm1_t* plm, uint8_t* cfg);
+
+// Complete a configuration string with its CRC nibble.
+void plm1_cfg_finalize(uint8_t* cfg);
+
+// Set the collision backoff policy.
+void plm1_set_backoff(plm1_t* plm, uint16_t seed, uint8_t minWindow, uint8_t maxWindow);
+
+// Get a snapshot of the driver statistics.
+void plm1_get_stats(plm1_t* plm, plm1_stats* stats);
+
+// Get one counter of the driver statistics.
+uint32_t plm1_get_stat(plm1_t* plm, plm1_stat stat, uint8_t index);
+
+// Get a snapshot of the link counters.
+void plm1_get_link_counters(plm1_t* plm, plm1_link_counters* counters);
+
+// Clear the driver statistics and journal.
+void plm1_clear_stats(plm1_t* plm);
+
+// Get a snapshot of the event journal.
+uint8_t plm1_get_journal(plm1_t* plm, plm1_event* events, uint8_t maxEvents);
+
+// Read and remove the oldest nibble trace entries.
+uint8_t plm1_read_trace(plm1_t* plm, plm1_trace_entry* entries, uint8_t maxEntries);
+
+// Get the number of plm1_timer() ticks elapsed.
+uint16_t plm1_get_tick(plm1_t* plm);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif /* _PLM1_H_ */
@@ -0,0 +1,355 @@
+/*******************************************************************************
+* Filename:     plm1agg.c
+* Description:  File implementing the PLM-1 small message aggregation.
+* Version:      1.0.0
+* Note:         Aggregated packet format: [Length][Data]...[Length][Data]
+*               A buffer holding a single message is sent as a plain packet.
+*               Received packets are fed by the application, after the layers
+*               below have cleared their channel bits, and split on request.
+*******************************************************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "plm1agg.h"
+
+/*------------------------------------------------------------------------------
+  Local constants declaration
+------------------------------------------------------------------------------*/
+
+// Parameters tests.
+#if PLM_AGG_BUFFER_NBR < 1
+#   error PLM-1 AGGREGATION: 'PLM_AGG_BUFFER_NBR' value is too low!
+#endif
+
+/*------------------------------------------------------------------------------
+  Local functions declaration
+------------------------------------------------------------------------------*/
+
+static plm1agg_buffer_t* get_buffer(plm1agg_t* agg, uint8_t channel);
+static bool flush_buffer(plm1agg_t* agg, plm1agg_buffer_t* buffer);
+
+/*------------------------------------------------------------------------------
+  Global functions
+------------------------------------------------------------------------------*/
+
+/*******************************************************************************
+* Name:         plm1agg_init()
+* Description:  Initialize an aggregation instance.
+* Parameters:   agg: Aggregation instance.
+*               plm: Driver instance carrying the packets.
+*               send: Send function of the layer the packets go through (e.g.
+*                     plm1lz_send), NULL to queue them to the driver.
+* Return:       None.
+* Note:
+*******************************************************************************/
+void plm1agg_init(plm1agg_t* agg, plm1_t* plm, plm1_send_func send)
+{
+    memset(agg, 0, sizeof(plm1agg_t));
+    agg->plm = plm;
+    agg->send = send;
+}
+
+/*******************************************************************************
+* Name:         plm1agg_send()
+* Description:  Send a message, aggregated with the next ones of the same
+*               channel.
+* Parameters:   agg: Aggregation instance.
+*               msg: Message to send.
+*               length: Length of the message (up to PLM_AGG_MAX_MSG_SIZE).
+*               prio: Priority of the message.
+*               channel: Channel number used to send the message
+*                        (PLM_AGG_CHANNEL_FLAG must be clear).
+*               flush: true to send the message and those held with it at once.
+* Return:       true if the message has been accepted, false if the length is
+*               invalid or the transmission buffer is full.
+* Note:         The held messages are sent when the next one does not fit,
+*               after PLM_AGG_DELAY ticks (see plm1agg_task()) or on flush.
+*******************************************************************************/
+bool plm1agg_send(plm1agg_t* agg, const uint8_t* msg, uint8_t length, plm1_priority prio, uint8_t channel, bool flush)
+{
+    plm1agg_buffer_t* buffer;
+
+    if((length == 0) || (length > PLM_AGG_MAX_MSG_SIZE))
+    {
+        return (false);
+    }
+
+    buffer = get_buffer(agg, channel);
+    if(buffer == NULL)
+    {
+        return (false);
+    }
+
+    // Make room for the message.
+    if((buffer->length + 1 + length) > PLM_PACKET_DATA_SIZE)
+    {
+        if(!flush_buffer(agg, buffer))
+        {
+            return (false);
+        }
+    }
+
+    if(buffer->length == 0)
+    {
+        buffer->channel = channel;
+        buffer->prio = prio;
+        buffer->start = plm1_get_tick(agg->plm);
+    }
+    else if(prio < buffer->prio)
+    {
+        buffer->prio = prio;
+    }
+    buffer->data[buffer->length] = length;
+    memcpy(&buffer->data[buffer->length + 1], msg, length);
+    buffer->length += 1 + length;
+    buffer->count++;
+    agg->counters.tx_messages++;
+
+    // Send at once if asked or if no other message fits. A failure leaves
+    // the messages held, plm1agg_task() retries.
+    if(flush || ((buffer->length + 2) > PLM_PACKET_DATA_SIZE))
+    {
+        flush_buffer(agg, buffer);
+    }
+
+    return (true);
+}
+
+/*******************************************************************************
+* Name:         plm1agg_flush()
+* Description:  Send the messages held for all channels.
+* Parameters:   agg: Aggregation instance.
+* Return:       true if all messages have been queued, false if the
+*               transmission buffer is full.
+* Note:
+*******************************************************************************/
+bool plm1agg_flush(plm1agg_t* agg)
+{
+    bool flushed = true;
+    uint8_t i;
+
+    for(i = 0; i < PLM_AGG_BUFFER_NBR; i++)
+    {
+        if(!flush_buffer(agg, &agg->tx[i]))
+        {
+            flushed = false;
+        }
+    }
+
+    return (flushed);
+}
+
+/*******************************************************************************
+* Name:         plm1agg_task()
+* Description:  Send the messages held for longer than PLM_AGG_DELAY.
+*               ** This function must be called from the main loop **
+* Parameters:   agg: Aggregation instance.
+* Return:       None.
+* Note:
+*******************************************************************************/
+void plm1agg_task(plm1agg_t* agg)
+{
+    uint16_t now = plm1_get_tick(agg->plm);
+    uint8_t i;
+
+    for(i = 0; i < PLM_AGG_BUFFER_NBR; i++)
+    {
+        if((agg->tx[i].length > 0) && ((uint16_t)(now - agg->tx[i].start) >= PLM_AGG_DELAY))
+        {
+            flush_buffer(agg, &agg->tx[i]);
+        }
+    }
+}
+
+/*******************************************************************************
+* Name:         plm1agg_input()
+* Description:  Feed a received packet, to be split into messages.
+* Parameters:   agg: Aggregation instance.
+*               packet: Packet returned by plm1_receive(), or by the layer
+*                       below.
+*               length: Length of the packet.
+*               prio: Priority of the packet.
+*               channel: Channel of the packet, with PLM_AGG_CHANNEL_FLAG.
+* Return:       None.
+* Note:         The messages of the packet are got with plm1agg_receive();
+*               those not got yet are dropped by the next packet fed. A
+*               packet without PLM_AGG_CHANNEL_FLAG is a single message.
+*******************************************************************************/
+void plm1agg_input(plm1agg_t* agg, const uint8_t* packet, uint8_t length, plm1_priority prio, uint8_t channel)
+{
+    if(length > PLM_PACKET_DATA_SIZE)
+    {
+        length = 0;
+    }
+    memcpy(agg->rx.data, packet, length);
+    agg->rx.length = length;
+    agg->rx.offset = 0;
+    agg->rx.aggregated = (channel & PLM_AGG_CHANNEL_FLAG) ? true : false;
+    agg->rx.channel = channel & ~PLM_AGG_CHANNEL_FLAG;
+    agg->rx.prio = prio;
+}
+
+/*******************************************************************************
+* Name:         plm1agg_receive()
+* Description:  Get the next message split from the packet fed.
+* Parameters:   agg: Aggregation instance.
+*               msg: Array of PLM_PACKET_DATA_SIZE bytes to which the message
+*                    is copied.
+*               prio: Priority of the message. NULL value is supported.
+*               channel: Channel of the message, without PLM_AGG_CHANNEL_FLAG.
+*                        NULL value is supported.
+* Return:       Length of the message, 0 once the packet is fully split.
+* Note:         A message with an invalid length drops the rest of the
+*               packet.
+*******************************************************************************/
+uint8_t plm1agg_receive(plm1agg_t* agg, uint8_t* msg, plm1_priority* prio, uint8_t* channel)
+{
+    plm1agg_rx_t* rx = &agg->rx;
+    uint8_t length;
+
+    if(rx->offset >= rx->length)
+    {
+        return (0);
+    }
+
+    if(!rx->aggregated)
+    {
+        // Plain packet.
+        length = rx->length;
+        memcpy(msg, rx->data, length);
+        rx->offset = rx->length;
+    }
+    else
+    {
+        // Split the next message.
+        length = rx->data[rx->offset];
+        if((length == 0) || (length > (rx->length - rx->offset - 1)))
+        {
+            agg->counters.rx_malformed++;
+            rx->offset = rx->length;
+            return (0);
+        }
+        memcpy(msg, &rx->data[rx->offset + 1], length);
+        rx->offset += 1 + length;
+    }
+    agg->counters.rx_messages++;
+
+    if(prio != NULL)
+    {
+        *prio = rx->prio;
+    }
+    if(channel != NULL)
+    {
+        *channel = rx->channel;
+    }
+
+    return (length);
+}
+
+/*******************************************************************************
+* Name:         plm1agg_get_counters()
+* Description:  Get aggregation counters.
+* Parameters:   agg: Aggregation instance.
+*               counters: Struct used to return the counters.
+* Return:       None.
+* Note:
+*******************************************************************************/
+void plm1agg_get_counters(plm1agg_t* agg, plm1agg_counters* counters)
+{
+    *counters = agg->counters;
+}
+
+/*------------------------------------------------------------------------------
+  Local functions
+------------------------------------------------------------------------------*/
+
+/*******************************************************************************
+* Name:         get_buffer()
+* Description:  Get the aggregation buffer of a channel.
+* Parameters:   agg: Aggregation instance.
+*               channel: Channel number.
+* Return:       Buffer of the channel, a free one or NULL if all buffers are
+*               busy and the oldest one could not be sent.
+* Note:         When all buffers are busy, the oldest one is sent to make room.
+*******************************************************************************/
+static plm1agg_buffer_t* get_buffer(plm1agg_t* agg, uint8_t channel)
+{
+    plm1agg_buffer_t* freeBuffer = NULL;
+    plm1agg_buffer_t* oldest = NULL;
+    uint16_t now = plm1_get_tick(agg->plm);
+    uint8_t i;
+
+    for(i = 0; i < PLM_AGG_BUFFER_NBR; i++)
+    {
+        if(agg->tx[i].length == 0)
+        {
+            if(freeBuffer == NULL)
+            {
+                freeBuffer = &agg->tx[i];
+            }
+        }
+        else if(agg->tx[i].channel == channel)
+        {
+            return (&agg->tx[i]);
+        }
+        else if((oldest == NULL) || ((uint16_t)(now - agg->tx[i].start) > (uint16_t)(now - oldest->start)))
+        {
+            oldest = &agg->tx[i];
+        }
+    }
+
+    if((freeBuffer == NULL) && flush_buffer(agg, oldest))
+    {
+        freeBuffer = oldest;
+    }
+
+    return (freeBuffer);
+}
+
+/*******************************************************************************
+* Name:         flush_buffer()
+* Description:  Queue the messages held in a buffer as a single packet.
+* Parameters:   agg: Aggregation instance.
+*               buffer: Aggregation buffer.
+* Return:       true if the buffer is empty, false if the transmission buffer
+*               is full.
+* Note:         A single message is sent as a plain packet.
+*******************************************************************************/
+static bool flush_buffer(plm1agg_t* agg, plm1agg_buffer_t* buffer)
+{
+    uint8_t* data = buffer->data;
+    uint8_t length = buffer->length;
+    uint8_t channel = buffer->channel | PLM_AGG_CHANNEL_FLAG;
+    bool sent;
+
+    if(buffer->length == 0)
+    {
+        return (true);
+    }
+
+    if(buffer->count == 1)
+    {
+        data++;
+        length--;
+        channel = buffer->channel;
+    }
+
+    if(agg->send != NULL)
+    {
+        sent = (agg->send(agg->plm, data, length, buffer->prio, channel) != PLM_TX_NO_HANDLE);
+    }
+    else
+    {
+        sent = (plm1_send_packet(agg->plm, data, length, buffer->prio, channel, false) != PLM_TX_NO_HANDLE);
+    }
+
+    if(sent)
+    {
+        buffer->length = 0;
+        buffer->count = 0;
+        agg->counters.tx_packets++;
+    }
+
+    return (sent);
+}
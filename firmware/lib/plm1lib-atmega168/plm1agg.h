@@ -0,0 +1,102 @@
+/*******************************************************************************
+* Filename:     plm1agg.h
+* Description:  File defining the PLM-1 small message aggregation.
+* Version:      1.0.0
+* Note:         Small messages sent to the same channel are held for up to
+*               PLM_AGG_DELAY ticks and packed into a single packet, saving
+*               the header, preamble and negotiation of the others. Packets
+*               holding several messages are flagged by PLM_AGG_CHANNEL_FLAG
+*               in the channel byte; nodes without aggregation see them on
+*               another channel and ignore them. One plm1agg_t instance
+*               serves one driver instance; the packets can be sent through
+*               another layer (see PLM_CHANNEL_NUMBER_MASK).
+*******************************************************************************/
+
+#ifndef _PLM1AGG_H_
+#define _PLM1AGG_H_
+
+#include "plm1.h"
+
+
+/*******************************************************************************
+ * USER PARAMETERS
+ *
+ * Parameters to be modified by the user.
+ ******************************************************************************/
+#define PLM_AGG_DELAY                  20                       // Max ticks a message is held before being sent.
+#define PLM_AGG_BUFFER_NBR             2                        // Nb of channels aggregated simultaneously.
+/*******************************************************************************
+ * END OF USER PARAMETERS
+ ******************************************************************************/
+
+#define PLM_AGG_CHANNEL_FLAG           PLM_CHANNEL_AGG_FLAG     // Aggregated packet flag, in the channel byte.
+#define PLM_AGG_MAX_MSG_SIZE           (PLM_PACKET_DATA_SIZE-1) // Max size of an aggregated message (1 byte length).
+
+/*------------------------------------------------------------------------------
+  Global types definition
+------------------------------------------------------------------------------*/
+
+// Aggregation counters.
+typedef struct _plm1agg_counters_ {
+    uint16_t tx_messages;                                       // Messages accepted for sending.
+    uint16_t tx_packets;                                        // Packets queued to the driver.
+    uint16_t rx_messages;                                       // Messages received.
+    uint16_t rx_malformed;                                      // Aggregated packets with an invalid length.
+} plm1agg_counters;
+
+// Structure holding the messages aggregated for a channel.
+typedef struct _plm1agg_buffer_t_ {
+    uint8_t length;                                             // Bytes used in "data", 0 if the buffer is free.
+    uint8_t count;                                              // Nb of messages held.
+    uint8_t channel;                                            // Channel of the messages.
+    plm1_priority prio;                                         // Highest priority of the messages.
+    uint16_t start;                                             // Tick of the first message.
+    uint8_t data[PLM_PACKET_DATA_SIZE];                         // Length delimited messages.
+} plm1agg_buffer_t;
+
+// Structure holding the received packet being split.
+typedef struct _plm1agg_rx_t_ {
+    uint8_t length;                                             // Length of the packet.
+    uint8_t offset;                                             // Offset of the next message.
+    bool aggregated;                                            // true if the packet holds length delimited messages.
+    uint8_t channel;                                            // Channel of the packet, flag cleared.
+    plm1_priority prio;                                         // Priority of the packet.
+    uint8_t data[PLM_PACKET_DATA_SIZE];                         // Packet.
+} plm1agg_rx_t;
+
+// Aggregation instance (one per driver instance).
+typedef struct _plm1agg_t_ {
+    plm1_t* plm;                                                // Driver instance carrying the packets.
+    plm1_send_func send;                                        // Layer the packets are sent through, NULL for the driver.
+    plm1agg_buffer_t tx[PLM_AGG_BUFFER_NBR];                    // Aggregation buffers.
+    plm1agg_rx_t rx;                                            // Reception struct.
+    plm1agg_counters counters;                                  // Counters.
+} plm1agg_t;
+
+/*------------------------------------------------------------------------------
+  Global functions definition
+------------------------------------------------------------------------------*/
+
+// Initialize an aggregation instance.
+void plm1agg_init(plm1agg_t* agg, plm1_t* plm, plm1_send_func send);
+
+// Send a message, aggregated with the next ones of the same channel.
+bool plm1agg_send(plm1agg_t* agg, const uint8_t* msg, uint8_t length, plm1_priority prio, uint8_t channel, bool flush);
+
+// Send the messages held for all channels.
+bool plm1agg_flush(plm1agg_t* agg);
+
+// Send the messages held for longer than PLM_AGG_DELAY.
+// ** This function must be called from the main loop **
+void plm1agg_task(plm1agg_t* agg);
+
+// Feed a received packet, to be split into messages.
+void plm1agg_input(plm1agg_t* agg, const uint8_t* packet, uint8_t length, plm1_priority prio, uint8_t channel);
+
+// Get the next message split from the packet fed.
+uint8_t plm1agg_receive(plm1agg_t* agg, uint8_t* msg, plm1_priority* prio, uint8_t* channel);
+
+// Get aggregation counters.
+void plm1agg_get_counters(plm1agg_t* agg, plm1agg_counters* counters);
+
+#endif /* _PLM1AGG_H_ */
@@ -0,0 +1,587 @@
+/*******************************************************************************
+* Filename:     plm1fec.c
+* Description:  File implementing the PLM-1 forward error correction.
+* Version:      1.0.0
+* Note:         Coded packet layout, before interleaving:
+*               PLM1FEC_RATE_2_3: [Data 0]...[Check MSB][Check LSB][P0|P1]...
+*                                 Pi is the parity nibble of byte i.
+*               PLM1FEC_RATE_1_2: [Codeword MSB 0][Codeword LSB 0]...
+*                                 A codeword is [Nibble][Parity nibble].
+*               Check is the CRC-16 (CCITT) of the data, coded as the data at
+*               both rates: it drops the packets whose errors were
+*               miscorrected.
+*               Interleaving sends bit 7 of every byte, then bit 6... so a
+*               burst of errors hits consecutive bytes once each. Coding
+*               relies on 16 entries tables only: a syndrome is a parity
+*               lookup, its correction another lookup. The code rate value 3
+*               is reserved: such packets are dropped and counted.
+*******************************************************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+#include "plm1fec.h"
+
+/*------------------------------------------------------------------------------
+  Local constants declaration
+------------------------------------------------------------------------------*/
+
+#define FEC_FIX_FAILED                 0xFF                         // Syndrome of an uncorrectable error.
+
+// Parameters tests.
+#if (PLM_FEC_INTERLEAVE != 0) && (PLM_FEC_INTERLEAVE != 1)
+#   error PLM-1 FEC: 'PLM_FEC_INTERLEAVE' must be 0 or 1!
+#endif
+
+// CRC-16 (polynomial x^16+x^12+x^5+1) of a nibble, indexed by the nibble XOR
+// the high nibble of the CRC.
+static const uint16_t fec_crc16[16] PROGMEM = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+// Hamming(12,8) parity nibble of the low and high nibbles of a data byte
+// (data bits columns: 3, 5, 6, 9, 10, 12, 7, 11).
+static const uint8_t fec_parity_lo[16] PROGMEM = {
+    0x0, 0x3, 0x5, 0x6, 0x6, 0x5, 0x3, 0x0, 0x9, 0xA, 0xC, 0xF, 0xF, 0xC, 0xA, 0x9
+};
+static const uint8_t fec_parity_hi[16] PROGMEM = {
+    0x0, 0xA, 0xC, 0x6, 0x7, 0xD, 0xB, 0x1, 0xB, 0x1, 0x7, 0xD, 0xC, 0x6, 0x0, 0xA
+};
+
+// Hamming(12,8) data bit to flip for each syndrome.
+static const uint8_t fec_fix_12_8[16] PROGMEM = {
+    0x00, 0x00, 0x00, 0x01, 0x00, 0x02, 0x04, 0x40, 0x00, 0x08, 0x10, 0x80, 0x20, 0xFF, 0xFF, 0xFF
+};
+
+// Extended Hamming(8,4) codeword of each nibble (even parity).
+static const uint8_t fec_codeword_8_4[16] PROGMEM = {
+    0x00, 0x1B, 0x2D, 0x36, 0x4E, 0x55, 0x63, 0x78, 0x87, 0x9C, 0xAA, 0xB1, 0xC9, 0xD2, 0xE4, 0xFF
+};
+
+// Extended Hamming(8,4) nibble bit to flip for each difference between the
+// received parity nibble and the one of the received nibble.
+static const uint8_t fec_fix_8_4[16] PROGMEM = {
+    0x00, 0x00, 0x00, 0xFF, 0x00, 0xFF, 0xFF, 0x08, 0x00, 0xFF, 0xFF, 0x01, 0xFF, 0x02, 0x04, 0xFF
+};
+
+/*------------------------------------------------------------------------------
+  Local functions declaration
+------------------------------------------------------------------------------*/
+
+static uint8_t parity_12_8(uint8_t data);
+static uint8_t add_check(const uint8_t* src, uint8_t length, uint8_t* dst);
+static uint16_t crc16(const uint8_t* data, uint8_t length);
+#if PLM_FEC_INTERLEAVE == 1
+static void interleave(const uint8_t* src, uint8_t* dst, uint8_t length);
+static void deinterleave(const uint8_t* src, uint8_t* dst, uint8_t length);
+#endif
+
+/*------------------------------------------------------------------------------
+  Global functions
+------------------------------------------------------------------------------*/
+
+/*******************************************************************************
+* Name:         plm1fec_init()
+* Description:  Initialize a FEC instance.
+* Parameters:   fec: FEC instance.
+*               plm: Driver instance carrying the packets.
+* Return:       None.
+* Note:         All channels start uncoded.
+*******************************************************************************/
+void plm1fec_init(plm1fec_t* fec, plm1_t* plm)
+{
+    memset(fec, 0, sizeof(plm1fec_t));
+    fec->plm = plm;
+}
+
+/*******************************************************************************
+* Name:         plm1fec_set_rate()
+* Description:  Select the code rate of a channel.
+* Parameters:   fec: FEC instance.
+*               channel: Channel number (below PLM_FEC_CHANNEL_NBR).
+*               rate: Code rate of the packets sent on the channel.
+* Return:       None.
+* Note:         Only the sender needs it; the receiver reads the code rate
+*               from the channel byte.
+*******************************************************************************/
+void plm1fec_set_rate(plm1fec_t* fec, uint8_t channel, plm1fec_rate rate)
+{
+    if((channel < PLM_FEC_CHANNEL_NBR) && (rate <= PLM1FEC_RATE_1_2))
+    {
+        fec->rates[channel] = (uint8_t)rate;
+    }
+}
+
+/*******************************************************************************
+* Name:         plm1fec_get_rate()
+* Description:  Get the code rate of a channel.
+* Parameters:   fec: FEC instance.
+*               channel: Channel number.
+* Return:       Code rate of the channel, PLM1FEC_RATE_NONE if out of range.
+* Note:
+*******************************************************************************/
+plm1fec_rate plm1fec_get_rate(plm1fec_t* fec, uint8_t channel)
+{
+    plm1fec_rate rate = PLM1FEC_RATE_NONE;
+
+    if(channel < PLM_FEC_CHANNEL_NBR)
+    {
+        rate = (plm1fec_rate)fec->rates[channel];
+    }
+
+    return (rate);
+}
+
+/*******************************************************************************
+* Name:         plm1fec_encode()
+* Description:  Encode a buffer.
+* Parameters:   src: Data to encode.
+*               length: Length of the data (up to PLM_FEC_MAX_DATA_2_3 or
+*                       PLM_FEC_MAX_DATA_1_2).
+*               rate: Code rate.
+*               dst: Array of PLM_PACKET_DATA_SIZE bytes receiving the coded
+*                    data.
+* Return:       Length of the coded data, 0 if the data is too long or the
+*               code rate is reserved.
+* Note:
+*******************************************************************************/
+uint8_t plm1fec_encode(const uint8_t* src, uint8_t length, plm1fec_rate rate, uint8_t* dst)
+{
+    uint8_t coded[PLM_PACKET_DATA_SIZE];
+    uint8_t codedLength = 0;
+    uint8_t i;
+
+    if(rate == PLM1FEC_RATE_2_3)
+    {
+        if(length <= PLM_FEC_MAX_DATA_2_3)
+        {
+            // Data and check bytes first, then the parity nibbles, two per
+            // byte.
+            length = add_check(src, length, coded);
+            memset(&coded[length], 0, (length + 1) / 2);
+            for(i = 0; i < length; i++)
+            {
+                coded[length + (i >> 1)] |= (i & 0x01) ? parity_12_8(coded[i]) : (parity_12_8(coded[i]) << 4);
+            }
+            codedLength = length + (length + 1) / 2;
+        }
+    }
+    else if(rate == PLM1FEC_RATE_1_2)
+    {
+        if(length <= PLM_FEC_MAX_DATA_1_2)
+        {
+            // Data and check bytes, held by "dst" until interleaved.
+            length = add_check(src, length, dst);
+            for(i = 0; i < length; i++)
+            {
+                coded[2 * i] = pgm_read_byte(&fec_codeword_8_4[dst[i] >> 4]);
+                coded[2 * i + 1] = pgm_read_byte(&fec_codeword_8_4[dst[i] & 0x0F]);
+            }
+            codedLength = 2 * length;
+        }
+    }
+    else if((rate == PLM1FEC_RATE_NONE) && (length <= PLM_PACKET_DATA_SIZE))
+    {
+        memcpy(coded, src, length);
+        codedLength = length;
+    }
+
+#if PLM_FEC_INTERLEAVE == 1
+    if(rate != PLM1FEC_RATE_NONE)
+    {
+        interleave(coded, dst, codedLength);
+    }
+    else
+#endif
+    {
+        memcpy(dst, coded, codedLength);
+    }
+
+    return (codedLength);
+}
+
+/*******************************************************************************
+* Name:         plm1fec_decode()
+* Description:  Decode a buffer, correcting the bit errors.
+* Parameters:   src: Coded data.
+*               length: Length of the coded data.
+*               rate: Code rate.
+*               dst: Array of PLM_PACKET_DATA_SIZE bytes receiving the data.
+*               corrected: Nb of bit errors corrected. NULL value is supported.
+* Return:       Length of the data, 0 if the length is not valid for the code
+*               rate, if the code rate is reserved or if an error could not
+*               be corrected.
+* Note:         Rate 2/3 corrects one bit error per data byte and its parity
+*               nibble. Rate 1/2 corrects one bit error per nibble and detects
+*               two. More errors may be miscorrected: the check bytes then
+*               drop the packet.
+*******************************************************************************/
+uint8_t plm1fec_decode(const uint8_t* src, uint8_t length, plm1fec_rate rate, uint8_t* dst, uint8_t* corrected)
+{
+    uint8_t coded[PLM_PACKET_DATA_SIZE];
+    uint8_t dataLength = 0;
+    uint8_t fixCount = 0;
+    uint16_t crc;
+    uint8_t syndrome;
+    uint8_t fix;
+    uint8_t i;
+
+    if((length > PLM_PACKET_DATA_SIZE) || (rate > PLM1FEC_RATE_1_2))
+    {
+        return (0);
+    }
+
+#if PLM_FEC_INTERLEAVE == 1
+    if(rate != PLM1FEC_RATE_NONE)
+    {
+        deinterleave(src, coded, length);
+    }
+    else
+#endif
+    {
+        memcpy(coded, src, length);
+    }
+
+    if(rate == PLM1FEC_RATE_2_3)
+    {
+        dataLength = (2 * length) / 3;
+        if((dataLength < PLM_FEC_CHECK_SIZE) || ((dataLength + (dataLength + 1) / 2) != length))
+        {
+            return (0);
+        }
+        for(i = 0; i < dataLength; i++)
+        {
+            syndrome = coded[dataLength + (i >> 1)];
+            syndrome = (i & 0x01) ? (syndrome & 0x0F) : (syndrome >> 4);
+            syndrome ^= parity_12_8(coded[i]);
+            fix = pgm_read_byte(&fec_fix_12_8[syndrome]);
+            if(fix == FEC_FIX_FAILED)
+            {
+                return (0);
+            }
+            dst[i] = coded[i] ^ fix;
+            if(syndrome != 0)
+            {
+                fixCount++;
+            }
+        }
+    }
+    else if(rate == PLM1FEC_RATE_1_2)
+    {
+        if((length < 2 * PLM_FEC_CHECK_SIZE) || (length & 0x01))
+        {
+            return (0);
+        }
+        dataLength = length / 2;
+        for(i = 0; i < length; i++)
+        {
+            syndrome = (pgm_read_byte(&fec_codeword_8_4[coded[i] >> 4]) ^ coded[i]) & 0x0F;
+            fix = pgm_read_byte(&fec_fix_8_4[syndrome]);
+            if(fix == FEC_FIX_FAILED)
+            {
+                return (0);
+            }
+            if(i & 0x01)
+            {
+                dst[i >> 1] |= (coded[i] >> 4) ^ fix;
+            }
+            else
+            {
+                dst[i >> 1] = ((coded[i] >> 4) ^ fix) << 4;
+            }
+            if(syndrome != 0)
+            {
+                fixCount++;
+            }
+        }
+    }
+    else
+    {
+        memcpy(dst, coded, length);
+        return (length);
+    }
+
+    // Check bytes of the corrected data.
+    dataLength -= PLM_FEC_CHECK_SIZE;
+    crc = crc16(dst, dataLength);
+    if((dst[dataLength] != (uint8_t)(crc >> 8)) || (dst[dataLength + 1] != (uint8_t)crc))
+    {
+        return (0);
+    }
+
+    if(corrected != NULL)
+    {
+        *corrected = fixCount;
+    }
+
+    return (dataLength);
+}
+
+/*******************************************************************************
+* Name:         plm1fec_send()
+* Description:  Send a packet on the powerline, coded at the rate of its
+*               channel.
+* Parameters:   fec: FEC instance.
+*               data: Data to send.
+*               length: Length of the data array (up to the max data size of
+*                       the code rate).
+*               prio: Packet priority.
+*               channel: Channel number used to send packet, with the bits
+*                        of the layers above (PLM_FEC_CHANNEL_MASK clear).
+* Return:       Handle of the packet, PLM_TX_NO_HANDLE if it was not queued.
+* Note:
+*******************************************************************************/
+plm1_tx_handle plm1fec_send(plm1fec_t* fec, uint8_t* data, uint8_t length, plm1_priority prio, uint8_t channel)
+{
+    uint8_t packet[PLM_PACKET_DATA_SIZE];
+    plm1fec_rate rate = plm1fec_get_rate(fec, channel & PLM_CHANNEL_NUMBER_MASK);
+    uint8_t codedLength;
+
+    if(rate == PLM1FEC_RATE_NONE)
+    {
+        return (plm1_send_packet(fec->plm, data, length, prio, channel, false));
+    }
+
+    codedLength = plm1fec_encode(data, length, rate, packet);
+    if(codedLength == 0)
+    {
+        return (PLM_TX_NO_HANDLE);
+    }
+
+    return (plm1_send_packet(fec->plm, packet, codedLength, prio, channel | ((uint8_t)rate << PLM_FEC_CHANNEL_SHIFT), false));
+}
+
+/*******************************************************************************
+* Name:         plm1fec_input()
+* Description:  Get the data of a received packet, decoded if necessary.
+* Parameters:   fec: FEC instance.
+*               packet: Packet returned by plm1_receive().
+*               length: Length of the packet.
+*               channel: Channel of the packet, PLM_FEC_CHANNEL_MASK is
+*                        cleared in it.
+*               data: Array of PLM_PACKET_DATA_SIZE bytes to which the data
+*                     is copied.
+* Return:       Length of the data, 0 if the packet is dropped.
+* Note:         Coded packets with errors that could not be corrected, or
+*               with the reserved code rate, are dropped and counted.
+*******************************************************************************/
+uint8_t plm1fec_input(plm1fec_t* fec, const uint8_t* packet, uint8_t length, uint8_t* channel, uint8_t* data)
+{
+    plm1fec_rate rate = (plm1fec_rate)((*channel & PLM_FEC_CHANNEL_MASK) >> PLM_FEC_CHANNEL_SHIFT);
+    uint8_t corrected;
+
+    *channel &= ~PLM_FEC_CHANNEL_MASK;
+
+    if(rate == PLM1FEC_RATE_NONE)
+    {
+        memcpy(data, packet, length);
+        return (length);
+    }
+    if(rate > PLM1FEC_RATE_1_2)
+    {
+        fec->counters.rx_reserved++;
+        return (0);
+    }
+
+    length = plm1fec_decode(packet, length, rate, data, &corrected);
+    if(length > 0)
+    {
+        fec->counters.rx_packets++;
+        fec->counters.rx_corrected += corrected;
+    }
+    else
+    {
+        fec->counters.rx_failed++;
+    }
+
+    return (length);
+}
+
+/*******************************************************************************
+* Name:         plm1fec_receive()
+* Description:  Get received packets, decoded if necessary.
+* Parameters:   fec: FEC instance.
+*               data: Array of PLM_PACKET_DATA_SIZE bytes to which the packet
+*                     data is copied.
+*               prio: Priority of the received packet. NULL value is supported.
+*               channel: Channel on which packet has been received, without
+*                        PLM_FEC_CHANNEL_MASK. NULL value is supported.
+* Return:       Length of the data loaded in "data", 0 if no packet is
+*               available.
+* Note:         Packets dropped by plm1fec_input() are skipped. Packets
+*               PLM-1 received with errors (see plm1_rx_errored()) are
+*               decoded as the others, the counters tell how many were saved.
+*******************************************************************************/
+uint8_t plm1fec_receive(plm1fec_t* fec, uint8_t* data, plm1_priority* prio, uint8_t* channel)
+{
+    uint8_t packet[PLM_PACKET_DATA_SIZE];
+    uint8_t rxChannel;
+    uint8_t length;
+
+    do
+    {
+        length = plm1_receive(fec->plm, packet, prio, &rxChannel);
+        if(length == 0)
+        {
+            return (0);
+        }
+        length = plm1fec_input(fec, packet, length, &rxChannel, data);
+    } while(length == 0);
+
+    if(plm1_rx_errored(fec->plm))
+    {
+        fec->counters.rx_recovered++;
+    }
+
+    if(channel != NULL)
+    {
+        *channel = rxChannel;
+    }
+
+    return (length);
+}
+
+/*******************************************************************************
+* Name:         plm1fec_get_counters()
+* Description:  Get FEC counters.
+* Parameters:   fec: FEC instance.
+*               counters: Struct used to return the counters.
+* Return:       None.
+* Note:
+*******************************************************************************/
+void plm1fec_get_counters(plm1fec_t* fec, plm1fec_counters* counters)
+{
+    *counters = fec->counters;
+}
+
+/*------------------------------------------------------------------------------
+  Local functions
+------------------------------------------------------------------------------*/
+
+/*******************************************************************************
+* Name:         parity_12_8()
+* Description:  Compute the Hamming(12,8) parity nibble of a byte.
+* Parameters:   data: Data byte.
+* Return:       Parity nibble.
+* Note:         Parity is linear: the nibbles of the byte are looked up apart.
+*******************************************************************************/
+static uint8_t parity_12_8(uint8_t data)
+{
+    return (pgm_read_byte(&fec_parity_lo[data & 0x0F]) ^ pgm_read_byte(&fec_parity_hi[data >> 4]));
+}
+
+/*******************************************************************************
+* Name:         add_check()
+* Description:  Copy data followed by its check bytes.
+* Parameters:   src: Data.
+*               length: Length of the data.
+*               dst: Array receiving the data and the check bytes.
+* Return:       Length of the data and check bytes.
+* Note:
+*******************************************************************************/
+static uint8_t add_check(const uint8_t* src, uint8_t length, uint8_t* dst)
+{
+    uint16_t crc = crc16(src, length);
+
+    memcpy(dst, src, length);
+    dst[length] = (uint8_t)(crc >> 8);
+    dst[length + 1] = (uint8_t)crc;
+
+    return (length + PLM_FEC_CHECK_SIZE);
+}
+
+/*******************************************************************************
+* Name:         crc16()
+* Description:  Compute the CRC-16 (CCITT) of a buffer.
+* Parameters:   data: Data.
+*               length: Length of the data.
+* Return:       CRC-16, initial value 0xFFFF.
+* Note:         Computed a nibble at a time, most significant first.
+*******************************************************************************/
+static uint16_t crc16(const uint8_t* data, uint8_t length)
+{
+    uint16_t crc = 0xFFFF;
+    uint8_t i;
+
+    for(i = 0; i < length; i++)
+    {
+        crc = (crc << 4) ^ pgm_read_word(&fec_crc16[(crc >> 12) ^ (data[i] >> 4)]);
+        crc = (crc << 4) ^ pgm_read_word(&fec_crc16[(crc >> 12) ^ (data[i] & 0x0F)]);
+    }
+
+    return (crc);
+}
+
+#if PLM_FEC_INTERLEAVE == 1
+
+/*******************************************************************************
+* Name:         interleave()
+* Description:  Bit-interleave a buffer.
+* Parameters:   src: Buffer to interleave.
+*               dst: Array receiving the interleaved buffer.
+*               length: Length of the buffer.
+* Return:       None.
+* Note:         Bit 7 of every source byte is sent first, then bit 6...
+*******************************************************************************/
+static void interleave(const uint8_t* src, uint8_t* dst, uint8_t length)
+{
+    uint8_t srcMask;
+    uint8_t dstMask = 0x80;
+    uint8_t i;
+
+    memset(dst, 0, length);
+    for(srcMask = 0x80; srcMask != 0; srcMask >>= 1)
+    {
+        for(i = 0; i < length; i++)
+        {
+            if(src[i] & srcMask)
+            {
+                *dst |= dstMask;
+            }
+            dstMask >>= 1;
+            if(dstMask == 0)
+            {
+                dstMask = 0x80;
+                dst++;
+            }
+        }
+    }
+}
+
+/*******************************************************************************
+* Name:         deinterleave()
+* Description:  Restore a buffer interleaved by interleave().
+* Parameters:   src: Interleaved buffer.
+*               dst: Array receiving the restored buffer.
+*               length: Length of the buffer.
+* Return:       None.
+* Note:
+*******************************************************************************/
+static void deinterleave(const uint8_t* src, uint8_t* dst, uint8_t length)
+{
+    uint8_t dstMask;
+    uint8_t srcMask = 0x80;
+    uint8_t i;
+
+    memset(dst, 0, length);
+    for(dstMask = 0x80; dstMask != 0; dstMask >>= 1)
+    {
+        for(i = 0; i < length; i++)
+        {
+            if(*src & srcMask)
+            {
+                dst[i] |= dstMask;
+            }
+            srcMask >>= 1;
+            if(srcMask == 0)
+            {
+                srcMask = 0x80;
+                src++;
+            }
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,103 @@
+/*******************************************************************************
+* Filename:     plm1fec.h
+* Description:  File defining the PLM-1 forward error correction.
+* Version:      1.0.0
+* Note:         Optional Hamming coding of the payload, with a code rate
+*               selected per channel. Packets are bit-interleaved so that a
+*               burst of errors is spread over many codewords, each one
+*               correcting a single bit error. The code rate is carried by
+*               PLM_FEC_CHANNEL_MASK in the channel byte; nodes without FEC
+*               see coded packets on another channel and ignore them. The
+*               code rate value 3 is reserved. One plm1fec_t instance serves
+*               one driver instance. The driver delivers coded packets even
+*               when PLM-1 reports a reception error, so that they get here.
+*
+*               PLM1FEC_RATE_2_3: Hamming(12,8), a parity nibble per byte.
+*               PLM1FEC_RATE_1_2: Extended Hamming(8,4) per nibble, double
+*                                 errors detected.
+*               At both rates a CRC-16 is coded after the data, to drop the
+*               packets whose errors were miscorrected.
+*******************************************************************************/
+
+#ifndef _PLM1FEC_H_
+#define _PLM1FEC_H_
+
+#include "plm1.h"
+
+
+/*******************************************************************************
+ * USER PARAMETERS
+ *
+ * Parameters to be modified by the user.
+ ******************************************************************************/
+#define PLM_FEC_INTERLEAVE             1                        // Bit-interleave coded packets (1) or not (0).
+/*******************************************************************************
+ * END OF USER PARAMETERS
+ ******************************************************************************/
+
+#define PLM_FEC_CHANNEL_MASK           PLM_CHANNEL_FEC_MASK     // Code rate, in the channel byte.
+#define PLM_FEC_CHANNEL_SHIFT          4                        // Position of the code rate in the channel byte.
+#define PLM_FEC_CHANNEL_NBR            16                       // Nb of channels usable with FEC (0 to 15).
+#define PLM_FEC_CHECK_SIZE             2                        // Check bytes coded after the data (CRC-16).
+#define PLM_FEC_MAX_DATA_2_3           ((2*PLM_PACKET_DATA_SIZE)/3-PLM_FEC_CHECK_SIZE) // Max data size at rate 2/3.
+#define PLM_FEC_MAX_DATA_1_2           (PLM_PACKET_DATA_SIZE/2-PLM_FEC_CHECK_SIZE) // Max data size at rate 1/2.
+
+/*------------------------------------------------------------------------------
+  Global types definition
+------------------------------------------------------------------------------*/
+
+// Code rate.
+typedef enum _plm1fec_rate_ {
+    PLM1FEC_RATE_NONE = 0,                                      // Payload sent as is.
+    PLM1FEC_RATE_2_3,                                           // Hamming(12,8), corrects 1 bit per byte.
+    PLM1FEC_RATE_1_2                                            // Extended Hamming(8,4), corrects 1 bit per nibble.
+} plm1fec_rate;
+
+// FEC counters.
+typedef struct _plm1fec_counters_ {
+    uint16_t rx_packets;                                        // Coded packets decoded.
+    uint16_t rx_corrected;                                      // Bit errors corrected.
+    uint16_t rx_failed;                                         // Coded packets dropped, errors not correctable.
+    uint16_t rx_reserved;                                       // Packets dropped, reserved code rate.
+    uint16_t rx_recovered;                                      // Coded packets received with errors by PLM-1 and decoded.
+} plm1fec_counters;
+
+// FEC instance (one per driver instance).
+typedef struct _plm1fec_t_ {
+    plm1_t* plm;                                                // Driver instance carrying the packets.
+    uint8_t rates[PLM_FEC_CHANNEL_NBR];                         // Code rate of each channel (plm1fec_rate).
+    plm1fec_counters counters;                                  // Counters.
+} plm1fec_t;
+
+/*------------------------------------------------------------------------------
+  Global functions definition
+------------------------------------------------------------------------------*/
+
+// Initialize a FEC instance.
+void plm1fec_init(plm1fec_t* fec, plm1_t* plm);
+
+// Select the code rate of a channel.
+void plm1fec_set_rate(plm1fec_t* fec, uint8_t channel, plm1fec_rate rate);
+
+// Get the code rate of a channel.
+plm1fec_rate plm1fec_get_rate(plm1fec_t* fec, uint8_t channel);
+
+// Encode a buffer.
+uint8_t plm1fec_encode(const uint8_t* src, uint8_t length, plm1fec_rate rate, uint8_t* dst);
+
+// Decode a buffer, correcting the bit errors.
+uint8_t plm1fec_decode(const uint8_t* src, uint8_t length, plm1fec_rate rate, uint8_t* dst, uint8_t* corrected);
+
+// Send a packet, coded at the rate of its channel.
+plm1_tx_handle plm1fec_send(plm1fec_t* fec, uint8_t* data, uint8_t length, plm1_priority prio, uint8_t channel);
+
+// Get the data of a received packet, decoded if necessary.
+uint8_t plm1fec_input(plm1fec_t* fec, const uint8_t* packet, uint8_t length, uint8_t* channel, uint8_t* data);
+
+// Get received packets, decoded if necessary.
+uint8_t plm1fec_receive(plm1fec_t* fec, uint8_t* data, plm1_priority* prio, uint8_t* channel);
+
+// Get FEC counters.
+void plm1fec_get_counters(plm1fec_t* fec, plm1fec_counters* counters);
+
+#endif /* _PLM1FEC_H_ */
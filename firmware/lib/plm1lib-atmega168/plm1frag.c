@@ -0,0 +1,309 @@
+/*******************************************************************************
+* Filename:     plm1frag.c
+* Description:  File implementing the PLM-1 fragmentation layer.
+* Version:      1.0.0
+* Note:         Fragment format: [Sender][Message ID][Last flag|Index][Data]
+*******************************************************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "plm1frag.h"
+
+/*------------------------------------------------------------------------------
+  Local constants declaration
+------------------------------------------------------------------------------*/
+
+// Parameters tests.
+#if PLM_FRAG_MAX_FRAGMENTS > 16
+#   error PLM-1 FRAGMENTATION: 'PLM_FRAG_MAX_MSG_SIZE' value is too high!
+#endif
+#if PLM_FRAG_MAX_MSG_SIZE > 255
+#   error PLM-1 FRAGMENTATION: 'PLM_FRAG_MAX_MSG_SIZE' value is too high!
+#endif
+#if PLM_FRAG_RX_SLOTS < 1
+#   error PLM-1 FRAGMENTATION: 'PLM_FRAG_RX_SLOTS' value is too low!
+#endif
+#if (PLM_FRAG_RX_SLOTS * PLM_FRAG_MAX_MSG_SIZE) > 256
+#   error PLM-1 FRAGMENTATION: 'PLM_FRAG_RX_SLOTS' * 'PLM_FRAG_MAX_MSG_SIZE' is too high for the RAM!
+#endif
+
+/*------------------------------------------------------------------------------
+  Local functions declaration
+------------------------------------------------------------------------------*/
+
+static plm1frag_slot_t* get_slot(plm1frag_t* frag, uint8_t sender, uint8_t msgId, uint8_t channel, uint16_t now);
+
+/*------------------------------------------------------------------------------
+  Global functions
+------------------------------------------------------------------------------*/
+
+/*******************************************************************************
+* Name:         plm1frag_init()
+* Description:  Initialize a fragmentation instance.
+* Parameters:   frag: Instance to initialize.
+*               plm: Driver instance carrying the fragments.
+*               node: Address of this node, used as sender of the fragments.
+* Return:       None.
+* Note:
+*******************************************************************************/
+void plm1frag_init(plm1frag_t* frag, plm1_t* plm, uint8_t node)
+{
+    memset(frag, 0, sizeof(plm1frag_t));
+    frag->plm = plm;
+    frag->node = node;
+}
+
+/*******************************************************************************
+* Name:         plm1frag_send()
+* Description:  Start sending a message.
+* Parameters:   frag: Fragmentation instance.
+*               msg: Message to send. It is not copied; the array must stay
+*                    valid until plm1frag_tx_idle() returns true.
+*               length: Length of the message (up to PLM_FRAG_MAX_MSG_SIZE).
+*               prio: Priority of the fragments.
+*               channel: Channel number used to send the fragments.
+* Return:       true if the message has been accepted, false if another message
+*               is still being sent or the length is invalid.
+* Note:         Fragments are streamed into the transmission buffer as space
+*               frees up, by this function and by plm1frag_task().
+*******************************************************************************/
+bool plm1frag_send(plm1frag_t* frag, const uint8_t* msg, uint16_t length, plm1_priority prio, uint8_t channel)
+{
+    if(frag->tx.busy || (length == 0) || (length > PLM_FRAG_MAX_MSG_SIZE))
+    {
+        return (false);
+    }
+
+    frag->tx.msg = msg;
+    frag->tx.length = (uint8_t)length;
+    frag->tx.offset = 0;
+    frag->tx.index = 0;
+    frag->tx.msg_id++;
+    frag->tx.prio = prio;
+    frag->tx.channel = channel;
+    frag->tx.busy = true;
+
+    // Queue as many fragments as possible right now.
+    plm1frag_task(frag);
+
+    return (true);
+}
+
+/*******************************************************************************
+* Name:         plm1frag_tx_idle()
+* Description:  Get fragmentation transmitter state.
+* Parameters:   frag: Fragmentation instance.
+* Return:       true if all fragments of the last message have been queued,
+*               false otherwise.
+* Note:
+*******************************************************************************/
+bool plm1frag_tx_idle(plm1frag_t* frag)
+{
+    return (!frag->tx.busy);
+}
+
+/*******************************************************************************
+* Name:         plm1frag_task()
+* Description:  Queue pending fragments and evict stale partial messages.
+*               ** This function must be called from the main loop **
+* Parameters:   frag: Fragmentation instance.
+* Return:       None.
+* Note:
+*******************************************************************************/
+void plm1frag_task(plm1frag_t* frag)
+{
+    uint8_t fragment[PLM_PACKET_DATA_SIZE];
+    uint16_t now = plm1_get_tick(frag->plm);
+    uint8_t chunk;
+    uint8_t i;
+
+    // Stream fragments while the driver accepts them.
+    while(frag->tx.busy)
+    {
+        chunk = ((frag->tx.length - frag->tx.offset) > PLM_FRAG_DATA_SIZE) ?
+                PLM_FRAG_DATA_SIZE : (frag->tx.length - frag->tx.offset);
+
+        fragment[0] = frag->node;
+        fragment[1] = frag->tx.msg_id;
+        fragment[2] = frag->tx.index;
+        if((frag->tx.offset + chunk) == frag->tx.length)
+        {
+            fragment[2] |= PLM_FRAG_LAST;
+        }
+        memcpy(&fragment[PLM_FRAG_HEADER_SIZE], frag->tx.msg + frag->tx.offset, chunk);
+
+        if(!plm1_send_packet(frag->plm, fragment, PLM_FRAG_HEADER_SIZE + chunk, frag->tx.prio, frag->tx.channel, false))
+        {
+            // Transmission buffer full, retry on next call.
+            break;
+        }
+
+        frag->tx.offset += chunk;
+        frag->tx.index++;
+        if(frag->tx.offset == frag->tx.length)
+        {
+            frag->tx.busy = false;
+            frag->counters.tx_messages++;
+        }
+    }
+
+    // Evict stale partial messages.
+    for(i = 0; i < PLM_FRAG_RX_SLOTS; i++)
+    {
+        if(frag->rx[i].used && ((uint16_t)(now - frag->rx[i].start) >= PLM_FRAG_RX_TIMEOUT))
+        {
+            frag->rx[i].used = false;
+            frag->counters.rx_evicted++;
+        }
+    }
+}
+
+/*******************************************************************************
+* Name:         plm1frag_input()
+* Description:  Feed a received packet to the reassembly buffer.
+* Parameters:   frag: Fragmentation instance.
+*               packet: Packet returned by plm1_receive().
+*               length: Length of the packet.
+*               channel: Channel the packet has been received on.
+*               msg: Array of PLM_FRAG_MAX_MSG_SIZE bytes to which a completed
+*                    message is copied.
+*               sender: Sender node of the completed message. NULL value is
+*                       supported.
+* Return:       Length of the message loaded in "msg", 0 if no message has been
+*               completed by this packet.
+* Note:
+*******************************************************************************/
+uint8_t plm1frag_input(plm1frag_t* frag, const uint8_t* packet, uint8_t length, uint8_t channel, uint8_t* msg, uint8_t* sender)
+{
+    plm1frag_slot_t* slot;
+    uint8_t index;
+    uint8_t dataLength;
+    uint16_t offset;
+    uint8_t msgLength = 0;
+
+    // Fragment holds a header and data?
+    if(length <= PLM_FRAG_HEADER_SIZE)
+    {
+        frag->counters.rx_dropped++;
+        return (0);
+    }
+
+    // Fragment is valid?
+    index = packet[2] & ~PLM_FRAG_LAST;
+    dataLength = length - PLM_FRAG_HEADER_SIZE;
+    offset = (uint16_t)index * PLM_FRAG_DATA_SIZE;
+    if((index >= PLM_FRAG_MAX_FRAGMENTS) || ((offset + dataLength) > PLM_FRAG_MAX_MSG_SIZE) ||
+       (((packet[2] & PLM_FRAG_LAST) == 0) && (dataLength != PLM_FRAG_DATA_SIZE)))
+    {
+        frag->counters.rx_dropped++;
+        return (0);
+    }
+
+    if(sender != NULL)
+    {
+        *sender = packet[0];
+    }
+
+    // Single fragment message, no need to reassemble.
+    if(packet[2] == PLM_FRAG_LAST)
+    {
+        memcpy(msg, &packet[PLM_FRAG_HEADER_SIZE], dataLength);
+        frag->counters.rx_messages++;
+        return (dataLength);
+    }
+
+    slot = get_slot(frag, packet[0], packet[1], channel, plm1_get_tick(frag->plm));
+    memcpy(&slot->data[offset], &packet[PLM_FRAG_HEADER_SIZE], dataLength);
+    slot->received |= (uint16_t)1 << index;
+    if(packet[2] & PLM_FRAG_LAST)
+    {
+        slot->last = index;
+        slot->length = (uint8_t)(offset + dataLength);
+    }
+
+    // Message complete?
+    if((slot->last != 0xFF) && (slot->received == (uint16_t)((2UL << slot->last) - 1)))
+    {
+        msgLength = slot->length;
+        memcpy(msg, slot->data, msgLength);
+        slot->used = false;
+        frag->counters.rx_messages++;
+    }
+
+    return (msgLength);
+}
+
+/*******************************************************************************
+* Name:         plm1frag_get_counters()
+* Description:  Get fragmentation counters.
+* Parameters:   frag: Fragmentation instance.
+*               counters: Struct used to return the counters.
+* Return:       None.
+* Note:
+*******************************************************************************/
+void plm1frag_get_counters(plm1frag_t* frag, plm1frag_counters* counters)
+{
+    *counters = frag->counters;
+}
+
+/*------------------------------------------------------------------------------
+  Local functions
+------------------------------------------------------------------------------*/
+
+/*******************************************************************************
+* Name:         get_slot()
+* Description:  Find the reassembly slot of a message, or allocate one.
+* Parameters:   frag: Fragmentation instance.
+*               sender: Sender node of the message.
+*               msgId: Message ID.
+*               channel: Channel the message is received on.
+*               now: Current tick.
+* Return:       Reassembly slot.
+* Note:         When all slots are in use, the oldest partial message is
+*               evicted.
+*******************************************************************************/
+static plm1frag_slot_t* get_slot(plm1frag_t* frag, uint8_t sender, uint8_t msgId, uint8_t channel, uint16_t now)
+{
+    plm1frag_slot_t* slot = NULL;
+    plm1frag_slot_t* oldest = &frag->rx[0];
+    uint8_t i;
+
+    for(i = 0; i < PLM_FRAG_RX_SLOTS; i++)
+    {
+        if(frag->rx[i].used)
+        {
+            if((frag->rx[i].sender == sender) && (frag->rx[i].msg_id == msgId) && (frag->rx[i].channel == channel))
+            {
+                // Message already being reassembled.
+                return (&frag->rx[i]);
+            }
+            if((uint16_t)(now - frag->rx[i].start) > (uint16_t)(now - oldest->start))
+            {
+                oldest = &frag->rx[i];
+            }
+        }
+        else if(slot == NULL)
+        {
+            slot = &frag->rx[i];
+        }
+    }
+
+    // No free slot, evict the oldest partial message.
+    if(slot == NULL)
+    {
+        slot = oldest;
+        frag->counters.rx_evicted++;
+    }
+
+    slot->used = true;
+    slot->sender = sender;
+    slot->msg_id = msgId;
+    slot->channel = channel;
+    slot->received = 0;
+    slot->last = 0xFF;
+    slot->length = 0;
+    slot->start = now;
+
+    return (slot);
+}
@@ -0,0 +1,103 @@
+/*******************************************************************************
+* Filename:     plm1frag.h
+* Description:  File defining the PLM-1 fragmentation layer.
+* Version:      1.0.0
+* Note:         Messages larger than PLM_PACKET_DATA_SIZE are split into
+*               fragments carrying a small header (sender, message ID, index)
+*               and reassembled by the receiver. One plm1frag_t instance
+*               serves one driver instance.
+*******************************************************************************/
+
+#ifndef _PLM1FRAG_H_
+#define _PLM1FRAG_H_
+
+#include "plm1.h"
+
+
+/*******************************************************************************
+ * USER PARAMETERS
+ *
+ * Parameters to be modified by the user.
+ ******************************************************************************/
+#define PLM_FRAG_MAX_MSG_SIZE          116                      // Max size of a reassembled message in bytes.
+#define PLM_FRAG_RX_SLOTS              2                        // Nb of messages reassembled simultaneously.
+#define PLM_FRAG_RX_TIMEOUT            500                      // Ticks before a partial message is evicted.
+/*******************************************************************************
+ * END OF USER PARAMETERS
+ ******************************************************************************/
+
+#define PLM_FRAG_HEADER_SIZE           3                        // Sender + Message ID + Fragment index.
+#define PLM_FRAG_DATA_SIZE             (PLM_PACKET_DATA_SIZE-PLM_FRAG_HEADER_SIZE) // Size allowed for data into fragment.
+#define PLM_FRAG_LAST                  0x80                     // Flag of the last fragment, in the index byte.
+#define PLM_FRAG_MAX_FRAGMENTS         ((PLM_FRAG_MAX_MSG_SIZE+PLM_FRAG_DATA_SIZE-1)/PLM_FRAG_DATA_SIZE)
+
+/*------------------------------------------------------------------------------
+  Global types definition
+------------------------------------------------------------------------------*/
+
+// Fragmentation counters.
+typedef struct _plm1frag_counters_ {
+    uint16_t tx_messages;                                       // Messages completely queued.
+    uint16_t rx_messages;                                       // Messages completely reassembled.
+    uint16_t rx_evicted;                                        // Partial messages evicted (timeout or no slot).
+    uint16_t rx_dropped;                                        // Fragments dropped (malformed or too large).
+} plm1frag_counters;
+
+// Structure holding a message being reassembled.
+typedef struct _plm1frag_slot_t_ {
+    bool used;                                                  // true if this slot is in use.
+    uint8_t sender;                                             // Sender node of the message.
+    uint8_t msg_id;                                             // Message ID.
+    uint8_t channel;                                            // Channel the message is received on.
+    uint16_t received;                                          // Bitmap of received fragments.
+    uint8_t last;                                               // Index of the last fragment (0xFF if unknown).
+    uint8_t length;                                             // Message length, valid once last fragment received.
+    uint16_t start;                                             // Tick of the first received fragment.
+    uint8_t data[PLM_FRAG_MAX_MSG_SIZE];                        // Reassembly buffer.
+} plm1frag_slot_t;
+
+// Structure holding the message being transmitted.
+typedef struct _plm1frag_tx_t_ {
+    bool busy;                                                  // true if a message is being sent.
+    const uint8_t* msg;                                         // Message to send (owned by the caller).
+    uint8_t length;                                             // Length of the message.
+    uint8_t offset;                                             // Offset of the next fragment to queue.
+    uint8_t index;                                              // Index of the next fragment to queue.
+    uint8_t msg_id;                                             // ID of the message.
+    plm1_priority prio;                                         // Priority of the fragments.
+    uint8_t channel;                                            // Channel of the fragments.
+} plm1frag_tx_t;
+
+// Fragmentation instance (one per driver instance).
+typedef struct _plm1frag_t_ {
+    plm1_t* plm;                                                // Driver instance carrying the fragments.
+    uint8_t node;                                               // Address of this node.
+    plm1frag_tx_t tx;                                           // Transmission struct.
+    plm1frag_slot_t rx[PLM_FRAG_RX_SLOTS];                      // Reassembly slots.
+    plm1frag_counters counters;                                 // Counters.
+} plm1frag_t;
+
+/*------------------------------------------------------------------------------
+  Global functions definition
+------------------------------------------------------------------------------*/
+
+// Initialize a fragmentation instance.
+void plm1frag_init(plm1frag_t* frag, plm1_t* plm, uint8_t node);
+
+// Start sending a message; fragments are queued by plm1frag_task().
+bool plm1frag_send(plm1frag_t* frag, const uint8_t* msg, uint16_t length, plm1_priority prio, uint8_t channel);
+
+// Get fragmentation transmitter state.
+bool plm1frag_tx_idle(plm1frag_t* frag);
+
+// Queue pending fragments and evict stale partial messages.
+// ** This function must be called from the main loop **
+void plm1frag_task(plm1frag_t* frag);
+
+// Feed a received packet to the reassembly buffer.
+uint8_t plm1frag_input(plm1frag_t* frag, const uint8_t* packet, uint8_t length, uint8_t channel, uint8_t* msg, uint8_t* sender);
+
+// Get fragmentation counters.
+void plm1frag_get_counters(plm1frag_t* frag, plm1frag_counters* counters);
+
+#endif /* _PLM1FRAG_H_ */
@@ -0,0 +1,301 @@
+/*******************************************************************************
+* Filename:     plm1lz.c
+* Description:  File implementing the PLM-1 payload compression.
+* Version:      1.0.0
+* Note:         Compressed stream is a sequence of tokens:
+*               0x00-0x7F: literal run, (token + 1) bytes follow.
+*               0x80-0xFF: match of ((token & 0x7F) + 3) bytes, followed by a
+*                          byte holding (distance - 1).
+*               No RAM is needed beyond the packet buffers.
+*******************************************************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "plm1lz.h"
+
+/*------------------------------------------------------------------------------
+  Local constants declaration
+------------------------------------------------------------------------------*/
+
+#define LZ_MATCH                       0x80                         // Match token flag.
+#define LZ_MIN_MATCH                   3                            // Shortest match worth a token.
+#define LZ_MAX_MATCH                   (0x7F + LZ_MIN_MATCH)        // Longest match of a token.
+#define LZ_MAX_LITERALS                0x80                         // Longest literal run of a token.
+
+// Parameters tests.
+#if (PLM_LZ_WINDOW < 1) || (PLM_LZ_WINDOW > 256)
+#   error PLM-1 COMPRESSION: 'PLM_LZ_WINDOW' must be between 1 and 256!
+#endif
+#if (PLM_LZ_MAX_INPUT < PLM_PACKET_DATA_SIZE) || (PLM_LZ_MAX_INPUT > 255)
+#   error PLM-1 COMPRESSION: 'PLM_LZ_MAX_INPUT' must be between PLM_PACKET_DATA_SIZE and 255!
+#endif
+
+/*------------------------------------------------------------------------------
+  Global functions
+------------------------------------------------------------------------------*/
+
+/*******************************************************************************
+* Name:         plm1lz_compress()
+* Description:  Compress a buffer.
+* Parameters:   src: Data to compress.
+*               length: Length of the data.
+*               dst: Array receiving the compressed data.
+*               dstSize: Size of the "dst" array.
+* Return:       Length of the compressed data, 0 if it does not fit in "dst".
+* Note:         Greedy parsing; the longest match of the window is taken.
+*******************************************************************************/
+uint8_t plm1lz_compress(const uint8_t* src, uint8_t length, uint8_t* dst, uint8_t dstSize)
+{
+    uint8_t in = 0;
+    uint8_t out = 0;
+    uint8_t litStart = 0;
+    uint8_t litCount = 0;
+    uint8_t bestLen;
+    uint8_t bestDist;
+    uint8_t maxLen;
+    uint8_t len;
+    uint16_t cand;
+
+    while(in < length)
+    {
+        // Look for the longest match in the window.
+        bestLen = 0;
+        bestDist = 0;
+        maxLen = ((length - in) > LZ_MAX_MATCH) ? LZ_MAX_MATCH : (length - in);
+        cand = (in > PLM_LZ_WINDOW) ? (in - PLM_LZ_WINDOW) : 0;
+        for(; (cand < in) && (bestLen < maxLen); cand++)
+        {
+            for(len = 0; (len < maxLen) && (src[cand + len] == src[in + len]); len++);
+            if(len > bestLen)
+            {
+                bestLen = len;
+                bestDist = in - cand;
+            }
+        }
+
+        // Flush literals before a match or when the run is full.
+        if(((bestLen >= LZ_MIN_MATCH) && (litCount > 0)) || (litCount == LZ_MAX_LITERALS))
+        {
+            if((uint16_t)out + 1 + litCount > dstSize)
+            {
+                return (0);
+            }
+            dst[out++] = litCount - 1;
+            memcpy(&dst[out], &src[litStart], litCount);
+            out += litCount;
+            litCount = 0;
+        }
+
+        if(bestLen >= LZ_MIN_MATCH)
+        {
+            if((uint16_t)out + 2 > dstSize)
+            {
+                return (0);
+            }
+            dst[out++] = LZ_MATCH | (bestLen - LZ_MIN_MATCH);
+            dst[out++] = bestDist - 1;
+            in += bestLen;
+        }
+        else
+        {
+            if(litCount == 0)
+            {
+                litStart = in;
+            }
+            litCount++;
+            in++;
+        }
+    }
+
+    // Flush remaining literals.
+    if(litCount > 0)
+    {
+        if((uint16_t)out + 1 + litCount > dstSize)
+        {
+            return (0);
+        }
+        dst[out++] = litCount - 1;
+        memcpy(&dst[out], &src[litStart], litCount);
+        out += litCount;
+    }
+
+    return (out);
+}
+
+/*******************************************************************************
+* Name:         plm1lz_decompress()
+* Description:  Decompress a buffer.
+* Parameters:   src: Compressed data.
+*               length: Length of the compressed data.
+*               dst: Array receiving the decompressed data.
+*               dstSize: Size of the "dst" array.
+* Return:       Length of the decompressed data, 0 if the compressed data is
+*               corrupted or does not fit in "dst".
+* Note:
+*******************************************************************************/
+uint8_t plm1lz_decompress(const uint8_t* src, uint8_t length, uint8_t* dst, uint8_t dstSize)
+{
+    uint8_t in = 0;
+    uint8_t out = 0;
+    uint8_t token;
+    uint8_t count;
+    uint16_t dist;
+
+    while(in < length)
+    {
+        token = src[in++];
+        if(token & LZ_MATCH)
+        {
+            // Match: copy byte per byte, source and destination may overlap.
+            count = (token & ~LZ_MATCH) + LZ_MIN_MATCH;
+            if(in >= length)
+            {
+                return (0);
+            }
+            dist = (uint16_t)src[in++] + 1;
+            if((dist > out) || ((uint16_t)out + count > dstSize))
+            {
+                return (0);
+            }
+            for(; count > 0; count--, out++)
+            {
+                dst[out] = dst[out - dist];
+            }
+        }
+        else
+        {
+            // Literal run.
+            count = token + 1;
+            if(((uint16_t)in + count > length) || ((uint16_t)out + count > dstSize))
+            {
+                return (0);
+            }
+            memcpy(&dst[out], &src[in], count);
+            in += count;
+            out += count;
+        }
+    }
+
+    return (out);
+}
+
+/*******************************************************************************
+* Name:         plm1lz_pack()
+* Description:  Build a compressed packet, if it saves space.
+* Parameters:   data: Data to send.
+*               length: Length of the data array (up to PLM_LZ_MAX_INPUT).
+*               packet: Array of PLM_PACKET_DATA_SIZE bytes to which the
+*                       compressed data is written.
+*               channel: Channel of the packet, PLM_LZ_CHANNEL_FLAG is set in
+*                        it when the data is compressed.
+* Return:       Length of the packet, 0 if compression saves nothing: the
+*               data is then sent as is, on the same channel.
+* Note:
+*******************************************************************************/
+uint8_t plm1lz_pack(const uint8_t* data, uint8_t length, uint8_t* packet, uint8_t* channel)
+{
+    uint8_t packedLength = 0;
+
+    if(length <= PLM_LZ_MAX_INPUT)
+    {
+        packedLength = plm1lz_compress(data, length, packet, PLM_PACKET_DATA_SIZE);
+    }
+
+    if((packedLength == 0) || (packedLength >= length))
+    {
+        return (0);
+    }
+
+    *channel |= PLM_LZ_CHANNEL_FLAG;
+    return (packedLength);
+}
+
+/*******************************************************************************
+* Name:         plm1lz_input()
+* Description:  Get the data of a received packet, decompressed if necessary.
+* Parameters:   packet: Packet returned by plm1_receive(), or by the layer
+*                       below.
+*               length: Length of the packet.
+*               channel: Channel of the packet, PLM_LZ_CHANNEL_FLAG is cleared
+*                        in it.
+*               data: Array of PLM_LZ_MAX_INPUT bytes to which the data is
+*                     copied.
+* Return:       Length of the data, 0 if a compressed packet is corrupted.
+* Note:
+*******************************************************************************/
+uint8_t plm1lz_input(const uint8_t* packet, uint8_t length, uint8_t* channel, uint8_t* data)
+{
+    if(*channel & PLM_LZ_CHANNEL_FLAG)
+    {
+        *channel &= ~PLM_LZ_CHANNEL_FLAG;
+        return (plm1lz_decompress(packet, length, data, PLM_LZ_MAX_INPUT));
+    }
+
+    if(length > PLM_LZ_MAX_INPUT)
+    {
+        return (0);
+    }
+    memcpy(data, packet, length);
+
+    return (length);
+}
+
+/*******************************************************************************
+* Name:         plm1lz_send()
+* Description:  Send a packet on the powerline, compressed when it saves space.
+* Parameters:   plm: Driver instance.
+*               data: Data to send.
+*               length: Length of the data array (up to PLM_LZ_MAX_INPUT).
+*               prio: Packet priority.
+*               channel: Channel number used to send packet (PLM_LZ_CHANNEL_FLAG
+*                        must be clear).
+* Return:       Handle of the packet, PLM_TX_NO_HANDLE if it was not queued.
+* Note:         Data larger than PLM_PACKET_DATA_SIZE is only sent if it
+*               compresses into a single packet.
+*******************************************************************************/
+plm1_tx_handle plm1lz_send(plm1_t* plm, uint8_t* data, uint8_t length, plm1_priority prio, uint8_t channel)
+{
+    uint8_t packet[PLM_PACKET_DATA_SIZE];
+    uint8_t packedLength;
+
+    packedLength = plm1lz_pack(data, length, packet, &channel);
+    if(packedLength > 0)
+    {
+        return (plm1_send_packet(plm, packet, packedLength, prio, channel, false));
+    }
+
+    return (plm1_send_packet(plm, data, length, prio, channel, false));
+}
+
+/*******************************************************************************
+* Name:         plm1lz_receive()
+* Description:  Get received packets, decompressed if necessary.
+* Parameters:   plm: Driver instance.
+*               data: Array of PLM_LZ_MAX_INPUT bytes to which the packet data is
+*                     copied.
+*               prio: Priority of the received packet. NULL value is supported.
+*               channel: Channel on which packet has been received, without
+*                        PLM_LZ_CHANNEL_FLAG. NULL value is supported.
+* Return:       Length of the data loaded in "data", 0 if no packet is available
+*               or a compressed packet is corrupted.
+* Note:
+*******************************************************************************/
+uint8_t plm1lz_receive(plm1_t* plm, uint8_t* data, plm1_priority* prio, uint8_t* channel)
+{
+    uint8_t packet[PLM_PACKET_DATA_SIZE];
+    uint8_t rxChannel;
+    uint8_t length;
+
+    length = plm1_receive(plm, packet, prio, &rxChannel);
+    if(length > 0)
+    {
+        length = plm1lz_input(packet, length, &rxChannel, data);
+        if(channel != NULL)
+        {
+            *channel = rxChannel;
+        }
+    }
+
+    return (length);
+}
@@ -0,0 +1,58 @@
+/*******************************************************************************
+* Filename:     plm1lz.h
+* Description:  File defining the PLM-1 payload compression.
+* Version:      1.0.0
+* Note:         LZ77 variant working inside a single packet. Compressed
+*               packets are flagged by PLM_LZ_CHANNEL_FLAG in the channel
+*               byte; nodes without compression see them on another channel
+*               and ignore them, so mixed networks keep working.
+*
+*               plm1lz_send() and plm1lz_receive() use the driver directly;
+*               plm1agg can send through plm1lz_send(). To stack another
+*               layer below, the packet is built by plm1lz_pack() and sent
+*               by that layer, and the decoded packet is fed to
+*               plm1lz_input().
+*******************************************************************************/
+
+#ifndef _PLM1LZ_H_
+#define _PLM1LZ_H_
+
+#include "plm1.h"
+
+
+/*******************************************************************************
+ * USER PARAMETERS
+ *
+ * Parameters to be modified by the user.
+ ******************************************************************************/
+#define PLM_LZ_MAX_INPUT               128                      // Max size of uncompressed data in bytes.
+#define PLM_LZ_WINDOW                  64                       // Match search window in bytes (up to 256).
+/*******************************************************************************
+ * END OF USER PARAMETERS
+ ******************************************************************************/
+
+#define PLM_LZ_CHANNEL_FLAG            PLM_CHANNEL_LZ_FLAG      // Compressed packet flag, in the channel byte.
+
+/*------------------------------------------------------------------------------
+  Global functions definition
+------------------------------------------------------------------------------*/
+
+// Compress a buffer.
+uint8_t plm1lz_compress(const uint8_t* src, uint8_t length, uint8_t* dst, uint8_t dstSize);
+
+// Decompress a buffer.
+uint8_t plm1lz_decompress(const uint8_t* src, uint8_t length, uint8_t* dst, uint8_t dstSize);
+
+// Build a compressed packet, if it saves space.
+uint8_t plm1lz_pack(const uint8_t* data, uint8_t length, uint8_t* packet, uint8_t* channel);
+
+// Get the data of a received packet, decompressed if necessary.
+uint8_t plm1lz_input(const uint8_t* packet, uint8_t length, uint8_t* channel, uint8_t* data);
+
+// Send a packet, compressed when it saves space.
+plm1_tx_handle plm1lz_send(plm1_t* plm, uint8_t* data, uint8_t length, plm1_priority prio, uint8_t channel);
+
+// Get received packets, decompressed if necessary.
+uint8_t plm1lz_receive(plm1_t* plm, uint8_t* data, plm1_priority* prio, uint8_t* channel);
+
+#endif /* _PLM1LZ_H_ */
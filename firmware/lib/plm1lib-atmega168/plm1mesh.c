@@ -0,0 +1,468 @@
+/*******************************************************************************
+* Filename:     plm1mesh.c
+* Description:  File implementing the PLM-1 multi-hop mesh routing.
+* Version:      1.0.0
+* Note:         Mesh packet: [Destination][Source][Sequence number][Hops][Via][Next hop][Data]
+*               "Hops" counts the repeaters already crossed, "Via" is the node
+*               which sent this copy of the packet and "Next hop" the only
+*               repeater allowed to forward it (PLM_MESH_ANY to flood it).
+*               Repeaters rewrite the three of them in place before handing
+*               the received buffer back to the driver, so forwarding costs no
+*               copy. Every packet heard teaches a route to its source (through
+*               "Via") and to "Via" itself; the shortest route heard lately
+*               wins.
+*******************************************************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "plm1mesh.h"
+
+/*------------------------------------------------------------------------------
+  Local constants declaration
+------------------------------------------------------------------------------*/
+
+// Offsets of the header fields.
+#define MESH_DEST                      0                            // Destination node.
+#define MESH_SRC                       1                            // Source node.
+#define MESH_SEQ                       2                            // Sequence number given by the source.
+#define MESH_HOPS                      3                            // Repeaters crossed.
+#define MESH_VIA                       4                            // Node which sent this copy.
+#define MESH_NEXT                      5                            // Repeater allowed to forward it.
+
+// Parameters tests.
+#if (PLM_MESH_MAX_HOPS < 1) || (PLM_MESH_MAX_HOPS > 15)
+#   error PLM-1 MESH: 'PLM_MESH_MAX_HOPS' must be between 1 and 15!
+#endif
+#if (PLM_MESH_ROUTE_NBR < 1) || (PLM_MESH_ROUTE_NBR > 64)
+#   error PLM-1 MESH: 'PLM_MESH_ROUTE_NBR' must be between 1 and 64!
+#endif
+#if (PLM_MESH_DUP_NBR < 1) || (PLM_MESH_DUP_NBR > 255)
+#   error PLM-1 MESH: 'PLM_MESH_DUP_NBR' must be between 1 and 255!
+#endif
+#if PLM_MESH_ROUTE_TICKS > 32767
+#   error PLM-1 MESH: 'PLM_MESH_ROUTE_TICKS' value is too high!
+#endif
+
+/*------------------------------------------------------------------------------
+  Local functions declaration
+------------------------------------------------------------------------------*/
+
+static plm1mesh_route_t* find_route(plm1mesh_t* mesh, uint8_t dest);
+static void learn_route(plm1mesh_t* mesh, uint8_t dest, uint8_t next, uint8_t hops, uint16_t now);
+static uint8_t next_hop(plm1mesh_t* mesh, uint8_t dest, uint8_t from);
+static bool duplicate(plm1mesh_t* mesh, uint8_t src, uint8_t seq);
+static void forward_packet(plm1mesh_t* mesh, uint8_t* packet, uint8_t length, plm1_priority prio);
+
+/*------------------------------------------------------------------------------
+  Global functions
+------------------------------------------------------------------------------*/
+
+/*******************************************************************************
+* Name:         plm1mesh_init()
+* Description:  Initialize a mesh routing instance.
+* Parameters:   mesh: Instance to initialize.
+*               plm: Driver instance carrying the mesh.
+*               node: Address of this node (0 to 254).
+*               repeater: true if this node forwards packets of other nodes.
+* Return:       None.
+* Note:         If channels are subscribed, PLM_MESH_CHANNEL must be one of
+*               them. All nodes must use the same PLM_MESH_MAX_HOPS.
+*******************************************************************************/
+void plm1mesh_init(plm1mesh_t* mesh, plm1_t* plm, uint8_t node, bool repeater)
+{
+    memset(mesh, 0, sizeof(plm1mesh_t));
+    memset(mesh->routes, PLM_MESH_NO_NODE, sizeof(mesh->routes));
+    memset(mesh->dups, PLM_MESH_NO_NODE, sizeof(mesh->dups));
+    mesh->plm = plm;
+    mesh->node = node;
+    mesh->repeater = repeater;
+}
+
+/*******************************************************************************
+* Name:         plm1mesh_send()
+* Description:  Send data to a node, or to all nodes.
+* Parameters:   mesh: Mesh routing instance.
+*               dest: Destination node, PLM_MESH_BROADCAST for all nodes.
+*               data: Data to send.
+*               length: Length of the data array (up to PLM_MESH_DATA_SIZE).
+* Return:       Handle of the packet, PLM_TX_NO_HANDLE if it was not queued.
+* Note:         The packet goes to the next hop of the route learnt to
+*               "dest"; without route, it is flooded.
+*******************************************************************************/
+plm1_tx_handle plm1mesh_send(plm1mesh_t* mesh, uint8_t dest, const uint8_t* data, uint8_t length)
+{
+    uint8_t packet[PLM_PACKET_DATA_SIZE];
+    plm1_tx_handle handle;
+
+    if((length == 0) || (length > PLM_MESH_DATA_SIZE) || (dest == mesh->node))
+    {
+        return (PLM_TX_NO_HANDLE);
+    }
+
+    packet[MESH_DEST] = dest;
+    packet[MESH_SRC] = mesh->node;
+    packet[MESH_SEQ] = mesh->seq;
+    packet[MESH_HOPS] = 0;
+    packet[MESH_VIA] = mesh->node;
+    packet[MESH_NEXT] = next_hop(mesh, dest, mesh->node);
+    memcpy(&packet[PLM_MESH_HEADER_SIZE], data, length);
+
+    handle = plm1_send_packet(mesh->plm, packet, PLM_MESH_HEADER_SIZE + length, PLM1_PRIO_NORMAL, PLM_MESH_CHANNEL, false);
+    if(handle != PLM_TX_NO_HANDLE)
+    {
+        mesh->seq++;
+        mesh->counters.sent++;
+    }
+
+    return (handle);
+}
+
+/*******************************************************************************
+* Name:         plm1mesh_peek()
+* Description:  Route the received packets, get the next one addressed to this
+*               node.
+* Parameters:   mesh: Mesh routing instance.
+*               length: Length of the data.
+*               src: Source node of the packet.
+* Return:       Data of the packet inside its pool buffer, NULL if no packet
+*               is addressed to this node.
+* Note:         Received packets of PLM_MESH_CHANNEL are taken in order
+*               with plm1_peek_channel(): the ones of other nodes are
+*               forwarded or dropped, and the first one addressed to this
+*               node (or broadcast) is returned. It stays queued until
+*               plm1mesh_release(), and must not be modified since a
+*               broadcast is forwarded on release. Packets of other channels
+*               are left to the application, which reads them with
+*               plm1_receive_channel() or plm1_peek_channel().
+*******************************************************************************/
+uint8_t* plm1mesh_peek(plm1mesh_t* mesh, uint8_t* length, uint8_t* src)
+{
+    uint16_t now = plm1_get_tick(mesh->plm);
+    plm1_priority prio;
+    uint8_t* packet;
+    uint8_t size;
+    bool forward;
+
+    while((packet = plm1_peek_channel(mesh->plm, PLM_MESH_CHANNEL, &size, &prio)) != NULL)
+    {
+        // Packet already returned, not released yet.
+        if(mesh->peeked)
+        {
+            break;
+        }
+
+        // Invalid packet, or one of ours repeated by a neighbour.
+        if((size < PLM_MESH_HEADER_SIZE) || (packet[MESH_SRC] == PLM_MESH_NO_NODE) ||
+           (packet[MESH_VIA] == PLM_MESH_NO_NODE) || (packet[MESH_SRC] == mesh->node))
+        {
+            plm1_release_channel(mesh->plm, PLM_MESH_CHANNEL);
+            continue;
+        }
+
+        // Learn from every copy heard, the shortest route wins.
+        learn_route(mesh, packet[MESH_SRC], packet[MESH_VIA], packet[MESH_HOPS] + 1, now);
+        if(packet[MESH_VIA] != packet[MESH_SRC])
+        {
+            learn_route(mesh, packet[MESH_VIA], packet[MESH_VIA], 1, now);
+        }
+
+        if(duplicate(mesh, packet[MESH_SRC], packet[MESH_SEQ]))
+        {
+            mesh->counters.duplicates++;
+            plm1_release_channel(mesh->plm, PLM_MESH_CHANNEL);
+            continue;
+        }
+
+        // Forward the packets of other nodes meant for this repeater.
+        forward = mesh->repeater && (packet[MESH_DEST] != mesh->node) &&
+                  ((packet[MESH_NEXT] == PLM_MESH_ANY) || (packet[MESH_NEXT] == mesh->node));
+        if(forward && (packet[MESH_HOPS] >= PLM_MESH_MAX_HOPS))
+        {
+            mesh->counters.hop_limit++;
+            forward = false;
+        }
+
+        if((packet[MESH_DEST] == mesh->node) || (packet[MESH_DEST] == PLM_MESH_BROADCAST))
+        {
+            // A broadcast is forwarded once read.
+            mesh->peeked = true;
+            mesh->forward_pending = forward;
+            mesh->counters.delivered++;
+            break;
+        }
+
+        if(forward)
+        {
+            forward_packet(mesh, packet, size, prio);
+        }
+        else
+        {
+            plm1_release_channel(mesh->plm, PLM_MESH_CHANNEL);
+        }
+    }
+
+    if(packet == NULL)
+    {
+        return (NULL);
+    }
+
+    *length = size - PLM_MESH_HEADER_SIZE;
+    *src = packet[MESH_SRC];
+    return (&packet[PLM_MESH_HEADER_SIZE]);
+}
+
+/*******************************************************************************
+* Name:         plm1mesh_release()
+* Description:  Free the packet returned by plm1mesh_peek().
+* Parameters:   mesh: Mesh routing instance.
+* Return:       None.
+* Note:         A broadcast is forwarded instead, in the same buffer.
+*******************************************************************************/
+void plm1mesh_release(plm1mesh_t* mesh)
+{
+    plm1_priority prio;
+    uint8_t* packet;
+    uint8_t size;
+
+    if(!mesh->peeked)
+    {
+        return;
+    }
+    mesh->peeked = false;
+
+    packet = plm1_peek_channel(mesh->plm, PLM_MESH_CHANNEL, &size, &prio);
+    if(packet == NULL)
+    {
+        return;
+    }
+
+    if(mesh->forward_pending)
+    {
+        forward_packet(mesh, packet, size, prio);
+    }
+    else
+    {
+        plm1_release_channel(mesh->plm, PLM_MESH_CHANNEL);
+    }
+    mesh->forward_pending = false;
+}
+
+/*******************************************************************************
+* Name:         plm1mesh_task()
+* Description:  Forget the routes not heard for PLM_MESH_ROUTE_TICKS.
+*               ** This function must be called from the main loop **
+* Parameters:   mesh: Mesh routing instance.
+* Return:       None.
+* Note:         Must be called at least every 65536 - PLM_MESH_ROUTE_TICKS
+*               ticks, before the age of a route wraps. Packets to a
+*               forgotten node are flooded until a new route is heard.
+*******************************************************************************/
+void plm1mesh_task(plm1mesh_t* mesh)
+{
+    uint16_t now = plm1_get_tick(mesh->plm);
+    uint8_t i;
+
+    for(i = 0; i < PLM_MESH_ROUTE_NBR; i++)
+    {
+        if((mesh->routes[i].dest != PLM_MESH_NO_NODE) &&
+           ((uint16_t)(now - mesh->routes[i].heard) >= PLM_MESH_ROUTE_TICKS))
+        {
+            mesh->routes[i].dest = PLM_MESH_NO_NODE;
+        }
+    }
+}
+
+/*******************************************************************************
+* Name:         plm1mesh_get_route()
+* Description:  Get the route learnt to a node.
+* Parameters:   mesh: Mesh routing instance.
+*               dest: Destination node.
+*               next: Neighbour the packets are sent to. NULL value is
+*                     supported.
+*               hops: Transmissions needed to reach "dest". NULL value is
+*                     supported.
+* Return:       true if a route is known, false otherwise.
+* Note:
+*******************************************************************************/
+bool plm1mesh_get_route(plm1mesh_t* mesh, uint8_t dest, uint8_t* next, uint8_t* hops)
+{
+    plm1mesh_route_t* route = find_route(mesh, dest);
+
+    if(route == NULL)
+    {
+        return (false);
+    }
+
+    if(next != NULL)
+    {
+        *next = route->next;
+    }
+    if(hops != NULL)
+    {
+        *hops = route->hops;
+    }
+    return (true);
+}
+
+/*------------------------------------------------------------------------------
+  Local functions
+------------------------------------------------------------------------------*/
+
+/*******************************************************************************
+* Name:         find_route()
+* Description:  Look for the route learnt to a node.
+* Parameters:   mesh: Mesh routing instance.
+*               dest: Destination node.
+* Return:       Route, NULL if none is known.
+* Note:
+*******************************************************************************/
+static plm1mesh_route_t* find_route(plm1mesh_t* mesh, uint8_t dest)
+{
+    uint8_t i;
+
+    if(dest == PLM_MESH_NO_NODE)
+    {
+        return (NULL);
+    }
+
+    for(i = 0; i < PLM_MESH_ROUTE_NBR; i++)
+    {
+        if(mesh->routes[i].dest == dest)
+        {
+            return (&mesh->routes[i]);
+        }
+    }
+
+    return (NULL);
+}
+
+/*******************************************************************************
+* Name:         learn_route()
+* Description:  Learn a route from a packet heard.
+* Parameters:   mesh: Mesh routing instance.
+*               dest: Node reached by the route.
+*               next: Neighbour the packet was heard from.
+*               hops: Transmissions the packet took to get here.
+*               now: Current tick.
+* Return:       None.
+* Note:         A longer route through another neighbour is ignored until the
+*               current one expires. When the table is full, the route heard
+*               the longest time ago is replaced.
+*******************************************************************************/
+static void learn_route(plm1mesh_t* mesh, uint8_t dest, uint8_t next, uint8_t hops, uint16_t now)
+{
+    plm1mesh_route_t* route;
+    uint8_t i;
+
+    if(dest == mesh->node)
+    {
+        return;
+    }
+
+    route = find_route(mesh, dest);
+    if(route == NULL)
+    {
+        route = &mesh->routes[0];
+        for(i = 0; i < PLM_MESH_ROUTE_NBR; i++)
+        {
+            if(mesh->routes[i].dest == PLM_MESH_NO_NODE)
+            {
+                route = &mesh->routes[i];
+                break;
+            }
+            if((uint16_t)(now - mesh->routes[i].heard) > (uint16_t)(now - route->heard))
+            {
+                route = &mesh->routes[i];
+            }
+        }
+    }
+    else if((hops > route->hops) && (next != route->next))
+    {
+        return;
+    }
+
+    route->dest = dest;
+    route->next = next;
+    route->hops = hops;
+    route->heard = now;
+}
+
+/*******************************************************************************
+* Name:         next_hop()
+* Description:  Select the next hop of a packet.
+* Parameters:   mesh: Mesh routing instance.
+*               dest: Destination node.
+*               from: Node the packet comes from.
+* Return:       Next hop, PLM_MESH_ANY to flood the packet.
+* Note:         A route leading back to "from" is not used.
+*******************************************************************************/
+static uint8_t next_hop(plm1mesh_t* mesh, uint8_t dest, uint8_t from)
+{
+    plm1mesh_route_t* route = find_route(mesh, dest);
+
+    if((route == NULL) || (route->next == from))
+    {
+        return (PLM_MESH_ANY);
+    }
+
+    return (route->next);
+}
+
+/*******************************************************************************
+* Name:         duplicate()
+* Description:  Check whether a packet has already been heard, and remember it.
+* Parameters:   mesh: Mesh routing instance.
+*               src: Source node of the packet.
+*               seq: Sequence number of the packet.
+* Return:       true if the packet has already been heard.
+* Note:         The PLM_MESH_DUP_NBR last packets are remembered.
+*******************************************************************************/
+static bool duplicate(plm1mesh_t* mesh, uint8_t src, uint8_t seq)
+{
+    uint8_t i;
+
+    for(i = 0; i < PLM_MESH_DUP_NBR; i++)
+    {
+        if((mesh->dups[i].src == src) && (mesh->dups[i].seq == seq))
+        {
+            return (true);
+        }
+    }
+
+    mesh->dups[mesh->dup_index].src = src;
+    mesh->dups[mesh->dup_index].seq = seq;
+    if(++mesh->dup_index >= PLM_MESH_DUP_NBR)
+    {
+        mesh->dup_index = 0;
+    }
+
+    return (false);
+}
+
+/*******************************************************************************
+* Name:         forward_packet()
+* Description:  Forward the oldest received packet, in its own buffer.
+* Parameters:   mesh: Mesh routing instance.
+*               packet: Packet returned by plm1_peek_channel().
+*               length: Length of the packet.
+*               prio: Priority of the packet, kept.
+* Return:       None.
+* Note:         The packet is dropped if the transmission queue is full.
+*******************************************************************************/
+static void forward_packet(plm1mesh_t* mesh, uint8_t* packet, uint8_t length, plm1_priority prio)
+{
+    packet[MESH_NEXT] = next_hop(mesh, packet[MESH_DEST], packet[MESH_VIA]);
+    packet[MESH_VIA] = mesh->node;
+    packet[MESH_HOPS]++;
+
+    if(plm1_forward_channel(mesh->plm, PLM_MESH_CHANNEL, length, prio, PLM_MESH_CHANNEL) != PLM_TX_NO_HANDLE)
+    {
+        mesh->counters.forwarded++;
+    }
+    else
+    {
+        mesh->counters.no_buffer++;
+        plm1_release_channel(mesh->plm, PLM_MESH_CHANNEL);
+    }
+}
@@ -0,0 +1,106 @@
+/*******************************************************************************
+* Filename:     plm1mesh.h
+* Description:  File defining the PLM-1 multi-hop mesh routing.
+* Version:      1.0.0
+* Note:         Optional routing layer built on plm1_send_packet() and the
+*               zero-copy reception functions. Nodes out of reach of each
+*               other talk through repeater nodes, which forward the packets
+*               of PLM_MESH_CHANNEL up to PLM_MESH_MAX_HOPS times. Packets
+*               are flooded until a route to their destination has been
+*               learnt from the traffic heard; they are then addressed to the
+*               next hop of that route only. One plm1mesh_t instance serves
+*               one driver instance.
+*******************************************************************************/
+
+#ifndef _PLM1MESH_H_
+#define _PLM1MESH_H_
+
+#include "plm1.h"
+
+
+/*******************************************************************************
+ * USER PARAMETERS
+ *
+ * Parameters to be modified by the user.
+ ******************************************************************************/
+#define PLM_MESH_CHANNEL               12                       // Channel of the mesh packets.
+#define PLM_MESH_MAX_HOPS              4                        // Max nb of repeaters crossed by a packet.
+#define PLM_MESH_ROUTE_NBR             8                        // Nb of routes learnt.
+#define PLM_MESH_ROUTE_TICKS           30000                    // Ticks a route is kept without being heard again.
+#define PLM_MESH_DUP_NBR               16                       // Nb of packets remembered to drop duplicates.
+/*******************************************************************************
+ * END OF USER PARAMETERS
+ ******************************************************************************/
+
+#define PLM_MESH_HEADER_SIZE           6                        // Destination + Source + Sequence number + Hops + Via + Next hop.
+#define PLM_MESH_DATA_SIZE             (PLM_PACKET_DATA_SIZE-PLM_MESH_HEADER_SIZE) // Size allowed for data into packet.
+#define PLM_MESH_BROADCAST             0xFF                     // Destination of a packet sent to all nodes.
+#define PLM_MESH_ANY                   0xFF                     // Next hop of a flooded packet, forwarded by all repeaters.
+#define PLM_MESH_NO_NODE               0xFF                     // Free route slot.
+
+/*------------------------------------------------------------------------------
+  Global types definition
+------------------------------------------------------------------------------*/
+
+// Learnt route.
+typedef struct _plm1mesh_route_t_ {
+    uint8_t dest;                                               // Destination node (PLM_MESH_NO_NODE if the slot is free).
+    uint8_t next;                                               // Neighbour to send the packets to.
+    uint8_t hops;                                               // Transmissions needed to reach the destination.
+    uint16_t heard;                                             // Tick when the route was last heard.
+} plm1mesh_route_t;
+
+// Packet remembered to drop its duplicates.
+typedef struct _plm1mesh_dup_t_ {
+    uint8_t src;                                                // Source node.
+    uint8_t seq;                                                // Sequence number given by the source.
+} plm1mesh_dup_t;
+
+// Mesh routing counters.
+typedef struct _plm1mesh_counters_ {
+    uint16_t sent;                                              // Packets sent by this node.
+    uint16_t delivered;                                         // Packets delivered to this node.
+    uint16_t forwarded;                                         // Packets forwarded for other nodes.
+    uint16_t duplicates;                                        // Packets heard again and dropped.
+    uint16_t hop_limit;                                         // Packets not forwarded, hop limit reached.
+    uint16_t no_buffer;                                         // Packets not forwarded, transmission queue full.
+} plm1mesh_counters;
+
+// Mesh routing instance (one per driver instance).
+typedef struct _plm1mesh_t_ {
+    plm1_t* plm;                                                // Driver instance carrying the mesh.
+    uint8_t node;                                               // Address of this node.
+    bool repeater;                                              // true if this node forwards packets of other nodes.
+    uint8_t seq;                                                // Sequence number of the next packet sent.
+    bool peeked;                                                // Packet returned by plm1mesh_peek() not released yet.
+    bool forward_pending;                                       // That packet is forwarded on release.
+    plm1mesh_route_t routes[PLM_MESH_ROUTE_NBR];                // Routes learnt.
+    plm1mesh_dup_t dups[PLM_MESH_DUP_NBR];                      // Packets heard lately.
+    uint8_t dup_index;                                          // Next entry of "dups" replaced.
+    plm1mesh_counters counters;                                 // Counters.
+} plm1mesh_t;
+
+/*------------------------------------------------------------------------------
+  Global functions definition
+------------------------------------------------------------------------------*/
+
+// Initialize a mesh routing instance.
+void plm1mesh_init(plm1mesh_t* mesh, plm1_t* plm, uint8_t node, bool repeater);
+
+// Send data to a node, or to all nodes.
+plm1_tx_handle plm1mesh_send(plm1mesh_t* mesh, uint8_t dest, const uint8_t* data, uint8_t length);
+
+// Route the received packets, get the next one addressed to this node.
+uint8_t* plm1mesh_peek(plm1mesh_t* mesh, uint8_t* length, uint8_t* src);
+
+// Free the packet returned by plm1mesh_peek().
+void plm1mesh_release(plm1mesh_t* mesh);
+
+// Forget the routes not heard for PLM_MESH_ROUTE_TICKS.
+// ** This function must be called from the main loop **
+void plm1mesh_task(plm1mesh_t* mesh);
+
+// Get the route learnt to a node.
+bool plm1mesh_get_route(plm1mesh_t* mesh, uint8_t dest, uint8_t* next, uint8_t* hops);
+
+#endif /* _PLM1MESH_H_ */
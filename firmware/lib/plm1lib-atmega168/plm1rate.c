@@ -0,0 +1,374 @@
+/*******************************************************************************
+* Filename:     plm1rate.c
+* Description:  File implementing the PLM-1 link rate adaptation.
+* Version:      1.0.0
+* Note:         Control packet format: [Magic][Profile][Delay LSB][Delay MSB]
+*               Delay is the number of ticks left before the switch, 0 in
+*               the periodic announces of the profile in use.
+*               The link is measured on the link counters of the driver,
+*               which plm1_clear_stats() does not touch.
+*******************************************************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+#include "plm1rate.h"
+
+/*------------------------------------------------------------------------------
+  Local constants declaration
+------------------------------------------------------------------------------*/
+
+// Parameters tests.
+#if (PLM_RATE_PROFILE_NBR < 1) || (PLM_RATE_PROFILE_NBR > 16)
+#   error PLM-1 RATE: 'PLM_RATE_PROFILE_NBR' must be between 1 and 16!
+#endif
+#if PLM_RATE_BASE_PROFILE >= PLM_RATE_PROFILE_NBR
+#   error PLM-1 RATE: 'PLM_RATE_BASE_PROFILE' value is too high!
+#endif
+#if PLM_RATE_ANNOUNCE_REPEAT < 1
+#   error PLM-1 RATE: 'PLM_RATE_ANNOUNCE_REPEAT' value is too low!
+#endif
+#if PLM_RATE_ANNOUNCE_PERIOD >= PLM_RATE_FALLBACK_TIMEOUT
+#   error PLM-1 RATE: 'PLM_RATE_ANNOUNCE_PERIOD' must be shorter than 'PLM_RATE_FALLBACK_TIMEOUT'!
+#endif
+
+// Profiles tests, each entry of PLM_RATE_PROFILES passed to the macros below.
+#define RATE_PROFILE_COUNT(_xdiv, _cpb, _cpt0, _cpt1)       + 1
+#define RATE_PROFILE_INVALID(_xdiv, _cpb, _cpt0, _cpt1)     + !PLM_CFG_PROFILE_VALID(_xdiv, _cpb, _cpt0, _cpt1)
+#if (0 PLM_RATE_PROFILES(RATE_PROFILE_COUNT)) != PLM_RATE_PROFILE_NBR
+#   error PLM-1 RATE: 'PLM_RATE_PROFILE_NBR' does not match the entries of 'PLM_RATE_PROFILES'!
+#endif
+#if (0 PLM_RATE_PROFILES(RATE_PROFILE_INVALID)) != 0
+#   error PLM-1 RATE: an entry of 'PLM_RATE_PROFILES' is out of range (see PLM_CFG_PROFILE_VALID())!
+#endif
+
+// Configuration profiles, complete but the CRC nibble.
+#define RATE_PROFILE_STRING(_xdiv, _cpb, _cpt0, _cpt1)      PLM_CFG_PROFILE(_xdiv, _cpb, _cpt0, _cpt1),
+static const uint8_t rate_profiles[PLM_RATE_PROFILE_NBR][PLM_CONFIG_DATA_LENGTH] PROGMEM = {
+    PLM_RATE_PROFILES(RATE_PROFILE_STRING)
+};
+
+/*------------------------------------------------------------------------------
+  Local functions declaration
+------------------------------------------------------------------------------*/
+
+static void apply_profile(plm1rate_t* rate, uint8_t profile, uint16_t now);
+static void announce_profile(plm1rate_t* rate, uint8_t profile, uint16_t now);
+static void send_announce(plm1rate_t* rate, uint16_t now);
+static void evaluate_link(plm1rate_t* rate, const plm1_link_counters* link, uint16_t now);
+
+/*------------------------------------------------------------------------------
+  Global functions
+------------------------------------------------------------------------------*/
+
+/*******************************************************************************
+* Name:         plm1rate_init()
+* Description:  Initialize the rate adaptation and configure PLM-1 with the base
+*               profile.
+* Parameters:   rate: Rate adaptation instance.
+*               plm: Driver instance whose profile is adapted.
+*               controller: true on the node deciding the switches (one per
+*                           network), false on the other nodes.
+* Return:       None.
+* Note:         plm1_init() must have been called. The application must
+*               subscribe PLM_RATE_CHANNEL and feed its packets to
+*               plm1rate_input().
+*******************************************************************************/
+void plm1rate_init(plm1rate_t* rate, plm1_t* plm, bool controller)
+{
+    memset(rate, 0, sizeof(plm1rate_t));
+    rate->plm = plm;
+    rate->controller = controller;
+    apply_profile(rate, PLM_RATE_BASE_PROFILE, plm1_get_tick(plm));
+}
+
+/*******************************************************************************
+* Name:         plm1rate_task()
+* Description:  Evaluate the link, announce and apply profile switches.
+*               ** This function must be called from the main loop **
+* Parameters:   rate: Rate adaptation instance.
+* Return:       None.
+* Note:
+*******************************************************************************/
+void plm1rate_task(plm1rate_t* rate)
+{
+    plm1_link_counters link;
+    plm1_cfg_result result;
+    uint16_t now = plm1_get_tick(rate->plm);
+
+    // Follow the configuration of the new profile.
+    if(rate->configuring)
+    {
+        result = plm1_configure_poll(rate->plm);
+        if(result == PLM1_CFG_IN_PROGRESS)
+        {
+            return;
+        }
+        rate->configuring = false;
+        if(result == PLM1_CFG_FAILED)
+        {
+            // Profile rejected, go back to the base profile.
+            rate->counters.config_failures++;
+            if(rate->profile != PLM_RATE_BASE_PROFILE)
+            {
+                apply_profile(rate, PLM_RATE_BASE_PROFILE, now);
+            }
+            return;
+        }
+    }
+
+    // Network still heard?
+    plm1_get_link_counters(rate->plm, &link);
+    if(link.rx_packets != rate->rx_packets)
+    {
+        rate->rx_packets = link.rx_packets;
+        rate->last_rx = now;
+    }
+
+    if(rate->target != PLM_RATE_NO_PROFILE)
+    {
+        // Switch pending: repeat the announce, then apply it.
+        if(rate->controller && (rate->announces > 0) &&
+           ((uint16_t)(now - rate->announced) >= (PLM_RATE_SWITCH_DELAY / (PLM_RATE_ANNOUNCE_REPEAT + 1))))
+        {
+            send_announce(rate, now);
+        }
+        if((int16_t)(now - rate->switch_at) >= 0)
+        {
+            if(rate->target == rate->profile)
+            {
+                // Announce of the profile in use.
+                rate->target = PLM_RATE_NO_PROFILE;
+            }
+            else
+            {
+                rate->counters.switches++;
+                apply_profile(rate, rate->target, now);
+            }
+        }
+    }
+    else if((rate->profile != PLM_RATE_BASE_PROFILE) &&
+            ((uint16_t)(now - rate->last_rx) >= PLM_RATE_FALLBACK_TIMEOUT))
+    {
+        // Switch missed by this node or by the others, meet on the base profile.
+        rate->counters.fallbacks++;
+        apply_profile(rate, PLM_RATE_BASE_PROFILE, now);
+    }
+    else if(rate->controller)
+    {
+        if((uint16_t)(now - rate->window_start) >= PLM_RATE_WINDOW)
+        {
+            evaluate_link(rate, &link, now);
+        }
+        if((rate->target == PLM_RATE_NO_PROFILE) && ((uint16_t)(now - rate->announced) >= PLM_RATE_ANNOUNCE_PERIOD))
+        {
+            send_announce(rate, now);
+        }
+    }
+}
+
+/*******************************************************************************
+* Name:         plm1rate_input()
+* Description:  Feed a packet received on PLM_RATE_CHANNEL.
+* Parameters:   rate: Rate adaptation instance.
+*               packet: Packet returned by plm1_receive_channel().
+*               length: Length of the packet.
+* Return:       None.
+* Note:         The switch is scheduled so that all nodes apply it at the time
+*               chosen by the controller. An announce of the profile in use
+*               is applied at once if this node is on another one.
+*******************************************************************************/
+void plm1rate_input(plm1rate_t* rate, const uint8_t* packet, uint8_t length)
+{
+    uint16_t delay;
+
+    if((length != PLM_RATE_PACKET_SIZE) || (packet[0] != PLM_RATE_MAGIC) ||
+       (packet[1] >= PLM_RATE_PROFILE_NBR) || rate->controller)
+    {
+        return;
+    }
+
+    delay = packet[2] | ((uint16_t)packet[3] << 8);
+    rate->target = packet[1];
+    rate->switch_at = plm1_get_tick(rate->plm) + delay;
+}
+
+/*******************************************************************************
+* Name:         plm1rate_set_profile()
+* Description:  Announce a switch to a profile.
+* Parameters:   rate: Rate adaptation instance.
+*               profile: Profile index (0 is the slowest).
+* Return:       true if the switch has been scheduled, false if this node is not
+*               the controller, a switch is pending or the profile is invalid.
+* Note:
+*******************************************************************************/
+bool plm1rate_set_profile(plm1rate_t* rate, uint8_t profile)
+{
+    if(!rate->controller || (rate->target != PLM_RATE_NO_PROFILE) || (profile >= PLM_RATE_PROFILE_NBR))
+    {
+        return (false);
+    }
+
+    announce_profile(rate, profile, plm1_get_tick(rate->plm));
+
+    return (true);
+}
+
+/*******************************************************************************
+* Name:         plm1rate_get_profile()
+* Description:  Get the profile in use.
+* Parameters:   rate: Rate adaptation instance.
+* Return:       Profile index (0 is the slowest).
+* Note:
+*******************************************************************************/
+uint8_t plm1rate_get_profile(plm1rate_t* rate)
+{
+    return (rate->profile);
+}
+
+/*******************************************************************************
+* Name:         plm1rate_get_counters()
+* Description:  Get rate adaptation counters.
+* Parameters:   rate: Rate adaptation instance.
+*               counters: Struct used to return the counters.
+* Return:       None.
+* Note:
+*******************************************************************************/
+void plm1rate_get_counters(plm1rate_t* rate, plm1rate_counters* counters)
+{
+    *counters = rate->counters;
+}
+
+/*------------------------------------------------------------------------------
+  Local functions
+------------------------------------------------------------------------------*/
+
+/*******************************************************************************
+* Name:         apply_profile()
+* Description:  Start configuring PLM-1 with a profile.
+* Parameters:   rate: Rate adaptation instance.
+*               profile: Profile index.
+*               now: Current tick.
+* Return:       None.
+* Note:         Packets queued for transmission are lost by the
+*               reconfiguration.
+*******************************************************************************/
+static void apply_profile(plm1rate_t* rate, uint8_t profile, uint16_t now)
+{
+    uint8_t cfg[PLM_CONFIG_DATA_LENGTH];
+
+    memcpy_P(cfg, rate_profiles[profile], PLM_CONFIG_DATA_LENGTH);
+    plm1_cfg_finalize(cfg);
+    plm1_configure_start(rate->plm, cfg, NULL);
+
+    rate->configuring = true;
+    rate->profile = profile;
+    rate->target = PLM_RATE_NO_PROFILE;
+
+    // Restart link evaluation on the new profile, and the period of the
+    // announces of the profile in use.
+    plm1_get_link_counters(rate->plm, &rate->link);
+    rate->window_start = now;
+    rate->last_rx = now;
+    rate->announced = now;
+    rate->clean_windows = 0;
+}
+
+/*******************************************************************************
+* Name:         announce_profile()
+* Description:  Schedule a switch and start announcing it.
+* Parameters:   rate: Rate adaptation instance.
+*               profile: Profile index.
+*               now: Current tick.
+* Return:       None.
+* Note:
+*******************************************************************************/
+static void announce_profile(plm1rate_t* rate, uint8_t profile, uint16_t now)
+{
+    rate->target = profile;
+    rate->switch_at = now + PLM_RATE_SWITCH_DELAY;
+    rate->announces = PLM_RATE_ANNOUNCE_REPEAT;
+    send_announce(rate, now);
+}
+
+/*******************************************************************************
+* Name:         send_announce()
+* Description:  Queue an announce of the pending switch, or of the profile in
+*               use if none is pending.
+* Parameters:   rate: Rate adaptation instance.
+*               now: Current tick.
+* Return:       None.
+* Note:         When the transmission buffer is full, the announce is retried
+*               on the next plm1rate_task() call.
+*******************************************************************************/
+static void send_announce(plm1rate_t* rate, uint16_t now)
+{
+    uint8_t packet[PLM_RATE_PACKET_SIZE];
+    uint16_t delay = 0;
+
+    packet[0] = PLM_RATE_MAGIC;
+    packet[1] = rate->profile;
+    if(rate->target != PLM_RATE_NO_PROFILE)
+    {
+        packet[1] = rate->target;
+        delay = rate->switch_at - now;
+    }
+    packet[2] = (uint8_t)delay;
+    packet[3] = (uint8_t)(delay >> 8);
+
+    if(plm1_send_packet(rate->plm, packet, PLM_RATE_PACKET_SIZE, PLM1_PRIO_HIGHEST, PLM_RATE_CHANNEL, false))
+    {
+        if(rate->target != PLM_RATE_NO_PROFILE)
+        {
+            rate->announces--;
+        }
+        rate->announced = now;
+        rate->counters.announces++;
+    }
+}
+
+/*******************************************************************************
+* Name:         evaluate_link()
+* Description:  Compare the error rate of the last window with the thresholds
+*               and announce a switch if needed.
+* Parameters:   rate: Rate adaptation instance.
+*               link: Current link counters.
+*               now: Current tick.
+* Return:       None.
+* Note:         Errors are receive errors and collisions. The counters wrap,
+*               so that their differences are exact over a window.
+*******************************************************************************/
+static void evaluate_link(plm1rate_t* rate, const plm1_link_counters* link, uint16_t now)
+{
+    uint16_t windowErrors = link->errors - rate->link.errors;
+    uint16_t windowTx = link->tx_packets - rate->link.tx_packets;
+    uint16_t windowRx = link->rx_packets - rate->link.rx_packets;
+    uint32_t windowPackets = (uint32_t)windowTx + windowRx;
+
+    rate->link = *link;
+    rate->window_start = now;
+
+    if(((uint32_t)windowErrors * 100 > (uint32_t)PLM_RATE_DOWN_PERCENT * windowPackets) && (windowErrors > 0))
+    {
+        // Too many errors, slow down.
+        rate->clean_windows = 0;
+        if(rate->profile > 0)
+        {
+            announce_profile(rate, rate->profile - 1, now);
+        }
+    }
+    else if((windowErrors == 0) && (windowPackets >= PLM_RATE_UP_MIN_PACKETS))
+    {
+        // Clean window, speed up after enough of them.
+        if((++rate->clean_windows >= PLM_RATE_UP_WINDOWS) && (rate->profile < (PLM_RATE_PROFILE_NBR - 1)))
+        {
+            rate->clean_windows = 0;
+            announce_profile(rate, rate->profile + 1, now);
+        }
+    }
+    else
+    {
+        rate->clean_windows = 0;
+    }
+}
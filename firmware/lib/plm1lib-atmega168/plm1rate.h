@@ -0,0 +1,103 @@
+/*******************************************************************************
+* Filename:     plm1rate.h
+* Description:  File defining the PLM-1 link rate adaptation.
+* Version:      1.0.0
+* Note:         One controller node watches the receive error and collision
+*               rates and moves the whole network between precomputed
+*               configuration profiles. The switch is announced on a control
+*               channel and applied by all nodes at the same time; a node
+*               that stops hearing the network falls back to the base profile.
+*               The controller also announces the profile in use every
+*               PLM_RATE_ANNOUNCE_PERIOD, so that the nodes of a quiet
+*               network keep hearing it and do not fall back. One plm1rate_t
+*               instance serves one driver instance.
+*******************************************************************************/
+
+#ifndef _PLM1RATE_H_
+#define _PLM1RATE_H_
+
+#include "plm1.h"
+
+
+/*******************************************************************************
+ * USER PARAMETERS
+ *
+ * Parameters to be modified by the user.
+ ******************************************************************************/
+#define PLM_RATE_PROFILES(_profile)                             /* Profiles, slowest first: _profile(XDIV, CPB, CPT0, CPT1). */ \
+    _profile(XDIV, 72, CPT0, CPT1)                                             \
+    _profile(XDIV, CPB, CPT0, CPT1)                                            \
+    _profile(XDIV, 18, CPT0, CPT1)
+#define PLM_RATE_PROFILE_NBR           3                        // Nb of profiles in PLM_RATE_PROFILES.
+#define PLM_RATE_BASE_PROFILE          1                        // Profile used at boot and as fallback.
+#define PLM_RATE_CHANNEL               15                       // Channel of the rate control packets.
+#define PLM_RATE_WINDOW                1000                     // Ticks between two rate evaluations.
+#define PLM_RATE_DOWN_PERCENT          10                       // Errors per 100 packets moving to a slower profile.
+#define PLM_RATE_UP_WINDOWS            5                        // Error free windows before moving to a faster profile.
+#define PLM_RATE_UP_MIN_PACKETS        20                       // Min packets in a window for it to count as error free.
+#define PLM_RATE_SWITCH_DELAY          200                      // Ticks between the first announce and the switch.
+#define PLM_RATE_ANNOUNCE_REPEAT       3                        // Nb of announces sent before a switch.
+#define PLM_RATE_FALLBACK_TIMEOUT      5000                     // Ticks without reception before falling back.
+#define PLM_RATE_ANNOUNCE_PERIOD       2000                     // Ticks between two announces of the profile in use.
+/*******************************************************************************
+ * END OF USER PARAMETERS
+ ******************************************************************************/
+
+#define PLM_RATE_PACKET_SIZE           4                        // Magic + Profile + Delay (2 bytes).
+#define PLM_RATE_MAGIC                 0xA7                     // First byte of a rate control packet.
+#define PLM_RATE_NO_PROFILE            0xFF                     // No profile switch pending.
+
+/*------------------------------------------------------------------------------
+  Global types definition
+------------------------------------------------------------------------------*/
+
+// Rate adaptation counters.
+typedef struct _plm1rate_counters_ {
+    uint16_t switches;                                          // Profile switches applied.
+    uint16_t fallbacks;                                         // Fallbacks to the base profile.
+    uint16_t config_failures;                                   // Profiles PLM-1 did not accept.
+    uint16_t announces;                                         // Announces sent (controller).
+} plm1rate_counters;
+
+// Rate adaptation instance (one per driver instance).
+typedef struct _plm1rate_t_ {
+    plm1_t* plm;                                                // Driver instance whose profile is adapted.
+    bool controller;                                            // true if this node decides the switches.
+    bool configuring;                                           // PLM-1 configuration in progress.
+    uint8_t profile;                                            // Profile in use.
+    uint8_t target;                                             // Profile to switch to (PLM_RATE_NO_PROFILE if none).
+    uint16_t switch_at;                                         // Tick of the switch.
+    uint8_t announces;                                          // Announces of the switch left to send.
+    uint16_t announced;                                         // Tick of the last announce.
+    uint16_t window_start;                                      // Tick of the current evaluation window.
+    uint8_t clean_windows;                                      // Consecutive error free windows.
+    plm1_link_counters link;                                    // Link counters at window start.
+    uint16_t rx_packets;                                        // Received packets at last check.
+    uint16_t last_rx;                                           // Tick of the last received packet.
+    plm1rate_counters counters;                                 // Counters.
+} plm1rate_t;
+
+/*------------------------------------------------------------------------------
+  Global functions definition
+------------------------------------------------------------------------------*/
+
+// Initialize the rate adaptation.
+void plm1rate_init(plm1rate_t* rate, plm1_t* plm, bool controller);
+
+// Evaluate the link, announce and apply profile switches.
+// ** This function must be called from the main loop **
+void plm1rate_task(plm1rate_t* rate);
+
+// Feed a packet received on PLM_RATE_CHANNEL.
+void plm1rate_input(plm1rate_t* rate, const uint8_t* packet, uint8_t length);
+
+// Announce a switch to a profile (controller only).
+bool plm1rate_set_profile(plm1rate_t* rate, uint8_t profile);
+
+// Get the profile in use.
+uint8_t plm1rate_get_profile(plm1rate_t* rate);
+
+// Get rate adaptation counters.
+void plm1rate_get_counters(plm1rate_t* rate, plm1rate_counters* counters);
+
+#endif /* _PLM1RATE_H_ */
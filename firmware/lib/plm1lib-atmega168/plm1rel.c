@@ -0,0 +1,466 @@
+/*******************************************************************************
+* Filename:     plm1rel.c
+* Description:  File implementing the PLM-1 reliable transport.
+* Version:      1.0.0
+* Note:         Data packet:        [DATA][Sequence number][Data]
+*               Acknowledge packet: [ACK][Cumulative ACK][Selective ACK bitmap]
+*               The cumulative ACK is the next sequence number expected by the
+*               receiver; bit i of the bitmap acknowledges sequence number
+*               (cumulative ACK + 1 + i).
+*******************************************************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "plm1rel.h"
+
+/*------------------------------------------------------------------------------
+  Local constants declaration
+------------------------------------------------------------------------------*/
+
+// Packet types.
+#define REL_TYPE_DATA                  0x01                         // Data packet.
+#define REL_TYPE_ACK                   0x02                         // Acknowledge packet.
+
+#define REL_ACK_SIZE                   3                            // Size of an acknowledge packet.
+#define REL_SACK_BITS                  8                            // Sequence numbers covered by the bitmap.
+
+// Parameters tests.
+#if (PLM_REL_MAX_WINDOW < 1) || (PLM_REL_MAX_WINDOW > 8) || (PLM_REL_MAX_WINDOW & (PLM_REL_MAX_WINDOW - 1))
+#   error PLM-1 RELIABLE TRANSPORT: 'PLM_REL_MAX_WINDOW' must be a power of 2 lower or equal to 8!
+#endif
+
+/*------------------------------------------------------------------------------
+  Local macros declaration
+------------------------------------------------------------------------------*/
+
+// Get window slot of a sequence number.
+#define SLOT(_seq)                                                             \
+    ((uint8_t)(_seq) % PLM_REL_MAX_WINDOW)
+
+/*------------------------------------------------------------------------------
+  Local functions declaration
+------------------------------------------------------------------------------*/
+
+static bool send_data(plm1rel_t* rel, uint8_t seq, uint16_t now);
+static bool send_ack(plm1rel_t* rel);
+static void ack_received(plm1rel_t* rel, uint8_t cumAck, uint8_t sack);
+static void update_rtt(plm1rel_t* rel, uint16_t rtt);
+static void reset_rto(plm1rel_t* rel);
+
+/*------------------------------------------------------------------------------
+  Global functions
+------------------------------------------------------------------------------*/
+
+/*******************************************************************************
+* Name:         plm1rel_init()
+* Description:  Initialize a reliable transport instance.
+* Parameters:   rel: Instance to initialize.
+*               plm: Driver instance carrying the channel.
+*               channel: Channel served by this instance.
+*               window: Send window in packets (1 to PLM_REL_MAX_WINDOW). A
+*                       window of 1 gives a stop-and-wait transport.
+* Return:       None.
+* Note:         Both ends of a channel must use the same PLM_REL_MAX_WINDOW.
+*******************************************************************************/
+void plm1rel_init(plm1rel_t* rel, plm1_t* plm, uint8_t channel, uint8_t window)
+{
+    memset(rel, 0, sizeof(plm1rel_t));
+    rel->plm = plm;
+    rel->channel = channel;
+    rel->window = ((window == 0) || (window > PLM_REL_MAX_WINDOW)) ? PLM_REL_MAX_WINDOW : window;
+    rel->rto = PLM_REL_INIT_RTO;
+}
+
+/*******************************************************************************
+* Name:         plm1rel_send()
+* Description:  Queue data for reliable delivery.
+* Parameters:   rel: Transport instance.
+*               data: Data to send.
+*               length: Length of the data array (up to PLM_REL_DATA_SIZE).
+* Return:       true if the data has been queued, false if the send window is
+*               full or the length is invalid.
+* Note:
+*******************************************************************************/
+bool plm1rel_send(plm1rel_t* rel, const uint8_t* data, uint8_t length)
+{
+    plm1rel_tx_slot_t* slot;
+
+    if(((uint8_t)(rel->snd_next - rel->snd_base) >= rel->window) ||
+       (length == 0) || (length > PLM_REL_DATA_SIZE))
+    {
+        return (false);
+    }
+
+    slot = &rel->tx[SLOT(rel->snd_next)];
+    memcpy(slot->data, data, length);
+    slot->length = length;
+    slot->queued = false;
+    slot->retransmitted = false;
+    slot->sacked = false;
+    rel->snd_next++;
+
+    // Send it right now if the driver has room.
+    plm1rel_task(rel);
+
+    return (true);
+}
+
+/*******************************************************************************
+* Name:         plm1rel_input()
+* Description:  Feed a packet received on the instance channel.
+* Parameters:   rel: Transport instance.
+*               packet: Packet returned by plm1_receive().
+*               length: Length of the packet.
+* Return:       None.
+* Note:         Data is stored in the receive window and delivered in order by
+*               plm1rel_receive().
+*******************************************************************************/
+void plm1rel_input(plm1rel_t* rel, const uint8_t* packet, uint8_t length)
+{
+    plm1rel_rx_slot_t* slot;
+    uint8_t offset;
+
+    if((packet[0] == REL_TYPE_ACK) && (length == REL_ACK_SIZE))
+    {
+        ack_received(rel, packet[1], packet[2]);
+    }
+    else if((packet[0] == REL_TYPE_DATA) && (length > PLM_REL_HEADER_SIZE))
+    {
+        offset = packet[1] - rel->rcv_base;
+        slot = &rel->rx[SLOT(packet[1])];
+        if((offset < PLM_REL_MAX_WINDOW) && (slot->length == 0))
+        {
+            slot->length = length - PLM_REL_HEADER_SIZE;
+            memcpy(slot->data, &packet[PLM_REL_HEADER_SIZE], slot->length);
+        }
+        else
+        {
+            // Already received or out of window; acknowledge it again anyway.
+            rel->counters.duplicates++;
+        }
+
+        rel->ack_pending = true;
+        if(send_ack(rel))
+        {
+            rel->ack_pending = false;
+        }
+    }
+}
+
+/*******************************************************************************
+* Name:         plm1rel_receive()
+* Description:  Get data delivered in order.
+* Parameters:   rel: Transport instance.
+*               data: Array of PLM_REL_DATA_SIZE bytes to which data is copied.
+* Return:       Length of the data loaded in "data", 0 if none is available.
+* Note:
+*******************************************************************************/
+uint8_t plm1rel_receive(plm1rel_t* rel, uint8_t* data)
+{
+    plm1rel_rx_slot_t* slot = &rel->rx[SLOT(rel->rcv_base)];
+    uint8_t length = slot->length;
+
+    if(length > 0)
+    {
+        memcpy(data, slot->data, length);
+        slot->length = 0;
+        rel->rcv_base++;
+        rel->counters.delivered++;
+    }
+
+    return (length);
+}
+
+/*******************************************************************************
+* Name:         plm1rel_task()
+* Description:  Send pending acknowledges, queue new packets and retransmit
+*               timed out ones.
+*               ** This function must be called from the main loop **
+* Parameters:   rel: Transport instance.
+* Return:       None.
+* Note:         Selectively acknowledged packets are never retransmitted. The
+*               timeout is doubled after each expiration until a new RTT sample
+*               is measured.
+*******************************************************************************/
+void plm1rel_task(plm1rel_t* rel)
+{
+    plm1rel_tx_slot_t* slot;
+    uint16_t now = plm1_get_tick(rel->plm);
+    bool expired = false;
+    uint8_t seq;
+
+    if(rel->ack_pending && send_ack(rel))
+    {
+        rel->ack_pending = false;
+    }
+
+    for(seq = rel->snd_base; seq != rel->snd_next; seq++)
+    {
+        slot = &rel->tx[SLOT(seq)];
+        if(slot->sacked)
+        {
+            continue;
+        }
+
+        if(!slot->queued)
+        {
+            // First transmission, or fast retransmission requested by a
+            // selective acknowledge.
+            if(!send_data(rel, seq, now))
+            {
+                // Transmission buffer full, retry on next call.
+                break;
+            }
+            slot->queued = true;
+            if(slot->retransmitted)
+            {
+                rel->counters.retransmitted++;
+            }
+            else
+            {
+                rel->counters.sent++;
+            }
+        }
+        else if((uint16_t)(now - slot->sent) >= rel->rto)
+        {
+            // Retransmission timeout.
+            if(!send_data(rel, seq, now))
+            {
+                break;
+            }
+            slot->retransmitted = true;
+            rel->counters.retransmitted++;
+            if(seq == rel->snd_base)
+            {
+                expired = true;
+            }
+        }
+    }
+
+    // Back off the timeout once per expiration of the oldest packet.
+    if(expired)
+    {
+        rel->rto = (rel->rto > (PLM_REL_MAX_RTO / 2)) ? PLM_REL_MAX_RTO : (rel->rto * 2);
+    }
+}
+
+/*******************************************************************************
+* Name:         plm1rel_tx_idle()
+* Description:  Get transport transmitter state.
+* Parameters:   rel: Transport instance.
+* Return:       true if all queued data has been acknowledged, false otherwise.
+* Note:
+*******************************************************************************/
+bool plm1rel_tx_idle(plm1rel_t* rel)
+{
+    return (rel->snd_base == rel->snd_next);
+}
+
+/*------------------------------------------------------------------------------
+  Local functions
+------------------------------------------------------------------------------*/
+
+/*******************************************************************************
+* Name:         send_data()
+* Description:  Hand a packet of the send window over to the driver.
+* Parameters:   rel: Transport instance.
+*               seq: Sequence number of the packet.
+*               now: Current tick.
+* Return:       true if the packet has been queued, false otherwise.
+* Note:
+*******************************************************************************/
+static bool send_data(plm1rel_t* rel, uint8_t seq, uint16_t now)
+{
+    plm1rel_tx_slot_t* slot = &rel->tx[SLOT(seq)];
+    uint8_t packet[PLM_PACKET_DATA_SIZE];
+
+    packet[0] = REL_TYPE_DATA;
+    packet[1] = seq;
+    memcpy(&packet[PLM_REL_HEADER_SIZE], slot->data, slot->length);
+
+    if(!plm1_send_packet(rel->plm, packet, PLM_REL_HEADER_SIZE + slot->length, PLM1_PRIO_NORMAL, rel->channel, false))
+    {
+        return (false);
+    }
+
+    slot->sent = now;
+    return (true);
+}
+
+/*******************************************************************************
+* Name:         send_ack()
+* Description:  Send an acknowledge describing the receive window.
+* Parameters:   rel: Transport instance.
+* Return:       true if the acknowledge has been queued, false otherwise.
+* Note:
+*******************************************************************************/
+static bool send_ack(plm1rel_t* rel)
+{
+    uint8_t packet[REL_ACK_SIZE];
+    uint8_t cumAck = rel->rcv_base;
+    uint8_t sack = 0;
+    uint8_t seq;
+    uint8_t i;
+
+    // First sequence number not yet received.
+    while(((uint8_t)(cumAck - rel->rcv_base) < PLM_REL_MAX_WINDOW) && rel->rx[SLOT(cumAck)].length)
+    {
+        cumAck++;
+    }
+
+    // Packets received beyond the first hole.
+    for(i = 0; i < REL_SACK_BITS; i++)
+    {
+        seq = cumAck + 1 + i;
+        if(((uint8_t)(seq - rel->rcv_base) < PLM_REL_MAX_WINDOW) && rel->rx[SLOT(seq)].length)
+        {
+            sack |= (1 << i);
+        }
+    }
+
+    packet[0] = REL_TYPE_ACK;
+    packet[1] = cumAck;
+    packet[2] = sack;
+
+    return (plm1_send_packet(rel->plm, packet, REL_ACK_SIZE, PLM1_PRIO_HIGH, rel->channel, false));
+}
+
+/*******************************************************************************
+* Name:         ack_received()
+* Description:  Slide the send window according to a received acknowledge.
+* Parameters:   rel: Transport instance.
+*               cumAck: Next sequence number expected by the receiver.
+*               sack: Selective acknowledge bitmap.
+* Return:       None.
+* Note:         The RTT is sampled on the newest packet acknowledged for the
+*               first time, only if it has been sent once (Karn's algorithm).
+*******************************************************************************/
+static void ack_received(plm1rel_t* rel, uint8_t cumAck, uint8_t sack)
+{
+    plm1rel_tx_slot_t* slot;
+    plm1rel_tx_slot_t* sample = NULL;
+    uint8_t acked = cumAck - rel->snd_base;
+    uint8_t seq;
+    uint8_t i;
+
+    // Acknowledge outside the send window?
+    if(acked > (uint8_t)(rel->snd_next - rel->snd_base))
+    {
+        return;
+    }
+
+    // Cumulative acknowledge.
+    for(seq = rel->snd_base; seq != cumAck; seq++)
+    {
+        slot = &rel->tx[SLOT(seq)];
+        if(!slot->sacked)
+        {
+            sample = slot;
+        }
+    }
+
+    // Selective acknowledge.
+    for(i = 0; i < REL_SACK_BITS; i++)
+    {
+        seq = cumAck + 1 + i;
+        slot = &rel->tx[SLOT(seq)];
+        if((sack & (1 << i)) && ((uint8_t)(seq - rel->snd_base) < (uint8_t)(rel->snd_next - rel->snd_base)) &&
+           !slot->sacked)
+        {
+            slot->sacked = true;
+            sample = slot;
+        }
+    }
+
+    if((sample != NULL) && sample->queued && !sample->retransmitted)
+    {
+        update_rtt(rel, plm1_get_tick(rel->plm) - sample->sent);
+    }
+
+    // Slide the window; new data acknowledged cancels the timeout back off.
+    if(acked > 0)
+    {
+        while(rel->snd_base != cumAck)
+        {
+            rel->tx[SLOT(rel->snd_base)].length = 0;
+            rel->snd_base++;
+        }
+        reset_rto(rel);
+    }
+
+    // Packets received beyond a hole: the hole is most likely lost, resend it
+    // once without waiting for the timeout.
+    slot = &rel->tx[SLOT(cumAck)];
+    if(sack && (cumAck != rel->snd_next) && slot->queued && !slot->retransmitted)
+    {
+        slot->queued = false;
+        slot->retransmitted = true;
+    }
+}
+
+/*******************************************************************************
+* Name:         update_rtt()
+* Description:  Update the smoothed RTT with a new sample.
+* Parameters:   rel: Transport instance.
+*               rtt: Measured round trip time in ticks.
+* Return:       None.
+* Note:         SRTT and RTTVAR are smoothed with gains of 1/8 and 1/4
+*               (Jacobson).
+*******************************************************************************/
+static void update_rtt(plm1rel_t* rel, uint16_t rtt)
+{
+    int16_t err;
+
+    if(rtt > PLM_REL_MAX_RTO)
+    {
+        rtt = PLM_REL_MAX_RTO;
+    }
+
+    if(rel->srtt == 0)
+    {
+        // First sample.
+        rel->srtt = rtt << 3;
+        rel->rttvar = rtt << 1;
+    }
+    else
+    {
+        err = (int16_t)rtt - (int16_t)(rel->srtt >> 3);
+        rel->srtt += err;
+        if(err < 0)
+        {
+            err = -err;
+        }
+        rel->rttvar += err - (int16_t)(rel->rttvar >> 2);
+    }
+}
+
+/*******************************************************************************
+* Name:         reset_rto()
+* Description:  Compute the retransmission timeout from the smoothed RTT.
+* Parameters:   rel: Transport instance.
+* Return:       None.
+* Note:         RTO = SRTT + 4 * RTTVAR. Initial timeout is kept until a first
+*               RTT sample is measured.
+*******************************************************************************/
+static void reset_rto(plm1rel_t* rel)
+{
+    uint16_t rto;
+
+    if(rel->srtt == 0)
+    {
+        rel->rto = PLM_REL_INIT_RTO;
+        return;
+    }
+
+    rto = (rel->srtt >> 3) + rel->rttvar;
+    if(rto < PLM_REL_MIN_RTO)
+    {
+        rto = PLM_REL_MIN_RTO;
+    }
+    else if(rto > PLM_REL_MAX_RTO)
+    {
+        rto = PLM_REL_MAX_RTO;
+    }
+    rel->rto = rto;
+}
@@ -0,0 +1,99 @@
+/*******************************************************************************
+* Filename:     plm1rel.h
+* Description:  File defining the PLM-1 reliable transport.
+* Version:      1.0.0
+* Note:         Optional sliding-window transport built on plm1_send_packet()
+*               and plm1_receive(). One plm1rel_t instance serves one channel.
+*******************************************************************************/
+
+#ifndef _PLM1REL_H_
+#define _PLM1REL_H_
+
+#include "plm1.h"
+
+
+/*******************************************************************************
+ * USER PARAMETERS
+ *
+ * Parameters to be modified by the user.
+ ******************************************************************************/
+#define PLM_REL_MAX_WINDOW             4                        // Max send/receive window in packets (up to 8).
+#define PLM_REL_INIT_RTO               200                      // Initial retransmission timeout in ticks.
+#define PLM_REL_MIN_RTO                20                       // Lower bound of the retransmission timeout in ticks.
+#define PLM_REL_MAX_RTO                2000                     // Upper bound of the retransmission timeout in ticks.
+/*******************************************************************************
+ * END OF USER PARAMETERS
+ ******************************************************************************/
+
+#define PLM_REL_HEADER_SIZE            2                        // Packet type + Sequence number.
+#define PLM_REL_DATA_SIZE              (PLM_PACKET_DATA_SIZE-PLM_REL_HEADER_SIZE) // Size allowed for data into packet.
+
+/*------------------------------------------------------------------------------
+  Global types definition
+------------------------------------------------------------------------------*/
+
+// Structure holding a packet of the send window.
+typedef struct _plm1rel_tx_slot_t_ {
+    uint8_t length;                                             // Length of the data, 0 if the slot is free.
+    bool queued;                                                // true once handed over to the driver.
+    bool retransmitted;                                         // true if sent more than once (no RTT sample).
+    bool sacked;                                                // true if selectively acknowledged.
+    uint16_t sent;                                              // Tick of the last transmission.
+    uint8_t data[PLM_REL_DATA_SIZE];                            // Data of the packet.
+} plm1rel_tx_slot_t;
+
+// Structure holding a packet of the receive window.
+typedef struct _plm1rel_rx_slot_t_ {
+    uint8_t length;                                             // Length of the data, 0 if not received.
+    uint8_t data[PLM_REL_DATA_SIZE];                            // Data of the packet.
+} plm1rel_rx_slot_t;
+
+// Reliable transport counters.
+typedef struct _plm1rel_counters_ {
+    uint16_t sent;                                              // Data packets sent for the first time.
+    uint16_t retransmitted;                                     // Data packets retransmitted.
+    uint16_t delivered;                                         // Data packets delivered in order.
+    uint16_t duplicates;                                        // Data packets received twice or out of window.
+} plm1rel_counters;
+
+// Reliable transport instance (one per channel).
+typedef struct _plm1rel_t_ {
+    plm1_t* plm;                                                // Driver instance carrying the channel.
+    uint8_t channel;                                            // Channel served by this instance.
+    uint8_t window;                                             // Send window in packets.
+    uint8_t snd_base;                                           // Oldest unacknowledged sequence number.
+    uint8_t snd_next;                                           // Next sequence number to use.
+    uint16_t srtt;                                              // Smoothed RTT, in ticks x 8.
+    uint16_t rttvar;                                            // RTT variation, in ticks x 4.
+    uint16_t rto;                                               // Retransmission timeout in ticks.
+    uint8_t rcv_base;                                           // Next sequence number to deliver.
+    bool ack_pending;                                           // An acknowledge has to be sent.
+    plm1rel_tx_slot_t tx[PLM_REL_MAX_WINDOW];                   // Send window.
+    plm1rel_rx_slot_t rx[PLM_REL_MAX_WINDOW];                   // Receive window.
+    plm1rel_counters counters;                                  // Counters.
+} plm1rel_t;
+
+/*------------------------------------------------------------------------------
+  Global functions definition
+------------------------------------------------------------------------------*/
+
+// Initialize a reliable transport instance.
+void plm1rel_init(plm1rel_t* rel, plm1_t* plm, uint8_t channel, uint8_t window);
+
+// Queue data for reliable delivery.
+bool plm1rel_send(plm1rel_t* rel, const uint8_t* data, uint8_t length);
+
+// Feed a packet received on the instance channel.
+void plm1rel_input(plm1rel_t* rel, const uint8_t* packet, uint8_t length);
+
+// Get data delivered in order.
+uint8_t plm1rel_receive(plm1rel_t* rel, uint8_t* data);
+
+// Send pending acknowledges and retransmit timed out packets.
+// ** This function must be called from the main loop **
+void plm1rel_task(plm1rel_t* rel);
+
+// Get transport transmitter state.
+bool plm1rel_tx_idle(plm1rel_t* rel);
+
+#endif /* _PLM1REL_H_ */
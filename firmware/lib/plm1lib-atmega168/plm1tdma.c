@@ -0,0 +1,448 @@
+/*******************************************************************************
+* Filename:     plm1tdma.c
+* Description:  File implementing the PLM-1 scheduled access MAC (TDMA).
+* Version:      1.0.0
+* Note:         Beacon format: [Magic][Flags][Owner of slot 2]...[Owner of slot N-1]
+*               Join format:   [Magic][Node]
+*               The coordinator queues the beacon of the next frame when its
+*               slot ends. It is flagged as timed only if nothing is queued
+*               before it, so that it leaves at the very start of the frame.
+*               Its own packets are only queued while they can leave within
+*               slot 0, one at a time, so that none is left ahead of the
+*               beacon when the slot ends, even under a constant backlog.
+*******************************************************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "plm1tdma.h"
+
+/*------------------------------------------------------------------------------
+  Local constants declaration
+------------------------------------------------------------------------------*/
+
+// Parameters tests.
+#if (PLM_TDMA_SLOT_NBR < 3) || (PLM_TDMA_SLOT_NBR > 32)
+#   error PLM-1 TDMA: 'PLM_TDMA_SLOT_NBR' must be between 3 and 32!
+#endif
+#if PLM_TDMA_SLOT_TICKS <= (PLM_TDMA_GUARD_TICKS + PLM_TDMA_TX_TICKS)
+#   error PLM-1 TDMA: 'PLM_TDMA_SLOT_TICKS' is too short to hold a packet!
+#endif
+#if PLM_TDMA_FRAME_TICKS > 32767
+#   error PLM-1 TDMA: frame duration is too long!
+#endif
+#if PLM_TDMA_LEASE_FRAMES < 4
+#   error PLM-1 TDMA: 'PLM_TDMA_LEASE_FRAMES' value is too low!
+#endif
+
+/*------------------------------------------------------------------------------
+  Local functions declaration
+------------------------------------------------------------------------------*/
+
+static void new_frame(plm1tdma_t* tdma);
+static bool gate_open(plm1tdma_t* tdma, uint16_t position);
+static void send_beacon(plm1tdma_t* tdma);
+static void send_join(plm1tdma_t* tdma);
+static void join_received(plm1tdma_t* tdma, uint8_t node);
+static void beacon_received(plm1tdma_t* tdma, const uint8_t* packet, uint16_t now);
+
+/*------------------------------------------------------------------------------
+  Global functions
+------------------------------------------------------------------------------*/
+
+/*******************************************************************************
+* Name:         plm1tdma_init()
+* Description:  Initialize a scheduled access MAC instance.
+* Parameters:   tdma: TDMA instance.
+*               plm: Driver instance scheduled.
+*               node: Address of this node (0 to 254).
+*               coordinator: true on the node sending the beacons (one per
+*                            network), false on the other nodes.
+* Return:       None.
+* Note:         plm1_init() must have been called. The application must
+*               subscribe PLM_TDMA_CHANNEL and feed its packets to
+*               plm1tdma_input() as soon as they are received: the beacons
+*               are timestamped on this call. Until a beacon is heard, nodes
+*               keep using contention access. The application packets are
+*               sent with plm1tdma_send().
+*******************************************************************************/
+void plm1tdma_init(plm1tdma_t* tdma, plm1_t* plm, uint8_t node, bool coordinator)
+{
+    memset(tdma, 0, sizeof(plm1tdma_t));
+    memset(tdma->owners, PLM_TDMA_NO_NODE, sizeof(tdma->owners));
+    tdma->plm = plm;
+    tdma->coordinator = coordinator;
+    tdma->node = node;
+    tdma->frame_start = plm1_get_tick(plm);
+    tdma->slot = PLM_TDMA_NO_SLOT;
+    tdma->open = true;
+
+    if(coordinator)
+    {
+        // The first frame starts now, with its beacon.
+        tdma->synced = true;
+        tdma->slot = PLM_TDMA_COORDINATOR_SLOT;
+        tdma->owners[PLM_TDMA_COORDINATOR_SLOT] = node;
+        send_beacon(tdma);
+
+        // That beacon is the one of the current frame.
+        tdma->beacon_queued = false;
+    }
+    plm1_tx_hold(plm, false);
+}
+
+/*******************************************************************************
+* Name:         plm1tdma_task()
+* Description:  Follow the frame clock, open and close the transmission gate.
+*               ** This function must be called from the main loop **
+* Parameters:   tdma: TDMA instance.
+* Return:       None.
+* Note:         The gate is only as accurate as the main loop period; the
+*               guard and PLM_TDMA_TX_TICKS must cover it.
+*******************************************************************************/
+void plm1tdma_task(plm1tdma_t* tdma)
+{
+    uint16_t position = plm1_get_tick(tdma->plm) - tdma->frame_start;
+    bool open;
+
+    // Frame boundaries.
+    while(position >= PLM_TDMA_FRAME_TICKS)
+    {
+        tdma->frame_start += PLM_TDMA_FRAME_TICKS;
+        position -= PLM_TDMA_FRAME_TICKS;
+        new_frame(tdma);
+    }
+
+    // Coordinator slot over: queue the beacon of the next frame.
+    if(tdma->coordinator && !tdma->beacon_queued && ((position / PLM_TDMA_SLOT_TICKS) != PLM_TDMA_COORDINATOR_SLOT))
+    {
+        send_beacon(tdma);
+    }
+
+    open = gate_open(tdma, position);
+    if(open != tdma->open)
+    {
+        tdma->open = open;
+        plm1_tx_hold(tdma->plm, !open);
+    }
+}
+
+/*******************************************************************************
+* Name:         plm1tdma_input()
+* Description:  Feed a packet received on PLM_TDMA_CHANNEL.
+* Parameters:   tdma: TDMA instance.
+*               packet: Packet returned by plm1_receive_channel().
+*               length: Length of the packet.
+* Return:       None.
+* Note:
+*******************************************************************************/
+void plm1tdma_input(plm1tdma_t* tdma, const uint8_t* packet, uint8_t length)
+{
+    if(tdma->coordinator)
+    {
+        if((length == PLM_TDMA_JOIN_SIZE) && (packet[0] == PLM_TDMA_JOIN_MAGIC))
+        {
+            join_received(tdma, packet[1]);
+        }
+    }
+    else if((length == PLM_TDMA_BEACON_SIZE) && (packet[0] == PLM_TDMA_BEACON_MAGIC))
+    {
+        beacon_received(tdma, packet, plm1_get_tick(tdma->plm));
+    }
+}
+
+/*******************************************************************************
+* Name:         plm1tdma_send()
+* Description:  Send a packet in the slot of this node.
+* Parameters:   tdma: TDMA instance.
+*               data: Data to send.
+*               length: Length of the data array.
+*               prio: Packet priority.
+*               channel: Channel number used to send packet.
+* Return:       Handle of the packet, PLM_TX_NO_HANDLE if it was not queued.
+* Note:         On the other nodes, the packet is queued at once and held by
+*               the gate until the slot of the node. On the coordinator, it
+*               is refused unless it can leave within slot 0 with nothing
+*               queued before it: the application keeps it and calls again.
+*               The coordinator must send all its packets through this
+*               function, or its beacons lose their timing.
+*******************************************************************************/
+plm1_tx_handle plm1tdma_send(plm1tdma_t* tdma, uint8_t* data, uint8_t length, plm1_priority prio, uint8_t channel)
+{
+    uint16_t position;
+
+    if(tdma->coordinator)
+    {
+        position = plm1_get_tick(tdma->plm) - tdma->frame_start;
+        if((position >= PLM_TDMA_FRAME_TICKS) || !gate_open(tdma, position) || !plm1_tx_idle(tdma->plm))
+        {
+            tdma->counters.held++;
+            return (PLM_TX_NO_HANDLE);
+        }
+    }
+
+    return (plm1_send_packet(tdma->plm, data, length, prio, channel, false));
+}
+
+/*******************************************************************************
+* Name:         plm1tdma_get_slot()
+* Description:  Get the slot assigned to this node.
+* Parameters:   tdma: TDMA instance.
+* Return:       Slot index, PLM_TDMA_NO_SLOT if none.
+* Note:
+*******************************************************************************/
+uint8_t plm1tdma_get_slot(plm1tdma_t* tdma)
+{
+    return (tdma->slot);
+}
+
+/*******************************************************************************
+* Name:         plm1tdma_synced()
+* Description:  Get synchronization state.
+* Parameters:   tdma: TDMA instance.
+* Return:       true if the frame clock is aligned on the beacons (always true
+*               on the coordinator).
+* Note:
+*******************************************************************************/
+bool plm1tdma_synced(plm1tdma_t* tdma)
+{
+    return (tdma->synced);
+}
+
+/*******************************************************************************
+* Name:         plm1tdma_get_counters()
+* Description:  Get TDMA counters.
+* Parameters:   tdma: TDMA instance.
+*               counters: Struct used to return the counters.
+* Return:       None.
+* Note:
+*******************************************************************************/
+void plm1tdma_get_counters(plm1tdma_t* tdma, plm1tdma_counters* counters)
+{
+    *counters = tdma->counters;
+}
+
+/*------------------------------------------------------------------------------
+  Local functions
+------------------------------------------------------------------------------*/
+
+/*******************************************************************************
+* Name:         new_frame()
+* Description:  Start a new frame: expire leases (coordinator), watch the
+*               beacons and send join requests (node).
+* Parameters:   tdma: TDMA instance.
+* Return:       None.
+* Note:
+*******************************************************************************/
+static void new_frame(plm1tdma_t* tdma)
+{
+    uint8_t i;
+
+    if(tdma->coordinator)
+    {
+        tdma->beacon_queued = false;
+        for(i = PLM_TDMA_JOIN_SLOT + 1; i < PLM_TDMA_SLOT_NBR; i++)
+        {
+            if((tdma->owners[i] != PLM_TDMA_NO_NODE) && (--tdma->leases[i] == 0))
+            {
+                tdma->owners[i] = PLM_TDMA_NO_NODE;
+            }
+        }
+        return;
+    }
+
+    if(!tdma->synced)
+    {
+        return;
+    }
+
+    if(++tdma->unsynced_frames >= PLM_TDMA_SYNC_FRAMES)
+    {
+        // Coordinator lost, go back to contention access.
+        tdma->synced = false;
+        tdma->slot = PLM_TDMA_NO_SLOT;
+        tdma->counters.sync_losses++;
+    }
+    else if((tdma->join_wait == 0) || (--tdma->join_wait == 0))
+    {
+        send_join(tdma);
+    }
+}
+
+/*******************************************************************************
+* Name:         gate_open()
+* Description:  Tell whether queued packets may be sent at a frame position.
+* Parameters:   tdma: TDMA instance.
+*               position: Ticks elapsed since the frame start.
+* Return:       true if the packets may be sent.
+* Note:         A packet is only started if it can end before its slot does.
+*******************************************************************************/
+static bool gate_open(plm1tdma_t* tdma, uint16_t position)
+{
+    uint8_t slot = position / PLM_TDMA_SLOT_TICKS;
+    uint16_t offset = position % PLM_TDMA_SLOT_TICKS;
+    uint8_t guard = tdma->coordinator ? 0 : PLM_TDMA_GUARD_TICKS;
+
+    if(!tdma->synced)
+    {
+        // Contention access.
+        return (true);
+    }
+    if(slot != ((tdma->slot != PLM_TDMA_NO_SLOT) ? tdma->slot : PLM_TDMA_JOIN_SLOT))
+    {
+        return (false);
+    }
+
+    return ((offset >= guard) && (offset < (PLM_TDMA_SLOT_TICKS - PLM_TDMA_TX_TICKS)));
+}
+
+/*******************************************************************************
+* Name:         send_beacon()
+* Description:  Queue the beacon of the next frame.
+* Parameters:   tdma: TDMA instance.
+* Return:       None.
+* Note:         When the transmission buffer is full, the beacon is retried
+*               on the next plm1tdma_task() call.
+*******************************************************************************/
+static void send_beacon(plm1tdma_t* tdma)
+{
+    uint8_t packet[PLM_TDMA_BEACON_SIZE];
+
+    packet[0] = PLM_TDMA_BEACON_MAGIC;
+    packet[1] = plm1_tx_idle(tdma->plm) ? PLM_TDMA_TIMED : 0;
+    memcpy(&packet[2], &tdma->owners[PLM_TDMA_JOIN_SLOT + 1], PLM_TDMA_SLOT_NBR - PLM_TDMA_JOIN_SLOT - 1);
+
+    if(plm1_send_packet(tdma->plm, packet, PLM_TDMA_BEACON_SIZE, PLM1_PRIO_HIGHEST, PLM_TDMA_CHANNEL, false))
+    {
+        tdma->beacon_queued = true;
+        tdma->counters.beacons++;
+        if(!(packet[1] & PLM_TDMA_TIMED))
+        {
+            tdma->counters.late_beacons++;
+        }
+    }
+}
+
+/*******************************************************************************
+* Name:         send_join()
+* Description:  Queue a join request, or the renewal of the slot owned.
+* Parameters:   tdma: TDMA instance.
+* Return:       None.
+* Note:         The request is released in the join slot, or in the slot
+*               owned. It is retried on the next frame if not queued.
+*******************************************************************************/
+static void send_join(plm1tdma_t* tdma)
+{
+    uint8_t packet[PLM_TDMA_JOIN_SIZE];
+
+    packet[0] = PLM_TDMA_JOIN_MAGIC;
+    packet[1] = tdma->node;
+
+    if(plm1_send_packet(tdma->plm, packet, PLM_TDMA_JOIN_SIZE, PLM1_PRIO_HIGH, PLM_TDMA_CHANNEL, false))
+    {
+        tdma->join_wait = (tdma->slot == PLM_TDMA_NO_SLOT) ? PLM_TDMA_JOIN_FRAMES : (PLM_TDMA_LEASE_FRAMES / 2);
+        tdma->counters.joins++;
+    }
+}
+
+/*******************************************************************************
+* Name:         join_received()
+* Description:  Renew the slot of a node, or assign it a free one.
+* Parameters:   tdma: TDMA instance.
+*               node: Node requesting a slot.
+* Return:       None.
+* Note:         The assignment is announced by the next beacon.
+*******************************************************************************/
+static void join_received(plm1tdma_t* tdma, uint8_t node)
+{
+    uint8_t freeSlot = PLM_TDMA_NO_SLOT;
+    uint8_t i;
+
+    if((node == PLM_TDMA_NO_NODE) || (node == tdma->node))
+    {
+        return;
+    }
+
+    for(i = PLM_TDMA_JOIN_SLOT + 1; i < PLM_TDMA_SLOT_NBR; i++)
+    {
+        if(tdma->owners[i] == node)
+        {
+            tdma->leases[i] = PLM_TDMA_LEASE_FRAMES;
+            return;
+        }
+        if((tdma->owners[i] == PLM_TDMA_NO_NODE) && (freeSlot == PLM_TDMA_NO_SLOT))
+        {
+            freeSlot = i;
+        }
+    }
+
+    if(freeSlot != PLM_TDMA_NO_SLOT)
+    {
+        tdma->owners[freeSlot] = node;
+        tdma->leases[freeSlot] = PLM_TDMA_LEASE_FRAMES;
+        tdma->counters.joins++;
+    }
+    else
+    {
+        tdma->counters.join_rejects++;
+    }
+}
+
+/*******************************************************************************
+* Name:         beacon_received()
+* Description:  Read the slot assignment of a beacon and align the frame clock
+*               on it.
+* Parameters:   tdma: TDMA instance.
+*               packet: Beacon.
+*               now: Tick of the reception.
+* Return:       None.
+* Note:         The clock jumps on the first beacon, then only half of the
+*               error is corrected to smooth the reception jitter.
+*******************************************************************************/
+static void beacon_received(plm1tdma_t* tdma, const uint8_t* packet, uint16_t now)
+{
+    uint16_t beaconStart = now - PLM_TDMA_BEACON_TICKS;
+    int16_t error;
+    uint8_t slot = PLM_TDMA_NO_SLOT;
+    uint8_t i;
+
+    tdma->counters.beacons++;
+
+    for(i = PLM_TDMA_JOIN_SLOT + 1; i < PLM_TDMA_SLOT_NBR; i++)
+    {
+        if(packet[2 + i - PLM_TDMA_JOIN_SLOT - 1] == tdma->node)
+        {
+            slot = i;
+            break;
+        }
+    }
+    if((slot != PLM_TDMA_NO_SLOT) && (tdma->slot == PLM_TDMA_NO_SLOT))
+    {
+        // Slot granted, renew it before the lease ends.
+        tdma->join_wait = PLM_TDMA_LEASE_FRAMES / 2;
+    }
+    tdma->slot = slot;
+
+    if(!(packet[1] & PLM_TDMA_TIMED))
+    {
+        return;
+    }
+
+    if(!tdma->synced)
+    {
+        tdma->frame_start = beaconStart;
+        tdma->synced = true;
+        tdma->join_wait = 0;
+    }
+    else
+    {
+        // Error to the closest frame start.
+        error = (uint16_t)(beaconStart - tdma->frame_start) % PLM_TDMA_FRAME_TICKS;
+        if(error > (PLM_TDMA_FRAME_TICKS / 2))
+        {
+            error -= PLM_TDMA_FRAME_TICKS;
+        }
+        tdma->frame_start += error / 2;
+    }
+    tdma->unsynced_frames = 0;
+}
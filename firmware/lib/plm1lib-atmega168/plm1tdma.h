@@ -0,0 +1,115 @@
+/*******************************************************************************
+* Filename:     plm1tdma.h
+* Description:  File defining the PLM-1 scheduled access MAC (TDMA).
+* Version:      1.0.0
+* Note:         A coordinator node cuts time into frames of PLM_TDMA_SLOT_NBR
+*               slots and sends a beacon at the start of each frame. Other
+*               nodes align their frame clock on the beacons and only release
+*               their queued packets during the slot assigned to them, so
+*               the line is never contended. A packet queued by a node owning
+*               a slot waits at most one frame before being sent.
+*
+*               Slot 0:  Coordinator (beacon first, then its own packets).
+*               Slot 1:  Join slot, contended by the nodes without a slot.
+*               Slot 2+: Assigned on join requests, renewed by the owner.
+*
+*               Packets are sent with plm1tdma_send(). On the coordinator,
+*               it only hands a packet to the driver when the packet can
+*               leave within slot 0, so that nothing is queued ahead of the
+*               next beacon. One plm1tdma_t instance serves one driver
+*               instance.
+*******************************************************************************/
+
+#ifndef _PLM1TDMA_H_
+#define _PLM1TDMA_H_
+
+#include "plm1.h"
+
+
+/*******************************************************************************
+ * USER PARAMETERS
+ *
+ * Parameters to be modified by the user.
+ ******************************************************************************/
+#define PLM_TDMA_CHANNEL               14                       // Channel of the beacons and join requests.
+#define PLM_TDMA_SLOT_NBR              8                        // Nb of slots per frame (3 to 32).
+#define PLM_TDMA_SLOT_TICKS            50                       // Duration of a slot in ticks.
+#define PLM_TDMA_GUARD_TICKS           2                        // Ticks left unused at the start of a slot.
+#define PLM_TDMA_TX_TICKS              20                       // Ticks needed to send a packet of PLM_MAX_PACKET_SIZE.
+#define PLM_TDMA_BEACON_TICKS          4                        // Ticks between frame start and beacon reception.
+#define PLM_TDMA_SYNC_FRAMES           4                        // Frames without beacon before losing synchronization.
+#define PLM_TDMA_LEASE_FRAMES          32                       // Frames a slot is kept without renewal.
+#define PLM_TDMA_JOIN_FRAMES           3                        // Frames between two join requests.
+/*******************************************************************************
+ * END OF USER PARAMETERS
+ ******************************************************************************/
+
+#define PLM_TDMA_FRAME_TICKS           (PLM_TDMA_SLOT_NBR*PLM_TDMA_SLOT_TICKS) // Duration of a frame in ticks.
+#define PLM_TDMA_BEACON_SIZE           (PLM_TDMA_SLOT_NBR)      // Magic + Flags + Owner of slots 2 and above.
+#define PLM_TDMA_JOIN_SIZE             2                        // Magic + Node.
+#define PLM_TDMA_BEACON_MAGIC          0xB7                     // First byte of a beacon.
+#define PLM_TDMA_JOIN_MAGIC            0xB8                     // First byte of a join request.
+#define PLM_TDMA_TIMED                 0x01                     // Beacon flag: sent at frame start, usable for sync.
+#define PLM_TDMA_COORDINATOR_SLOT      0                        // Slot of the coordinator.
+#define PLM_TDMA_JOIN_SLOT             1                        // Slot of the join requests.
+#define PLM_TDMA_NO_SLOT               0xFF                     // No slot assigned.
+#define PLM_TDMA_NO_NODE               0xFF                     // Free slot, in a beacon.
+
+/*------------------------------------------------------------------------------
+  Global types definition
+------------------------------------------------------------------------------*/
+
+// TDMA counters.
+typedef struct _plm1tdma_counters_ {
+    uint16_t beacons;                                           // Beacons sent (coordinator) or received.
+    uint16_t late_beacons;                                      // Beacons not queued on an idle transmitter, not usable for sync.
+    uint16_t joins;                                             // Join requests sent (node) or accepted (coordinator).
+    uint16_t join_rejects;                                      // Join requests rejected, no slot free (coordinator).
+    uint16_t sync_losses;                                       // Synchronizations lost (node).
+    uint16_t held;                                              // Packets refused outside of slot 0 (coordinator).
+} plm1tdma_counters;
+
+// TDMA instance (one per driver instance).
+typedef struct _plm1tdma_t_ {
+    plm1_t* plm;                                                // Driver instance scheduled.
+    bool coordinator;                                           // true if this node sends the beacons.
+    uint8_t node;                                               // Address of this node.
+    bool synced;                                                // true if the frame clock is aligned on the beacons.
+    uint16_t frame_start;                                       // Tick of the current frame start.
+    uint8_t unsynced_frames;                                    // Frames since the last timed beacon.
+    uint8_t slot;                                               // Slot assigned to this node (PLM_TDMA_NO_SLOT if none).
+    bool open;                                                  // true if queued packets are released.
+    bool beacon_queued;                                         // Beacon of the next frame queued (coordinator).
+    uint8_t join_wait;                                          // Frames before the next join request (node).
+    uint8_t owners[PLM_TDMA_SLOT_NBR];                          // Node owning each slot (coordinator).
+    uint8_t leases[PLM_TDMA_SLOT_NBR];                          // Frames left before a slot is freed (coordinator).
+    plm1tdma_counters counters;                                 // Counters.
+} plm1tdma_t;
+
+/*------------------------------------------------------------------------------
+  Global functions definition
+------------------------------------------------------------------------------*/
+
+// Initialize a scheduled access MAC instance.
+void plm1tdma_init(plm1tdma_t* tdma, plm1_t* plm, uint8_t node, bool coordinator);
+
+// Follow the frame clock, open and close the transmission gate.
+// ** This function must be called from the main loop **
+void plm1tdma_task(plm1tdma_t* tdma);
+
+// Feed a packet received on PLM_TDMA_CHANNEL.
+void plm1tdma_input(plm1tdma_t* tdma, const uint8_t* packet, uint8_t length);
+
+// Send a packet in the slot of this node.
+plm1_tx_handle plm1tdma_send(plm1tdma_t* tdma, uint8_t* data, uint8_t length, plm1_priority prio, uint8_t channel);
+
+// Get the slot assigned to this node.
+uint8_t plm1tdma_get_slot(plm1tdma_t* tdma);
+
+// Get synchronization state.
+bool plm1tdma_synced(plm1tdma_t* tdma);
+
+// Get TDMA counters.
+void plm1tdma_get_counters(plm1tdma_t* tdma, plm1tdma_counters* counters);
+
+#endif /* _PLM1TDMA_H_ */
@@ -1,8 +1,9 @@
 /*******************************************************************************
 * Filename:     plmcfg.h
 * Description:  File defining the PLM-1 configuration.
-* Version:      1.6.0
-* Note:         
+* Version:      1.7.0
+* Note:         Derived parameters are integer constant expressions; the
+*               configuration string is built at compile time.
 *******************************************************************************/
 
 #ifndef _PLMCFG_H_
@@ -30,27 +31,22 @@
  
 /* PLM-1 configuration parameters (Advanced) */
 #define WDIV                0
-#define DEL                 (CPT1 / 2)
-#define FC_HIGH             (XDIV / 2)
-#define FC_LOW              (uint8_t)(XDIV * 1.5)
-#define N0                  (CPT0 + 2)
-#define N1                  (CPT1 + 2)
-#define HT0PB               (uint8_t)((CPB * 2 / N0) - 1)
-/*#define FC                  0x15  *//* Computed by build_cfg_string() */
-/*#define OFFSET              210   *//* Computed by build_cfg_string() */
-/*#define DPHG                2     *//* Computed by build_cfg_string() */
-/*#define FTH                 68    *//* Computed by build_cfg_string() */
-/*#define FITH                136   *//* Computed by build_cfg_string() */
-#if CPT0 > CPT1
-#   define _PRIME_SIGN      -
-#else
-#   define _PRIME_SIGN      +
-#endif
+#define DEL                 PLM_CFG_DEL(CPT1)
+#define FC_HIGH             PLM_CFG_FC_HIGH(XDIV)
+#define FC_LOW              PLM_CFG_FC_LOW(XDIV)
+#define N0                  PLM_CFG_N(CPT0)
+#define N1                  PLM_CFG_N(CPT1)
+#define HT0PB               PLM_CFG_HT0PB(CPB, CPT0)
+/*#define FC                  0x15  *//* Computed by PLM_CFG_FC() */
+/*#define OFFSET              210   *//* Computed by PLM_CFG_OFFSET() */
+/*#define DPHG                2     *//* Computed by PLM_CFG_DPHG() */
+/*#define FTH                 68    *//* Computed by PLM_CFG_FTH() */
+/*#define FITH                136   *//* Computed by PLM_CFG_FITH() */
 
 
 /* PLM-1 configuration parameters (MAC) */
 #define PATTERN             0xAA
-/*#define THRESHOLD           5     *//* Computed by build_cfg_string() */
+/*#define THRESHOLD           5     *//* Computed by PLM_CFG_THRESHOLD() */
 #define MASK                0xFC
 #define NOPRIO              0
 #define NOPREAM             0
@@ -93,4 +89,188 @@
 #endif
 
 
+/*******************************************************************************
+ * CONFIGURATION STRING GENERATION
+ *
+ * Integer only macros computing the derived parameters from the basic ones,
+ * so that any set of XDIV, CPB, CPT0 and CPT1 values can be turned into a
+ * configuration string constant.
+ ******************************************************************************/
+
+/* floor(log2(p / q)), clipped to [0, 9]. */
+#define _PLM_LOG2_FLOOR(_p, _q)                                                \
+    (((_p) >= 512L * (_q)) ? 9 : ((_p) >= 256L * (_q)) ? 8 :                   \
+     ((_p) >= 128L * (_q)) ? 7 : ((_p) >=  64L * (_q)) ? 6 :                   \
+     ((_p) >=  32L * (_q)) ? 5 : ((_p) >=  16L * (_q)) ? 4 :                   \
+     ((_p) >=   8L * (_q)) ? 3 : ((_p) >=   4L * (_q)) ? 2 :                   \
+     ((_p) >=   2L * (_q)) ? 1 : 0)
+
+/* ceil(log2(p / q)), clipped to [0, 10]. */
+#define _PLM_LOG2_CEIL(_p, _q)                                                 \
+    (((_p) <=        (_q)) ? 0 : ((_p) <=   2L * (_q)) ? 1 :                   \
+     ((_p) <=   4L * (_q)) ? 2 : ((_p) <=   8L * (_q)) ? 3 :                   \
+     ((_p) <=  16L * (_q)) ? 4 : ((_p) <=  32L * (_q)) ? 5 :                   \
+     ((_p) <=  64L * (_q)) ? 6 : ((_p) <= 128L * (_q)) ? 7 :                   \
+     ((_p) <= 256L * (_q)) ? 8 : ((_p) <= 512L * (_q)) ? 9 : 10)
+
+/* Advanced parameters depending on the basic ones. */
+#define PLM_CFG_N(_cpt)                     ((_cpt) + 2)
+#define PLM_CFG_DEL(_cpt1)                  ((_cpt1) / 2)
+#define PLM_CFG_FC_HIGH(_xdiv)              ((_xdiv) / 2)
+#define PLM_CFG_FC_LOW(_xdiv)               (uint8_t)(((_xdiv) * 3) / 2)
+#define PLM_CFG_HT0PB(_cpb, _cpt0)          (uint8_t)(((_cpb) * 2 / PLM_CFG_N(_cpt0)) - 1)
+
+/* -1 if CPT0 > CPT1, +1 otherwise. */
+#define PLM_CFG_PS(_cpt0, _cpt1)            (((_cpt0) > (_cpt1)) ? -1L : 1L)
+
+/* N0 and N1 primes: (N - 1) if CPT0 > CPT1, (N + 1) otherwise. */
+#define PLM_CFG_N0P(_cpt0, _cpt1)           (PLM_CFG_N(_cpt0) + PLM_CFG_PS(_cpt0, _cpt1))
+#define PLM_CFG_N1P(_cpt0, _cpt1)           (PLM_CFG_N(_cpt1) + PLM_CFG_PS(_cpt0, _cpt1))
+
+/*  +----------------------------------------------------+
+    |          |      /   16 * (N0'   )(N1'   ) \  |     |
+    |   DPHG = | log  | ------------------------|  | - 1 |
+    |          |    2 |  WDIV                   |  |     |
+    |          |_     \ 2     * XDIV * (N0 - N1)/ _|     |
+    +----------------------------------------------------+ */
+#define _PLM_CFG_DPHG_LOG2(_xdiv, _cpt0, _cpt1)                                \
+    _PLM_LOG2_FLOOR(16L * PLM_CFG_N0P(_cpt0, _cpt1) * PLM_CFG_N1P(_cpt0, _cpt1), \
+                    (1L << WDIV) * (_xdiv) * -PLM_CFG_PS(_cpt0, _cpt1) * (PLM_CFG_N(_cpt0) - PLM_CFG_N(_cpt1)))
+#define PLM_CFG_DPHG(_xdiv, _cpt0, _cpt1)                                      \
+    (uint8_t)(_PLM_CFG_DPHG_LOG2(_xdiv, _cpt0, _cpt1) - 1)
+
+/*  +----------------------------------------------------------------+
+    |             (DPHG + WDIV + 1)          (N0'   ) + (N1'   )     |
+    |   OFFSET = 2                  * XDIV * -------------------     |
+    |                                        (N0'   )(N1'   )        |
+    +----------------------------------------------------------------+ */
+#define _PLM_CFG_OFFSET_L(_xdiv, _cpt0, _cpt1, _dphg)                         \
+    (-PLM_CFG_PS(_cpt0, _cpt1) * (1L << ((_dphg) + WDIV + 1)) * (_xdiv) *      \
+     (PLM_CFG_N0P(_cpt0, _cpt1) + PLM_CFG_N1P(_cpt0, _cpt1)) /                 \
+     (PLM_CFG_N0P(_cpt0, _cpt1) * PLM_CFG_N1P(_cpt0, _cpt1)))
+#define PLM_CFG_OFFSET(_xdiv, _cpt0, _cpt1, _dphg)                             \
+    (short)_PLM_CFG_OFFSET_L(_xdiv, _cpt0, _cpt1, _dphg)
+
+/*  +-------------------------------------------------------------------------------------+
+    |                                     /           WDIV                 \              |
+    |          (DPHG + WDIV + 2)          |          2     * N0 * CPB      |              |
+    |   FTH = 2                  * XDIV * |1 - ----------------------------| + OFFSET     |
+    |                                     |     WDIV                       |              |
+    |                                     \    2     * CPB * (N0'   ) + N0 /              |
+    +-------------------------------------------------------------------------------------+
+    Computed as a single fraction, Q being the denominator of the inner ratio. */
+#define _PLM_CFG_FTH_Q(_cpb, _cpt0, _cpt1)                                     \
+    ((1L << WDIV) * (_cpb) * PLM_CFG_N0P(_cpt0, _cpt1) + PLM_CFG_N(_cpt0))
+#define _PLM_CFG_FTH_L(_xdiv, _cpb, _cpt0, _cpt1, _dphg, _offset)             \
+    (((1L << ((_dphg) + WDIV + 2)) * (_xdiv) *                                 \
+      (_PLM_CFG_FTH_Q(_cpb, _cpt0, _cpt1) - (1L << WDIV) * PLM_CFG_N(_cpt0) * (_cpb)) + \
+      (_offset) * _PLM_CFG_FTH_Q(_cpb, _cpt0, _cpt1)) /                        \
+     _PLM_CFG_FTH_Q(_cpb, _cpt0, _cpt1))
+#define PLM_CFG_FTH(_xdiv, _cpb, _cpt0, _cpt1, _dphg, _offset)                 \
+    (uint8_t)_PLM_CFG_FTH_L(_xdiv, _cpb, _cpt0, _cpt1, _dphg, _offset)
+
+#define PLM_CFG_FITH(_fth)                  (uint8_t)((_fth) * 2)
+
+/*  +---------------------------------------------------------------------------------------------------------+
+    |                                          _             _                                                |
+    |                                         |      / CPB \  |                       |  (n + 4)    6   |     |
+    |   FC = [n2,n1,n0,m2,m1,m0]          n = | log  | --- |  | - 1          m = 15 - | 2        * ---  |     |
+    |                                         |    2 \  6  /  |                       |_           CPB _|     |
+    +---------------------------------------------------------------------------------------------------------+ */
+#define _PLM_CFG_FC_N(_cpb)                 (_PLM_LOG2_CEIL((_cpb), 6) - 1)
+#define PLM_CFG_FC(_cpb)                                                       \
+    (uint8_t)(((_PLM_CFG_FC_N(_cpb) & 0x7) << 3) |                             \
+              ((15 - (uint8_t)((1L << (_PLM_CFG_FC_N(_cpb) + 4)) * 6 / (_cpb))) & 0x7))
+
+/* CPB reduced to 4 bits by shifting it right, rounded, and halved. */
+#define _PLM_CFG_CPB_SHIFT(_cpb)                                               \
+    (((_cpb) >= 512) ? 6 : ((_cpb) >= 256) ? 5 : ((_cpb) >= 128) ? 4 :         \
+     ((_cpb) >=  64) ? 3 : ((_cpb) >=  32) ? 2 : ((_cpb) >=  16) ? 1 : 0)
+#define PLM_CFG_THRESHOLD(_cpb)                                                \
+    (uint8_t)((((_cpb) >> _PLM_CFG_CPB_SHIFT(_cpb)) +                          \
+               ((((_cpb) << 1) >> _PLM_CFG_CPB_SHIFT(_cpb)) & 0x01)) / 2)
+
+/* Configuration string (19 bytes) from basic and derived parameters. The CRC
+   nibble (low nibble of the last byte) is left to 0 and must be completed at
+   run time. */
+#define PLM_CFG_STRING(_xdiv, _cpb, _cpt0, _cpt1, _dphg, _offset, _fth, _fith, _fc, _threshold) \
+{                                                                              \
+    PATTERN,                                                                   \
+    MASK,                                                                      \
+    (uint8_t)(((_threshold) << 3) | ((_xdiv) >> 4)),                           \
+    (uint8_t)(((_xdiv) << 4) | ((_dphg) & 0x0F)),                              \
+    (uint8_t)((_offset) >> 3),                                                 \
+    (uint8_t)(((_offset) << 5) | ((_fith) >> 3)),                              \
+    (uint8_t)(((_fith) << 5) | ((_fth) >> 2)),                                 \
+    (uint8_t)(((_fth) << 6) | ((_fc) & 0x3F)),                                 \
+    (WDIV << 6) | (INPOL << 5) | (LTRINT << 4) | (INTPOL << 3) | (INTYPE << 2) | (TXOUTPOL << 1) | TXOUTYPE, \
+    (uint8_t)((TXENPOL << 7) | 0x60 | (NOPRIO << 4) | (NOPREAM << 3) | (NOMAC << 2) | ((_cpb) >> 8)), \
+    (uint8_t)(_cpb),                                                           \
+    (uint8_t)((PLM_CFG_DEL(_cpt1) << 1) | (PLM_CFG_HT0PB(_cpb, _cpt0) >> 4)),  \
+    (uint8_t)((PLM_CFG_HT0PB(_cpb, _cpt0) << 4) | ((_cpt1) >> 4)),             \
+    (uint8_t)(((_cpt1) << 4) | ((_cpt0) >> 4)),                                \
+    (uint8_t)(((_cpt0) << 4) | (RND >> 4)),                                    \
+    (uint8_t)((RND << 4) | (TIMCFG >> 4)),                                     \
+    (uint8_t)((TIMCFG << 4) | (PLM_CFG_FC_LOW(_xdiv) >> 4)),                   \
+    (uint8_t)((PLM_CFG_FC_LOW(_xdiv) << 4) | (PLM_CFG_FC_HIGH(_xdiv) >> 4)),   \
+    (uint8_t)(PLM_CFG_FC_HIGH(_xdiv) << 4)                                     \
+}
+
+/* Configuration string of a set of basic parameters, all derived parameters
+   computed. */
+#define PLM_CFG_PROFILE(_xdiv, _cpb, _cpt0, _cpt1)                             \
+    PLM_CFG_STRING(_xdiv, _cpb, _cpt0, _cpt1,                                  \
+                   PLM_CFG_DPHG(_xdiv, _cpt0, _cpt1),                          \
+                   PLM_CFG_OFFSET(_xdiv, _cpt0, _cpt1, PLM_CFG_DPHG(_xdiv, _cpt0, _cpt1)), \
+                   PLM_CFG_FTH(_xdiv, _cpb, _cpt0, _cpt1, PLM_CFG_DPHG(_xdiv, _cpt0, _cpt1), \
+                               PLM_CFG_OFFSET(_xdiv, _cpt0, _cpt1, PLM_CFG_DPHG(_xdiv, _cpt0, _cpt1))), \
+                   PLM_CFG_FITH(PLM_CFG_FTH(_xdiv, _cpb, _cpt0, _cpt1, PLM_CFG_DPHG(_xdiv, _cpt0, _cpt1), \
+                                            PLM_CFG_OFFSET(_xdiv, _cpt0, _cpt1, PLM_CFG_DPHG(_xdiv, _cpt0, _cpt1)))), \
+                   PLM_CFG_FC(_cpb),                                           \
+                   PLM_CFG_THRESHOLD(_cpb))
+
+/* 1 if a set of basic parameters passes the parameters tests above and gives
+   a DPHG, an HT0PB and an FTH in range, 0 otherwise. Usable in #if, for the
+   sets given to PLM_CFG_PROFILE(). */
+#define _PLM_CFG_FTH_OF(_xdiv, _cpb, _cpt0, _cpt1)                             \
+    _PLM_CFG_FTH_L(_xdiv, _cpb, _cpt0, _cpt1, _PLM_CFG_DPHG_LOG2(_xdiv, _cpt0, _cpt1) - 1, \
+                   _PLM_CFG_OFFSET_L(_xdiv, _cpt0, _cpt1, _PLM_CFG_DPHG_LOG2(_xdiv, _cpt0, _cpt1) - 1))
+#define PLM_CFG_PROFILE_VALID(_xdiv, _cpb, _cpt0, _cpt1)                       \
+    (((_xdiv) >= 1) && ((_xdiv) <= 0x7F) &&                                    \
+     ((_cpb) >= 8) && ((_cpb) <= 0x03FF) &&                                    \
+     ((_cpt0) <= 0xFF) && ((_cpt1) <= 0xFF) && ((_cpt0) != (_cpt1)) &&         \
+     (_PLM_CFG_DPHG_LOG2(_xdiv, _cpt0, _cpt1) >= 1) &&                         \
+     (((_cpb) * 2 / PLM_CFG_N(_cpt0)) >= 1) && (((_cpb) * 2 / PLM_CFG_N(_cpt0)) <= 0x20) && \
+     (_PLM_CFG_FTH_OF(_xdiv, _cpb, _cpt0, _cpt1) >= 0) && (_PLM_CFG_FTH_OF(_xdiv, _cpb, _cpt0, _cpt1) <= 0xFF))
+
+/* Derived parameters of the default configuration, unless defined above. */
+#ifndef DPHG
+#   define DPHG             PLM_CFG_DPHG(XDIV, CPT0, CPT1)
+#endif
+#ifndef OFFSET
+#   define OFFSET           PLM_CFG_OFFSET(XDIV, CPT0, CPT1, DPHG)
+#endif
+#ifndef FTH
+#   define FTH              PLM_CFG_FTH(XDIV, CPB, CPT0, CPT1, DPHG, OFFSET)
+#endif
+#ifndef FITH
+#   define FITH             PLM_CFG_FITH(FTH)
+#endif
+#ifndef FC
+#   define FC               PLM_CFG_FC(CPB)
+#endif
+#ifndef THRESHOLD
+#   define THRESHOLD        PLM_CFG_THRESHOLD(CPB)
+#endif
+
+/* Derived parameters tests. */
+#if _PLM_CFG_DPHG_LOG2(XDIV, CPT0, CPT1) < 1
+#   error PLM-1 CONFIGURATION: 'DPHG' value is too low, check 'XDIV', 'CPT0' and 'CPT1'!
+#endif
+
+/* Default configuration string. */
+#define PLM_CFG_DEFAULT                                                        \
+    PLM_CFG_STRING(XDIV, CPB, CPT0, CPT1, DPHG, OFFSET, FTH, FITH, FC, THRESHOLD)
+
+
 #endif
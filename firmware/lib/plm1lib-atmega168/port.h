@@ -0,0 +1,52 @@
+/*******************************************************************************
+* Filename:     port.h
+* Description:  File defining the register and pin helpers of the PLM-1 library.
+* Version:      1.0.0
+* Note:         Pins are given as a "port letter,bit" pair, as the USER
+*               parameters of plm1.h do (e.g. B,2 for PB2). The pair is
+*               expanded through a second macro so that it can be passed as
+*               a single macro argument.
+*******************************************************************************/
+
+#ifndef _PORT_H_
+#define _PORT_H_
+
+#include <avr/io.h>
+
+/*------------------------------------------------------------------------------
+  Register helpers
+------------------------------------------------------------------------------*/
+
+// Set a bit of a register.
+#define SET_BIT(_reg, _bit)            ((_reg) |= (uint8_t)(1 << (_bit)))
+
+// Clear a bit of a register.
+#define CLR_BIT(_reg, _bit)            ((_reg) &= (uint8_t)~(1 << (_bit)))
+
+/*------------------------------------------------------------------------------
+  Pin helpers
+------------------------------------------------------------------------------*/
+
+// Drive a pin high.
+#define SET_OUTPUT(_pin)               PORT_SET_OUTPUT(_pin)
+
+// Drive a pin low.
+#define CLR_OUTPUT(_pin)               PORT_CLR_OUTPUT(_pin)
+
+// Read a pin, 0 or 1.
+#define GET_INPUT(_pin)                PORT_GET_INPUT(_pin)
+
+// Make a pin an output.
+#define DIR_OUTPUT(_pin)               PORT_DIR_OUTPUT(_pin)
+
+// Make a pin an input.
+#define DIR_INPUT(_pin)                PORT_DIR_INPUT(_pin)
+
+// Second level, "_pin" expanded into its port letter and bit.
+#define PORT_SET_OUTPUT(_port, _bit)   SET_BIT(PORT##_port, _bit)
+#define PORT_CLR_OUTPUT(_port, _bit)   CLR_BIT(PORT##_port, _bit)
+#define PORT_GET_INPUT(_port, _bit)    ((PIN##_port >> (_bit)) & 0x01)
+#define PORT_DIR_OUTPUT(_port, _bit)   SET_BIT(DDR##_port, _bit)
+#define PORT_DIR_INPUT(_port, _bit)    CLR_BIT(DDR##_port, _bit)
+
+#endif /* _PORT_H_ */
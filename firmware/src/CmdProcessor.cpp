@@ -79,7 +79,8 @@ bool CmdProcessor::checkCommands()
             } else {
                 _pHW->print("Ok\n");
             }
-        } else {
+        } else if (_cmdPos < 127) {
+            // Keep room for the terminating null.
             _pCmdString[_cmdPos++] = c;
         }
     }
@@ -0,0 +1,137 @@
+
+#include <string.h>
+#include <stddef.h>
+#ifdef __AVR__
+#include <avr/eeprom.h>
+#else
+#include <stdio.h>
+#endif
+#include "ConfigStore.h"
+
+ConfigStore::ConfigStore()
+{
+    setDefaults();
+    _loaded = false;
+}
+
+ConfigStore::~ConfigStore()
+{
+}
+
+//! Read the record from EEPROM. Falls back to the defaults and
+//! returns false when the record is missing, of another version
+//! or corrupted.
+bool ConfigStore::load() {
+    ConfigRecord rec;
+
+    readBytes(CONFIG_RECORD_ADDR, &rec, sizeof(rec));
+    _loaded = (rec.magic == CONFIG_RECORD_MAGIC) &&
+              (rec.version == CONFIG_RECORD_VERSION) &&
+              (rec.crc == crc16((const uint8_t*)&rec, offsetof(ConfigRecord, crc)));
+    if (_loaded) {
+        _record = rec;
+    } else {
+        setDefaults();
+    }
+
+    return _loaded;
+}
+
+//! true if the settings come from EEPROM.
+bool ConfigStore::loaded() {
+    return _loaded;
+}
+
+//! Settings used without a valid record. The PLM-1 configuration
+//! string is left empty: plm1_configure_start() then uses the one
+//! generated from plmcfg.h.
+void ConfigStore::setDefaults() {
+    memset(&_record, 0, sizeof(_record));
+    _record.magic = CONFIG_RECORD_MAGIC;
+    _record.version = CONFIG_RECORD_VERSION;
+    _record.txChannel = PLM_TX_CHANNEL;
+    _record.serialRate = CONFIG_SERIAL_RATE;
+}
+
+//! Current settings, to be read or changed before commit().
+ConfigRecord& ConfigStore::record() {
+    return _record;
+}
+
+//! Write the current settings to EEPROM.
+bool ConfigStore::commit() {
+    _record.magic = CONFIG_RECORD_MAGIC;
+    _record.version = CONFIG_RECORD_VERSION;
+    _record.crc = crc16((const uint8_t*)&_record, offsetof(ConfigRecord, crc));
+    _loaded = writeBytes(CONFIG_RECORD_ADDR, &_record, sizeof(_record));
+
+    return _loaded;
+}
+
+//! CRC16-CCITT (polynomial 0x1021, initial value 0xFFFF).
+uint16_t ConfigStore::crc16(const uint8_t* pData, uint16_t len) {
+    uint16_t crc = 0xFFFF;
+
+    while (len--) {
+        crc ^= (uint16_t)(*pData++) << 8;
+        for (uint8_t i = 0; i < 8; i++) {
+            crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+        }
+    }
+
+    return crc;
+}
+
+#ifdef __AVR__
+
+void ConfigStore::readBytes(uint16_t addr, void* pData, uint16_t len) {
+    eeprom_read_block(pData, (const void*)addr, len);
+}
+
+bool ConfigStore::writeBytes(uint16_t addr, const void* pData, uint16_t len) {
+    // Only the bytes that changed are written, sparing EEPROM cycles.
+    eeprom_update_block(pData, (void*)addr, len);
+    return true;
+}
+
+#else
+
+// Host builds: the EEPROM is a file of CONFIG_EEPROM_SIZE bytes,
+// read as erased (0xFF) until written.
+
+void ConfigStore::readBytes(uint16_t addr, void* pData, uint16_t len) {
+    FILE* pFile = fopen(CONFIG_EEPROM_FILE, "rb");
+    size_t cnt = 0;
+
+    if (pFile != NULL) {
+        if (fseek(pFile, addr, SEEK_SET) == 0) {
+            cnt = fread(pData, 1, len, pFile);
+        }
+        fclose(pFile);
+    }
+    memset((uint8_t*)pData + cnt, 0xFF, len - cnt);
+}
+
+bool ConfigStore::writeBytes(uint16_t addr, const void* pData, uint16_t len) {
+    FILE* pFile = fopen(CONFIG_EEPROM_FILE, "r+b");
+    bool written = false;
+
+    if (pFile == NULL) {
+        // Create an erased EEPROM.
+        uint8_t erased[CONFIG_EEPROM_SIZE];
+        memset(erased, 0xFF, sizeof(erased));
+        pFile = fopen(CONFIG_EEPROM_FILE, "w+b");
+        if (pFile != NULL) {
+            fwrite(erased, 1, sizeof(erased), pFile);
+        }
+    }
+    if (pFile != NULL) {
+        written = (fseek(pFile, addr, SEEK_SET) == 0) &&
+                  (fwrite(pData, 1, len, pFile) == len);
+        fclose(pFile);
+    }
+
+    return written;
+}
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef CONFIGSTORE_H
+#define CONFIGSTORE_H
+
+#include <stdint.h>
+#include "plm1.h"
+
+#define CONFIG_RECORD_MAGIC     0x504C      //! "PL", marks a written record.
+#define CONFIG_RECORD_VERSION   2           //! Bump when ConfigRecord changes.
+#define CONFIG_RECORD_ADDR      0           //! EEPROM offset of the record.
+#define CONFIG_SERIAL_RATE      9600        //! Default serial rate.
+#ifndef CONFIG_EEPROM_FILE
+#define CONFIG_EEPROM_FILE      "eeprom.bin" //! File backing the EEPROM on host builds.
+#endif
+#define CONFIG_EEPROM_SIZE      1024        //! Size of the EEPROM (ATmega328).
+
+//! Settings kept across resets.
+struct ConfigRecord
+{
+    uint16_t        magic;                          //! CONFIG_RECORD_MAGIC.
+    uint8_t         version;                        //! CONFIG_RECORD_VERSION.
+    uint8_t         plmCfg[PLM_CONFIG_DATA_LENGTH]; //! PLM-1 configuration string, CRC nibble included.
+    uint8_t         txChannel;                      //! Transmission channel.
+    uint8_t         node;                           //! Address of this node, seeds the collision backoff (0 = not set).
+    uint32_t        serialRate;                     //! Serial rate of the command interface.
+    uint16_t        crc;                            //! CRC16 of the fields above.
+};
+
+//! Versioned, CRC checked configuration record in EEPROM. On host
+//! builds the EEPROM is a file, CONFIG_EEPROM_FILE.
+class ConfigStore
+{
+    ConfigRecord    _record;        //! Current settings.
+    bool            _loaded;        //! Record read from EEPROM is valid.
+
+    static uint16_t crc16(const uint8_t* pData, uint16_t len);
+    static void readBytes(uint16_t addr, void* pData, uint16_t len);
+    static bool writeBytes(uint16_t addr, const void* pData, uint16_t len);
+
+public:
+    ConfigStore();
+    ~ConfigStore();
+
+    bool load();
+    bool loaded();
+    void setDefaults();
+    ConfigRecord& record();
+    bool commit();
+};
+
+#endif
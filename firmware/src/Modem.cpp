@@ -1,11 +1,56 @@
 
+#include <stdio.h>
 #include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
 #include <SPI.h>
 #include "Modem.h"
 
-static char buffer[128];
+static char buffer[48];       //! Longest reply line built at once.
+static plm1_t* pIsrPlm;       //! Driver instance served by the ISRs, set by setup().
 
-Modem::Modem()
+//! PLM-1 interrupt, falling edge of INT0 (PD2).
+ISR(INT0_vect)
+{
+	plm1_interrupt(pIsrPlm);
+}
+
+//! Nibble exchanged with PLM-1.
+ISR(SPI_STC_vect)
+{
+	plm1_spi_isr(pIsrPlm, SPDR);
+}
+
+//! 1 ms time base of the driver.
+ISR(TIMER2_COMPA_vect)
+{
+	plm1_timer(pIsrPlm);
+}
+
+//! Seed of the collision backoff. Nodes colliding with the same seed
+//! would draw the same slots and collide again, so it comes from the
+//! node address; a node without address takes the noise of the ADC
+//! on the 1.1 V bandgap instead.
+static uint16_t backoffSeed(uint8_t node) {
+	if (node != 0) {
+		return PLM_BACKOFF_NODE_SEED(node);
+	}
+	
+	uint16_t seed = PLM_BACKOFF_SEED;
+	ADMUX = _BV(REFS0) | 0x0E;
+	ADCSRA = _BV(ADEN) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+	for (uint8_t i = 0; i < 32; i++) {
+		ADCSRA |= _BV(ADSC);
+		while (ADCSRA & _BV(ADSC)) {
+		}
+		seed = (uint16_t)((seed << 3) | (seed >> 13)) ^ ADC;
+	}
+	ADCSRA = 0;
+	
+	return seed;
+}
+
+Modem::Modem() : _plm(), _txChannel(PLM_TX_CHANNEL), _configuring(false), _txAccepted(0), _creditSlots(0), _creditActive(false), _creditTick(0)
 {
 }
 
@@ -13,12 +58,43 @@ Modem::~Modem()
 {
 }
 
-void Modem::setup() {
+//! Start the PLM-1 with the stored settings. The configuration
+//! string is used as is; an empty one selects the plmcfg.h default.
+void Modem::setup(const ConfigRecord& rConfig) {
 	SPI.begin();
 	SPI.setClockDivider(SPI_CLOCK_DIV32); // 16Mhz / 32
 	SPI.setDataMode(SPI_MODE0);
 	SPI.setBitOrder(MSBFIRST);
 	
+	// nRESET (PB0) is driven by the driver; CS (PB2) is SS, already an
+	// output after SPI.begin().
+	DDRB |= _BV(PB0) | _BV(PB2);
+	
+	// PLM-1 interrupt on falling edge. The driver unmasks INT0, SPI and
+	// Timer2 interrupts itself.
+	EICRA = (EICRA & ~(_BV(ISC01) | _BV(ISC00))) | _BV(ISC01);
+	
+	// plm1_timer() every 1 ms: 16 MHz / 128 / 125, Timer2 in CTC mode.
+	// Timer2 PWM (pins 3 and 11) is lost, pin 11 is MOSI anyway.
+	TCCR2A = _BV(WGM21);
+	TCCR2B = _BV(CS22) | _BV(CS20);
+	OCR2A = 124;
+	
+#if PLM_TRACE_SIZE > 0
+	// Trace timestamps: Timer1 free running over its 16 bits, 16 MHz / 64,
+	// 4 us per tick (plm1trace.py --tick-us 4). The Arduino core leaves it
+	// in 8 bits PWM mode; its PWM (pins 9 and 10) is lost.
+	TCCR1A = 0;
+	TCCR1B = _BV(CS11) | _BV(CS10);
+#endif
+	
+	memcpy(_cfg, rConfig.plmCfg, PLM_CONFIG_DATA_LENGTH);
+	_txChannel = rConfig.txChannel;
+	pIsrPlm = &_plm;
+	plm1_init(&_plm, &plm1_default_port);
+	setNode(rConfig.node);
+	plm1_configure_start(&_plm, _cfg, NULL);
+	_configuring = true;
 }
 
 void Modem::setSerial(Stream& stream) {
@@ -31,8 +107,96 @@ uint8_t Modem::test(uint8_t valIn) {
 	return result;
 }
 
-void Modem::Loop()
-{
+//! One counter of the driver statistics.
+uint32_t Modem::getStat(plm1_stat stat, uint8_t index) {
+	return plm1_get_stat(&_plm, stat, index);
+}
+
+void Modem::clearStats() {
+	plm1_clear_stats(&_plm);
+}
+
+uint8_t Modem::getJournal(plm1_event* pEvents, uint8_t maxEvents) {
+	return plm1_get_journal(&_plm, pEvents, maxEvents);
+}
+
+uint8_t Modem::readTrace(plm1_trace_entry* pEntries, uint8_t maxEntries) {
+	return plm1_read_trace(&_plm, pEntries, maxEntries);
+}
+
+//! Configuration string in use, false while PLM-1 is not configured.
+bool Modem::getConfiguration(uint8_t* pCfg) {
+	return plm1_get_configuration(&_plm, pCfg);
+}
+
+uint8_t Modem::txChannel() {
+	return _txChannel;
+}
+
+//! Seed the collision backoff from the address of this node.
+void Modem::setNode(uint8_t node) {
+	plm1_set_backoff(&_plm, backoffSeed(node), PLM_BACKOFF_MIN_WINDOW, PLM_BACKOFF_MAX_WINDOW);
 }
 
+//! Queue a packet from the host on the transmission channel. The
+//! host only sends within its credits, so the packet takes one of
+//! the buffers reserved for it; false if the host overran them.
+//! Other senders never use those buffers.
+bool Modem::send(uint8_t* pData, uint8_t length) {
+	if (plm1_send_reserved(&_plm, pData, length, PLM1_PRIO_NORMAL, _txChannel) == PLM_TX_NO_HANDLE) {
+		return false;
+	}
+	_txAccepted++;
+	_creditSlots--;
+	return true;
+}
 
+//! Transmission credits of the host: slots reserved for its next
+//! packets, data bytes they can carry and packets accepted so far.
+//! The host may queue "slots - (sent - accepted)" more packets, so
+//! that a packet crossing the credit update is not counted twice.
+//! Up to MODEM_TX_CREDITS buffers are reserved, once PLM-1 is
+//! configured, and kept until the host is idle.
+uint8_t Modem::getCredit(uint16_t& bytes, uint8_t& accepted) {
+	if (!_configuring) {
+		_creditSlots = plm1_tx_reserve(&_plm, MODEM_TX_CREDITS);
+		_creditActive = true;
+		_creditTick = plm1_get_tick(&_plm);
+	}
+	bytes = (uint16_t)_creditSlots * PLM_PACKET_DATA_SIZE;
+	accepted = _txAccepted;
+	return _creditSlots;
+}
+
+void Modem::Loop()
+{
+	if (_configuring) {
+		_configuring = (plm1_configure_poll(&_plm) == PLM1_CFG_IN_PROGRESS);
+		return;
+	}
+	
+	// Recover from a stuck PLM-1 within the watchdog timeouts.
+	plm1_watchdog(&_plm);
+	
+	if (!_creditActive) {
+		return;
+	}
+	
+	// Unsolicited credit update once sent packets free their buffers,
+	// or once the host is idle and its buffers go back to reception.
+	uint8_t slots;
+	if ((uint16_t)(plm1_get_tick(&_plm) - _creditTick) >= MODEM_CREDIT_IDLE_TICKS) {
+		_creditActive = false;
+		slots = plm1_tx_reserve(&_plm, 0);
+	} else {
+		slots = plm1_tx_reserve(&_plm, MODEM_TX_CREDITS);
+		if (slots <= _creditSlots) {
+			_creditSlots = slots;
+			return;
+		}
+	}
+	_creditSlots = slots;
+	sprintf(buffer,"Ok:credit slots:%u bytes:%u acked:%u\n",_creditSlots,
+	        (uint16_t)_creditSlots * PLM_PACKET_DATA_SIZE,_txAccepted);
+	_pSerial->print(buffer);
+}
@@ -3,21 +3,45 @@
 
 #include <Stream.h>
 //#include "plmcfg.h"
+#include "plm1.h"
+#include "ConfigStore.h"
+
+#define MODEM_TX_CREDITS        2           //! Buffers reserved for the host while it sends.
+#define MODEM_CREDIT_IDLE_TICKS 2000        //! Ticks (ms) without "send" or "credit" before they are released.
 
 class Modem
 {
     Stream          * _pSerial;           //! Store the serial object.
+    plm1_t            _plm;               //! PLM-1 driver instance.
+    uint8_t           _cfg[PLM_CONFIG_DATA_LENGTH]; //! Configuration string sent at boot.
+    uint8_t           _txChannel;         //! Transmission channel.
+    bool              _configuring;       //! PLM-1 configuration in progress.
+    uint8_t           _txAccepted;        //! Packets accepted from the host (wraps).
+    uint8_t           _creditSlots;       //! Transmission slots last advertised to the host.
+    bool              _creditActive;      //! Host granted credits, not idle yet.
+    uint16_t          _creditTick;        //! Tick of the last "send" or "credit" of the host.
 
 public:
     Modem();
     ~Modem();
     
     void setSerial(Stream& stream);
-    void setup();
+    void setup(const ConfigRecord& rConfig);
     void Loop();
     
     uint8_t test(uint8_t valin);
     
+    uint32_t getStat(plm1_stat stat, uint8_t index = 0);
+    void clearStats();
+    uint8_t getJournal(plm1_event* pEvents, uint8_t maxEvents);
+    uint8_t readTrace(plm1_trace_entry* pEntries, uint8_t maxEntries);
+    bool getConfiguration(uint8_t* pCfg);
+    uint8_t txChannel();
+    void setNode(uint8_t node);
+    
+    bool send(uint8_t* pData, uint8_t length);
+    uint8_t getCredit(uint16_t& bytes, uint8_t& accepted);
+    
 };
 
 #endif
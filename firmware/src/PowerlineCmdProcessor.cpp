@@ -1,12 +1,31 @@
 
+#include <ctype.h>
+#include <stdio.h>
 #include <string.h>
 #include "PowerlineCmdProcessor.h"
 
-static char buffer[1024];
+static char buffer[64];       //! Longest reply line built at once.
 
-PowerlineCmdProcessor::PowerlineCmdProcessor(Modem& rModem) : CmdProcessor()
+//! Convert a string of hex digits into bytes. Return the number of
+//! bytes, 0 if the string is empty, odd, too long or not hex.
+static uint8_t parseHex(const char* pHex, uint8_t* pData, uint8_t maxLength)
+{
+    uint8_t length = 0;
+    while (pHex[0] && pHex[1] && length < maxLength) {
+        unsigned int byte;
+        if (!isxdigit(pHex[0]) || !isxdigit(pHex[1]) || sscanf(pHex,"%2x",&byte) != 1) {
+            return 0;
+        }
+        pData[length++] = (uint8_t)byte;
+        pHex += 2;
+    }
+    return (*pHex == 0) ? length : 0;
+}
+
+PowerlineCmdProcessor::PowerlineCmdProcessor(Modem& rModem, ConfigStore& rConfig) : CmdProcessor()
 {
 	_pModem = &rModem;
+	_pConfig = &rConfig;
 }
 
 PowerlineCmdProcessor::~PowerlineCmdProcessor()
@@ -34,11 +53,131 @@ void PowerlineCmdProcessor::Loop()
             } else {
                 _pHW->print("Fail:test require a single param.\n");
             }
+        } else if(strcmp(pCmd,"stats") == 0) {
+            // Counters are read one by one, a plm1_stats would not fit
+            // on the stack.
+            sprintf(buffer,"Ok:stats tx:%lu/%lu rx:%lu/%lu",
+                    _pModem->getStat(PLM1_STAT_TX_PACKETS),_pModem->getStat(PLM1_STAT_TX_BYTES),
+                    _pModem->getStat(PLM1_STAT_RX_PACKETS),_pModem->getStat(PLM1_STAT_RX_BYTES));
+            _pHW->print(buffer);
+            sprintf(buffer," neg:%lu retry:%lu\n",
+                    _pModem->getStat(PLM1_STAT_NEGOTIATIONS),_pModem->getStat(PLM1_STAT_RETRIES));
+            _pHW->print(buffer);
+            for (uint8_t i = 0; i < 16; i++) {
+                uint32_t count = _pModem->getStat(PLM1_STAT_STATUS, i);
+                if (count != 0) {
+                    sprintf(buffer,"Ok:status 0x%02X:%lu\n",i,count);
+                    _pHW->print(buffer);
+                }
+            }
+            for (uint8_t i = 0; i < PLM1_STATE_NBR; i++) {
+                sprintf(buffer,"Ok:dwell %d:%lu\n",i,_pModem->getStat(PLM1_STAT_DWELL, i));
+                _pHW->print(buffer);
+            }
+            for (uint8_t i = 0; i < PLM1_DROP_NBR; i++) {
+                uint32_t count = _pModem->getStat(PLM1_STAT_RX_DROPS, i);
+                if (count != 0) {
+                    sprintf(buffer,"Ok:drop %d:%lu\n",i,count);
+                    _pHW->print(buffer);
+                }
+            }
+            for (uint8_t i = 0; i < PLM1_WD_NBR; i++) {
+                uint32_t count = _pModem->getStat(PLM1_STAT_RECOVERIES, i);
+                if (count != 0) {
+                    sprintf(buffer,"Ok:recovery %d:%lu\n",i,count);
+                    _pHW->print(buffer);
+                }
+            }
+        } else if(strcmp(pCmd,"clearstats") == 0) {
+            _pModem->clearStats();
+            _pHW->print("Ok:stats cleared\n");
+        } else if(strcmp(pCmd,"journal") == 0) {
+            plm1_event events[PLM_JOURNAL_SIZE];
+            uint8_t cnt = _pModem->getJournal(events, PLM_JOURNAL_SIZE);
+            for (uint8_t i = 0; i < cnt; i++) {
+                sprintf(buffer,"Ok:journal %u status:0x%02X state:%u\n",
+                        events[i].tick,events[i].status,events[i].state);
+                _pHW->print(buffer);
+            }
+            sprintf(buffer,"Ok:journal events:%d\n",cnt);
+            _pHW->print(buffer);
+        } else if(strcmp(pCmd,"trace") == 0) {
+            // Header gives the entry count, followed by the raw 5 bytes
+            // entries (see tools/plm1trace.py).
+            plm1_trace_entry entries[8];
+            uint8_t cnt = _pModem->readTrace(NULL, 0);
+            sprintf(buffer,"Ok:trace %d\n",cnt);
+            _pHW->print(buffer);
+            while (cnt > 0) {
+                uint8_t n = _pModem->readTrace(entries, (cnt < 8) ? cnt : 8);
+                _pHW->write((const uint8_t*)entries, n * sizeof(plm1_trace_entry));
+                cnt -= n;
+            }
+        } else if(strcmp(pCmd,"config") == 0) {
+            ConfigRecord& rec = _pConfig->record();
+            sprintf(buffer,"Ok:config from:%s channel:%u node:%u rate:%lu\n",
+                    _pConfig->loaded() ? "eeprom" : "defaults",
+                    rec.txChannel,rec.node,rec.serialRate);
+            _pHW->print(buffer);
+        } else if(strcmp(pCmd,"saveconfig") == 0) {
+            // Keep the stored string while PLM-1 is not configured.
+            ConfigRecord& rec = _pConfig->record();
+            uint8_t cfg[PLM_CONFIG_DATA_LENGTH];
+            if (_pModem->getConfiguration(cfg)) {
+                memcpy(rec.plmCfg, cfg, PLM_CONFIG_DATA_LENGTH);
+            }
+            rec.txChannel = _pModem->txChannel();
+            if (_pConfig->commit()) {
+                _pHW->print("Ok:config saved\n");
+            } else {
+                _pHW->print("Fail:config not saved\n");
+            }
+        } else if(strcmp(pCmd,"node") == 0) {
+            // Address of this node, unique on the line: it seeds the
+            // collision backoff. Applied now, kept by saveconfig.
+            ConfigRecord& rec = _pConfig->record();
+            if (paramCnt() > 0) {
+                getParam(0,rec.node);
+                _pModem->setNode(rec.node);
+            }
+            sprintf(buffer,"Ok:node %u\n",rec.node);
+            _pHW->print(buffer);
+        } else if(strcmp(pCmd,"send") == 0) {
+            // Flow controlled by credits: once the host asks for
+            // "credit", the node reserves a few buffers for it and
+            // advertises them on the replies of "send" and "credit", or
+            // unsolicited when buffers are freed, and when they are
+            // released after the host stayed idle. The host keeps count
+            // of the packets it sent and never has more than "slots" of
+            // them not yet acked; a refused packet is kept by the host.
+            uint8_t data[PLM_PACKET_DATA_SIZE];
+            uint8_t length = (paramCnt() > 0) ? parseHex(_pTokens[0], data, PLM_PACKET_DATA_SIZE) : 0;
+            uint16_t bytes;
+            uint8_t acked;
+            if (length == 0) {
+                _pHW->print("Fail:send require hex data.\n");
+            } else if (_pModem->send(data, length)) {
+                uint8_t slots = _pModem->getCredit(bytes, acked);
+                sprintf(buffer,"Ok:send slots:%u bytes:%u acked:%u\n",slots,bytes,acked);
+                _pHW->print(buffer);
+            } else {
+                uint8_t slots = _pModem->getCredit(bytes, acked);
+                sprintf(buffer,"Fail:send no credit slots:%u bytes:%u acked:%u\n",slots,bytes,acked);
+                _pHW->print(buffer);
+            }
+        } else if(strcmp(pCmd,"credit") == 0) {
+            uint16_t bytes;
+            uint8_t acked;
+            uint8_t slots = _pModem->getCredit(bytes, acked);
+            sprintf(buffer,"Ok:credit slots:%u bytes:%u acked:%u\n",slots,bytes,acked);
+            _pHW->print(buffer);
         } else if(strcmp(pCmd,"help") == 0) {
-			_pHW->print("Ok:valid commands are=> status, levels, pump, north, south, sump_trigger, sump_trig_en, help.\n");
+			_pHW->print("Ok:valid commands are=> test, stats, clearstats, journal, trace, config, saveconfig, node, send, credit, help.\n");
         } else {
-            sprintf(buffer,"Fail:This is an Invalid Cmd:%s\n",pCmd);
-            _pHW->print(buffer);
+            // Command may be longer than the buffer.
+            _pHW->print("Fail:This is an Invalid Cmd:");
+            _pHW->print(pCmd);
+            _pHW->print("\n");
         }
 
         resetCmd();
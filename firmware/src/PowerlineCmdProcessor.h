@@ -3,14 +3,16 @@
 
 #include "CmdProcessor.h"
 #include "Modem.h"
+#include "ConfigStore.h"
 
 class PowerlineCmdProcessor : public CmdProcessor
 {
 
 	Modem* _pModem;
+	ConfigStore* _pConfig;
 
 public:
-    PowerlineCmdProcessor(Modem& rModem);
+    PowerlineCmdProcessor(Modem& rModem, ConfigStore& rConfig);
     ~PowerlineCmdProcessor();
     
     
@@ -3,12 +3,15 @@
 #include <stdio.h>
 #include "PowerlineCmdProcessor.h"
 #include "Modem.h"
+#include "ConfigStore.h"
 //#include "plmcfg.h"
 //#include "plm1.h"
 
+ConfigStore theConfig = ConfigStore();
+
 Modem  theModem = Modem();
 
-PowerlineCmdProcessor cmdProc = PowerlineCmdProcessor(theModem);
+PowerlineCmdProcessor cmdProc = PowerlineCmdProcessor(theModem, theConfig);
 
 int statusLed = 7;
 int errorLed = 7;
@@ -49,13 +52,19 @@ void toggleLed()
 // ------------------ S E T U P ----------------------------------------------
 
 void setup() {
-    Serial.begin(9600);
+    // Stored settings, or defaults if the record is invalid.
+    theConfig.load();
+
+    Serial.begin(theConfig.record().serialRate);
 
     //Serial.setTimeout(1000);
     cmdProc.setSerial(Serial);
     theModem.setSerial(Serial);
     
-	pinMode(statusLed,OUTPUT);
+	// No status LED: pin 7 is CNFGD of PLM-1 (PLM_CNFGD), an input.
+	//pinMode(statusLed,OUTPUT);
+	
+	theModem.setup(theConfig.record());
 	
 	Serial.print("Welcome to the Powerline Controller\n");
 }
@@ -67,6 +76,7 @@ void loop()
     char buffer[128];
 
     cmdProc.Loop();
+    theModem.Loop();
 
 	if ( millis() - oneSecondCounter > oneSecondInterval) {
 		oneSecondCounter = millis();
@@ -0,0 +1,673 @@
+/*******************************************************************************
+* Filename:     plm1prof.c
+* Description:  Cycle-accurate profiler of the PLM-1 library ISRs, running the
+*               profiling firmware under simavr.
+* Version:      1.0.0
+* Note:         Usage: plm1prof <firmware.elf> <firmware.sym> [options]
+*
+*                 --seconds <s>      Simulated time (default 5).
+*                 --bitrate <bps>    Line bit rate (default from plmcfg.h).
+*                 --rx-interval <ms> Period of the packets received from the
+*                                    line, 0 for none (default 50).
+*                 --rx-size <bytes>  Data bytes of the received packets
+*                                    (default 16).
+*                 --collisions <%>   Negotiations lost to a collision
+*                                    (default 5).
+*
+*               The SPI port of the ATmega328P is wired to a behavioral model
+*               of the PLM-1: it answers each SPI exchange with its oldest
+*               pending event (TXRE, received nibble, collision...) or NOP,
+*               shifts transmitted nibbles out at the line bit rate and pulls
+*               INT0 low when an event waits outside of a SPI transaction.
+*
+*               The CPU is stepped one instruction at a time. An ISR runs from
+*               the first instruction of its __vector_N to its RETI; latency
+*               runs from the interrupt flag being set to that first
+*               instruction. SPI ISRs are broken down by driver state and by
+*               received nibble, read at ISR entry.
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sim_avr.h>
+#include <sim_elf.h>
+#include <sim_irq.h>
+#include <sim_cycle_timers.h>
+#include <avr_ioport.h>
+#include <avr_spi.h>
+#include "plmcfg.h"
+
+/*------------------------------------------------------------------------------
+  Local constants declaration
+------------------------------------------------------------------------------*/
+
+#define PROF_F_CPU                     16000000UL               // Clock of the modem board.
+#define PROF_DATA_OFFSET               0x800000                 // Data space offset of avr-nm addresses.
+
+// ATmega328P registers (data space addresses).
+#define REG_EIFR                       0x3C
+#define REG_TIFR2                      0x37
+#define REG_SPSR                       0x4D
+#define REG_SPL                        0x5D
+#define REG_SPH                        0x5E
+
+// Interrupt flags.
+#define FLAG_INTF0                     0x01                     // EIFR.
+#define FLAG_OCF2A                     0x02                     // TIFR2.
+#define FLAG_SPIF                      0x80                     // SPSR.
+
+// RETI opcode.
+#define OPCODE_RETI                    0x9518
+#define CYCLES_RETI                    4
+
+// Pins.
+#define PIN_CS                         2                        // PB2, active low.
+#define PIN_INT0                       2                        // PD2.
+#define PIN_CNFGD                      7                        // PD7.
+
+// PLM-1 control codes.
+#define CC_EOP                         0x11
+#define CC_COLLISION                   0x14
+#define CC_RESET                       0x16
+#define CC_TX_UNDERRUN                 0x17
+#define CC_TXRE                        0x18
+#define CC_NOP                         0x1F
+
+#define CONFIG_NIBBLES                 38                       // Nibbles of the configuration string.
+#define NEGOTIATION_NIBBLES            8                        // Line time of a negotiation, in nibbles.
+#define EVENT_QUEUE_SIZE               64                       // Events pending in the model (power of 2).
+#define STATE_NBR                      6                        // plm1_state values.
+#define STATE_IDLE                     2                        // PLM1_STATE_IDLE.
+#define NIBBLE_CLASS_NBR               18                       // Data nibbles, 16 control codes, unknown.
+#define NO_NIBBLE                      0xFF
+
+/*------------------------------------------------------------------------------
+  Local types declaration
+------------------------------------------------------------------------------*/
+
+// Profiled vectors.
+enum {
+    VEC_INT0 = 0,
+    VEC_TIMER2,
+    VEC_SPI,
+    VEC_NBR
+};
+
+// Cycle counters of a group of ISR invocations.
+typedef struct {
+    uint32_t count;
+    uint64_t total;
+    uint32_t min;
+    uint32_t max;
+} prof_bin;
+
+// Profiled vector.
+typedef struct {
+    const char* name;
+    const char* symbol;
+    uint16_t flag_reg;
+    uint8_t flag;
+    uint32_t addr;                                              // Address of __vector_N.
+    uint64_t flag_cycle;                                        // Cycle the flag was seen set (0 if clear).
+    uint32_t max_latency;
+    prof_bin total;
+    prof_bin bins[STATE_NBR][NIBBLE_CLASS_NBR];
+} prof_vector;
+
+// Behavioral model of the PLM-1.
+typedef struct {
+    avr_t* avr;
+    avr_irq_t* spi_in;
+    avr_irq_t* int0;
+    avr_irq_t* cnfgd;
+    uint64_t nibble_cycles;                                     // Line time of a nibble.
+    uint8_t events[EVENT_QUEUE_SIZE];
+    uint8_t event_head;
+    uint8_t event_tail;
+    uint8_t last_reply;                                         // Nibble answered to the last exchange.
+    int cs;                                                     // Chip select asserted.
+    int config_nibbles;                                         // Configuration nibbles left, -1 when not configuring.
+    int tx_active;                                              // Transmission on the line (negotiation included).
+    uintptr_t tx_negotiation;                                   // Negotiations started, tags their timer.
+    int tx_on_line;                                             // Line acquired.
+    uint8_t tx_reg;                                             // Transmit register, NO_NIBBLE if empty.
+    uint8_t tx_shift;                                           // Nibble being shifted on the line.
+    int rx_active;
+    uint8_t rx_packet[2 + 64];
+    int rx_nibbles;                                             // Nibbles of the packet being received.
+    int rx_index;
+    uint64_t rx_interval;                                       // Cycles between received packets, 0 for none.
+    int rx_size;
+    int collision_pct;
+    uint32_t seed;
+    uint32_t packets_sent;
+    uint32_t packets_received;
+    uint32_t collisions;
+    uint32_t underruns;
+} plm1_model;
+
+/*------------------------------------------------------------------------------
+  Local variables declaration
+------------------------------------------------------------------------------*/
+
+static prof_vector vectors[VEC_NBR] = {
+    { "INT0",    "__vector_1",  REG_EIFR,  FLAG_INTF0 },
+    { "TIMER2",  "__vector_7",  REG_TIFR2, FLAG_OCF2A },
+    { "SPI_STC", "__vector_17", REG_SPSR,  FLAG_SPIF  }
+};
+
+static const char* state_names[STATE_NBR] = {
+    "NOT_CFG", "CONFIG", "IDLE", "NEGO", "TX", "RX"
+};
+
+static plm1_model model;
+
+/*------------------------------------------------------------------------------
+  PLM-1 model
+------------------------------------------------------------------------------*/
+
+static uint32_t model_random(void)
+{
+    model.seed = model.seed * 1103515245 + 12345;
+    return (model.seed >> 16);
+}
+
+// Request the attention of the MCU if events wait outside of a transaction.
+static void model_notify(void)
+{
+    if(!model.cs && (model.event_head != model.event_tail))
+    {
+        avr_raise_irq(model.int0, 0);
+        avr_raise_irq(model.int0, 1);
+    }
+}
+
+static void model_event(uint8_t nibble)
+{
+    if((uint8_t)(model.event_head - model.event_tail) < EVENT_QUEUE_SIZE)
+    {
+        model.events[model.event_head++ & (EVENT_QUEUE_SIZE - 1)] = nibble;
+    }
+    model_notify();
+}
+
+static avr_cycle_count_t model_shift_done(avr_t* avr, avr_cycle_count_t when, void* param);
+static void model_negotiate(avr_t* avr);
+
+// Move the transmit register to the line.
+static void model_shift(avr_t* avr)
+{
+    model.tx_shift = model.tx_reg;
+    model.tx_reg = NO_NIBBLE;
+    model_event(CC_TXRE);
+    avr_cycle_timer_register(avr, model.nibble_cycles, model_shift_done, NULL);
+}
+
+static avr_cycle_count_t model_shift_done(avr_t* avr, avr_cycle_count_t when, void* param)
+{
+    if(model.tx_shift == CC_EOP)
+    {
+        model.tx_on_line = 0;
+        model.packets_sent++;
+
+        // Next packet written after the End Of Packet?
+        model.tx_active = (model.tx_reg != NO_NIBBLE);
+        if(model.tx_active)
+        {
+            model_negotiate(avr);
+        }
+    }
+    else if(model.tx_reg != NO_NIBBLE)
+    {
+        model_shift(avr);
+    }
+    else
+    {
+        model.tx_active = 0;
+        model.tx_on_line = 0;
+        model.underruns++;
+        model_event(CC_TX_UNDERRUN);
+    }
+
+    return (0);
+}
+
+static avr_cycle_count_t model_negotiated(avr_t* avr, avr_cycle_count_t when, void* param)
+{
+    // Ignore a negotiation given up meanwhile for a reception.
+    if(model.tx_active && ((uintptr_t)param == model.tx_negotiation))
+    {
+        if((int)(model_random() % 100) < model.collision_pct)
+        {
+            model.tx_active = 0;
+            model.tx_reg = NO_NIBBLE;
+            model.collisions++;
+            model_event(CC_COLLISION);
+        }
+        else
+        {
+            model.tx_on_line = 1;
+            model_shift(avr);
+        }
+    }
+
+    return (0);
+}
+
+// Acquire the line for the nibble in the transmit register.
+static void model_negotiate(avr_t* avr)
+{
+    model.tx_negotiation++;
+    avr_cycle_timer_register(avr, NEGOTIATION_NIBBLES * model.nibble_cycles, model_negotiated,
+                             (void*)model.tx_negotiation);
+}
+
+static avr_cycle_count_t model_rx_nibble(avr_t* avr, avr_cycle_count_t when, void* param)
+{
+    uint8_t byte;
+
+    if(model.rx_index < model.rx_nibbles)
+    {
+        byte = model.rx_packet[model.rx_index >> 1];
+        model_event((model.rx_index & 1) ? (byte & 0x0F) : (byte >> 4));
+        model.rx_index++;
+        return (when + model.nibble_cycles);
+    }
+
+    model_event(CC_EOP);
+    model.rx_active = 0;
+    model.packets_received++;
+
+    return (0);
+}
+
+static avr_cycle_count_t model_rx_start(avr_t* avr, avr_cycle_count_t when, void* param)
+{
+    int i;
+
+    if(!model.tx_on_line && !model.rx_active && (model.config_nibbles < 0))
+    {
+        // A pending negotiation loses the line.
+        model.tx_active = 0;
+        model.tx_reg = NO_NIBBLE;
+
+        model.rx_packet[0] = 0xA0;
+        model.rx_packet[1] = 4;
+        for(i = 0; i < model.rx_size; i++)
+        {
+            model.rx_packet[2 + i] = (uint8_t)model_random();
+        }
+        model.rx_nibbles = 2 * (2 + model.rx_size);
+        model.rx_index = 0;
+        model.rx_active = 1;
+        avr_cycle_timer_register(avr, NEGOTIATION_NIBBLES * model.nibble_cycles, model_rx_nibble, NULL);
+    }
+
+    return (when + model.rx_interval);
+}
+
+// End of a SPI exchange: answer it, then handle the byte written by the MCU.
+static void model_spi(avr_irq_t* irq, uint32_t value, void* param)
+{
+    uint8_t reply = CC_NOP;
+
+    if(model.event_head != model.event_tail)
+    {
+        reply = model.events[model.event_tail++ & (EVENT_QUEUE_SIZE - 1)];
+    }
+    model.last_reply = reply;
+    avr_raise_irq(model.spi_in, reply);
+
+    if(value == CC_RESET)
+    {
+        model.config_nibbles = CONFIG_NIBBLES;
+        model.tx_active = 0;
+        model.tx_on_line = 0;
+        model.tx_reg = NO_NIBBLE;
+        model.event_head = model.event_tail;
+        avr_raise_irq(model.cnfgd, 0);
+    }
+    else if(model.config_nibbles > 0)
+    {
+        // CNFGD is read by the ISR at the end of the last nibble.
+        if(--model.config_nibbles == 0)
+        {
+            model.config_nibbles = -1;
+            avr_raise_irq(model.cnfgd, 1);
+        }
+    }
+    else if((value < 0x10) || (value == CC_EOP))
+    {
+        if(model.tx_active)
+        {
+            model.tx_reg = (uint8_t)value;
+        }
+        else if(!model.rx_active)
+        {
+            model.tx_active = 1;
+            model.tx_reg = (uint8_t)value;
+            model_negotiate(model.avr);
+        }
+    }
+}
+
+static void model_cs(avr_irq_t* irq, uint32_t value, void* param)
+{
+    model.cs = (value == 0);
+    model_notify();
+}
+
+/*------------------------------------------------------------------------------
+  Profiling
+------------------------------------------------------------------------------*/
+
+static void bin_add(prof_bin* bin, uint32_t cycles)
+{
+    if((bin->count == 0) || (cycles < bin->min))
+    {
+        bin->min = cycles;
+    }
+    if(cycles > bin->max)
+    {
+        bin->max = cycles;
+    }
+    bin->count++;
+    bin->total += cycles;
+}
+
+// Nibble class: 0 for data, 1 to 16 for 0x10 to 0x1F, then unknown.
+static int nibble_class(uint8_t nibble)
+{
+    if(nibble < 0x10)
+    {
+        return (0);
+    }
+    if(nibble < 0x20)
+    {
+        return (nibble - 0x0F);
+    }
+    return (NIBBLE_CLASS_NBR - 1);
+}
+
+static const char* nibble_name(int nibbleClass)
+{
+    static const char* names[NIBBLE_CLASS_NBR] = {
+        "data",
+        "EOF", "EOP", "RX_ERROR", "RX_OVERRUN", "COLLISION", "0x15", "RESET", "TX_UNDERRUN",
+        "TXRE", "TX_OVERRUN", "0x1A", "0x1B", "0x1C", "0x1D", "0x1E", "NOP",
+        "?"
+    };
+
+    return (names[nibbleClass]);
+}
+
+// Driver state, through the pointer published by the firmware.
+static int read_state(avr_t* avr, uint32_t stateAddr)
+{
+    return (avr->data[avr->data[stateAddr] | (avr->data[stateAddr + 1] << 8)]);
+}
+
+static int load_symbols(const char* path, uint32_t* stateAddr)
+{
+    char line[256];
+    char name[200];
+    char type;
+    unsigned int addr;
+    FILE* f = fopen(path, "r");
+    int i;
+
+    if(f == NULL)
+    {
+        return (-1);
+    }
+    while(fgets(line, sizeof(line), f) != NULL)
+    {
+        if(sscanf(line, "%x %c %199s", &addr, &type, name) != 3)
+        {
+            continue;
+        }
+        for(i = 0; i < VEC_NBR; i++)
+        {
+            if(strcmp(name, vectors[i].symbol) == 0)
+            {
+                vectors[i].addr = addr;
+            }
+        }
+        if(strcmp(name, "plm1prof_state") == 0)
+        {
+            *stateAddr = addr - PROF_DATA_OFFSET;
+        }
+    }
+    fclose(f);
+
+    for(i = 0; i < VEC_NBR; i++)
+    {
+        if(vectors[i].addr == 0)
+        {
+            fprintf(stderr, "plm1prof: %s not found in %s\n", vectors[i].symbol, path);
+            return (-1);
+        }
+    }
+    return ((*stateAddr != 0) ? 0 : -1);
+}
+
+static void report(double seconds, uint64_t isrCycles[VEC_NBR], uint64_t cycles, double bitrate)
+{
+    prof_bin* bin;
+    uint64_t all = 0;
+    int v;
+    int s;
+    int n;
+
+    printf("plm1prof: %.0f Hz, %.0f bps, %.2f s simulated (after configuration)\n",
+           (double)PROF_F_CPU, bitrate, seconds);
+    printf("line: %u packets sent, %u received, %u collisions, %u underruns\n\n",
+           model.packets_sent, model.packets_received, model.collisions, model.underruns);
+
+    printf("%-8s %-8s %-12s %8s %6s %8s %6s\n", "ISR", "State", "Nibble", "Count", "Min", "Avg", "Max");
+    for(v = 0; v < VEC_NBR; v++)
+    {
+        for(s = 0; s < STATE_NBR; s++)
+        {
+            for(n = 0; n < NIBBLE_CLASS_NBR; n++)
+            {
+                bin = &vectors[v].bins[s][n];
+                if(bin->count == 0)
+                {
+                    continue;
+                }
+                printf("%-8s %-8s %-12s %8u %6u %8.1f %6u\n", vectors[v].name, state_names[s],
+                       (v == VEC_SPI) ? nibble_name(n) : "-",
+                       bin->count, bin->min, (double)bin->total / bin->count, bin->max);
+            }
+        }
+    }
+
+    printf("\n%-8s %8s %6s %8s %6s %12s %8s\n", "ISR", "Count", "Min", "Avg", "Max", "Latency max", "CPU");
+    for(v = 0; v < VEC_NBR; v++)
+    {
+        bin = &vectors[v].total;
+        all += isrCycles[v];
+        printf("%-8s %8u %6u %8.1f %6u %12u %7.2f%%\n", vectors[v].name, bin->count, bin->min,
+               bin->count ? (double)bin->total / bin->count : 0.0, bin->max,
+               vectors[v].max_latency, 100.0 * isrCycles[v] / cycles);
+    }
+    printf("\nCPU share of the ISRs: %.2f%%, headroom for the application: %.2f%%\n",
+           100.0 * all / cycles, 100.0 - 100.0 * all / cycles);
+}
+
+int main(int argc, char* argv[])
+{
+    elf_firmware_t firmware;
+    avr_t* avr;
+    uint64_t isrCycles[VEC_NBR] = { 0 };
+    uint64_t start = 0;
+    uint64_t end;
+    uint64_t entry = 0;
+    uint32_t stateAddr = 0;
+    uint32_t cycles;
+    uint16_t sp;
+    uint16_t entrySp = 0;
+    uint16_t opcode;
+    double seconds = 5.0;
+    double bitrate = (double)PLM_CFG_FOSC / ((XDIV + 1) * CPB);
+    int rxInterval = 50;
+    int current = -1;
+    int state = 0;
+    int nibble = 0;
+    int run;
+    int i;
+    int v;
+
+    if(argc < 3)
+    {
+        fprintf(stderr, "usage: plm1prof <firmware.elf> <firmware.sym> [--seconds s] [--bitrate bps]"
+                        " [--rx-interval ms] [--rx-size bytes] [--collisions %%]\n");
+        return (1);
+    }
+
+    memset(&model, 0, sizeof(model));
+    model.rx_size = 16;
+    model.collision_pct = 5;
+    model.seed = 1;
+    for(i = 3; i + 1 < argc; i += 2)
+    {
+        if(strcmp(argv[i], "--seconds") == 0)
+        {
+            seconds = atof(argv[i + 1]);
+        }
+        else if(strcmp(argv[i], "--bitrate") == 0)
+        {
+            bitrate = atof(argv[i + 1]);
+        }
+        else if(strcmp(argv[i], "--rx-interval") == 0)
+        {
+            rxInterval = atoi(argv[i + 1]);
+        }
+        else if(strcmp(argv[i], "--rx-size") == 0)
+        {
+            model.rx_size = atoi(argv[i + 1]);
+        }
+        else if(strcmp(argv[i], "--collisions") == 0)
+        {
+            model.collision_pct = atoi(argv[i + 1]);
+        }
+    }
+    if((model.rx_size < 0) || (model.rx_size > 61) || (bitrate <= 0))
+    {
+        fprintf(stderr, "plm1prof: invalid option\n");
+        return (1);
+    }
+
+    if(load_symbols(argv[2], &stateAddr) != 0)
+    {
+        fprintf(stderr, "plm1prof: cannot read the symbols of %s\n", argv[2]);
+        return (1);
+    }
+    memset(&firmware, 0, sizeof(firmware));
+    if(elf_read_firmware(argv[1], &firmware) != 0)
+    {
+        fprintf(stderr, "plm1prof: cannot read %s\n", argv[1]);
+        return (1);
+    }
+
+    avr = avr_make_mcu_by_name("atmega328p");
+    if(avr == NULL)
+    {
+        fprintf(stderr, "plm1prof: atmega328p not supported by simavr\n");
+        return (1);
+    }
+    avr_init(avr);
+    avr_load_firmware(avr, &firmware);
+    avr->frequency = PROF_F_CPU;
+
+    // Wire the PLM-1 model.
+    model.avr = avr;
+    model.tx_reg = NO_NIBBLE;
+    model.config_nibbles = -1;
+    model.nibble_cycles = (uint64_t)(4.0 * PROF_F_CPU / bitrate);
+    model.rx_interval = (uint64_t)rxInterval * (PROF_F_CPU / 1000);
+    model.spi_in = avr_io_getirq(avr, AVR_IOCTL_SPI_GETIRQ(0), SPI_IRQ_INPUT);
+    model.int0 = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('D'), PIN_INT0);
+    model.cnfgd = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('D'), PIN_CNFGD);
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_SPI_GETIRQ(0), SPI_IRQ_OUTPUT), model_spi, NULL);
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), PIN_CS), model_cs, NULL);
+    avr_raise_irq(model.int0, 1);
+    avr_raise_irq(model.cnfgd, 0);
+
+    // Run until configured, then profile.
+    end = (uint64_t)-1;
+    do
+    {
+        // ISR entry or exit?
+        if(current < 0)
+        {
+            for(v = 0; v < VEC_NBR; v++)
+            {
+                if(avr->pc == vectors[v].addr)
+                {
+                    current = v;
+                    entry = avr->cycle;
+                    entrySp = avr->data[REG_SPL] | (avr->data[REG_SPH] << 8);
+                    state = read_state(avr, stateAddr);
+                    nibble = nibble_class(model.last_reply);
+                    if((start != 0) && (vectors[v].flag_cycle != 0) &&
+                       (avr->cycle - vectors[v].flag_cycle > vectors[v].max_latency))
+                    {
+                        vectors[v].max_latency = (uint32_t)(avr->cycle - vectors[v].flag_cycle);
+                    }
+                    vectors[v].flag_cycle = 0;
+                    break;
+                }
+            }
+        }
+        else
+        {
+            opcode = avr->flash[avr->pc] | (avr->flash[avr->pc + 1] << 8);
+            sp = avr->data[REG_SPL] | (avr->data[REG_SPH] << 8);
+            if((opcode == OPCODE_RETI) && (sp == entrySp))
+            {
+                cycles = (uint32_t)(avr->cycle + CYCLES_RETI - entry);
+                if((start != 0) && (state < STATE_NBR))
+                {
+                    isrCycles[current] += cycles;
+                    bin_add(&vectors[current].total, cycles);
+                    bin_add(&vectors[current].bins[state][(current == VEC_SPI) ? nibble : 0], cycles);
+                }
+                current = -1;
+            }
+        }
+
+        run = avr_run(avr);
+
+        // Interrupt flags just set.
+        for(v = 0; v < VEC_NBR; v++)
+        {
+            if((avr->data[vectors[v].flag_reg] & vectors[v].flag) && (vectors[v].flag_cycle == 0))
+            {
+                vectors[v].flag_cycle = avr->cycle;
+            }
+        }
+
+        if((start == 0) && (model.config_nibbles < 0) && (read_state(avr, stateAddr) >= STATE_IDLE))
+        {
+            start = avr->cycle;
+            end = start + (uint64_t)(seconds * PROF_F_CPU);
+            if(model.rx_interval != 0)
+            {
+                avr_cycle_timer_register(avr, model.rx_interval, model_rx_start, NULL);
+            }
+        }
+    } while((run != cpu_Done) && (run != cpu_Crashed) && (avr->cycle < end));
+
+    if(start == 0)
+    {
+        fprintf(stderr, "plm1prof: PLM-1 never configured\n");
+        return (1);
+    }
+    report((double)(avr->cycle - start) / PROF_F_CPU, isrCycles, avr->cycle - start, bitrate);
+
+    return (0);
+}
@@ -0,0 +1,114 @@
+/*******************************************************************************
+* Filename:     plm1prof_fw.c
+* Description:  Profiling firmware of the PLM-1 library, run under simavr by
+*               plm1prof.
+* Version:      1.0.0
+* Note:         The driver is wired to the interrupts as on the modem board:
+*               INT0 (PD2) for the PLM-1 interrupt, SPI transfer complete and
+*               a 1 ms Timer2 compare match for plm1_timer(). The main loop
+*               keeps the transmission queue full and drains the received
+*               packets, so that every ISR path is exercised.
+*******************************************************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "plm1.h"
+
+
+/*******************************************************************************
+ * USER PARAMETERS
+ *
+ * Parameters to be modified by the user.
+ ******************************************************************************/
+#define PROF_PACKET_DATA_SIZE          16                       // Data bytes of the packets sent.
+/*******************************************************************************
+ * END OF USER PARAMETERS
+ ******************************************************************************/
+
+/*------------------------------------------------------------------------------
+  Global variables declaration
+------------------------------------------------------------------------------*/
+
+// Driver instance.
+plm1_t plm;
+
+// State of the driver, read by plm1prof at each ISR entry.
+volatile plm1_state* volatile plm1prof_state;
+
+/*------------------------------------------------------------------------------
+  Interrupt handlers
+------------------------------------------------------------------------------*/
+
+ISR(INT0_vect)
+{
+    plm1_interrupt(&plm);
+}
+
+ISR(SPI_STC_vect)
+{
+    plm1_spi_isr(&plm, SPDR);
+}
+
+ISR(TIMER2_COMPA_vect)
+{
+    plm1_timer(&plm);
+}
+
+/*------------------------------------------------------------------------------
+  Main
+------------------------------------------------------------------------------*/
+
+int main(void)
+{
+    uint8_t data[PROF_PACKET_DATA_SIZE];
+    uint8_t rxData[PLM_PACKET_DATA_SIZE];
+    plm1_priority prio;
+    uint8_t channel;
+    uint8_t i;
+
+    plm1prof_state = &plm.sts.state;
+
+    // CS, nRESET, MOSI and SCK as outputs, SPI master at F_CPU / 32 as the
+    // sketch does.
+    DDRB |= _BV(PB0) | _BV(PB2) | _BV(PB3) | _BV(PB5);
+    SPCR = _BV(SPE) | _BV(MSTR) | _BV(SPR1);
+    SPSR = _BV(SPI2X);
+
+    // PLM-1 interrupt on falling edge.
+    EICRA = _BV(ISC01);
+
+    // plm1_timer() every 1 ms: 16 MHz / 128 / 125.
+    TCCR2A = _BV(WGM21);
+    TCCR2B = _BV(CS22) | _BV(CS20);
+    OCR2A = 124;
+
+    for(i = 0; i < PROF_PACKET_DATA_SIZE; i++)
+    {
+        data[i] = i;
+    }
+
+    plm1_init(&plm, &plm1_default_port);
+    sei();
+    plm1_configure(&plm, NULL);
+
+    for(;;)
+    {
+        // Keep the transmission queue full.
+        while(plm1_send_packet(&plm, data, PROF_PACKET_DATA_SIZE, PLM1_PRIO_NORMAL, PLM_TX_CHANNEL, false) != PLM_TX_NO_HANDLE)
+        {
+            data[0]++;
+        }
+
+        while(plm1_receive(&plm, rxData, &prio, &channel) > 0)
+        {
+        }
+
+        plm1_tx_poll(&plm);
+        plm1_watchdog(&plm);
+    }
+
+    return (0);
+}
@@ -0,0 +1,35 @@
+/*******************************************************************************
+* Filename:     io.h
+* Description:  Host stand-in of <avr/io.h> for the host build of the PLM-1
+*               library.
+* Version:      1.0.0
+* Note:         Only what the default port of plm1.c uses; the registers are
+*               defined by io.c and never drive anything, host programs
+*               providing their own plm1_port. The pin helpers come from the
+*               port.h of the library, as on the target.
+*******************************************************************************/
+
+#ifndef _HOST_AVR_IO_H_
+#define _HOST_AVR_IO_H_
+
+#include <stdint.h>
+
+// Registers used by the USER parameters of plm1.h and by port.h.
+extern volatile uint8_t EIMSK;
+extern volatile uint8_t SPCR;
+extern volatile uint8_t SPDR;
+extern volatile uint8_t TIMSK2;
+extern volatile uint16_t TCNT1;
+extern volatile uint8_t PORTB;
+extern volatile uint8_t DDRB;
+extern volatile uint8_t PINB;
+extern volatile uint8_t PORTD;
+extern volatile uint8_t DDRD;
+extern volatile uint8_t PIND;
+
+// Bits.
+#define INT0                           0
+#define SPIE                           7
+#define OCIE2A                         1
+
+#endif /* _HOST_AVR_IO_H_ */
@@ -0,0 +1,20 @@
+/*******************************************************************************
+* Filename:     pgmspace.h
+* Description:  Host stand-in of <avr/pgmspace.h> for the host build of the
+*               PLM-1 library.
+* Version:      1.0.0
+* Note:         Program memory is ordinary memory on the host.
+*******************************************************************************/
+
+#ifndef _HOST_AVR_PGMSPACE_H_
+#define _HOST_AVR_PGMSPACE_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define memcpy_P(_dest, _src, _size)   memcpy((_dest), (_src), (_size))
+#define pgm_read_byte(_addr)           (*(const uint8_t*)(_addr))
+#define pgm_read_word(_addr)           (*(const uint16_t*)(_addr))
+
+#endif /* _HOST_AVR_PGMSPACE_H_ */
@@ -0,0 +1,21 @@
+/*******************************************************************************
+* Filename:     io.c
+* Description:  Registers of the host <avr/io.h>.
+* Version:      1.0.0
+* Note:         Only touched by the default port of plm1.c, unused on the
+*               host.
+*******************************************************************************/
+
+#include <avr/io.h>
+
+volatile uint8_t EIMSK;
+volatile uint8_t SPCR;
+volatile uint8_t SPDR;
+volatile uint8_t TIMSK2;
+volatile uint16_t TCNT1;
+volatile uint8_t PORTB;
+volatile uint8_t DDRB;
+volatile uint8_t PINB;
+volatile uint8_t PORTD;
+volatile uint8_t DDRD;
+volatile uint8_t PIND;
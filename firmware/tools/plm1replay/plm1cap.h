@@ -0,0 +1,62 @@
+/*******************************************************************************
+* Filename:     plm1cap.h
+* Description:  File defining the PLM-1 nibble capture format.
+* Version:      1.0.0
+* Note:         A capture is the nibble trace of the library (PLM_TRACE_SIZE)
+*               converted by "plm1trace.py --save": a header followed by
+*               fixed size entries, all little endian and naturally aligned,
+*               so that the file can be mapped and read in place.
+*
+*               Each entry is a call of plm1_spi_isr() (rx is the nibble it
+*               was given) or a SPI transaction started outside of it
+*               (rx = PLM1CAP_NONE: plm1_interrupt(), plm1_timer() or a
+*               configuration), with the nibble the driver wrote back. The
+*               latter are recorded as the transaction starts: the state
+*               after a transmission started by plm1_timer() is still idle.
+*               Gap entries (rx = PLM1CAP_LOST) stand for the entries
+*               dropped while the trace of the node was full.
+*******************************************************************************/
+
+#ifndef _PLM1CAP_H_
+#define _PLM1CAP_H_
+
+#include <stdint.h>
+
+#define PLM1CAP_MAGIC                  "PLM1CAP"                // Magic string, NUL included.
+#define PLM1CAP_VERSION                1                        // Version of the format.
+#define PLM1CAP_NONE                   0xFF                     // No nibble received/transmitted (PLM_TRACE_NONE).
+#define PLM1CAP_LOST                   0xFE                     // "rx" of a gap entry, "tx" holds the nb of entries lost (PLM_TRACE_LOST).
+
+// PLM-1 control codes met in captures.
+#define PLM1CAP_EOP                    0x11                     // End of Packet.
+#define PLM1CAP_RESET                  0x16                     // Software reset, starts a configuration.
+#define PLM1CAP_TX_UNDERRUN            0x17                     // Transmit register underrun.
+#define PLM1CAP_TXRE                   0x18                     // Transmit Register Empty.
+#define PLM1CAP_TX_OVERRUN             0x19                     // Transmit register overrun.
+#define PLM1CAP_NOP                    0x1F                     // No Operation.
+
+/*------------------------------------------------------------------------------
+  Global types definition
+------------------------------------------------------------------------------*/
+
+// Capture header (32 bytes).
+typedef struct _plm1cap_header_ {
+    char magic[8];                                              // PLM1CAP_MAGIC.
+    uint16_t version;                                           // PLM1CAP_VERSION.
+    uint16_t entry_size;                                        // sizeof(plm1cap_entry).
+    uint32_t count;                                             // Nb of entries following the header.
+    uint32_t tick_ns;                                           // Duration of a time tick in ns (0 if unknown).
+    uint32_t lost;                                              // Entries lost, summed over the gap entries.
+    uint8_t reserved[8];                                        // Zero.
+} plm1cap_header;
+
+// Capture entry (8 bytes).
+typedef struct _plm1cap_entry_ {
+    uint32_t time;                                              // Ticks since the first entry (PLM_TRACE_TIME() unwrapped).
+    uint8_t rx;                                                 // Nibble given to plm1_spi_isr(), PLM1CAP_NONE or PLM1CAP_LOST.
+    uint8_t tx;                                                 // Nibble written to SPI port (PLM1CAP_NONE if none).
+    uint8_t state;                                              // State before (bits 7-4) and after (bits 3-0).
+    uint8_t reserved;                                           // Zero.
+} plm1cap_entry;
+
+#endif /* _PLM1CAP_H_ */
@@ -0,0 +1,707 @@
+/*******************************************************************************
+* Filename:     plm1replay.c
+* Description:  Replay of a PLM-1 nibble capture into the host build of the
+*               library.
+* Version:      1.0.0
+* Note:         Usage: plm1replay <capture> [options]
+*
+*                 --realtime         Feed the entries at their recorded time
+*                                    instead of at full speed.
+*                 --timer-us <us>    Period of plm1_timer() on the node
+*                                    (default 1000).
+*                 --drain <n>        Run the main loop every n entries
+*                                    (default 1).
+*                 --repeat <n>       Replay n times, report the fastest run
+*                                    (default 1).
+*                 --verbose          Print every divergence, not only the
+*                                    first ones.
+*
+*               Each entry is fed as it was recorded: its nibble is given to
+*               plm1_spi_isr(), or the call that started the SPI transaction
+*               is made again (plm1_interrupt(), plm1_timer() or
+*               plm1_configure_start()). The packets transmitted by the node
+*               are rebuilt from the nibbles it wrote and queued when the
+*               capture starts negotiating them. plm1_timer() also runs at
+*               the recorded time, so backoffs and timeouts elapse.
+*
+*               The nibble written back and the state reached are compared
+*               with the capture; a divergence means the library does not
+*               behave as the one that was recorded.
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "plm1.h"
+#include "plm1cap.h"
+
+/*------------------------------------------------------------------------------
+  Local constants declaration
+------------------------------------------------------------------------------*/
+
+#define REPLAY_DIVERGENCES_SHOWN       10                       // Divergences printed without --verbose.
+#define REPLAY_MAX_FORCED_TICKS        (PLM_BACKOFF_MAX_WINDOW * PLM_BACKOFF_SLOT_TICKS + 1) // Ticks to start a transmission.
+
+/*------------------------------------------------------------------------------
+  Local types declaration
+------------------------------------------------------------------------------*/
+
+// Packet transmitted by the recorded node.
+typedef struct {
+    uint32_t start;                                             // Entry starting its first negotiation.
+    uint8_t length;
+    uint8_t data[PLM_MAX_PACKET_SIZE];
+} replay_packet;
+
+// Replay results.
+typedef struct {
+    uint32_t entries;                                           // Entries fed.
+    uint32_t nibbles;                                           // Nibbles given to plm1_spi_isr().
+    uint32_t gaps;                                              // Gap entries met.
+    uint32_t resync;                                            // Entries not compared after a gap.
+    uint32_t tx_diverged;                                       // Entries where another nibble was written.
+    uint32_t state_diverged;                                    // Entries ending in another state.
+    uint32_t unrecorded;                                        // Transactions started by plm1_timer() out of the capture.
+    uint32_t forced_ticks;                                      // Extra plm1_timer() calls to start a transmission.
+    uint32_t queue_full;                                        // Packets the replayed driver did not accept.
+    uint32_t rx_packets;
+    uint32_t rx_bytes;
+    uint32_t tx_sent;
+    uint32_t tx_aborted;
+    uint32_t transitions[PLM1_STATE_NBR][PLM1_STATE_NBR];       // State changes of the replayed driver.
+    uint32_t recorded[PLM1_STATE_NBR][PLM1_STATE_NBR];          // State changes of the capture.
+} replay_result;
+
+/*------------------------------------------------------------------------------
+  Local functions declaration
+------------------------------------------------------------------------------*/
+
+static void replay_set_cs(void* arg, bool select);
+static void replay_set_reset(void* arg, bool run);
+static bool replay_get_cnfgd(void* arg);
+static void replay_spi_tx(void* arg, uint8_t byte);
+static void replay_mask_irq(void* arg, bool mask);
+
+/*------------------------------------------------------------------------------
+  Local variables declaration
+------------------------------------------------------------------------------*/
+
+static const char* state_names[PLM1_STATE_NBR] = {
+    "NOT_CFG", "CONFIG", "IDLE", "NEGO", "TX", "RX"
+};
+
+// Port of the replayed driver: records what it writes, CNFGD as recorded.
+static const plm1_port replay_port = {
+    replay_set_cs,
+    replay_set_reset,
+    replay_get_cnfgd,
+    replay_spi_tx,
+    replay_mask_irq,
+    NULL
+};
+
+static uint8_t written;                                         // Nibble written by the driver, PLM1CAP_NONE if none.
+static bool cnfgd;                                              // Level of the CNFGD pin.
+static replay_result result;
+
+/*------------------------------------------------------------------------------
+  Replay port
+------------------------------------------------------------------------------*/
+
+static void replay_set_cs(void* arg, bool select)
+{
+}
+
+static void replay_set_reset(void* arg, bool run)
+{
+}
+
+static bool replay_get_cnfgd(void* arg)
+{
+    return (cnfgd);
+}
+
+static void replay_spi_tx(void* arg, uint8_t byte)
+{
+    written = byte;
+}
+
+static void replay_mask_irq(void* arg, bool mask)
+{
+}
+
+static void tx_done(plm1_t* plm, const plm1_tx_done* done)
+{
+    if(done->outcome == PLM1_TX_SENT)
+    {
+        result.tx_sent++;
+    }
+    else
+    {
+        result.tx_aborted++;
+    }
+}
+
+/*------------------------------------------------------------------------------
+  Capture
+------------------------------------------------------------------------------*/
+
+// State reached by an entry. A transaction is recorded as it starts, so a
+// transmission started by plm1_timer() still shows the idle state.
+static uint8_t entry_state(const plm1cap_entry* entry)
+{
+    if((entry->rx == PLM1CAP_NONE) && (entry->tx < 0x10))
+    {
+        return (PLM1_STATE_NEGOTIATING);
+    }
+    return (entry->state & 0x0F);
+}
+
+static const plm1cap_entry* map_capture(const char* path, plm1cap_header* header)
+{
+    const uint8_t* data;
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+
+    if(fd < 0)
+    {
+        return (NULL);
+    }
+    if((fstat(fd, &st) != 0) || (st.st_size < (off_t)sizeof(plm1cap_header)))
+    {
+        close(fd);
+        return (NULL);
+    }
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED)
+    {
+        return (NULL);
+    }
+
+    memcpy(header, data, sizeof(plm1cap_header));
+    if((memcmp(header->magic, PLM1CAP_MAGIC, sizeof(header->magic)) != 0) ||
+       (header->version != PLM1CAP_VERSION) || (header->entry_size != sizeof(plm1cap_entry)) ||
+       ((uint64_t)st.st_size < sizeof(plm1cap_header) + (uint64_t)header->count * sizeof(plm1cap_entry)))
+    {
+        munmap((void*)data, st.st_size);
+        return (NULL);
+    }
+
+    return ((const plm1cap_entry*)(data + sizeof(plm1cap_header)));
+}
+
+static void build_packet(replay_packet* pkt, const uint8_t* nibbles, int length)
+{
+    int n;
+
+    pkt->length = (uint8_t)((length + 1) / 2);
+    for(n = 0; n < length; n++)
+    {
+        pkt->data[n / 2] = (n & 1) ? (pkt->data[n / 2] | nibbles[n]) : (nibbles[n] << 4);
+    }
+}
+
+// Add a packet cut by a gap or by the end of the capture: its first nibbles
+// are enough to replay what was recorded.
+static uint32_t cut_packet(replay_packet* packets, uint32_t nbr, uint32_t first, const uint8_t* nibbles, int length)
+{
+    if((length > 0) && ((nbr == 0) || (packets[nbr - 1].start != first)))
+    {
+        build_packet(&packets[nbr], nibbles, length);
+        packets[nbr++].start = first;
+    }
+
+    return (nbr);
+}
+
+// Rebuild the packets transmitted by the node from the nibbles it wrote.
+// A negotiation following a completed packet starts a new packet; the other
+// ones retry the current packet (after a collision, a lost negotiation or an
+// underrun).
+static uint32_t extract_packets(const plm1cap_entry* entries, uint32_t count, replay_packet* packets)
+{
+    uint8_t nibbles[2 * PLM_MAX_PACKET_SIZE];
+    replay_packet* pkt;
+    uint32_t nbr = 0;
+    uint32_t start = 0;
+    uint32_t first = 0;
+    uint32_t i;
+    int length = -1;                                            // Nibbles collected, -1 when not collecting.
+    bool done = true;                                           // Current packet completed.
+    bool eop = false;                                           // EOP written, completed on next TXRE.
+    uint8_t before;
+    uint8_t after;
+
+    for(i = 0; i < count; i++)
+    {
+        before = entries[i].state >> 4;
+        after = entry_state(&entries[i]);
+
+        if(entries[i].rx == PLM1CAP_LOST)
+        {
+            if(!done)
+            {
+                nbr = cut_packet(packets, nbr, first, nibbles, length);
+            }
+            length = -1;
+            eop = false;
+            done = true;
+            continue;
+        }
+
+        // End Of Packet taken by PLM-1.
+        if(eop && (before == PLM1_STATE_TRANSMITTING) && (entries[i].rx == PLM1CAP_TXRE))
+        {
+            eop = false;
+            done = true;
+        }
+
+        if((after == PLM1_STATE_NEGOTIATING) && (before != PLM1_STATE_NEGOTIATING) && (entries[i].tx < 0x10))
+        {
+            // Negotiation started, first nibble written.
+            if(done)
+            {
+                first = i;
+                done = false;
+            }
+            start = i;
+            nibbles[0] = entries[i].tx;
+            length = 1;
+            eop = false;
+        }
+        else if((before == PLM1_STATE_TRANSMITTING) && (entries[i].tx < 0x10) &&
+                ((entries[i].rx == PLM1CAP_TX_UNDERRUN) || (entries[i].rx == PLM1CAP_TX_OVERRUN)))
+        {
+            // Packet written again from its first nibble.
+            nibbles[0] = entries[i].tx;
+            length = 1;
+            eop = false;
+        }
+        else if((length >= 0) && (entries[i].tx != PLM1CAP_NONE) &&
+                ((before == PLM1_STATE_NEGOTIATING) || (before == PLM1_STATE_TRANSMITTING)))
+        {
+            if(entries[i].tx == PLM1CAP_EOP)
+            {
+                eop = true;
+                if((length > 0) && ((length & 1) == 0))
+                {
+                    // Packet retried once already rebuilt? A different content
+                    // means the previous one has been aborted.
+                    pkt = &packets[nbr];
+                    build_packet(pkt, nibbles, length);
+                    if((nbr == 0) || (packets[nbr - 1].start != first))
+                    {
+                        pkt->start = first;
+                        nbr++;
+                    }
+                    else if((packets[nbr - 1].length != pkt->length) ||
+                            (memcmp(packets[nbr - 1].data, pkt->data, pkt->length) != 0))
+                    {
+                        pkt->start = start;
+                        first = start;
+                        nbr++;
+                    }
+                }
+                length = -1;
+            }
+            else if(entries[i].tx < 0x10)
+            {
+                if(length < (int)sizeof(nibbles))
+                {
+                    nibbles[length++] = entries[i].tx;
+                }
+            }
+        }
+    }
+
+    if(!done)
+    {
+        nbr = cut_packet(packets, nbr, first, nibbles, length);
+    }
+
+    return (nbr);
+}
+
+/*------------------------------------------------------------------------------
+  Replay
+------------------------------------------------------------------------------*/
+
+// Driver instance read directly: the replay is a test harness.
+static uint8_t driver_state(plm1_t* plm)
+{
+    return ((uint8_t)plm->sts.state);
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+static void wait_until(uint64_t deadline)
+{
+    struct timespec ts;
+
+    ts.tv_sec = deadline / 1000000000ULL;
+    ts.tv_nsec = deadline % 1000000000ULL;
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0)
+    {
+    }
+}
+
+static void divergence(const plm1cap_entry* entry, uint32_t index, uint8_t state, bool verbose)
+{
+    uint32_t count = result.tx_diverged + result.state_diverged + result.unrecorded;
+
+    if(verbose || (count <= REPLAY_DIVERGENCES_SHOWN))
+    {
+        printf("diverged at entry %u (time %u): rx 0x%02X, tx 0x%02X/0x%02X, state %s/%s (recorded/replayed)\n",
+               index, entry->time, entry->rx, entry->tx, written,
+               state_names[entry_state(entry) % PLM1_STATE_NBR], state_names[state % PLM1_STATE_NBR]);
+    }
+}
+
+// Bring the driver where the capture starts.
+static void start_driver(plm1_t* plm, const plm1cap_entry* first)
+{
+    uint8_t state = (first != NULL) ? (first->state >> 4) : PLM1_STATE_NOT_CONFIGURED;
+    bool reset = (first != NULL) && (first->rx == PLM1CAP_NONE) && (first->tx == PLM1CAP_RESET);
+
+    plm1_init(plm, &replay_port);
+    plm1_set_tx_callback(plm, tx_done);
+    cnfgd = true;
+    written = PLM1CAP_NONE;
+
+    // A capture starting with a configuration replays it whole; one starting
+    // in the middle of it feeds the remaining nibbles.
+    if((state == PLM1_STATE_CONFIGURING) && !reset)
+    {
+        plm1_configure_start(plm, NULL, NULL);
+    }
+    else if(state >= PLM1_STATE_IDLE)
+    {
+        plm1_configure_start(plm, NULL, NULL);
+        while(driver_state(plm) == PLM1_STATE_CONFIGURING)
+        {
+            plm1_spi_isr(plm, PLM1CAP_NOP);
+        }
+        plm1_configure_poll(plm);
+    }
+}
+
+static void main_loop(plm1_t* plm)
+{
+    uint8_t data[PLM_PACKET_DATA_SIZE];
+    uint8_t length;
+
+    while((length = plm1_receive(plm, data, NULL, NULL)) > 0)
+    {
+        result.rx_packets++;
+        result.rx_bytes += length;
+    }
+    plm1_tx_poll(plm);
+    plm1_configure_poll(plm);
+}
+
+static void replay(plm1_t* plm, const plm1cap_header* header, const plm1cap_entry* entries,
+                   const replay_packet* packets, uint32_t packetNbr, uint32_t timerUs,
+                   uint32_t drain, bool realtime, bool verbose)
+{
+    const plm1cap_entry* entry;
+    uint64_t startNs = now_ns();
+    uint64_t elapsed;
+    uint64_t ticks = 0;
+    uint64_t due;
+    uint32_t nextPacket = 0;
+    uint32_t i;
+    uint32_t n;
+    uint8_t before;
+    uint8_t after;
+    bool timerStart;
+    bool resync = false;                                        // Gap met, not compared until both drivers are idle.
+
+    memset(&result, 0, sizeof(result));
+    for(i = 0; (i < header->count) && (entries[i].rx == PLM1CAP_LOST); i++)
+    {
+    }
+    start_driver(plm, (i < header->count) ? &entries[i] : NULL);
+
+    for(i = 0; i < header->count; i++)
+    {
+        entry = &entries[i];
+        if(entry->rx == PLM1CAP_LOST)
+        {
+            result.gaps++;
+            resync = true;
+            continue;
+        }
+
+        // Time of the entry: timer ticks elapsed meanwhile. The last one is
+        // left to the entry if it is a transmission started by plm1_timer().
+        elapsed = (uint64_t)entry->time * header->tick_ns;
+        if(realtime)
+        {
+            wait_until(startNs + elapsed);
+        }
+        timerStart = (entry->rx == PLM1CAP_NONE) && (entry->tx < 0x10);
+        due = elapsed / (timerUs * 1000ULL);
+        if(timerStart && (due > ticks))
+        {
+            due--;
+        }
+        while(ticks < due)
+        {
+            written = PLM1CAP_NONE;
+            plm1_timer(plm);
+            ticks++;
+            if((written != PLM1CAP_NONE) && !resync)
+            {
+                result.unrecorded++;
+                divergence(entry, i, driver_state(plm), verbose);
+            }
+        }
+
+        // Packets queued by the node when this entry was recorded.
+        while((nextPacket < packetNbr) && (packets[nextPacket].start <= i))
+        {
+            if(plm1_send_packet(plm, (uint8_t*)packets[nextPacket].data, packets[nextPacket].length,
+                                PLM1_PRIO_NORMAL, 0, true) == PLM_TX_NO_HANDLE)
+            {
+                result.queue_full++;
+            }
+            nextPacket++;
+        }
+
+        before = driver_state(plm);
+        after = entry_state(entry);
+        written = PLM1CAP_NONE;
+        cnfgd = (after != PLM1_STATE_NOT_CONFIGURED);
+
+        if(entry->rx != PLM1CAP_NONE)
+        {
+            plm1_spi_isr(plm, entry->rx);
+            result.nibbles++;
+        }
+        else if(entry->tx == PLM1CAP_RESET)
+        {
+            plm1_configure_start(plm, NULL, NULL);
+        }
+        else if(entry->tx == PLM1CAP_NOP)
+        {
+            plm1_interrupt(plm);
+        }
+        else
+        {
+            // Transmission started by plm1_timer(), once the backoff is over.
+            for(n = 0; (n < REPLAY_MAX_FORCED_TICKS) && (written == PLM1CAP_NONE); n++)
+            {
+                plm1_timer(plm);
+            }
+            if((n > 0) && (ticks < elapsed / (timerUs * 1000ULL)))
+            {
+                ticks++;
+                n--;
+            }
+            result.forced_ticks += n;
+        }
+        result.entries++;
+
+        if((entry->state >> 4) != after)
+        {
+            result.recorded[(entry->state >> 4) % PLM1_STATE_NBR][after % PLM1_STATE_NBR]++;
+        }
+        if(driver_state(plm) != before)
+        {
+            result.transitions[before][driver_state(plm)]++;
+        }
+        if(resync)
+        {
+            resync = (driver_state(plm) != PLM1_STATE_IDLE) || (after != PLM1_STATE_IDLE);
+            result.resync++;
+        }
+        else if(written != entry->tx)
+        {
+            result.tx_diverged++;
+            divergence(entry, i, driver_state(plm), verbose);
+        }
+        else if(driver_state(plm) != after)
+        {
+            result.state_diverged++;
+            divergence(entry, i, driver_state(plm), verbose);
+        }
+
+        if((i % drain) == drain - 1)
+        {
+            main_loop(plm);
+        }
+    }
+}
+
+/*------------------------------------------------------------------------------
+  Report
+------------------------------------------------------------------------------*/
+
+static void report(plm1_t* plm, const plm1cap_header* header, const plm1cap_entry* entries,
+                   uint32_t packetNbr, uint64_t bestNs)
+{
+    double recorded = 0.0;
+    plm1_stats stats;
+    uint32_t drops = 0;
+    int from;
+    int to;
+    int i;
+
+    plm1_get_stats(plm, &stats);
+    if(header->count > 0)
+    {
+        recorded = entries[header->count - 1].time * (header->tick_ns * 1e-9);
+    }
+
+    printf("\ncapture: %u entries, %u gaps (%u entries lost), %u packets sent by the node, %.3f s recorded\n",
+           header->count, result.gaps, header->lost, packetNbr, recorded);
+    printf("replay: %u entries, %u nibbles in %.3f ms: %.0f nibbles/s", result.entries, result.nibbles,
+           bestNs / 1e6, (bestNs != 0) ? result.nibbles * 1e9 / bestNs : 0.0);
+    if((recorded > 0) && (bestNs != 0))
+    {
+        printf(", %.0fx the recorded time", recorded * 1e9 / bestNs);
+    }
+    printf("\ndivergences: %u nibbles written, %u states, %u transactions not recorded, "
+           "%u ticks forced, %u packets not queued, %u entries not compared after gaps\n",
+           result.tx_diverged, result.state_diverged, result.unrecorded, result.forced_ticks, result.queue_full,
+           result.resync);
+
+    printf("\n%-18s %10s %10s\n", "Transition", "Recorded", "Replayed");
+    for(from = 0; from < PLM1_STATE_NBR; from++)
+    {
+        for(to = 0; to < PLM1_STATE_NBR; to++)
+        {
+            if((result.recorded[from][to] != 0) || (result.transitions[from][to] != 0))
+            {
+                printf("%-8s > %-7s %10u %10u\n", state_names[from], state_names[to],
+                       result.recorded[from][to], result.transitions[from][to]);
+            }
+        }
+    }
+
+    for(i = 0; i < PLM1_DROP_NBR; i++)
+    {
+        drops += stats.rx_drops[i];
+    }
+    printf("\ntraffic: %u packets (%u bytes) received, %u dropped; %u sent, %u aborted\n",
+           result.rx_packets, result.rx_bytes, drops, result.tx_sent, result.tx_aborted);
+    printf("final: state %s, pool %u free / %u rx / %u tx, %u packets to send, %u received not read\n",
+           state_names[driver_state(plm) % PLM1_STATE_NBR], plm->pool.free_nbr, plm->pool.rx_held,
+           plm->pool.tx_held, (uint8_t)(plm->tx.desc_index + PLM_TX_DESC_NBR - plm->tx.packet_index) % PLM_TX_DESC_NBR,
+           (uint8_t)(plm->rx.desc_index + PLM_RX_DESC_NBR - plm->rx.packet_index) % PLM_RX_DESC_NBR);
+    for(i = 0; i < 16; i++)
+    {
+        if(stats.status[i] != 0)
+        {
+            printf("status 0x%02X: %u\n", i, stats.status[i]);
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    static plm1_t plm;
+    plm1cap_header header;
+    const plm1cap_entry* entries;
+    replay_packet* packets;
+    uint64_t bestNs = 0;
+    uint64_t startNs;
+    uint32_t packetNbr;
+    uint32_t timerUs = 1000;
+    uint32_t drain = 1;
+    uint32_t repeat = 1;
+    uint32_t run;
+    bool realtime = false;
+    bool verbose = false;
+    int i;
+
+    if(argc < 2)
+    {
+        fprintf(stderr, "usage: plm1replay <capture> [--realtime] [--timer-us us] [--drain n] [--repeat n] [--verbose]\n");
+        return (1);
+    }
+    for(i = 2; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--realtime") == 0)
+        {
+            realtime = true;
+        }
+        else if(strcmp(argv[i], "--verbose") == 0)
+        {
+            verbose = true;
+        }
+        else if((strcmp(argv[i], "--timer-us") == 0) && (i + 1 < argc))
+        {
+            timerUs = (uint32_t)atoi(argv[++i]);
+        }
+        else if((strcmp(argv[i], "--drain") == 0) && (i + 1 < argc))
+        {
+            drain = (uint32_t)atoi(argv[++i]);
+        }
+        else if((strcmp(argv[i], "--repeat") == 0) && (i + 1 < argc))
+        {
+            repeat = (uint32_t)atoi(argv[++i]);
+        }
+        else
+        {
+            fprintf(stderr, "plm1replay: unknown option %s\n", argv[i]);
+            return (1);
+        }
+    }
+    if((timerUs == 0) || (drain == 0) || (repeat == 0))
+    {
+        fprintf(stderr, "plm1replay: invalid option\n");
+        return (1);
+    }
+
+    entries = map_capture(argv[1], &header);
+    if(entries == NULL)
+    {
+        fprintf(stderr, "plm1replay: %s is not a valid capture\n", argv[1]);
+        return (1);
+    }
+    if(realtime && (header.tick_ns == 0))
+    {
+        fprintf(stderr, "plm1replay: capture without time base, --realtime not possible\n");
+        return (1);
+    }
+
+    packets = malloc((header.count / 3 + 1) * sizeof(replay_packet));
+    if(packets == NULL)
+    {
+        fprintf(stderr, "plm1replay: out of memory\n");
+        return (1);
+    }
+    packetNbr = extract_packets(entries, header.count, packets);
+
+    // Every run is identical; only the fastest one is timed.
+    for(run = 0; run < repeat; run++)
+    {
+        startNs = now_ns();
+        replay(&plm, &header, entries, packets, packetNbr, timerUs, drain, realtime, verbose && (run == 0));
+        startNs = now_ns() - startNs;
+        if((run == 0) || (startNs < bestNs))
+        {
+            bestNs = startNs;
+        }
+    }
+
+    report(&plm, &header, entries, packetNbr, bestNs);
+    free(packets);
+
+    return ((result.tx_diverged + result.state_diverged + result.unrecorded) ? 2 : 0);
+}
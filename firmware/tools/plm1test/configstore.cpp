@@ -0,0 +1,194 @@
+/*******************************************************************************
+* Filename:     configstore.cpp
+* Description:  Test of the configuration record of the sketch on its host
+*               EEPROM file.
+* Version:      1.0.0
+* Note:         Usage: configstore
+*
+*               ConfigStore is built for the host, where the EEPROM is the
+*               CONFIG_EEPROM_FILE file, set to configstore.bin by the
+*               Makefile. The test writes and corrupts that file and checks
+*               what load() keeps:
+*                 - no file (erased EEPROM): defaults;
+*                 - a good record: loaded as written;
+*                 - a bad CRC: defaults;
+*                 - another version with a good CRC: defaults;
+*                 - "saveconfig" then load: the saved settings.
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "ConfigStore.h"
+
+/*------------------------------------------------------------------------------
+  Local functions declaration
+------------------------------------------------------------------------------*/
+
+static void check(bool ok, const char* what);
+static bool is_default(ConfigStore& store);
+static void write_record(const ConfigRecord& rec);
+static uint16_t crc16(const uint8_t* data, uint16_t length);
+
+/*------------------------------------------------------------------------------
+  Local variables declaration
+------------------------------------------------------------------------------*/
+
+static uint32_t errors;
+
+/*******************************************************************************
+* Name:         main()
+* Description:  Run the test.
+* Parameters:   None.
+* Return:       0 if no check failed, 1 otherwise.
+*******************************************************************************/
+int main(void)
+{
+    ConfigStore store;
+    ConfigRecord rec;
+    uint8_t i;
+
+    remove(CONFIG_EEPROM_FILE);
+
+    // Erased EEPROM.
+    check(!store.load() && !store.loaded() && is_default(store), "erased: defaults");
+
+    // Good record, written as the sketch does.
+    for(i = 0; i < PLM_CONFIG_DATA_LENGTH; i++)
+    {
+        store.record().plmCfg[i] = (uint8_t)(0x10 + i);
+    }
+    store.record().txChannel = 9;
+    store.record().node = 17;
+    store.record().serialRate = 57600;
+    check(store.commit(), "good: commit");
+    {
+        ConfigStore loaded;
+        check(loaded.load() && loaded.loaded(), "good: loaded");
+        check(memcmp(&loaded.record(), &store.record(), offsetof(ConfigRecord, crc)) == 0, "good: same settings");
+        rec = loaded.record();
+    }
+
+    // Bad CRC: one setting changed behind the record.
+    rec.txChannel++;
+    write_record(rec);
+    {
+        ConfigStore loaded;
+        check(!loaded.load() && is_default(loaded), "bad crc: defaults");
+    }
+
+    // Other version, CRC good for it.
+    rec.txChannel--;
+    rec.version = CONFIG_RECORD_VERSION + 1;
+    rec.crc = crc16((const uint8_t*)&rec, offsetof(ConfigRecord, crc));
+    write_record(rec);
+    {
+        ConfigStore loaded;
+        check(!loaded.load() && is_default(loaded), "version: defaults");
+    }
+
+    // "saveconfig" over the defaults, then load as at boot.
+    {
+        ConfigStore saved;
+        saved.load();
+        memcpy(saved.record().plmCfg, rec.plmCfg, PLM_CONFIG_DATA_LENGTH);
+        saved.record().txChannel = 3;
+        saved.record().node = 5;
+        check(saved.commit() && saved.loaded(), "saveconfig: commit");
+
+        ConfigStore loaded;
+        check(loaded.load(), "saveconfig: loaded");
+        check(memcmp(loaded.record().plmCfg, rec.plmCfg, PLM_CONFIG_DATA_LENGTH) == 0, "saveconfig: configuration string");
+        check(loaded.record().txChannel == 3, "saveconfig: channel");
+        check(loaded.record().node == 5, "saveconfig: node");
+        check(loaded.record().serialRate == CONFIG_SERIAL_RATE, "saveconfig: serial rate");
+    }
+
+    remove(CONFIG_EEPROM_FILE);
+
+    printf("%s:configstore errors:%u\n", (errors == 0) ? "Ok" : "Fail", errors);
+    return ((errors == 0) ? 0 : 1);
+}
+
+/*******************************************************************************
+* Name:         check()
+* Description:  Count and print a failed check.
+* Parameters:   ok: Result of the check.
+*               what: Check.
+* Return:       None.
+*******************************************************************************/
+static void check(bool ok, const char* what)
+{
+    if(!ok)
+    {
+        errors++;
+        printf("Fail:%s\n", what);
+    }
+}
+
+/*******************************************************************************
+* Name:         is_default()
+* Description:  Check that a store holds the default settings.
+* Parameters:   store: Store checked.
+* Return:       true if the settings are the defaults.
+*******************************************************************************/
+static bool is_default(ConfigStore& store)
+{
+    ConfigRecord& rec = store.record();
+    uint8_t i;
+
+    for(i = 0; i < PLM_CONFIG_DATA_LENGTH; i++)
+    {
+        if(rec.plmCfg[i] != 0)
+        {
+            return (false);
+        }
+    }
+    return ((rec.magic == CONFIG_RECORD_MAGIC) && (rec.version == CONFIG_RECORD_VERSION) &&
+            (rec.txChannel == PLM_TX_CHANNEL) && (rec.node == 0) && (rec.serialRate == CONFIG_SERIAL_RATE));
+}
+
+/*******************************************************************************
+* Name:         write_record()
+* Description:  Overwrite the record in the EEPROM file.
+* Parameters:   rec: Record written as is.
+* Return:       None.
+*******************************************************************************/
+static void write_record(const ConfigRecord& rec)
+{
+    FILE* file = fopen(CONFIG_EEPROM_FILE, "r+b");
+
+    if(file != NULL)
+    {
+        fseek(file, CONFIG_RECORD_ADDR, SEEK_SET);
+        fwrite(&rec, 1, sizeof(rec), file);
+        fclose(file);
+    }
+}
+
+/*******************************************************************************
+* Name:         crc16()
+* Description:  CRC16-CCITT (polynomial 0x1021, initial value 0xFFFF).
+* Parameters:   data: Bytes.
+*               length: Nb of bytes.
+* Return:       CRC.
+* Note:         Written again here, so that a record of another version can
+*               be forged without the private ConfigStore::crc16().
+*******************************************************************************/
+static uint16_t crc16(const uint8_t* data, uint16_t length)
+{
+    uint16_t crc = 0xFFFF;
+    uint8_t i;
+
+    while(length--)
+    {
+        crc ^= (uint16_t)(*data++) << 8;
+        for(i = 0; i < 8; i++)
+        {
+            crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+        }
+    }
+
+    return (crc);
+}
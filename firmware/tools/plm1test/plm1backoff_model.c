@@ -0,0 +1,410 @@
+/*******************************************************************************
+* Filename:     plm1backoff_model.c
+* Description:  Multi-node model of the collision backoff of the host build of
+*               the library.
+* Version:      1.0.0
+* Note:         Usage: plm1backoff_model [steps]
+*
+*               Several driver instances share a line, one step being a
+*               nibble time. The model plays the PLM-1 of each node:
+*                 - a node negotiating while the line is free gets TXRE if
+*                   it is alone, COLLISION if others negotiate in the same
+*                   step; a collision keeps the line busy for
+*                   MODEL_COLLISION_STEPS;
+*                 - the nibbles of the node holding the line are fed to all
+*                   other nodes, up to the EOP, followed by a gap of
+*                   MODEL_GAP_STEPS;
+*                 - plm1_timer() is called every MODEL_TIMER_STEPS.
+*               Every node keeps its transmission queue full and receives on
+*               each step, so nothing is lost but to the backoff policy.
+*
+*               The model checks that:
+*                 - every node receives the packets of the others intact and
+*                   in order;
+*                 - with the default policy, the line is used and no node
+*                   starves;
+*                 - without backoff (window of 1 slot), the nodes keep
+*                   colliding;
+*                 - with the same seed on every node, as when nodes are not
+*                   given their address, the nodes keep colliding too: they
+*                   draw the same slots. Nodes are seeded from their address
+*                   with PLM_BACKOFF_NODE_SEED(), as the sketch does;
+*                 - plm1_set_backoff() rounds the windows down to a power of
+*                   2 and the window never exceeds its cap.
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "plm1.h"
+
+/*------------------------------------------------------------------------------
+  Local constants declaration
+------------------------------------------------------------------------------*/
+
+#define MODEL_MAX_NODES                10                       // Nodes of the largest run.
+#define MODEL_TIMER_STEPS              8                        // Steps between two plm1_timer() calls.
+#define MODEL_GAP_STEPS                MODEL_TIMER_STEPS        // Line quiet after an EOP.
+#define MODEL_COLLISION_STEPS          4                        // Line busy after a collision.
+#define MODEL_DATA_LENGTH              16                       // Data bytes of the packets sent.
+#define MODEL_NO_OWNER                 0xFF                     // Line free.
+
+/*------------------------------------------------------------------------------
+  Local types declaration
+------------------------------------------------------------------------------*/
+
+// Node of the line.
+typedef struct {
+    plm1_t plm;
+    plm1_port port;
+    uint8_t written;                                            // Last byte written by the driver to the SPI port.
+    uint8_t tx_seq;                                             // Sequence number of the next packet sent.
+    uint8_t rx_seq[MODEL_MAX_NODES];                            // Sequence number expected from each node.
+    uint32_t delivered;                                         // Packets of this node received by node 0 (or 1).
+} model_node;
+
+// Result of a run.
+typedef struct {
+    uint32_t delivered;                                         // Packets delivered.
+    uint32_t collisions;                                        // Collisions on the line.
+    uint32_t busy;                                              // Steps carrying packets.
+    uint32_t min_node;                                          // Packets delivered by the least served node.
+    uint32_t max_node;                                          // Packets delivered by the most served node.
+    uint8_t max_window;                                         // Largest contention window seen.
+} model_result;
+
+/*------------------------------------------------------------------------------
+  Local functions declaration
+------------------------------------------------------------------------------*/
+
+static void run(uint8_t nodes, uint8_t minWindow, uint8_t maxWindow, bool sameSeed, uint32_t steps, model_result* result);
+static void init_node(uint8_t index, uint8_t minWindow, uint8_t maxWindow, bool sameSeed);
+static void main_loop(uint8_t index);
+static void check_packet(uint8_t receiver, const uint8_t* data, uint8_t length, uint8_t channel);
+static void check(bool ok, const char* what);
+static void model_set_cs(void* arg, bool select);
+static void model_set_reset(void* arg, bool run);
+static bool model_get_cnfgd(void* arg);
+static void model_spi_tx(void* arg, uint8_t byte);
+static void model_mask_irq(void* arg, bool mask);
+
+/*------------------------------------------------------------------------------
+  Local variables declaration
+------------------------------------------------------------------------------*/
+
+static model_node node[MODEL_MAX_NODES];
+static uint32_t errors;
+
+/*******************************************************************************
+* Name:         main()
+* Description:  Run the model.
+* Parameters:   argc, argv: [steps].
+* Return:       0 if no check failed, 1 otherwise.
+*******************************************************************************/
+int main(int argc, char** argv)
+{
+    static const uint8_t runNodes[] = { 2, 5, MODEL_MAX_NODES };
+    uint32_t steps = (argc > 1) ? (uint32_t)atoi(argv[1]) : 200000;
+    model_result results[sizeof(runNodes)];
+    model_result result;
+    uint8_t i;
+
+    printf("%u steps, %u data bytes per packet\n", steps, MODEL_DATA_LENGTH);
+    printf("nodes  window  seeds   delivered  collisions  line use  per node min/max  max window\n");
+    for(i = 0; i < sizeof(runNodes); i++)
+    {
+        run(runNodes[i], PLM_BACKOFF_MIN_WINDOW, PLM_BACKOFF_MAX_WINDOW, false, steps, &results[i]);
+        check(results[i].delivered > 0, "default policy: packets delivered");
+        check(results[i].min_node > 0, "default policy: no node starves");
+        check(results[i].busy > steps / 2, "default policy: line used half of the time");
+
+        run(runNodes[i], 1, 1, false, steps, &result);
+        check(result.delivered < results[i].delivered / 10, "no backoff: nodes keep colliding");
+
+        run(runNodes[i], PLM_BACKOFF_MIN_WINDOW, PLM_BACKOFF_MAX_WINDOW, true, steps, &result);
+        check(result.delivered < results[i].delivered / 10, "same seed: nodes keep colliding");
+    }
+
+    // Windows which are not a power of 2.
+    run(MODEL_MAX_NODES, 3, 100, false, steps, &result);
+    check((node[0].plm.sts.min_window == 2) && (node[0].plm.sts.max_window == 64), "set_backoff: windows rounded down");
+    check(result.max_window <= 64, "set_backoff: window capped");
+    run(MODEL_MAX_NODES, 200, 255, false, steps, &result);
+    check((node[0].plm.sts.min_window == 128) && (node[0].plm.sts.max_window == 128), "set_backoff: windows clamped to 128");
+
+    printf("%s:backoff errors:%u\n", (errors == 0) ? "Ok" : "Fail", errors);
+    return ((errors == 0) ? 0 : 1);
+}
+
+/*------------------------------------------------------------------------------
+  Local functions
+------------------------------------------------------------------------------*/
+
+/*******************************************************************************
+* Name:         run()
+* Description:  Run nodes sharing the line.
+* Parameters:   nodes: Nb of nodes.
+*               minWindow, maxWindow: Backoff windows given to
+*                                     plm1_set_backoff().
+*               sameSeed: true to give all nodes the same backoff seed.
+*               steps: Nb of steps.
+*               result: Struct used to return the result.
+* Return:       None.
+*******************************************************************************/
+static void run(uint8_t nodes, uint8_t minWindow, uint8_t maxWindow, bool sameSeed, uint32_t steps, model_result* result)
+{
+    uint8_t owner = MODEL_NO_OWNER;
+    uint32_t quiet = 0;
+    uint8_t contenders;
+    uint8_t nibble;
+    uint32_t step;
+    uint8_t i;
+    uint8_t j;
+
+    memset(result, 0, sizeof(model_result));
+    for(i = 0; i < nodes; i++)
+    {
+        init_node(i, minWindow, maxWindow, sameSeed);
+    }
+
+    for(step = 0; step < steps; step++)
+    {
+        if((step % MODEL_TIMER_STEPS) == 0)
+        {
+            for(i = 0; i < nodes; i++)
+            {
+                plm1_timer(&node[i].plm);
+            }
+        }
+
+        if(owner != MODEL_NO_OWNER)
+        {
+            // Nibble on the line, then TXRE to its sender.
+            result->busy++;
+            nibble = node[owner].written;
+            for(j = 0; j < nodes; j++)
+            {
+                if(j != owner)
+                {
+                    plm1_spi_isr(&node[j].plm, nibble);
+                }
+            }
+            plm1_spi_isr(&node[owner].plm, 0x18);
+            if(nibble == 0x11)
+            {
+                owner = MODEL_NO_OWNER;
+                quiet = MODEL_GAP_STEPS;
+            }
+        }
+        else if(quiet > 0)
+        {
+            quiet--;
+        }
+        else
+        {
+            // Line free: resolve the negotiations.
+            contenders = 0;
+            for(i = 0; i < nodes; i++)
+            {
+                if(node[i].plm.sts.state == PLM1_STATE_NEGOTIATING)
+                {
+                    contenders++;
+                    owner = i;
+                }
+            }
+            if(contenders > 1)
+            {
+                for(i = 0; i < nodes; i++)
+                {
+                    if(node[i].plm.sts.state == PLM1_STATE_NEGOTIATING)
+                    {
+                        plm1_spi_isr(&node[i].plm, 0x14);
+                    }
+                }
+                owner = MODEL_NO_OWNER;
+                quiet = MODEL_COLLISION_STEPS;
+                result->collisions++;
+            }
+        }
+
+        for(i = 0; i < nodes; i++)
+        {
+            main_loop(i);
+            if(node[i].plm.tx.window > result->max_window)
+            {
+                result->max_window = node[i].plm.tx.window;
+            }
+        }
+    }
+
+    result->min_node = UINT32_MAX;
+    for(i = 0; i < nodes; i++)
+    {
+        result->delivered += node[i].delivered;
+        if(node[i].delivered < result->min_node)
+        {
+            result->min_node = node[i].delivered;
+        }
+        if(node[i].delivered > result->max_node)
+        {
+            result->max_node = node[i].delivered;
+        }
+    }
+
+    printf("%5u  %3u-%-3u  %-4s  %9u  %10u  %7.1f%%  %7u/%-7u  %10u\n",
+           nodes, node[0].plm.sts.min_window, node[0].plm.sts.max_window, sameSeed ? "same" : "node", result->delivered, result->collisions,
+           100.0 * result->busy / steps, result->min_node, result->max_node, result->max_window);
+}
+
+/*******************************************************************************
+* Name:         init_node()
+* Description:  Initialize and configure a node.
+* Parameters:   index: Index of the node.
+*               minWindow, maxWindow: Backoff windows.
+*               sameSeed: true to seed the node as all others.
+* Return:       None.
+*******************************************************************************/
+static void init_node(uint8_t index, uint8_t minWindow, uint8_t maxWindow, bool sameSeed)
+{
+    model_node* n = &node[index];
+
+    memset(n, 0, sizeof(model_node));
+    n->port.set_cs = model_set_cs;
+    n->port.set_reset = model_set_reset;
+    n->port.get_cnfgd = model_get_cnfgd;
+    n->port.spi_tx = model_spi_tx;
+    n->port.mask_irq = model_mask_irq;
+    n->port.arg = n;
+
+    plm1_init(&n->plm, &n->port);
+    plm1_configure_start(&n->plm, NULL, NULL);
+    while(n->plm.sts.state == PLM1_STATE_CONFIGURING)
+    {
+        plm1_spi_isr(&n->plm, 0x1F);
+    }
+    check(plm1_configure_poll(&n->plm) == PLM1_CFG_DONE, "configuration");
+
+    // One seed per node address (1 to nodes), as set by the sketch.
+    plm1_set_backoff(&n->plm, sameSeed ? PLM_BACKOFF_SEED : PLM_BACKOFF_NODE_SEED(index + 1), minWindow, maxWindow);
+}
+
+/*******************************************************************************
+* Name:         main_loop()
+* Description:  Main loop of a node: receive, keep the queue full.
+* Parameters:   index: Index of the node.
+* Return:       None.
+*******************************************************************************/
+static void main_loop(uint8_t index)
+{
+    model_node* n = &node[index];
+    uint8_t data[PLM_PACKET_DATA_SIZE];
+    uint8_t channel;
+    uint8_t length;
+    uint8_t i;
+
+    while((length = plm1_receive(&n->plm, data, NULL, &channel)) > 0)
+    {
+        check_packet(index, data, length, channel);
+    }
+
+    plm1_tx_poll(&n->plm);
+    data[0] = n->tx_seq;
+    for(i = 1; i < MODEL_DATA_LENGTH; i++)
+    {
+        data[i] = (uint8_t)(n->tx_seq * 31 + index + i);
+    }
+    if(plm1_send_packet(&n->plm, data, MODEL_DATA_LENGTH, PLM1_PRIO_NORMAL, index, false) != PLM_TX_NO_HANDLE)
+    {
+        n->tx_seq++;
+    }
+}
+
+/*******************************************************************************
+* Name:         check_packet()
+* Description:  Check a packet received by a node.
+* Parameters:   receiver: Index of the receiving node.
+*               data: Data of the packet.
+*               length: Length of the data.
+*               channel: Channel of the packet, index of its sender.
+* Return:       None.
+*******************************************************************************/
+static void check_packet(uint8_t receiver, const uint8_t* data, uint8_t length, uint8_t channel)
+{
+    uint8_t i;
+
+    if((length != MODEL_DATA_LENGTH) || (channel >= MODEL_MAX_NODES) || (channel == receiver))
+    {
+        check(false, "packet header");
+        return;
+    }
+    check(data[0] == node[receiver].rx_seq[channel], "packets in order");
+    node[receiver].rx_seq[channel] = data[0] + 1;
+    for(i = 1; i < MODEL_DATA_LENGTH; i++)
+    {
+        if(data[i] != (uint8_t)(data[0] * 31 + channel + i))
+        {
+            check(false, "packet data");
+            return;
+        }
+    }
+
+    // Counted once, by the first node which is not the sender.
+    if(receiver == ((channel == 0) ? 1 : 0))
+    {
+        node[channel].delivered++;
+    }
+}
+
+/*******************************************************************************
+* Name:         check()
+* Description:  Count and print a failed check.
+* Parameters:   ok: Result of the check.
+*               what: Check.
+* Return:       None.
+*******************************************************************************/
+static void check(bool ok, const char* what)
+{
+    if(!ok)
+    {
+        errors++;
+        if(errors <= 20)
+        {
+            printf("Fail:%s\n", what);
+        }
+    }
+}
+
+/*------------------------------------------------------------------------------
+  Port of the driver
+------------------------------------------------------------------------------*/
+
+static void model_set_cs(void* arg, bool select)
+{
+    (void)arg;
+    (void)select;
+}
+
+static void model_set_reset(void* arg, bool run)
+{
+    (void)arg;
+    (void)run;
+}
+
+static bool model_get_cnfgd(void* arg)
+{
+    (void)arg;
+    return (true);
+}
+
+static void model_spi_tx(void* arg, uint8_t byte)
+{
+    ((model_node*)arg)->written = byte;
+}
+
+static void model_mask_irq(void* arg, bool mask)
+{
+    (void)arg;
+    (void)mask;
+}
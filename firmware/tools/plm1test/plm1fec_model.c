@@ -0,0 +1,377 @@
+/*******************************************************************************
+* Filename:     plm1fec_model.c
+* Description:  Noise injection model of the goodput of plm1fec at each code
+*               rate.
+* Version:      1.0.0
+* Note:         Usage: plm1fec_model [packets] [seed]
+*
+*               Full packets of random data are coded by plm1fec_encode(),
+*               hit by noise and fed to the driver nibble by nibble on the
+*               coded channel, ended as PLM-1 does: RX_ERROR if its CRC
+*               fails (payload changed by the noise), EOP otherwise. They are
+*               read back by plm1fec_receive(). A packet not delivered intact
+*               is sent again. The header is not hit by the noise.
+*               Each transmission costs the coded payload plus
+*               MODEL_OVERHEAD byte times (header, preamble, negotiation).
+*               Goodput is the payload delivered per line byte.
+*
+*               Noise: independent bit errors at the given BER, and optional
+*               bursts of MODEL_BURST_BITS consecutive bits starting on a
+*               byte at MODEL_BURST_RATE per mille.
+*
+*               The model checks that:
+*                 - without noise every packet is delivered at each rate;
+*                 - at BER 3e-3, both code rates beat the uncoded payload,
+*                   and deliver packets PLM-1 received with errors;
+*                 - no packet is delivered with errors, at any noise level
+*                   (rate 2/3 miscorrections are dropped by its check
+*                   byte);
+*                 - a packet of the reserved code rate is dropped and
+*                   counted;
+*                 - the coded packets are received on the subscribed
+*                   channel number, whatever their code rate, and
+*                   plm1_receive_channel() gives their channel byte.
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "plm1fec.h"
+
+/*------------------------------------------------------------------------------
+  Local constants declaration
+------------------------------------------------------------------------------*/
+
+#define MODEL_OVERHEAD                 10                       // Byte times per packet besides the payload.
+#define MODEL_CHANNEL                  3                        // Channel of the packets.
+#define MODEL_BURST_BITS               6                        // Bits flipped by a burst.
+#define MODEL_BURST_RATE               10                       // Per mille chance of a burst per byte.
+#define MODEL_MAX_TRIES                50                       // Transmissions of a packet before it is given up.
+#define MODEL_RATE_NBR                 3                        // Code rates modelled.
+#define MODEL_CC_EOP                   0x11                     // PLM-1 special character: end of packet.
+#define MODEL_CC_RX_ERROR              0x12                     // PLM-1 special character: receiver error.
+
+/*------------------------------------------------------------------------------
+  Local types declaration
+------------------------------------------------------------------------------*/
+
+// Result of a run at a code rate.
+typedef struct {
+    uint32_t delivered;                                         // Packets delivered intact.
+    uint32_t undetected;                                        // Packets delivered with errors (miscorrected).
+    uint32_t recovered;                                         // Packets received with errors by PLM-1, then decoded.
+    uint32_t payload;                                           // Payload bytes delivered.
+    uint32_t line;                                              // Line byte times used.
+} model_result;
+
+/*------------------------------------------------------------------------------
+  Local functions declaration
+------------------------------------------------------------------------------*/
+
+static void run(plm1fec_rate rate, double ber, bool bursts, uint32_t packets, model_result* result);
+static void add_noise(uint8_t* packet, uint8_t length, double ber, bool bursts);
+static void feed_packet(uint8_t channel, const uint8_t* data, uint8_t length, bool errored);
+static void feed_byte(uint8_t byte);
+static double goodput(const model_result* result);
+static void check(bool ok, const char* what);
+static void model_set_cs(void* arg, bool select);
+static void model_set_reset(void* arg, bool run);
+static bool model_get_cnfgd(void* arg);
+static void model_spi_tx(void* arg, uint8_t byte);
+static void model_mask_irq(void* arg, bool mask);
+
+/*------------------------------------------------------------------------------
+  Local variables declaration
+------------------------------------------------------------------------------*/
+
+static const plm1_port model_port = {
+    model_set_cs,
+    model_set_reset,
+    model_get_cnfgd,
+    model_spi_tx,
+    model_mask_irq,
+    NULL
+};
+
+static const uint8_t model_sizes[MODEL_RATE_NBR] = {
+    PLM_PACKET_DATA_SIZE, PLM_FEC_MAX_DATA_2_3, PLM_FEC_MAX_DATA_1_2
+};
+static const double model_bers[] = { 0.0, 1e-4, 1e-3, 3e-3, 1e-2 };
+static plm1_t plm;
+static plm1fec_t fec;
+static uint32_t errors;
+
+/*******************************************************************************
+* Name:         main()
+* Description:  Run the model.
+* Parameters:   argc, argv: [packets] [seed].
+* Return:       0 if no check failed, 1 otherwise.
+*******************************************************************************/
+int main(int argc, char** argv)
+{
+    uint32_t packets = (argc > 1) ? (uint32_t)atoi(argv[1]) : 2000;
+    model_result results[MODEL_RATE_NBR];
+    plm1fec_counters counters;
+    plm1_channel_stats stats;
+    uint8_t packet[PLM_PACKET_DATA_SIZE];
+    uint8_t data[PLM_PACKET_DATA_SIZE];
+    uint8_t channel;
+    uint8_t b;
+    uint8_t r;
+
+    srand((argc > 2) ? (unsigned)atoi(argv[2]) : 1);
+    plm1_init(&plm, &model_port);
+    plm1_configure_start(&plm, NULL, NULL);
+    while(plm.sts.state == PLM1_STATE_CONFIGURING)
+    {
+        plm1_spi_isr(&plm, 0x1F);
+    }
+    check(plm1_configure_poll(&plm) == PLM1_CFG_DONE, "configuration");
+    plm1fec_init(&fec, &plm);
+    check(plm1_subscribe(&plm, MODEL_CHANNEL, 1), "subscribe");
+
+    printf("goodput, payload per line byte (%u packets, %u byte times of overhead)\n", packets, MODEL_OVERHEAD);
+    printf("BER       none    2/3     1/2\n");
+    for(b = 0; b < (sizeof(model_bers) / sizeof(model_bers[0])); b++)
+    {
+        for(r = 0; r < MODEL_RATE_NBR; r++)
+        {
+            run((plm1fec_rate)r, model_bers[b], false, packets, &results[r]);
+            check(results[r].undetected == 0, "no packet delivered with errors");
+            if(model_bers[b] == 0.0)
+            {
+                check((results[r].delivered == packets) && (results[r].undetected == 0), "no noise: all delivered");
+            }
+        }
+        printf("%-8g  %.3f   %.3f   %.3f\n", model_bers[b], goodput(&results[0]), goodput(&results[1]), goodput(&results[2]));
+        if(model_bers[b] == 3e-3)
+        {
+            check(goodput(&results[1]) > goodput(&results[0]), "BER 3e-3: rate 2/3 beats no coding");
+            check(goodput(&results[2]) > goodput(&results[0]), "BER 3e-3: rate 1/2 beats no coding");
+            check((results[1].recovered > 0) && (results[2].recovered > 0), "BER 3e-3: errored packets decoded");
+            check(results[0].recovered == 0, "BER 3e-3: errored uncoded packets dropped");
+        }
+    }
+
+    printf("bursts of %u bits at %u per mille per byte, BER 1e-3:\n", MODEL_BURST_BITS, MODEL_BURST_RATE);
+    for(r = 0; r < MODEL_RATE_NBR; r++)
+    {
+        run((plm1fec_rate)r, 1e-3, true, packets, &results[r]);
+        check(results[r].undetected == 0, "bursts: no packet delivered with errors");
+    }
+    printf("          %.3f   %.3f   %.3f\n", goodput(&results[0]), goodput(&results[1]), goodput(&results[2]));
+    printf("undetected errors: %u %u %u\n", results[0].undetected, results[1].undetected, results[2].undetected);
+
+    // Reserved code rate.
+    memset(packet, 0, sizeof(packet));
+    channel = MODEL_CHANNEL | PLM_FEC_CHANNEL_MASK;
+    plm1fec_get_counters(&fec, &counters);
+    check(plm1fec_input(&fec, packet, 30, &channel, data) == 0, "reserved rate: dropped");
+    check(channel == MODEL_CHANNEL, "reserved rate: channel bits cleared");
+    r = counters.rx_reserved;
+    plm1fec_get_counters(&fec, &counters);
+    check(counters.rx_reserved == (uint16_t)(r + 1), "reserved rate: counted");
+    check(plm1fec_encode(data, 10, (plm1fec_rate)3, packet) == 0, "reserved rate: not encoded");
+
+    // Subscription on the channel number.
+    check(plm1_get_channel_stats(&plm, MODEL_CHANNEL | PLM_FEC_CHANNEL_MASK, &stats) && (stats.received > 0), "subscription: coded packets received");
+    channel = MODEL_CHANNEL | (PLM1FEC_RATE_1_2 << PLM_FEC_CHANNEL_SHIFT);
+    feed_packet(channel, packet, 10, false);
+    check(plm1_receive_channel(&plm, MODEL_CHANNEL, data, NULL) == 10, "subscription: coded packet read on its channel");
+    check(plm1_rx_channel(&plm) == channel, "subscription: channel byte with the code rate");
+
+    printf("%s:fec errors:%u\n", (errors == 0) ? "Ok" : "Fail", errors);
+    return ((errors == 0) ? 0 : 1);
+}
+
+/*------------------------------------------------------------------------------
+  Local functions
+------------------------------------------------------------------------------*/
+
+/*******************************************************************************
+* Name:         run()
+* Description:  Send packets at a code rate over a noisy line.
+* Parameters:   rate: Code rate.
+*               ber: Bit error rate.
+*               bursts: true to add error bursts.
+*               packets: Nb of packets.
+*               result: Struct used to return the result.
+* Return:       None.
+*******************************************************************************/
+static void run(plm1fec_rate rate, double ber, bool bursts, uint32_t packets, model_result* result)
+{
+    uint8_t payload[PLM_PACKET_DATA_SIZE];
+    uint8_t coded[PLM_PACKET_DATA_SIZE];
+    uint8_t line[PLM_PACKET_DATA_SIZE];
+    uint8_t data[PLM_PACKET_DATA_SIZE];
+    uint8_t size = model_sizes[rate];
+    uint8_t codedLength;
+    uint8_t channel = MODEL_CHANNEL | ((uint8_t)rate << PLM_FEC_CHANNEL_SHIFT);
+    uint8_t length;
+    uint16_t recovered = fec.counters.rx_recovered;
+    uint32_t i;
+    uint8_t tries;
+    uint8_t j;
+
+    memset(result, 0, sizeof(model_result));
+    for(i = 0; i < packets; i++)
+    {
+        for(j = 0; j < size; j++)
+        {
+            payload[j] = (uint8_t)rand();
+        }
+        codedLength = plm1fec_encode(payload, size, rate, coded);
+
+        for(tries = 0; tries < MODEL_MAX_TRIES; tries++)
+        {
+            memcpy(line, coded, codedLength);
+            add_noise(line, codedLength, ber, bursts);
+            result->line += codedLength + MODEL_OVERHEAD;
+
+            // The CRC of the PLM-1 fails on any error.
+            feed_packet(channel, line, codedLength, memcmp(line, coded, codedLength) != 0);
+            length = plm1fec_receive(&fec, data, NULL, NULL);
+            if(length == 0)
+            {
+                continue;
+            }
+            if((length != size) || (memcmp(data, payload, size) != 0))
+            {
+                result->undetected++;
+                continue;
+            }
+            result->delivered++;
+            result->payload += size;
+            break;
+        }
+    }
+    result->recovered = (uint16_t)(fec.counters.rx_recovered - recovered);
+}
+
+/*******************************************************************************
+* Name:         feed_packet()
+* Description:  Feed a received packet to the driver, as PLM-1 does.
+* Parameters:   channel: Channel byte of the packet.
+*               data: Payload.
+*               length: Length of the payload.
+*               errored: true to end the packet on RX_ERROR instead of EOP.
+* Return:       None.
+*******************************************************************************/
+static void feed_packet(uint8_t channel, const uint8_t* data, uint8_t length, bool errored)
+{
+    uint8_t i;
+
+    feed_byte((uint8_t)PLM1_PRIO_NORMAL);
+    feed_byte(channel);
+    for(i = 0; i < length; i++)
+    {
+        feed_byte(data[i]);
+    }
+    plm1_spi_isr(&plm, errored ? MODEL_CC_RX_ERROR : MODEL_CC_EOP);
+}
+
+/*******************************************************************************
+* Name:         feed_byte()
+* Description:  Feed a byte to the driver, most significant nibble first.
+* Parameters:   byte: Byte.
+* Return:       None.
+*******************************************************************************/
+static void feed_byte(uint8_t byte)
+{
+    plm1_spi_isr(&plm, byte >> 4);
+    plm1_spi_isr(&plm, byte & 0x0F);
+}
+
+/*******************************************************************************
+* Name:         add_noise()
+* Description:  Flip bits of a packet.
+* Parameters:   packet: Packet.
+*               length: Length of the packet.
+*               ber: Bit error rate.
+*               bursts: true to add error bursts.
+* Return:       None.
+*******************************************************************************/
+static void add_noise(uint8_t* packet, uint8_t length, double ber, bool bursts)
+{
+    uint16_t bit;
+    uint16_t end;
+
+    for(bit = 0; bit < (length * 8); bit++)
+    {
+        if((ber > 0.0) && (((double)rand() / RAND_MAX) < ber))
+        {
+            packet[bit >> 3] ^= (uint8_t)(0x80 >> (bit & 0x07));
+        }
+        if(bursts && ((bit & 0x07) == 0) && ((rand() % 1000) < MODEL_BURST_RATE))
+        {
+            for(end = bit + MODEL_BURST_BITS; (bit < end) && (bit < (length * 8)); bit++)
+            {
+                packet[bit >> 3] ^= (uint8_t)(0x80 >> (bit & 0x07));
+            }
+            bit--;
+        }
+    }
+}
+
+/*******************************************************************************
+* Name:         goodput()
+* Description:  Payload delivered per line byte.
+* Parameters:   result: Result of a run.
+* Return:       Goodput, 0 to 1.
+*******************************************************************************/
+static double goodput(const model_result* result)
+{
+    return ((result->line != 0) ? ((double)result->payload / result->line) : 0.0);
+}
+
+/*******************************************************************************
+* Name:         check()
+* Description:  Count and print a failed check.
+* Parameters:   ok: Result of the check.
+*               what: Check.
+* Return:       None.
+*******************************************************************************/
+static void check(bool ok, const char* what)
+{
+    if(!ok)
+    {
+        errors++;
+        printf("Fail:%s\n", what);
+    }
+}
+
+/*------------------------------------------------------------------------------
+  Port of the driver
+------------------------------------------------------------------------------*/
+
+static void model_set_cs(void* arg, bool select)
+{
+    (void)arg;
+    (void)select;
+}
+
+static void model_set_reset(void* arg, bool run)
+{
+    (void)arg;
+    (void)run;
+}
+
+static bool model_get_cnfgd(void* arg)
+{
+    (void)arg;
+    return (true);
+}
+
+static void model_spi_tx(void* arg, uint8_t byte)
+{
+    (void)arg;
+    (void)byte;
+}
+
+static void model_mask_irq(void* arg, bool mask)
+{
+    (void)arg;
+    (void)mask;
+}
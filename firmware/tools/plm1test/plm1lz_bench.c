@@ -0,0 +1,433 @@
+/*******************************************************************************
+* Filename:     plm1lz_bench.c
+* Description:  Benchmark of plm1lz on the packets of a PLM-1 nibble capture.
+* Version:      1.0.0
+* Note:         Usage: plm1lz_bench <capture> [repeat]
+*
+*               The packets received and transmitted by the recorded node
+*               are rebuilt from the capture (see plm1cap.h): the data
+*               nibbles given to plm1_spi_isr() up to an EOP, and the data
+*               nibbles written up to an EOP. A transmission retried with
+*               the same content is counted once. The data of each packet,
+*               header excluded, goes through plm1lz_pack() and
+*               plm1lz_input().
+*
+*               Reported:
+*                 - the compression ratio, packets which do not shrink
+*                   being sent as is (as plm1lz_send() does);
+*                 - the time per input byte of plm1lz_compress() and of
+*                   plm1lz_decompress(), fastest of [repeat] runs (default
+*                   20), in host TSC cycles on x86 and in ns.
+*               Host figures rank changes of plm1lz against each other;
+*               they are not AVR cycles.
+*
+*               Every packet must come back intact from plm1lz_input().
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "plm1lz.h"
+#include "plm1cap.h"
+
+/*------------------------------------------------------------------------------
+  Local constants declaration
+------------------------------------------------------------------------------*/
+
+#define BENCH_MAX_PACKETS              200000                   // Packets kept from a capture.
+#define BENCH_CHANNEL                  4                        // Channel given to plm1lz_pack().
+
+/*------------------------------------------------------------------------------
+  Local types declaration
+------------------------------------------------------------------------------*/
+
+// Data of a packet of the capture, header excluded.
+typedef struct {
+    uint8_t length;
+    uint8_t data[PLM_PACKET_DATA_SIZE];
+} bench_packet;
+
+// Nibbles of a packet being rebuilt.
+typedef struct {
+    uint8_t nibbles[2 * PLM_MAX_PACKET_SIZE];
+    int length;                                                 // Nibbles collected, -1 when not collecting.
+} bench_collect;
+
+// Time of a run.
+typedef struct {
+    uint64_t ns;
+    uint64_t cycles;                                            // 0 if not measured.
+} bench_time;
+
+/*------------------------------------------------------------------------------
+  Local functions declaration
+------------------------------------------------------------------------------*/
+
+static const plm1cap_entry* map_capture(const char* path, plm1cap_header* header);
+static uint32_t extract_packets(const plm1cap_entry* entries, uint32_t count);
+static void collect(bench_collect* c, uint8_t nibble, bool tx);
+static void time_runs(bool compress, uint32_t repeat, bench_time* best);
+static uint64_t now_ns(void);
+static uint64_t now_cycles(void);
+
+/*------------------------------------------------------------------------------
+  Local variables declaration
+------------------------------------------------------------------------------*/
+
+static bench_packet packets[BENCH_MAX_PACKETS];
+static uint8_t packed[BENCH_MAX_PACKETS][PLM_PACKET_DATA_SIZE];
+static uint8_t packed_length[BENCH_MAX_PACKETS];
+static uint32_t packet_nbr;
+static uint32_t rx_nbr;
+static uint32_t tx_nbr;
+static volatile uint32_t sink;                                  // Keeps the timed calls.
+
+/*******************************************************************************
+* Name:         main()
+* Description:  Run the benchmark.
+* Parameters:   argc, argv: <capture> [repeat].
+* Return:       0 if every packet came back intact, 1 otherwise.
+*******************************************************************************/
+int main(int argc, char** argv)
+{
+    const plm1cap_entry* entries;
+    plm1cap_header header;
+    uint8_t data[PLM_LZ_MAX_INPUT];
+    uint32_t repeat = (argc > 2) ? (uint32_t)atoi(argv[2]) : 20;
+    uint64_t inBytes = 0;
+    uint64_t outBytes = 0;
+    uint64_t packedIn = 0;
+    uint32_t compressed = 0;
+    uint32_t errors = 0;
+    bench_time comp;
+    bench_time decomp;
+    uint8_t channel;
+    uint8_t length;
+    uint32_t i;
+
+    if(argc < 2)
+    {
+        printf("Usage: plm1lz_bench <capture> [repeat]\n");
+        return (1);
+    }
+    entries = map_capture(argv[1], &header);
+    if(entries == NULL)
+    {
+        printf("Fail:cannot read capture %s\n", argv[1]);
+        return (1);
+    }
+    extract_packets(entries, header.count);
+    if(packet_nbr == 0)
+    {
+        printf("Fail:no packet in capture %s\n", argv[1]);
+        return (1);
+    }
+
+    for(i = 0; i < packet_nbr; i++)
+    {
+        channel = BENCH_CHANNEL;
+        length = plm1lz_pack(packets[i].data, packets[i].length, packed[i], &channel);
+        inBytes += packets[i].length;
+        if(length > 0)
+        {
+            compressed++;
+            packedIn += packets[i].length;
+            outBytes += length;
+        }
+        else
+        {
+            memcpy(packed[i], packets[i].data, packets[i].length);
+            length = packets[i].length;
+            outBytes += length;
+        }
+        packed_length[i] = length;
+
+        if((plm1lz_input(packed[i], length, &channel, data) != packets[i].length) ||
+           (channel != BENCH_CHANNEL) || (memcmp(data, packets[i].data, packets[i].length) != 0))
+        {
+            errors++;
+        }
+    }
+
+    time_runs(true, repeat, &comp);
+    time_runs(false, repeat, &decomp);
+
+    printf("%u packets (%u received, %u transmitted), %llu data bytes\n",
+           packet_nbr, rx_nbr, tx_nbr, (unsigned long long)inBytes);
+    printf("compressed: %u packets (%.1f %%), %llu bytes sent for %llu (ratio %.3f)\n",
+           compressed, 100.0 * compressed / packet_nbr,
+           (unsigned long long)outBytes, (unsigned long long)inBytes, (double)outBytes / inBytes);
+    printf("compress:   %.1f ns/byte", (double)comp.ns / inBytes);
+    if(comp.cycles != 0)
+    {
+        printf(", %.1f host cycles/byte", (double)comp.cycles / inBytes);
+    }
+    if(packedIn == 0)
+    {
+        printf("\ndecompress: no packet compressed\n");
+    }
+    else
+    {
+        printf("\ndecompress: %.1f ns/byte", (double)decomp.ns / packedIn);
+        if(decomp.cycles != 0)
+        {
+            printf(", %.1f host cycles/byte", (double)decomp.cycles / packedIn);
+        }
+        printf(" (of decompressed data)\n");
+    }
+
+    printf("%s:lz errors:%u\n", (errors == 0) ? "Ok" : "Fail", errors);
+    return ((errors == 0) ? 0 : 1);
+}
+
+/*------------------------------------------------------------------------------
+  Local functions
+------------------------------------------------------------------------------*/
+
+/*******************************************************************************
+* Name:         map_capture()
+* Description:  Map a capture file.
+* Parameters:   path: Path of the capture.
+*               header: Struct used to return the header.
+* Return:       First entry, NULL if the file is not a valid capture.
+*******************************************************************************/
+static const plm1cap_entry* map_capture(const char* path, plm1cap_header* header)
+{
+    const uint8_t* data;
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+
+    if(fd < 0)
+    {
+        return (NULL);
+    }
+    if((fstat(fd, &st) != 0) || (st.st_size < (off_t)sizeof(plm1cap_header)))
+    {
+        close(fd);
+        return (NULL);
+    }
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED)
+    {
+        return (NULL);
+    }
+
+    memcpy(header, data, sizeof(plm1cap_header));
+    if((memcmp(header->magic, PLM1CAP_MAGIC, sizeof(header->magic)) != 0) ||
+       (header->version != PLM1CAP_VERSION) || (header->entry_size != sizeof(plm1cap_entry)) ||
+       ((uint64_t)st.st_size < sizeof(plm1cap_header) + (uint64_t)header->count * sizeof(plm1cap_entry)))
+    {
+        munmap((void*)data, st.st_size);
+        return (NULL);
+    }
+
+    return ((const plm1cap_entry*)(data + sizeof(plm1cap_header)));
+}
+
+/*******************************************************************************
+* Name:         extract_packets()
+* Description:  Rebuild the packets received and transmitted by the node.
+* Parameters:   entries: Entries of the capture.
+*               count: Nb of entries.
+* Return:       Nb of packets.
+* Note:         A gap drops the packets being rebuilt.
+*******************************************************************************/
+static uint32_t extract_packets(const plm1cap_entry* entries, uint32_t count)
+{
+    bench_collect rx = { {0}, -1 };
+    bench_collect tx = { {0}, -1 };
+    uint8_t before;
+    uint8_t after;
+    uint32_t i;
+
+    for(i = 0; (i < count) && (packet_nbr < BENCH_MAX_PACKETS); i++)
+    {
+        before = entries[i].state >> 4;
+        after = entries[i].state & 0x0F;
+
+        if(entries[i].rx == PLM1CAP_LOST)
+        {
+            rx.length = -1;
+            tx.length = -1;
+            continue;
+        }
+
+        // Reception: data nibbles from idle or negotiating, up to the EOP.
+        if(entries[i].rx < 0x10)
+        {
+            if((before != PLM1_STATE_RECEIVING) && (after == PLM1_STATE_RECEIVING))
+            {
+                rx.length = 0;
+            }
+            if(rx.length >= 0)
+            {
+                collect(&rx, entries[i].rx, false);
+            }
+        }
+        else if(before == PLM1_STATE_RECEIVING)
+        {
+            if(entries[i].rx == PLM1CAP_EOP)
+            {
+                collect(&rx, PLM1CAP_EOP, false);
+            }
+            rx.length = -1;
+        }
+
+        // Transmission: first nibble written as the negotiation starts.
+        if((entries[i].tx < 0x10) && (before != PLM1_STATE_NEGOTIATING) && (before != PLM1_STATE_TRANSMITTING))
+        {
+            tx.length = 0;
+        }
+        if((tx.length >= 0) && (entries[i].tx != PLM1CAP_NONE) &&
+           ((entries[i].tx < 0x10) || (entries[i].tx == PLM1CAP_EOP)))
+        {
+            if((entries[i].rx == PLM1CAP_TX_UNDERRUN) || (entries[i].rx == PLM1CAP_TX_OVERRUN))
+            {
+                tx.length = 0;
+            }
+            collect(&tx, entries[i].tx, true);
+        }
+    }
+
+    return (packet_nbr);
+}
+
+/*******************************************************************************
+* Name:         collect()
+* Description:  Add a nibble to a packet being rebuilt, keep the packet on EOP.
+* Parameters:   c: Packet being rebuilt.
+*               nibble: Data nibble or PLM1CAP_EOP.
+*               tx: true for a transmitted packet.
+* Return:       None.
+*******************************************************************************/
+static void collect(bench_collect* c, uint8_t nibble, bool tx)
+{
+    bench_packet* pkt = &packets[packet_nbr];
+    int n;
+
+    if(nibble != PLM1CAP_EOP)
+    {
+        if(c->length < (int)sizeof(c->nibbles))
+        {
+            c->nibbles[c->length++] = nibble;
+        }
+        return;
+    }
+
+    if((c->length & 1) || (c->length <= 2 * PLM_PACKET_HEADER_SIZE) ||
+       (c->length > 2 * PLM_MAX_PACKET_SIZE))
+    {
+        c->length = -1;
+        return;
+    }
+
+    pkt->length = (uint8_t)(c->length / 2 - PLM_PACKET_HEADER_SIZE);
+    for(n = 2 * PLM_PACKET_HEADER_SIZE; n < c->length; n += 2)
+    {
+        pkt->data[n / 2 - PLM_PACKET_HEADER_SIZE] = (uint8_t)((c->nibbles[n] << 4) | c->nibbles[n + 1]);
+    }
+    c->length = -1;
+
+    // A retry writes the same packet again.
+    if(tx && (tx_nbr > 0) && (packet_nbr > 0) && (packets[packet_nbr - 1].length == pkt->length) &&
+       (memcmp(packets[packet_nbr - 1].data, pkt->data, pkt->length) == 0))
+    {
+        return;
+    }
+    packet_nbr++;
+    if(tx)
+    {
+        tx_nbr++;
+    }
+    else
+    {
+        rx_nbr++;
+    }
+}
+
+/*******************************************************************************
+* Name:         time_runs()
+* Description:  Time the compression or the decompression of all packets.
+* Parameters:   compress: true for plm1lz_compress(), false for
+*                         plm1lz_decompress() of the compressed packets.
+*               repeat: Nb of runs.
+*               best: Struct used to return the fastest run.
+* Return:       None.
+*******************************************************************************/
+static void time_runs(bool compress, uint32_t repeat, bench_time* best)
+{
+    uint8_t out[PLM_LZ_MAX_INPUT];
+    uint64_t ns;
+    uint64_t cycles;
+    uint32_t r;
+    uint32_t i;
+
+    best->ns = UINT64_MAX;
+    best->cycles = UINT64_MAX;
+    for(r = 0; r < repeat; r++)
+    {
+        ns = now_ns();
+        cycles = now_cycles();
+        for(i = 0; i < packet_nbr; i++)
+        {
+            if(compress)
+            {
+                sink += plm1lz_compress(packets[i].data, packets[i].length, out, PLM_PACKET_DATA_SIZE);
+            }
+            else if(packed_length[i] < packets[i].length)
+            {
+                sink += plm1lz_decompress(packed[i], packed_length[i], out, PLM_LZ_MAX_INPUT);
+            }
+        }
+        cycles = now_cycles() - cycles;
+        ns = now_ns() - ns;
+        if(ns < best->ns)
+        {
+            best->ns = ns;
+        }
+        if(cycles < best->cycles)
+        {
+            best->cycles = cycles;
+        }
+    }
+}
+
+/*******************************************************************************
+* Name:         now_ns()
+* Description:  Monotonic time.
+* Parameters:   None.
+* Return:       Time in ns.
+*******************************************************************************/
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+/*******************************************************************************
+* Name:         now_cycles()
+* Description:  Time stamp counter of the host.
+* Parameters:   None.
+* Return:       Cycles, 0 if the host has no time stamp counter.
+*******************************************************************************/
+static uint64_t now_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return (__rdtsc());
+#else
+    return (0);
+#endif
+}
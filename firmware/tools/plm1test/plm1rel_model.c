@@ -0,0 +1,431 @@
+/*******************************************************************************
+* Filename:     plm1rel_model.c
+* Description:  Two-node model of the reliable transport over a lossy line,
+*               built on the host build of the library.
+* Version:      1.0.0
+* Note:         Usage: plm1rel_model [steps] [seed]
+*
+*               A sender and a receiver share a line, one step being a
+*               nibble time, as in plm1backoff_model: the model plays the
+*               PLM-1 of both nodes (TXRE, collisions, nibbles fed to the
+*               other node, gap after each EOP). A packet is lost with the
+*               given probability: the receiver gets RX_ERROR instead of its
+*               EOP. Data packets and acknowledges are lost alike. The main
+*               loop of each node only runs every MODEL_LOOP_STEPS, so that
+*               each acknowledge comes back late.
+*
+*               The sender keeps its plm1rel send window full of packets
+*               carrying a 16 bits counter; the receiver reads them with
+*               plm1rel_receive(). The model checks that:
+*                 - every packet is delivered once, intact and in order,
+*                   across several wraps of the 8 bits sequence number,
+*                   with and without loss;
+*                 - without loss, stop-and-wait never retransmits, and a
+*                   full window retransmits under 1% of its packets (acks
+*                   queued behind data make the RTT jump);
+*                 - with loss, packets are retransmitted, some of them
+*                   after a selective acknowledge;
+*                 - a window of PLM_REL_MAX_WINDOW packets delivers more
+*                   than a window of 1 (stop-and-wait), with and without
+*                   loss.
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "plm1rel.h"
+
+/*------------------------------------------------------------------------------
+  Local constants declaration
+------------------------------------------------------------------------------*/
+
+#define MODEL_NODES                    2                        // Sender (0) and receiver (1).
+#define MODEL_TIMER_STEPS              8                        // Steps between two plm1_timer() calls.
+#define MODEL_LOOP_STEPS               64                       // Steps between two main loops of a node.
+#define MODEL_GAP_STEPS                MODEL_TIMER_STEPS        // Line quiet after an EOP.
+#define MODEL_COLLISION_STEPS          4                        // Line busy after a collision.
+#define MODEL_DATA_LENGTH              16                       // Data bytes of the packets sent.
+#define MODEL_CHANNEL                  5                        // Channel of the transport.
+#define MODEL_NO_OWNER                 0xFF                     // Line free.
+
+/*------------------------------------------------------------------------------
+  Local types declaration
+------------------------------------------------------------------------------*/
+
+// Node of the line.
+typedef struct {
+    plm1_t plm;
+    plm1_port port;
+    plm1rel_t rel;
+    uint8_t written;                                            // Last byte written by the driver to the SPI port.
+} model_node;
+
+// Result of a run.
+typedef struct {
+    uint32_t delivered;                                         // Packets delivered in order.
+    uint32_t lost;                                              // Packets lost on the line.
+    uint16_t retransmitted;                                     // Packets retransmitted by the sender.
+    uint16_t fast;                                              // Packets retransmitted before their timeout.
+    uint16_t duplicates;                                        // Packets received twice by the receiver.
+} model_result;
+
+/*------------------------------------------------------------------------------
+  Local functions declaration
+------------------------------------------------------------------------------*/
+
+static void run(uint8_t window, uint8_t lossPercent, uint32_t steps, model_result* result);
+static void init_node(uint8_t index, uint8_t window);
+static void sender_loop(void);
+static void receiver_loop(void);
+static uint32_t model_random(void);
+static void check(bool ok, const char* what);
+static void model_set_cs(void* arg, bool select);
+static void model_set_reset(void* arg, bool run);
+static bool model_get_cnfgd(void* arg);
+static void model_spi_tx(void* arg, uint8_t byte);
+static void model_mask_irq(void* arg, bool mask);
+
+/*------------------------------------------------------------------------------
+  Local variables declaration
+------------------------------------------------------------------------------*/
+
+static model_node node[MODEL_NODES];
+static uint16_t tx_count;                                       // Counter carried by the next packet sent.
+static uint16_t rx_count;                                       // Counter expected in the next packet delivered.
+static uint32_t fast_retransmits;                               // Retransmissions requested by a selective acknowledge.
+static uint32_t seed;
+static uint32_t errors;
+
+/*******************************************************************************
+* Name:         main()
+* Description:  Run the model.
+* Parameters:   argc, argv: [steps] [seed].
+* Return:       0 if no check failed, 1 otherwise.
+*******************************************************************************/
+int main(int argc, char** argv)
+{
+    static const uint8_t runLoss[] = { 0, 10 };
+    uint32_t steps = (argc > 1) ? (uint32_t)atoi(argv[1]) : 400000;
+    model_result single;
+    model_result full;
+    uint8_t i;
+
+    seed = (argc > 2) ? (uint32_t)atoi(argv[2]) : 1;
+
+    printf("%u steps, %u data bytes per packet, main loop every %u steps\n", steps, MODEL_DATA_LENGTH, MODEL_LOOP_STEPS);
+    printf("loss  window  delivered  lost  retransmitted  fast  duplicates\n");
+    for(i = 0; i < sizeof(runLoss); i++)
+    {
+        run(1, runLoss[i], steps, &single);
+        run(PLM_REL_MAX_WINDOW, runLoss[i], steps, &full);
+
+        check(full.delivered > 2 * 256, "sequence numbers wrapped twice");
+        check(full.delivered > single.delivered, "full window beats stop-and-wait");
+        if(runLoss[i] == 0)
+        {
+            check(single.retransmitted == 0, "no loss: stop-and-wait, no retransmission");
+            check(full.retransmitted * 100 < full.delivered, "no loss: full window, under 1% of spurious retransmissions");
+        }
+        else
+        {
+            check(single.retransmitted > 0, "loss: stop-and-wait retransmits");
+            check(full.fast > 0, "loss: selective acknowledges trigger retransmissions");
+        }
+    }
+
+    printf("%s:rel errors:%u\n", (errors == 0) ? "Ok" : "Fail", errors);
+    return ((errors == 0) ? 0 : 1);
+}
+
+/*------------------------------------------------------------------------------
+  Local functions
+------------------------------------------------------------------------------*/
+
+/*******************************************************************************
+* Name:         run()
+* Description:  Run the sender and the receiver over the line.
+* Parameters:   window: Send window of the transport.
+*               lossPercent: Probability of a packet to be lost, in percent.
+*               steps: Nb of steps.
+*               result: Struct used to return the result.
+* Return:       None.
+*******************************************************************************/
+static void run(uint8_t window, uint8_t lossPercent, uint32_t steps, model_result* result)
+{
+    uint8_t owner = MODEL_NO_OWNER;
+    uint32_t quiet = 0;
+    uint8_t contenders;
+    uint8_t nibble;
+    uint32_t step;
+    uint8_t i;
+
+    memset(result, 0, sizeof(model_result));
+    tx_count = 0;
+    rx_count = 0;
+    fast_retransmits = 0;
+    for(i = 0; i < MODEL_NODES; i++)
+    {
+        init_node(i, window);
+    }
+
+    for(step = 0; step < steps; step++)
+    {
+        if((step % MODEL_TIMER_STEPS) == 0)
+        {
+            for(i = 0; i < MODEL_NODES; i++)
+            {
+                plm1_timer(&node[i].plm);
+            }
+        }
+
+        if(owner != MODEL_NO_OWNER)
+        {
+            // Nibble on the line, then TXRE to its sender. A lost packet
+            // ends on a receiver error.
+            nibble = node[owner].written;
+            if((nibble == 0x11) && ((model_random() % 100) < lossPercent))
+            {
+                plm1_spi_isr(&node[owner ^ 1].plm, 0x12);
+                result->lost++;
+            }
+            else
+            {
+                plm1_spi_isr(&node[owner ^ 1].plm, nibble);
+            }
+            plm1_spi_isr(&node[owner].plm, 0x18);
+            if(nibble == 0x11)
+            {
+                owner = MODEL_NO_OWNER;
+                quiet = MODEL_GAP_STEPS;
+            }
+        }
+        else if(quiet > 0)
+        {
+            quiet--;
+        }
+        else
+        {
+            // Line free: resolve the negotiations.
+            contenders = 0;
+            for(i = 0; i < MODEL_NODES; i++)
+            {
+                if(node[i].plm.sts.state == PLM1_STATE_NEGOTIATING)
+                {
+                    contenders++;
+                    owner = i;
+                }
+            }
+            if(contenders > 1)
+            {
+                for(i = 0; i < MODEL_NODES; i++)
+                {
+                    plm1_spi_isr(&node[i].plm, 0x14);
+                }
+                owner = MODEL_NO_OWNER;
+                quiet = MODEL_COLLISION_STEPS;
+            }
+        }
+
+        if((step % MODEL_LOOP_STEPS) == 0)
+        {
+            sender_loop();
+            receiver_loop();
+        }
+    }
+
+    result->delivered = node[1].rel.counters.delivered;
+    result->retransmitted = node[0].rel.counters.retransmitted;
+    result->fast = (uint16_t)fast_retransmits;
+    result->duplicates = node[1].rel.counters.duplicates;
+    check(result->delivered == rx_count, "delivered packets counted");
+
+    printf("%3u%%  %6u  %9u  %4u  %13u  %4u  %10u\n",
+           lossPercent, window, result->delivered, result->lost, result->retransmitted, result->fast, result->duplicates);
+}
+
+/*******************************************************************************
+* Name:         init_node()
+* Description:  Initialize and configure a node and its transport.
+* Parameters:   index: Index of the node.
+*               window: Send window of the transport.
+* Return:       None.
+*******************************************************************************/
+static void init_node(uint8_t index, uint8_t window)
+{
+    model_node* n = &node[index];
+
+    memset(n, 0, sizeof(model_node));
+    n->port.set_cs = model_set_cs;
+    n->port.set_reset = model_set_reset;
+    n->port.get_cnfgd = model_get_cnfgd;
+    n->port.spi_tx = model_spi_tx;
+    n->port.mask_irq = model_mask_irq;
+    n->port.arg = n;
+
+    plm1_init(&n->plm, &n->port);
+    plm1_configure_start(&n->plm, NULL, NULL);
+    while(n->plm.sts.state == PLM1_STATE_CONFIGURING)
+    {
+        plm1_spi_isr(&n->plm, 0x1F);
+    }
+    check(plm1_configure_poll(&n->plm) == PLM1_CFG_DONE, "configuration");
+    plm1_set_backoff(&n->plm, PLM_BACKOFF_NODE_SEED(index + 1), PLM_BACKOFF_MIN_WINDOW, PLM_BACKOFF_MAX_WINDOW);
+
+    plm1rel_init(&n->rel, &n->plm, MODEL_CHANNEL, window);
+}
+
+/*******************************************************************************
+* Name:         sender_loop()
+* Description:  Main loop of the sender: read the acknowledges, keep the send
+*               window full.
+* Parameters:   None.
+* Return:       None.
+*******************************************************************************/
+static void sender_loop(void)
+{
+    model_node* n = &node[0];
+    uint8_t data[PLM_PACKET_DATA_SIZE];
+    uint8_t length;
+    uint8_t seq;
+    uint8_t i;
+
+    while((length = plm1_receive(&n->plm, data, NULL, NULL)) > 0)
+    {
+        plm1rel_input(&n->rel, data, length);
+    }
+
+    // Retransmissions requested by a selective acknowledge are the slots
+    // handed back to plm1rel_task() before their timeout.
+    for(seq = n->rel.snd_base; seq != n->rel.snd_next; seq++)
+    {
+        if(!n->rel.tx[seq % PLM_REL_MAX_WINDOW].queued && n->rel.tx[seq % PLM_REL_MAX_WINDOW].retransmitted)
+        {
+            fast_retransmits++;
+        }
+    }
+    plm1rel_task(&n->rel);
+    plm1_tx_poll(&n->plm);
+
+    for(;;)
+    {
+        data[0] = (uint8_t)tx_count;
+        data[1] = (uint8_t)(tx_count >> 8);
+        for(i = 2; i < MODEL_DATA_LENGTH; i++)
+        {
+            data[i] = (uint8_t)(tx_count * 7 + i);
+        }
+        if(!plm1rel_send(&n->rel, data, MODEL_DATA_LENGTH))
+        {
+            break;
+        }
+        tx_count++;
+    }
+}
+
+/*******************************************************************************
+* Name:         receiver_loop()
+* Description:  Main loop of the receiver: feed the transport, check the data
+*               delivered.
+* Parameters:   None.
+* Return:       None.
+*******************************************************************************/
+static void receiver_loop(void)
+{
+    model_node* n = &node[1];
+    uint8_t data[PLM_PACKET_DATA_SIZE];
+    uint8_t length;
+    uint8_t i;
+
+    while((length = plm1_receive(&n->plm, data, NULL, NULL)) > 0)
+    {
+        plm1rel_input(&n->rel, data, length);
+    }
+
+    while((length = plm1rel_receive(&n->rel, data)) > 0)
+    {
+        if((length != MODEL_DATA_LENGTH) || ((data[0] | ((uint16_t)data[1] << 8)) != rx_count))
+        {
+            check(false, "packets delivered in order");
+        }
+        else
+        {
+            for(i = 2; i < MODEL_DATA_LENGTH; i++)
+            {
+                if(data[i] != (uint8_t)(rx_count * 7 + i))
+                {
+                    check(false, "packet data");
+                    break;
+                }
+            }
+        }
+        rx_count++;
+    }
+    plm1rel_task(&n->rel);
+    plm1_tx_poll(&n->plm);
+}
+
+/*******************************************************************************
+* Name:         model_random()
+* Description:  Random generator of the line (LCG), independent of rand().
+* Parameters:   None.
+* Return:       Random value, 15 bits.
+*******************************************************************************/
+static uint32_t model_random(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return ((seed >> 16) & 0x7FFF);
+}
+
+/*******************************************************************************
+* Name:         check()
+* Description:  Count and print a failed check.
+* Parameters:   ok: Result of the check.
+*               what: Check.
+* Return:       None.
+*******************************************************************************/
+static void check(bool ok, const char* what)
+{
+    if(!ok)
+    {
+        errors++;
+        if(errors <= 20)
+        {
+            printf("Fail:%s\n", what);
+        }
+    }
+}
+
+/*------------------------------------------------------------------------------
+  Port of the driver
+------------------------------------------------------------------------------*/
+
+static void model_set_cs(void* arg, bool select)
+{
+    (void)arg;
+    (void)select;
+}
+
+static void model_set_reset(void* arg, bool run)
+{
+    (void)arg;
+    (void)run;
+}
+
+static bool model_get_cnfgd(void* arg)
+{
+    (void)arg;
+    return (true);
+}
+
+static void model_spi_tx(void* arg, uint8_t byte)
+{
+    ((model_node*)arg)->written = byte;
+}
+
+static void model_mask_irq(void* arg, bool mask)
+{
+    (void)arg;
+    (void)mask;
+}
@@ -0,0 +1,573 @@
+/*******************************************************************************
+* Filename:     plm1stress.c
+* Description:  Stress test of the ISR/main loop sharing of the host build of
+*               the library.
+* Version:      1.0.0
+* Note:         Usage: plm1stress [seconds] [seed]
+*
+*               One thread plays the ISRs: it feeds plm1_spi_isr() with the
+*               nibbles of received packets and answers the transmissions
+*               (TXRE, collisions, under-runs), and calls plm1_timer() and
+*               plm1_interrupt(). The ISR calls are serialized by a mutex,
+*               which is also taken by the port when the library masks the
+*               interrupts, so they never nest as on the target.
+*
+*               The main thread runs the main loop at the same time: it
+*               receives and sends packets, polls the completions, runs the
+*               watchdog, reads and clears the statistics and reads the
+*               journal. It checks that:
+*                 - received packets are delivered intact;
+*                 - no counter goes backwards between two snapshots, unless
+*                   the statistics were cleared in between (torn read);
+*                 - a clear is not lost: once requested, the counters never
+*                   exceed what the ISR did since the request;
+*                 - at the end, every packet fed since the last clear is
+*                   counted once, received or dropped.
+*
+*               Then, with a slow main loop, PLM_POOL_RX_RESERVED packets fed
+*               back to back with no driver function called in between must
+*               all be received.
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include "plm1.h"
+
+/*------------------------------------------------------------------------------
+  Local constants declaration
+------------------------------------------------------------------------------*/
+
+#define STRESS_CHANNEL                 4                        // Channel of the packets received and sent.
+#define STRESS_TIMER_PERIOD            8                        // ISR steps between two plm1_timer() calls.
+#define STRESS_MAX_ERRORS              10                       // Errors printed.
+
+/*------------------------------------------------------------------------------
+  Local types declaration
+------------------------------------------------------------------------------*/
+
+// Packet fed to the driver, nibble by nibble.
+typedef struct {
+    uint8_t data[PLM_MAX_PACKET_SIZE];
+    uint8_t size;
+    uint8_t nibble;                                             // Next nibble fed (0 = packet not started).
+} stress_packet;
+
+// Counters of the ISR thread (read by the main thread with atomics).
+typedef struct {
+    uint32_t steps;                                             // ISR calls.
+    uint32_t started;                                           // Packets whose first nibble was fed.
+    uint32_t fed;                                               // Packets fed up to their EOP.
+    uint32_t fed_at_clear;                                      // "fed" when the last clear was done by plm1_timer().
+    uint32_t clears;                                            // Clears done by plm1_timer().
+} stress_isr_counters;
+
+/*------------------------------------------------------------------------------
+  Local functions declaration
+------------------------------------------------------------------------------*/
+
+static void stress_set_cs(void* arg, bool select);
+static void stress_set_reset(void* arg, bool run);
+static bool stress_get_cnfgd(void* arg);
+static void stress_spi_tx(void* arg, uint8_t byte);
+static void stress_mask_irq(void* arg, bool mask);
+static void* isr_thread(void* arg);
+static void isr_step(void);
+static void next_rx_packet(void);
+static void check_packet(const uint8_t* data, uint8_t length);
+static void check_stats(const plm1_stats* stats, const plm1_stats* last, bool cleared, uint32_t fedSinceClear);
+static uint32_t check_burst(void);
+static void error(const char* what, uint32_t expected, uint32_t got);
+static uint32_t stress_random(uint32_t* seed);
+
+/*------------------------------------------------------------------------------
+  Local variables declaration
+------------------------------------------------------------------------------*/
+
+static const plm1_port stress_port = {
+    stress_set_cs,
+    stress_set_reset,
+    stress_get_cnfgd,
+    stress_spi_tx,
+    stress_mask_irq,
+    NULL
+};
+
+static plm1_t plm;
+static pthread_mutex_t irq_lock;                                // Held by an ISR, or while interrupts are masked.
+static volatile bool running;
+static stress_isr_counters isr;
+static stress_packet rx_packet;
+static uint8_t rx_seq;
+static uint32_t isr_seed;                                       // Random generator of the ISR thread.
+static uint32_t main_seed;                                      // Random generator of the main thread.
+static uint32_t main_loops;                                     // Main loop iterations.
+static uint32_t errors;
+
+/*******************************************************************************
+* Name:         main()
+* Description:  Run the stress test.
+* Parameters:   argc, argv: Command line.
+* Return:       0 if no check failed, 1 otherwise.
+*******************************************************************************/
+int main(int argc, char** argv)
+{
+    pthread_mutexattr_t attr;
+    pthread_t thread;
+    time_t end;
+    plm1_stats stats;
+    plm1_stats last;
+    plm1_event events[PLM_JOURNAL_SIZE];
+    uint8_t data[PLM_PACKET_DATA_SIZE];
+    plm1_priority prio;
+    uint8_t channel;
+    uint8_t length;
+    uint32_t fedBefore = 0;
+    uint32_t received = 0;
+    uint32_t sent = 0;
+    uint32_t clears = 0;
+    uint32_t snapshots = 0;
+    bool cleared = false;
+    uint32_t i;
+
+    end = time(NULL) + ((argc > 1) ? atoi(argv[1]) : 3);
+    main_seed = (argc > 2) ? (uint32_t)atoi(argv[2]) : 1;
+    isr_seed = main_seed * 7919 + 1;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&irq_lock, &attr);
+
+    // Configure the driver before starting the ISR thread.
+    plm1_init(&plm, &stress_port);
+    plm1_configure_start(&plm, NULL, NULL);
+    while(plm.sts.state == PLM1_STATE_CONFIGURING)
+    {
+        plm1_spi_isr(&plm, 0x1F);
+    }
+    if(plm1_configure_poll(&plm) != PLM1_CFG_DONE)
+    {
+        printf("Fail:configuration\n");
+        return (1);
+    }
+    next_rx_packet();
+    memset(&last, 0, sizeof(last));
+
+    running = true;
+    pthread_create(&thread, NULL, isr_thread, NULL);
+
+    while(time(NULL) < end)
+    {
+        while((length = plm1_receive(&plm, data, &prio, &channel)) > 0)
+        {
+            check_packet(data, length);
+            received++;
+        }
+
+        if((stress_random(&main_seed) % 4) == 0)
+        {
+            for(i = 0; i < sizeof(data); i++)
+            {
+                data[i] = (uint8_t)(sent + i);
+            }
+            if(plm1_send_packet(&plm, data, (uint8_t)(stress_random(&main_seed) % 30 + 1), PLM1_PRIO_NORMAL, STRESS_CHANNEL, false) != PLM_TX_NO_HANDLE)
+            {
+                sent++;
+            }
+        }
+        plm1_tx_poll(&plm);
+        plm1_watchdog(&plm);
+        plm1_get_journal(&plm, events, PLM_JOURNAL_SIZE);
+
+        // Snapshot taken first: it cannot count packets started after.
+        plm1_get_stats(&plm, &stats);
+        check_stats(&stats, &last, cleared, __atomic_load_n(&isr.started, __ATOMIC_SEQ_CST) - fedBefore);
+        last = stats;
+        cleared = false;
+        snapshots++;
+        __atomic_store_n(&main_loops, main_loops + 1, __ATOMIC_SEQ_CST);
+
+        if((stress_random(&main_seed) % 64) == 0)
+        {
+            // Packets fed from now on may be counted after the clear.
+            fedBefore = __atomic_load_n(&isr.fed, __ATOMIC_SEQ_CST);
+            plm1_clear_stats(&plm);
+            cleared = true;
+            clears++;
+        }
+    }
+
+    running = false;
+    pthread_join(thread, NULL);
+
+    // Everything fed since the last clear was done is counted once.
+    for(i = 0; i < PLM_POOL_BUFFER_NBR; i++)
+    {
+        while(plm1_receive(&plm, data, &prio, &channel) > 0)
+        {
+            received++;
+        }
+    }
+    if(plm.sts.stats_clear)
+    {
+        plm1_timer(&plm);
+        isr.fed_at_clear = isr.fed;
+    }
+    plm1_get_stats(&plm, &stats);
+    for(i = 0; i < PLM1_DROP_NBR; i++)
+    {
+        stats.rx_packets += stats.rx_drops[i];
+    }
+    if(stats.rx_packets != isr.fed - isr.fed_at_clear)
+    {
+        error("packets counted since the last clear", isr.fed - isr.fed_at_clear, stats.rx_packets);
+    }
+
+    received += check_burst();
+
+    printf("%s:stress isr_steps:%u fed:%u received:%u sent:%u snapshots:%u clears:%u/%u errors:%u\n",
+           (errors == 0) ? "Ok" : "Fail", isr.steps, isr.fed, received, sent, snapshots, isr.clears, clears, errors);
+    return ((errors == 0) ? 0 : 1);
+}
+
+/*******************************************************************************
+* Name:         isr_thread()
+* Description:  Play the ISRs until the main thread stops.
+* Parameters:   arg: Unused.
+* Return:       NULL.
+*******************************************************************************/
+static void* isr_thread(void* arg)
+{
+    (void)arg;
+
+    // Stop between two packets, so that the final count is exact.
+    while(running || (rx_packet.nibble != 0))
+    {
+        pthread_mutex_lock(&irq_lock);
+        isr_step();
+        pthread_mutex_unlock(&irq_lock);
+    }
+
+    return (NULL);
+}
+
+/*******************************************************************************
+* Name:         isr_step()
+* Description:  Run one ISR, chosen from the state of the driver.
+* Parameters:   None.
+* Return:       None.
+* Note:         Called with the interrupts lock held.
+*******************************************************************************/
+static void isr_step(void)
+{
+    uint8_t byte;
+    bool clearPending;
+    uint32_t loops;
+
+    isr.steps++;
+
+    // A clear is not done in the middle of a packet: which of its counts
+    // are cleared would be ambiguous for the final check.
+    if(((isr.steps % STRESS_TIMER_PERIOD) == 0) && !(plm.sts.stats_clear && (rx_packet.nibble != 0)))
+    {
+        clearPending = plm.sts.stats_clear;
+        plm1_timer(&plm);
+        if(clearPending && !plm.sts.stats_clear)
+        {
+            __atomic_store_n(&isr.fed_at_clear, isr.fed, __ATOMIC_SEQ_CST);
+            isr.clears++;
+        }
+        return;
+    }
+
+    switch(plm.sts.state)
+    {
+    case PLM1_STATE_NEGOTIATING:
+        plm1_spi_isr(&plm, ((stress_random(&isr_seed) % 16) == 0) ? 0x14 : 0x18);
+        break;
+
+    case PLM1_STATE_TRANSMITTING:
+        plm1_spi_isr(&plm, ((stress_random(&isr_seed) % 256) == 0) ? 0x17 : 0x18);
+        break;
+
+    case PLM1_STATE_IDLE:
+    case PLM1_STATE_RECEIVING:
+        if((rx_packet.nibble == 0) && (plm.sts.state == PLM1_STATE_IDLE) && ((stress_random(&isr_seed) % 4) != 0))
+        {
+            // Line quiet, or PLM-1 interrupt.
+            if((stress_random(&isr_seed) % 8) == 0)
+            {
+                plm1_interrupt(&plm);
+                if(plm.sts.spi_in_use)
+                {
+                    plm1_spi_isr(&plm, 0x1F);
+                }
+            }
+        }
+        else if(rx_packet.nibble < 2 * rx_packet.size)
+        {
+            if(rx_packet.nibble == 0)
+            {
+                __atomic_store_n(&isr.started, isr.started + 1, __ATOMIC_SEQ_CST);
+            }
+            byte = rx_packet.data[rx_packet.nibble / 2];
+            plm1_spi_isr(&plm, (rx_packet.nibble & 1) ? (byte & 0x0F) : (byte >> 4));
+            rx_packet.nibble++;
+        }
+        else
+        {
+            plm1_spi_isr(&plm, 0x11);
+            __atomic_store_n(&isr.fed, isr.fed + 1, __ATOMIC_SEQ_CST);
+            next_rx_packet();
+            
+            // Line quiet until the main loop has run, even on a single core.
+            loops = __atomic_load_n(&main_loops, __ATOMIC_SEQ_CST);
+            while(running && (__atomic_load_n(&main_loops, __ATOMIC_SEQ_CST) - loops < 2))
+            {
+                sched_yield();
+            }
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+/*******************************************************************************
+* Name:         next_rx_packet()
+* Description:  Build the next packet fed to the driver.
+* Parameters:   None.
+* Return:       None.
+* Note:         Data bytes are the sequence number, the length and a pattern
+*               derived from both, so that check_packet() needs no state.
+*******************************************************************************/
+static void next_rx_packet(void)
+{
+    uint8_t length = (uint8_t)(stress_random(&isr_seed) % (PLM_PACKET_DATA_SIZE - 2) + 2);
+    uint8_t i;
+
+    rx_packet.data[0] = 0x40;
+    rx_packet.data[1] = STRESS_CHANNEL;
+    rx_packet.data[2] = rx_seq++;
+    rx_packet.data[3] = length;
+    for(i = 2; i < length; i++)
+    {
+        rx_packet.data[2 + i] = (uint8_t)(rx_packet.data[2] * 31 + i);
+    }
+    rx_packet.size = PLM_PACKET_HEADER_SIZE + length;
+    rx_packet.nibble = 0;
+}
+
+/*******************************************************************************
+* Name:         check_packet()
+* Description:  Check a packet delivered by plm1_receive().
+* Parameters:   data: Data of the packet.
+*               length: Length of the data.
+* Return:       None.
+*******************************************************************************/
+static void check_packet(const uint8_t* data, uint8_t length)
+{
+    uint8_t i;
+
+    if(data[1] != length)
+    {
+        error("packet length", data[1], length);
+        return;
+    }
+    for(i = 2; i < length; i++)
+    {
+        if(data[i] != (uint8_t)(data[0] * 31 + i))
+        {
+            error("packet byte", (uint8_t)(data[0] * 31 + i), data[i]);
+            return;
+        }
+    }
+}
+
+/*******************************************************************************
+* Name:         check_stats()
+* Description:  Check a snapshot of the statistics against the previous one.
+* Parameters:   stats: Snapshot.
+*               last: Previous snapshot.
+*               cleared: true if the statistics were cleared in between.
+*               fedSinceClear: Packets started since the last clear request.
+* Note:         A packet counted after the clear may have been started before
+*               the request, but its EOP was fed after it.
+* Return:       None.
+*******************************************************************************/
+static void check_stats(const plm1_stats* stats, const plm1_stats* last, bool cleared, uint32_t fedSinceClear)
+{
+    uint32_t counted = stats->rx_packets;
+    uint8_t i;
+
+    for(i = 0; i < PLM1_DROP_NBR; i++)
+    {
+        counted += stats->rx_drops[i];
+    }
+    if(counted > fedSinceClear)
+    {
+        error("packets counted since the clear request", fedSinceClear, counted);
+    }
+
+    if(cleared)
+    {
+        return;
+    }
+    if((stats->rx_packets < last->rx_packets) || (stats->rx_bytes < last->rx_bytes) ||
+       (stats->tx_packets < last->tx_packets) || (stats->tx_bytes < last->tx_bytes) ||
+       (stats->negotiations < last->negotiations) || (stats->retries < last->retries))
+    {
+        error("packet counters going backwards", last->rx_packets, stats->rx_packets);
+    }
+    for(i = 0; i < PLM1_STATE_NBR; i++)
+    {
+        if(stats->dwell[i] < last->dwell[i])
+        {
+            error("dwell going backwards", last->dwell[i], stats->dwell[i]);
+        }
+    }
+    for(i = 0; i < 16; i++)
+    {
+        if(stats->status[i] < last->status[i])
+        {
+            error("status count going backwards", last->status[i], stats->status[i]);
+        }
+    }
+}
+
+/*******************************************************************************
+* Name:         check_burst()
+* Description:  Feed packets back to back, as seen by a slow main loop.
+* Parameters:   None.
+* Return:       Nb of packets received.
+* Note:         Called once the ISR thread is stopped. The ISRs only run
+*               from this thread: no driver function of the main loop is
+*               called between the packets, so the ISR has no other buffers
+*               than the ones posted before the burst.
+*******************************************************************************/
+static uint32_t check_burst(void)
+{
+    uint8_t data[PLM_PACKET_DATA_SIZE];
+    plm1_priority prio;
+    uint8_t channel;
+    uint8_t length;
+    uint32_t drops;
+    uint32_t received = 0;
+    uint8_t byte;
+    uint8_t i;
+
+    // Let the transmissions end, then read everything.
+    while(!plm1_tx_idle(&plm) || (plm.sts.state != PLM1_STATE_IDLE) || (rx_packet.nibble != 0))
+    {
+        isr_step();
+    }
+    while(plm1_receive(&plm, data, &prio, &channel) > 0)
+    {
+        received++;
+    }
+    drops = plm1_get_stat(&plm, PLM1_STAT_RX_DROPS, PLM1_DROP_BUFFER_FULL);
+
+    // The main loop is busy elsewhere.
+    for(i = 0; i < PLM_POOL_RX_RESERVED; i++)
+    {
+        while(rx_packet.nibble < 2 * rx_packet.size)
+        {
+            byte = rx_packet.data[rx_packet.nibble / 2];
+            plm1_spi_isr(&plm, (rx_packet.nibble & 1) ? (byte & 0x0F) : (byte >> 4));
+            rx_packet.nibble++;
+        }
+        plm1_spi_isr(&plm, 0x11);
+        isr.fed++;
+        next_rx_packet();
+    }
+
+    if(plm1_get_stat(&plm, PLM1_STAT_RX_DROPS, PLM1_DROP_BUFFER_FULL) != drops)
+    {
+        error("packets of a burst dropped", drops, plm1_get_stat(&plm, PLM1_STAT_RX_DROPS, PLM1_DROP_BUFFER_FULL));
+    }
+    for(i = 0; (length = plm1_receive(&plm, data, &prio, &channel)) > 0; i++)
+    {
+        check_packet(data, length);
+        received++;
+    }
+    if(i != PLM_POOL_RX_RESERVED)
+    {
+        error("packets of a burst received", PLM_POOL_RX_RESERVED, i);
+    }
+
+    return (received);
+}
+
+/*******************************************************************************
+* Name:         error()
+* Description:  Count a failed check, print the first ones.
+* Parameters:   what: Value checked.
+*               expected, got: Values compared.
+* Return:       None.
+*******************************************************************************/
+static void error(const char* what, uint32_t expected, uint32_t got)
+{
+    if(errors++ < STRESS_MAX_ERRORS)
+    {
+        printf("Fail:%s expected:%u got:%u\n", what, expected, got);
+    }
+}
+
+/*******************************************************************************
+* Name:         stress_random()
+* Description:  Pseudo-random generator, one state per thread.
+* Parameters:   seed: State of the generator.
+* Return:       Pseudo-random value.
+*******************************************************************************/
+static uint32_t stress_random(uint32_t* seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return ((*seed >> 16) & 0x7FFF);
+}
+
+/*------------------------------------------------------------------------------
+  Port of the driver
+------------------------------------------------------------------------------*/
+
+static void stress_set_cs(void* arg, bool select)
+{
+    (void)arg;
+    (void)select;
+}
+
+static void stress_set_reset(void* arg, bool run)
+{
+    (void)arg;
+    (void)run;
+}
+
+static bool stress_get_cnfgd(void* arg)
+{
+    (void)arg;
+    return (true);
+}
+
+static void stress_spi_tx(void* arg, uint8_t byte)
+{
+    (void)arg;
+    (void)byte;
+}
+
+static void stress_mask_irq(void* arg, bool mask)
+{
+    (void)arg;
+    if(mask)
+    {
+        pthread_mutex_lock(&irq_lock);
+    }
+    else
+    {
+        pthread_mutex_unlock(&irq_lock);
+    }
+}
@@ -0,0 +1,380 @@
+/*******************************************************************************
+* Filename:     plm1tdma_model.c
+* Description:  Model of a five node network scheduled by plm1tdma.
+* Version:      1.0.0
+* Note:         Usage: plm1tdma_model [frames] [seed]
+*
+*               plm1tdma.c is built as is, with one plm1tdma_t instance per
+*               node. The driver is replaced by a line model: each node has
+*               its own tick counter (random phase), a transmission queue
+*               ordered by priority and the hold of plm1_tx_hold(). When the
+*               line is free, a node with a packet not held starts it; a
+*               packet of n bytes lasts 2 + n/4 ticks, so that the beacon is
+*               received PLM_TDMA_BEACON_TICKS after its start.
+*
+*               Node 0 is the coordinator and always has a packet to send:
+*               it offers it to plm1tdma_send() on every tick. Nodes 1 to 4
+*               queue packets at random. Once all the nodes have a slot, the
+*               model checks that:
+*                 - two nodes never have a packet released at the same time
+*                   (no collision);
+*                 - every beacon starts at the frame start of the coordinator
+*                   and is flagged timed, despite its backlog;
+*                 - a packet at the head of a node queue starts within a
+*                   frame plus PLM_TDMA_TX_TICKS;
+*                 - the coordinator still sends its own packets.
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "plm1tdma.h"
+
+/*------------------------------------------------------------------------------
+  Local constants declaration
+------------------------------------------------------------------------------*/
+
+#define MODEL_NODE_NBR                 5                        // Nb of nodes, node 0 is the coordinator.
+#define MODEL_ADDRESS                  10                       // Address of node 0, the others follow.
+#define MODEL_QUEUE_SIZE               8                        // Packets queued per node.
+#define MODEL_DATA_CHANNEL             4                        // Channel of the data packets.
+#define MODEL_DATA_SIZE                40                       // Size of a data packet.
+#define MODEL_NODE_BACKLOG             4                        // Packets queued at most by nodes 1 to 4.
+#define MODEL_NODE_RATE                6                        // Per mille chance of a new node packet per tick.
+#define MODEL_SYNC_FRAMES              50                       // Frames allowed to give a slot to every node.
+#define MODEL_MAX_ERRORS               10                       // Errors printed.
+
+/*------------------------------------------------------------------------------
+  Local types declaration
+------------------------------------------------------------------------------*/
+
+// Packet queued on a node.
+typedef struct {
+    uint8_t data[PLM_MAX_PACKET_SIZE];
+    uint8_t length;
+    uint8_t channel;
+    plm1_priority prio;
+    uint32_t head;                                              // Time the packet became the head of the queue.
+} model_packet;
+
+// Node of the model.
+typedef struct {
+    plm1_t plm;                                                 // Only its address is used, as a key.
+    plm1tdma_t tdma;
+    uint16_t tick;                                              // Tick counter of the node.
+    model_packet queue[MODEL_QUEUE_SIZE];
+    uint8_t queued;
+    bool hold;
+} model_node;
+
+/*------------------------------------------------------------------------------
+  Local functions declaration
+------------------------------------------------------------------------------*/
+
+static model_node* node_of(plm1_t* plm);
+static void line_step(void);
+static bool all_synced(void);
+static void error(const char* what, uint32_t expected, uint32_t got);
+
+/*------------------------------------------------------------------------------
+  Local variables declaration
+------------------------------------------------------------------------------*/
+
+static model_node nodes[MODEL_NODE_NBR];
+static uint32_t now;                                            // Model time, in ticks.
+static uint32_t synced_at;                                      // Time all the nodes got a slot (0 = not yet).
+static int8_t sender = -1;                                      // Node on the line (-1 = line free).
+static uint32_t line_end;                                       // Time the packet on the line ends.
+static uint32_t errors;
+
+// Results.
+static uint32_t collisions;
+static uint32_t beacons;
+static uint32_t coordinator_packets;
+static uint32_t node_packets;
+static uint32_t max_wait;
+
+/*******************************************************************************
+* Name:         main()
+* Description:  Run the model.
+* Parameters:   argc, argv: [frames] [seed].
+* Return:       0 if no check failed, 1 otherwise.
+*******************************************************************************/
+int main(int argc, char** argv)
+{
+    uint32_t frames = (argc > 1) ? (uint32_t)atoi(argv[1]) : 2000;
+    uint32_t end = frames * PLM_TDMA_FRAME_TICKS;
+    uint8_t data[MODEL_DATA_SIZE];
+    plm1tdma_counters counters;
+    uint8_t i;
+
+    srand((argc > 2) ? (unsigned)atoi(argv[2]) : 1);
+    memset(data, 0x55, sizeof(data));
+
+    for(i = 0; i < MODEL_NODE_NBR; i++)
+    {
+        nodes[i].tick = (uint16_t)rand();
+        plm1tdma_init(&nodes[i].tdma, &nodes[i].plm, MODEL_ADDRESS + i, i == 0);
+    }
+
+    for(now = 1; now < end; now++)
+    {
+        for(i = 0; i < MODEL_NODE_NBR; i++)
+        {
+            nodes[i].tick++;
+            plm1tdma_task(&nodes[i].tdma);
+        }
+
+        // Coordinator backlog, offered on every tick until taken.
+        plm1tdma_send(&nodes[0].tdma, data, MODEL_DATA_SIZE, PLM1_PRIO_NORMAL, MODEL_DATA_CHANNEL);
+
+        // Node traffic.
+        for(i = 1; i < MODEL_NODE_NBR; i++)
+        {
+            if((nodes[i].queued < MODEL_NODE_BACKLOG) && ((rand() % 1000) < MODEL_NODE_RATE))
+            {
+                plm1tdma_send(&nodes[i].tdma, data, MODEL_DATA_SIZE, PLM1_PRIO_NORMAL, MODEL_DATA_CHANNEL);
+            }
+        }
+
+        line_step();
+
+        if((synced_at == 0) && all_synced())
+        {
+            synced_at = now;
+        }
+    }
+
+    if((synced_at == 0) || (synced_at > (MODEL_SYNC_FRAMES * PLM_TDMA_FRAME_TICKS)))
+    {
+        error("all nodes with a slot, frames", MODEL_SYNC_FRAMES, synced_at / PLM_TDMA_FRAME_TICKS);
+    }
+    if(coordinator_packets < (frames / 2))
+    {
+        error("coordinator packets", frames / 2, coordinator_packets);
+    }
+
+    printf("synced in %u frames, slots:", synced_at / PLM_TDMA_FRAME_TICKS);
+    for(i = 0; i < MODEL_NODE_NBR; i++)
+    {
+        printf(" %u", plm1tdma_get_slot(&nodes[i].tdma));
+    }
+    printf("\nbeacons:%u collisions:%u coordinator packets:%u node packets:%u max wait:%u (frame %u)\n",
+           beacons, collisions, coordinator_packets, node_packets, max_wait, PLM_TDMA_FRAME_TICKS);
+    plm1tdma_get_counters(&nodes[0].tdma, &counters);
+    printf("coordinator beacons:%u late:%u held:%u joins:%u rejects:%u\n",
+           counters.beacons, counters.late_beacons, counters.held, counters.joins, counters.join_rejects);
+    for(i = 1; i < MODEL_NODE_NBR; i++)
+    {
+        plm1tdma_get_counters(&nodes[i].tdma, &counters);
+        printf("node %u beacons:%u joins:%u sync losses:%u\n", i, counters.beacons, counters.joins, counters.sync_losses);
+    }
+
+    printf("%s:tdma errors:%u\n", (errors == 0) ? "Ok" : "Fail", errors);
+    return ((errors == 0) ? 0 : 1);
+}
+
+/*------------------------------------------------------------------------------
+  Driver model
+------------------------------------------------------------------------------*/
+
+uint16_t plm1_get_tick(plm1_t* plm)
+{
+    return (node_of(plm)->tick);
+}
+
+bool plm1_tx_idle(plm1_t* plm)
+{
+    return (node_of(plm)->queued == 0);
+}
+
+void plm1_tx_hold(plm1_t* plm, bool hold)
+{
+    node_of(plm)->hold = hold;
+}
+
+plm1_tx_handle plm1_send_packet(plm1_t* plm, uint8_t* data, uint8_t length, plm1_priority prio, uint8_t channel, bool rawMode)
+{
+    model_node* node = node_of(plm);
+    uint8_t i;
+
+    (void)rawMode;
+    if(node->queued == MODEL_QUEUE_SIZE)
+    {
+        return (PLM_TX_NO_HANDLE);
+    }
+
+    // After the packets of the same or a higher priority, but never before
+    // the one on the line.
+    for(i = node->queued; (i > 1) || ((i == 1) && (sender != (node - nodes))); i--)
+    {
+        if(node->queue[i - 1].prio <= prio)
+        {
+            break;
+        }
+        node->queue[i] = node->queue[i - 1];
+    }
+    memcpy(node->queue[i].data, data, length);
+    node->queue[i].length = length;
+    node->queue[i].channel = channel;
+    node->queue[i].prio = prio;
+    node->queue[i].head = now;
+    node->queued++;
+
+    return (1);
+}
+
+/*------------------------------------------------------------------------------
+  Local functions
+------------------------------------------------------------------------------*/
+
+/*******************************************************************************
+* Name:         node_of()
+* Description:  Get the node of a driver instance.
+* Parameters:   plm: Driver instance.
+* Return:       Node.
+*******************************************************************************/
+static model_node* node_of(plm1_t* plm)
+{
+    return ((model_node*)((uint8_t*)plm - offsetof(model_node, plm)));
+}
+
+/*******************************************************************************
+* Name:         line_step()
+* Description:  Move the line one tick forward: end the packet on the line and
+*               deliver it, or start the next one.
+* Parameters:   None.
+* Return:       None.
+*******************************************************************************/
+static void line_step(void)
+{
+    model_node* node;
+    model_packet packet;
+    uint16_t position;
+    uint8_t ready = 0;
+    uint8_t i;
+
+    if(sender >= 0)
+    {
+        if(now < line_end)
+        {
+            return;
+        }
+
+        // Packet received by all the other nodes.
+        node = &nodes[sender];
+        packet = node->queue[0];
+        memmove(&node->queue[0], &node->queue[1], --node->queued * sizeof(model_packet));
+        if(node->queued)
+        {
+            node->queue[0].head = now;
+        }
+        for(i = 0; i < MODEL_NODE_NBR; i++)
+        {
+            if((i != sender) && (packet.channel == PLM_TDMA_CHANNEL))
+            {
+                plm1tdma_input(&nodes[i].tdma, packet.data, packet.length);
+            }
+        }
+        sender = -1;
+    }
+
+    for(i = 0; i < MODEL_NODE_NBR; i++)
+    {
+        if(nodes[i].queued && !nodes[i].hold)
+        {
+            ready++;
+            sender = i;
+        }
+    }
+    if(ready == 0)
+    {
+        return;
+    }
+
+    node = &nodes[sender];
+    line_end = now + 2 + node->queue[0].length / 4;
+    if(!synced_at)
+    {
+        return;
+    }
+
+    if(ready > 1)
+    {
+        collisions++;
+        error("collision, nodes ready", 1, ready);
+    }
+    // Only the packets that became the head once all the slots were known.
+    if((node->queue[0].head >= synced_at) && ((now - node->queue[0].head) > (PLM_TDMA_FRAME_TICKS + PLM_TDMA_TX_TICKS)))
+    {
+        error("head of queue wait", PLM_TDMA_FRAME_TICKS + PLM_TDMA_TX_TICKS, now - node->queue[0].head);
+    }
+    if((sender != 0) && (node->queue[0].head >= synced_at) && ((now - node->queue[0].head) > max_wait))
+    {
+        max_wait = now - node->queue[0].head;
+    }
+
+    if(node->queue[0].channel != PLM_TDMA_CHANNEL)
+    {
+        if(sender == 0)
+        {
+            coordinator_packets++;
+        }
+        else
+        {
+            node_packets++;
+        }
+    }
+    else if((sender == 0) && (node->queue[0].data[0] == PLM_TDMA_BEACON_MAGIC))
+    {
+        beacons++;
+        position = (uint16_t)(node->tick - node->tdma.frame_start) % PLM_TDMA_FRAME_TICKS;
+        if(!(node->queue[0].data[1] & PLM_TDMA_TIMED))
+        {
+            error("beacon not timed, frame position", 0, position);
+        }
+        else if(position > 1)
+        {
+            error("timed beacon late, frame position", 0, position);
+        }
+    }
+}
+
+/*******************************************************************************
+* Name:         all_synced()
+* Description:  Tell whether all the nodes are synchronized and have a slot.
+* Parameters:   None.
+* Return:       true if they are.
+*******************************************************************************/
+static bool all_synced(void)
+{
+    uint8_t i;
+
+    for(i = 1; i < MODEL_NODE_NBR; i++)
+    {
+        if(!plm1tdma_synced(&nodes[i].tdma) || (plm1tdma_get_slot(&nodes[i].tdma) == PLM_TDMA_NO_SLOT))
+        {
+            return (false);
+        }
+    }
+    return (true);
+}
+
+/*******************************************************************************
+* Name:         error()
+* Description:  Count and print an error.
+* Parameters:   what: Check failed.
+*               expected: Value expected.
+*               got: Value found.
+* Return:       None.
+*******************************************************************************/
+static void error(const char* what, uint32_t expected, uint32_t got)
+{
+    if(errors++ < MODEL_MAX_ERRORS)
+    {
+        printf("Fail:%s expected %u got %u at %u\n", what, expected, got, now);
+    }
+}
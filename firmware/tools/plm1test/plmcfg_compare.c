@@ -0,0 +1,256 @@
+/*******************************************************************************
+* Filename:     plmcfg_compare.c
+* Description:  Comparison of the configuration strings built by the
+*               PLM_CFG_PROFILE() macro with those of the former run time
+*               build_cfg_string().
+* Version:      1.0.0
+* Note:         Usage: plmcfg_compare
+*
+*               build_cfg_string() is reproduced below as it was in plm1.c
+*               before the configuration string moved to plmcfg.h, with the
+*               32 bit float and 16 bit int arithmetic of the AVR. Sets for
+*               which it overflowed a 16 bit int are skipped: its output was
+*               wrong there.
+*
+*               Every set of XDIV (1 to 127), CPB (8 to 1023) and CPT0, CPT1
+*               (0 to 15) accepted by PLM_CFG_PROFILE_VALID() is compared.
+*
+*               The test checks that:
+*                 - the default configuration string is unchanged;
+*                 - DPHG, OFFSET, FC and THRESHOLD are always identical;
+*                 - FTH differs by 1 LSB at most (the float rounding of the
+*                   former code), FITH following it;
+*                 - less than 0.5 % of the sets differ.
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "plm1.h"
+
+/*------------------------------------------------------------------------------
+  Local constants declaration
+------------------------------------------------------------------------------*/
+
+#define COMPARE_MAX_CPT                15                       // Highest CPT0 and CPT1 compared.
+#define COMPARE_MAX_DIFF_PPM           5000                     // Max sets differing, per million.
+
+/*------------------------------------------------------------------------------
+  Local types declaration
+------------------------------------------------------------------------------*/
+
+// Derived parameters of a set.
+typedef struct {
+    uint8_t dphg;
+    short offset;
+    uint8_t fth;
+    uint8_t fith;
+    uint8_t fc;
+    uint8_t threshold;
+} compare_params;
+
+/*------------------------------------------------------------------------------
+  Local functions declaration
+------------------------------------------------------------------------------*/
+
+static bool old_params(int xdiv, int cpb, int cpt0, int cpt1, compare_params* p);
+static uint8_t log2_round(float n, bool ceil);
+static void check(bool ok, const char* what);
+
+/*------------------------------------------------------------------------------
+  Local variables declaration
+------------------------------------------------------------------------------*/
+
+static uint32_t errors;
+
+/*******************************************************************************
+* Name:         main()
+* Description:  Run the comparison.
+* Parameters:   None.
+* Return:       0 if no check failed, 1 otherwise.
+*******************************************************************************/
+int main(void)
+{
+    const uint8_t defaultCfg[PLM_CONFIG_DATA_LENGTH] = PLM_CFG_DEFAULT;
+    compare_params p;
+    uint32_t compared = 0;
+    uint32_t skipped = 0;
+    uint32_t differing = 0;
+    int fthDiff;
+    int xdiv;
+    int cpb;
+    int cpt0;
+    int cpt1;
+
+    for(xdiv = 1; xdiv <= 0x7F; xdiv++)
+    {
+        for(cpb = 8; cpb <= 0x03FF; cpb++)
+        {
+            for(cpt0 = 0; cpt0 <= COMPARE_MAX_CPT; cpt0++)
+            {
+                for(cpt1 = 0; cpt1 <= COMPARE_MAX_CPT; cpt1++)
+                {
+                    if(!PLM_CFG_PROFILE_VALID(xdiv, cpb, cpt0, cpt1))
+                    {
+                        continue;
+                    }
+                    if(!old_params(xdiv, cpb, cpt0, cpt1, &p))
+                    {
+                        skipped++;
+                        continue;
+                    }
+
+                    {
+                        const uint8_t newCfg[PLM_CONFIG_DATA_LENGTH] = PLM_CFG_PROFILE(xdiv, cpb, cpt0, cpt1);
+                        const uint8_t oldCfg[PLM_CONFIG_DATA_LENGTH] =
+                            PLM_CFG_STRING(xdiv, cpb, cpt0, cpt1, p.dphg, p.offset, p.fth, p.fith, p.fc, p.threshold);
+                        uint8_t newFth = PLM_CFG_FTH(xdiv, cpb, cpt0, cpt1, p.dphg, p.offset);
+
+                        compared++;
+                        check(PLM_CFG_DPHG(xdiv, cpt0, cpt1) == p.dphg, "DPHG identical");
+                        check(PLM_CFG_OFFSET(xdiv, cpt0, cpt1, p.dphg) == p.offset, "OFFSET identical");
+                        check(PLM_CFG_FC(cpb) == p.fc, "FC identical");
+                        check(PLM_CFG_THRESHOLD(cpb) == p.threshold, "THRESHOLD identical");
+                        if(memcmp(newCfg, oldCfg, PLM_CONFIG_DATA_LENGTH) != 0)
+                        {
+                            differing++;
+                            fthDiff = (int)newFth - (int)p.fth;
+                            check((fthDiff == 1) || (fthDiff == -1), "FTH within 1 LSB");
+                            if(differing <= 5)
+                            {
+                                printf("XDIV %3d CPB %4d CPT0 %2d CPT1 %2d: FTH %3u, was %3u\n",
+                                       xdiv, cpb, cpt0, cpt1, newFth, p.fth);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    old_params(XDIV, CPB, CPT0, CPT1, &p);
+    {
+        const uint8_t oldCfg[PLM_CONFIG_DATA_LENGTH] =
+            PLM_CFG_STRING(XDIV, CPB, CPT0, CPT1, p.dphg, p.offset, p.fth, p.fith, p.fc, p.threshold);
+
+        check(memcmp(defaultCfg, oldCfg, PLM_CONFIG_DATA_LENGTH) == 0, "default string identical");
+    }
+
+    printf("%u sets compared, %u skipped (16 bit overflow of the former code), %u differ (%.3f %%)\n",
+           compared, skipped, differing, (compared != 0) ? (100.0 * differing / compared) : 0.0);
+    check(compared > 0, "sets compared");
+    check((uint64_t)differing * 1000000 < (uint64_t)compared * COMPARE_MAX_DIFF_PPM, "few sets differ");
+
+    printf("%s:plmcfg errors:%u\n", (errors == 0) ? "Ok" : "Fail", errors);
+    return ((errors == 0) ? 0 : 1);
+}
+
+/*------------------------------------------------------------------------------
+  Local functions
+------------------------------------------------------------------------------*/
+
+/*******************************************************************************
+* Name:         old_params()
+* Description:  Derived parameters of a set, computed as the former
+*               build_cfg_string() did on the AVR.
+* Parameters:   xdiv, cpb, cpt0, cpt1: Basic parameters.
+*               p: Struct used to return the derived parameters.
+* Return:       false if the former code overflowed a 16 bit int.
+*******************************************************************************/
+static bool old_params(int xdiv, int cpb, int cpt0, int cpt1, compare_params* p)
+{
+    int n0 = cpt0 + 2;
+    int n1 = cpt1 + 2;
+    int ps = (cpt0 > cpt1) ? -1 : 1;                            // _PRIME_SIGN
+    long temp_WPB;
+    uint8_t temp_CPBn4 = 0;
+    uint8_t temp_N;
+
+    p->dphg = (log2_round((16.0f * (n0 + ps) * (n1 + ps)) / ((short)(1 << WDIV) * xdiv * -ps * (n0 - n1)), false) - 1);
+
+    // (short)(N0') * (N1') and (short)1 << (DPHG + WDIV + 2) * XDIV were int.
+    if(((long)(n0 + ps) * (n1 + ps) > INT16_MAX) ||
+       (((long)1 << (p->dphg + WDIV + 2)) * xdiv > INT16_MAX))
+    {
+        return (false);
+    }
+
+    p->offset = (short)(-ps * ((long)1 << (p->dphg + WDIV + 1)) * xdiv * (float)((n0 + ps) + (n1 + ps)) / ((short)(n0 + ps) * (n1 + ps)));
+    p->fth = (uint8_t)(((short)1 << (p->dphg + WDIV + 2)) * xdiv * (1 - (float)((long)(1 << WDIV) * n0 * cpb)/((long)(1 << WDIV) * cpb * (n0 + ps) + n0)) + p->offset);
+    p->fith = (uint8_t)(p->fth * 2);
+
+    temp_N = log2_round(cpb / 6.0f, true) - 1;
+    p->fc = ((temp_N & 0x7) << 3) | ((15 - (uint8_t)(((uint16_t)1 << (temp_N + 4)) * 6 / cpb)) & 0x7);
+
+    temp_WPB = cpb;
+    while(temp_WPB & 0xFFF0)
+    {
+        temp_CPBn4 = (uint8_t)(temp_WPB & 0x01);
+        temp_WPB = temp_WPB >> 1;
+    }
+    p->threshold = (uint8_t)((temp_WPB + temp_CPBn4) / 2);
+
+    return (true);
+}
+
+/*******************************************************************************
+* Name:         log2_round()
+* Description:  Compute binary log (log2), as the former plm1.c did.
+* Parameters:   n: log2(n).
+*               ceil: Use a CEIL function to round result if true, otherwise use
+*                     a FLOOR function.
+* Return:       Computed binary log.
+*******************************************************************************/
+static uint8_t log2_round(float n, bool ceil)
+{
+    uint8_t result;
+
+    if(ceil)
+    {
+        result = (n <=   1.0f) ? 0 :
+                 (n <=   2.0f) ? 1 :
+                 (n <=   4.0f) ? 2 :
+                 (n <=   8.0f) ? 3 :
+                 (n <=  16.0f) ? 4 :
+                 (n <=  32.0f) ? 5 :
+                 (n <=  64.0f) ? 6 :
+                 (n <= 128.0f) ? 7 :
+                 (n <= 256.0f) ? 8 :
+                 (n <= 512.0f) ? 9 : 10;
+    }
+    else
+    {
+        result = (n <   2.0f) ? 0 :
+                 (n <   4.0f) ? 1 :
+                 (n <   8.0f) ? 2 :
+                 (n <  16.0f) ? 3 :
+                 (n <  32.0f) ? 4 :
+                 (n <  64.0f) ? 5 :
+                 (n < 128.0f) ? 6 :
+                 (n < 256.0f) ? 7 :
+                 (n < 512.0f) ? 8 : 9;
+    }
+
+    return (result);
+}
+
+/*******************************************************************************
+* Name:         check()
+* Description:  Count and print a failed check.
+* Parameters:   ok: Result of the check.
+*               what: Check.
+* Return:       None.
+*******************************************************************************/
+static void check(bool ok, const char* what)
+{
+    if(!ok)
+    {
+        errors++;
+        if(errors <= 20)
+        {
+            printf("Fail:%s\n", what);
+        }
+    }
+}
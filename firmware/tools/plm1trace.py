@@ -0,0 +1,164 @@
+#!/usr/bin/env python
+"""
+Decode a PLM-1 nibble trace dumped by the "trace" command.
+
+The dump is the line "Ok:trace <count>\\n" followed by <count> entries of
+5 bytes: timestamp (uint16, little endian), received nibble, transmitted
+nibble and state (before in bits 7-4, after in bits 3-0). 0xFF means no
+nibble; a received nibble of 0xFE marks a gap, the transmitted nibble being
+the number of entries dropped while the trace was full.
+
+Usage: plm1trace.py <capture file> [--tick-us <us per timer tick>] [--gap <ticks>]
+                    [--save <capture file>]
+
+Timestamps are PLM_TRACE_TIME() ticks, 16 bits unwrapped. The sketch runs
+Timer1 at 16 MHz / 64: 4 us per tick, the default of --tick-us. A gap longer
+than the 262 ms period of the timer is seen modulo the period.
+
+The capture file is the raw serial output of the sketch; any text around the
+trace dump is ignored. --save also saves the trace in the binary format of
+tools/plm1replay/plm1cap.h, replayed by plm1replay.
+"""
+
+import argparse
+import re
+import struct
+import sys
+
+STATES = ["NOT_CFG", "CONFIG", "IDLE", "NEGO", "TX", "RX"]
+
+CONTROL_CODES = {
+    0x10: "EOF",
+    0x11: "EOP",
+    0x12: "RX_ERROR",
+    0x13: "RX_OVERRUN",
+    0x14: "COLLISION",
+    0x16: "RESET",
+    0x17: "TX_UNDERRUN",
+    0x18: "TXRE",
+    0x19: "TX_OVERRUN",
+    0x1F: "NOP",
+}
+
+NONE = 0xFF
+LOST = 0xFE
+TXRE = 0x18
+ENTRY = struct.Struct("<HBBB")
+
+# plm1cap.h
+CAP_MAGIC = b"PLM1CAP\0"
+CAP_VERSION = 1
+CAP_HEADER = struct.Struct("<8sHHIII8x")
+CAP_ENTRY = struct.Struct("<IBBBx")
+
+
+def nibble_name(nibble):
+    if nibble == NONE:
+        return "-"
+    if nibble in CONTROL_CODES:
+        return CONTROL_CODES[nibble]
+    if nibble & 0x10:
+        return "0x%02X" % nibble
+    return "%X" % nibble
+
+
+def state_name(state):
+    return STATES[state] if state < len(STATES) else "?%d" % state
+
+
+def parse(data):
+    match = re.search(rb"Ok:trace (\d+)\n", data)
+    if match is None:
+        raise ValueError("no trace dump found")
+    count = int(match.group(1))
+    start = match.end()
+    raw = data[start:start + count * ENTRY.size]
+    if len(raw) < count * ENTRY.size:
+        raise ValueError("truncated trace dump")
+    return [ENTRY.unpack_from(raw, i * ENTRY.size) for i in range(count)]
+
+
+def render(entries, tick_us, gap):
+    prev_time = None
+    txre_time = None
+    underruns = 0
+
+    print("%10s %8s  %-8s %-12s %-12s %s" % ("time", "delta", "state", "rx", "tx", "note"))
+    for time, rx, tx, state in entries:
+        delta = 0 if prev_time is None else (time - prev_time) & 0xFFFF
+        before, after = state >> 4, state & 0x0F
+        states = state_name(before)
+        if before != after:
+            states += ">" + state_name(after)
+
+        if rx == LOST:
+            print("%10.1f %8.1f  %-8s %d entries lost" % (time * tick_us, delta * tick_us, states, tx))
+            prev_time = time
+            txre_time = None
+            continue
+
+        # Track the time between TXRE and the nibble that refills the
+        # transmit register; long gaps are where underruns come from.
+        note = ""
+        if rx == TXRE and tx == NONE:
+            txre_time = time
+        elif txre_time is not None and tx != NONE:
+            wait = (time - txre_time) & 0xFFFF
+            if wait >= gap:
+                note = "TXRE gap %.1f us" % (wait * tick_us)
+                underruns += 1
+            txre_time = None
+        if rx == 0x17:
+            note = "UNDERRUN"
+
+        print("%10.1f %8.1f  %-8s %-12s %-12s %s" % (
+            time * tick_us, delta * tick_us, states, nibble_name(rx), nibble_name(tx), note))
+        prev_time = time
+
+    print("%d entries, %d TXRE gaps >= %d ticks" % (len(entries), underruns, gap))
+
+
+def save_capture(path, entries, tick_us):
+    # Timestamps are unwrapped assuming less than a timer period between two
+    # entries, as the deltas above.
+    records = []
+    lost = 0
+    time = 0
+    prev_time = None
+    for stamp, rx, tx, state in entries:
+        if prev_time is not None:
+            time += (stamp - prev_time) & 0xFFFF
+        prev_time = stamp
+        if rx == LOST:
+            lost += tx
+        records.append(CAP_ENTRY.pack(time, rx, tx, state))
+
+    with open(path, "wb") as f:
+        f.write(CAP_HEADER.pack(CAP_MAGIC, CAP_VERSION, CAP_ENTRY.size, len(records),
+                                int(round(tick_us * 1000)), lost))
+        f.write(b"".join(records))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode a PLM-1 nibble trace.")
+    parser.add_argument("capture", help="raw serial capture containing the trace dump")
+    parser.add_argument("--tick-us", type=float, default=4.0, help="microseconds per timer tick (4 for the sketch)")
+    parser.add_argument("--gap", type=int, default=1, help="TXRE gap reported, in timer ticks")
+    parser.add_argument("--save", help="also save the trace as a plm1replay capture")
+    args = parser.parse_args()
+
+    with open(args.capture, "rb") as f:
+        data = f.read()
+    try:
+        entries = parse(data)
+    except ValueError as e:
+        sys.stderr.write("plm1trace: %s\n" % e)
+        return 1
+    render(entries, args.tick_us, args.gap)
+    if args.save:
+        save_capture(args.save, entries, args.tick_us)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())